@@ -0,0 +1,52 @@
+#ifndef AIRTIME_MANAGER_H
+#define AIRTIME_MANAGER_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Reparto explícito de la única radio de 2.4 GHz del maestro. En cada trama
+// TDMA el aire va, por turnos, a la recepción ESP-NOW (slots + una cola
+// ajustable), a una ventana de subida sin BLE y al escaneo BLE, cuya
+// ventana dentro de cada intervalo deja huecos a WiFi mientras hay envíos
+// en curso. Se mide lo que pierde cada uno (tramas ESP-NOW fuera de
+// ventana, fallos de subida, beacons por escaneo frente a escaneos sin
+// carga) y el reparto se corrige trama a trama.
+class AirtimeManager {
+public:
+    AirtimeManager();
+    void begin();
+    void end();
+    void planFrame();
+    void recordFrame(unsigned long rxWindow, unsigned long frameLength);
+    void recordScan(size_t beaconCount, uint16_t window, int seconds);
+    unsigned long getRxTail() const { return rxTail; }
+    unsigned long getUplinkWindow() const { return uplinkWindow; }
+    uint16_t getScanWindow() const { return scanWindow; }
+
+private:
+    bool active;
+    unsigned long rxTail;
+    unsigned long uplinkWindow;
+    uint16_t scanWindow;
+    size_t backlog;
+    uint32_t lastFailed;
+
+    // Pérdidas medidas
+    float espNowLate;       // Fracción de tramas ESP-NOW fuera de ventana (EWMA)
+    float bleBaseline;      // Beacons por escaneo con BLE a pleno y sin subida (EWMA)
+    float bleLoss;          // Caída respecto de esa referencia (EWMA)
+    uint32_t uplinkFailures;
+
+    // Reparto acumulado para el informe
+    unsigned long reportStart;
+    unsigned long rxTime;
+    unsigned long uplinkTime;
+    unsigned long frameTime;
+    unsigned long scanAirTime;
+
+    void report(unsigned long now);
+};
+
+extern AirtimeManager airtimeManager;
+
+#endif
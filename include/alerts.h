@@ -1,8 +1,14 @@
 #ifndef ALERTS_H
 #define ALERTS_H
 #include <Arduino.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 #include "config.h"
 
+// LED RGB y zumbador sin bloquear: show*() y beep() encolan un patrón de
+// parpadeo y vuelven enseguida; un esp_timer de una vez avanza cada fase.
+// Un patrón de mayor prioridad corta al que está sonando.
 class AlertManager {
 public:
     AlertManager();
@@ -17,9 +23,39 @@ public:
     void beep(int duration = 200);
     void allOff();
     void setColor(uint8_t red, uint8_t green, uint8_t blue);
+    bool isBusy() const { return playing; }
 private:
-    void flashColor(uint8_t red, uint8_t green, uint8_t blue, int times, int delayMs);
+    struct Pattern {
+        uint8_t red;
+        uint8_t green;
+        uint8_t blue;
+        bool buzzer;
+        uint16_t onTime;
+        uint16_t offTime;
+        uint8_t repeat;
+        AlertPriority priority;
+    };
+
+    Pattern queue[ALERT_QUEUE_SIZE];
+    int queueCount;
+    Pattern current;
+    volatile bool playing;
+    bool phaseOn;
+    uint8_t remaining;
+    int64_t phaseDeadline;
     bool loaderState;
+    esp_timer_handle_t timer;
+    SemaphoreHandle_t lock;
+
+    void post(uint8_t red, uint8_t green, uint8_t blue, bool buzzer,
+              uint16_t onTime, uint16_t offTime, int times, AlertPriority priority);
+    void startLocked(const Pattern& pattern);
+    void advanceLocked();
+    void finishLocked();
+    void schedulePhase(uint16_t duration);
+    void writeOutputs(uint8_t red, uint8_t green, uint8_t blue, bool buzzer);
+    void showIdle();
+    static void onTimer(void* arg);
 };
 
 extern AlertManager alertManager;
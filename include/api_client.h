@@ -6,21 +6,76 @@
 #include <ArduinoJson.h>
 #include <vector>
 #include <map>
+#include <deque>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
 #include "config.h"
+#include "uplink.h"
 
 class APIClient {
 public:
     APIClient();
-    bool initializeTimeSync();
     String getCurrentTimestamp();
     time_t getCurrentEpoch();
     
-    bool sendDetections(const std::map<String, BeaconData>& beacons);
+    // Encola el payload y devuelve el id del envío (0 si no se encoló).
+    // El POST corre en una tarea propia; loop() solo lanza el siguiente
+    // intento y aplica el resultado (reintentos, circuito, callback).
+    uint32_t sendDetections(const String& payload);
+    bool cancel(uint32_t jobId);
+    void loop();
+    void onDelivery(DeliveryCallback callback) { deliveryCallback = callback; }
+    size_t getPendingCount() const { return jobs.size(); }
+    CircuitState getCircuitState() const { return circuitState; }
     String checkBeaconStatus(const String& macAddress);
     std::map<String, String> checkMultipleBeaconStatus(const std::vector<String>& macAddresses);
 
 private:
-    String createDetectionsPayload(const std::map<String, BeaconData>& beacons);
+    struct PostJob {
+        uint32_t id;
+        String payload;
+        int attempts;
+        unsigned long nextAttemptAt;
+    };
+
+    struct PostResult {
+        uint32_t id;
+        int httpCode;
+        String response;
+        unsigned long retryAfter;
+        unsigned long elapsed;
+    };
+
+    std::deque<PostJob> jobs;
+    uint32_t nextJobId;
+    DeliveryCallback deliveryCallback;
+    CircuitState circuitState;
+    int consecutiveFailures;
+    unsigned long circuitOpenedAt;
+    unsigned long circuitOpenTime;
+
+    // Intento en curso: solo el loop escribe inFlightId/inFlightPayload y
+    // no los toca hasta recoger el resultado que deja la tarea
+    TaskHandle_t postTask;
+    SemaphoreHandle_t resultLock;
+    SemaphoreHandle_t sessionLock;  // backendSession (tarea y consultas de status)
+    uint32_t inFlightId;
+    String inFlightPayload;
+    bool resultReady;
+    PostResult result;
+
+    void startJob(PostJob& job);
+    void collectResult();
+    void handleResult(const PostResult& done);
+    void runPost();
+    static void postTaskMain(void* arg);
+    PostJob* findJob(uint32_t jobId);
+    void finishJob(uint32_t jobId, bool success, int httpCode);
+    void recordOutcome(bool backendHealthy);
+    bool circuitAllowsRequest();
+    unsigned long computeBackoff(int httpCode, int attempts, unsigned long retryAfter);
+
     bool handleResponse(int httpCode, const String& response);
     bool shouldRetry(int httpCode);
     unsigned long getRetryDelay(int httpCode);
@@ -0,0 +1,46 @@
+#ifndef BEACON_STATUS_CACHE_H
+#define BEACON_STATUS_CACHE_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Cache MAC -> estado de registro del backend. Tamaño fijo con desalojo LRU
+// y TTL por entrada; las respuestas negativas (sin estado) duran menos.
+class BeaconStatusCache {
+public:
+    BeaconStatusCache();
+    void load();
+    bool lookup(const String& macAddress, String& status);
+    void store(const String& macAddress, const String& status, bool negative = false);
+    void saveIfDirty();
+    void clear();
+    size_t size() const;
+
+private:
+    struct Entry {
+        char mac[18];
+        char status[14];
+        bool valid;
+        unsigned long expiresAt;
+        unsigned long lastUsed;
+    };
+
+    // Formato persistido: solo lo necesario, con el TTL restante
+    struct StoredEntry {
+        char mac[18];
+        char status[14];
+        uint32_t remaining;
+    };
+
+    Entry entries[BEACON_STATUS_CACHE_SIZE];
+    bool dirty;
+    unsigned long lastSave;
+
+    Entry* find(const String& macAddress);
+    Entry* allocate();
+    static String normalize(const String& macAddress);
+};
+
+extern BeaconStatusCache beaconStatusCache;
+
+#endif
@@ -6,29 +6,51 @@
 #include <BLEUtils.h>
 #include <BLEScan.h>
 #include <BLEAdvertisedDevice.h>
+#include <functional>
 #include <map>
 #include <vector>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 #include "config.h"
 
+typedef std::function<void()> ScanCompleteCallback;
+
 class BLEScanner {
 public:
     BLEScanner();
     bool initialize();
-    void performScan();
-    void startBeaconRegistrationMode();
+    void end();
+    void onConfigChanged(uint32_t changes);
+    bool startScan(int seconds);
+    bool isScanning() const { return scanning; }
+    bool hasResults() const { return resultsReady; }
+    void onScanComplete(ScanCompleteCallback callback) { scanCompleteCallback = callback; }
+    void setDuty(uint16_t window, uint16_t interval);
+    uint16_t getScanWindow() const { return scanWindow; }
+    int getScanSeconds() const { return scanSeconds; }
     std::map<String, BeaconData> getBeaconData();
+    std::map<String, BeaconData> takeBeacons();
     void clearBeacons();
     float calculateDistance(int8_t rssi);
 
 private:
+    // beacons y scanLocation los escribe la tarea de BLE (processDevice)
+    // mientras el loop los toma o limpia: siempre bajo beaconsLock
     std::map<String, BeaconData> beacons;   
     std::map<String, BeaconData> configurableBeacons;
-    std::map<String, unsigned long> registeredBeaconsCache;
+    String scanLocation;
+    SemaphoreHandle_t beaconsLock;
+    volatile bool scanning;
+    volatile bool resultsReady;
+    uint16_t scanWindow;
+    uint16_t scanInterval;
+    int scanSeconds;
+    ScanCompleteCallback scanCompleteCallback;
     
+    static void handleScanComplete(BLEScanResults results);
     void processDevice(BLEAdvertisedDevice advertisedDevice);
-    bool shouldProcessBeacon(BLEAdvertisedDevice& device);
+    void updateScanLocation();
     uint32_t extractAnimalId(std::string manufacturerData);
-    void publishBeaconsToMQTT(const std::vector<String>& macAddresses);
 
     friend class AnimalBeaconCallbacks;
 };
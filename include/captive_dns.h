@@ -0,0 +1,25 @@
+#ifndef CAPTIVE_DNS_H
+#define CAPTIVE_DNS_H
+
+#include <Arduino.h>
+#include <AsyncUDP.h>
+
+// DNS del portal cautivo: responde toda consulta A con la IP del AP.
+// Corre sobre AsyncUDP, así que atiende desde la tarea de lwIP y no
+// depende de que el loop principal lo sondee.
+class CaptiveDNS {
+public:
+    CaptiveDNS();
+    bool start(uint16_t port, const IPAddress& resolvedIP);
+    void stop();
+    bool isActive() const { return active; }
+
+private:
+    AsyncUDP udp;
+    IPAddress resolvedIP;
+    bool active;
+
+    void handlePacket(AsyncUDPPacket& packet);
+};
+
+#endif
@@ -3,8 +3,10 @@
 
 #include "models/beacon.h"
 #include "models/espnow_message.h"
+#include "models/espnow_sync.h"
 #include "enums/device.h"
 #include "enums/beacon.h"
+#include "enums/network.h"
 #include "config/network_config.h"
 #include "config/device_config.h"
 #include "config/hardware_config.h"
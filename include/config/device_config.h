@@ -3,6 +3,7 @@
 #include "enums/device.h"
 
 extern String LOADED_SUB_LOCATION;
+extern String LOADED_LOCATION_NAME;  // Parte "nombre" de "tipo/nombre"; vacía si no hay tipo
 extern String LOADED_ZONE_NAME;
 extern String LOADED_DEVICE_ID;
 extern int LOADED_ZONE_ID;
@@ -15,3 +16,57 @@ const char* getDeviceLocation();
 constexpr int ESPNOW_CHANNEL = 0;
 constexpr int MAX_SLAVES = 10;
 constexpr unsigned long ESPNOW_SEND_INTERVAL = 3000;
+
+// Planificador cooperativo del loop principal (ver scheduler.h)
+constexpr int SCHEDULER_MAX_JOBS = 10;
+constexpr unsigned long SCHEDULER_IDLE_SLICE = 10;        // Espera máxima entre vueltas (ms)
+constexpr unsigned long SCHEDULER_REPORT_INTERVAL = 60000;
+
+// Ciclos escaneados esperando envío; con la cola llena el escaneo espera
+constexpr size_t CYCLE_PIPELINE_DEPTH = 2;
+
+// Bajo consumo para esclavos a batería (ver power_manager.h). Es un ajuste
+// de cada esclavo (portal, configStore); esto es solo el valor inicial
+constexpr bool ENABLE_LOW_POWER_SLAVE = false;
+constexpr unsigned long POWER_SCAN_INTERVAL = 30000;     // Una ventana BLE cada 30 s
+constexpr unsigned long POWER_SERVICES_INTERVAL = 1000;  // Servicios y LCD sin prisa
+constexpr unsigned long POWER_MIN_SLEEP = 50;            // Por debajo no compensa dormir
+constexpr uint32_t POWER_CPU_MHZ_IDLE = 80;              // Mínimo con la radio activa
+constexpr float POWER_NOMINAL_VOLTAGE = 3.7f;            // Si no hay lectura de batería
+// Consumo aproximado por estado (mA) para estimar la energía de cada ciclo
+constexpr float POWER_CURRENT_SLEEP_MA = 0.8f;
+constexpr float POWER_CURRENT_ACTIVE_MA = 25.0f;
+constexpr float POWER_CURRENT_SCAN_MA = 100.0f;
+constexpr float POWER_CURRENT_RADIO_MA = 130.0f;
+
+// TDMA de ESP-NOW: el maestro reparte slots de transmisión en una baliza de
+// sincronía y escanea BLE fuera de la ventana de recepción (ver tdma_manager.h)
+constexpr uint32_t TDMA_SYNC_MAGIC = 0x54444D41;               // "TDMA"
+constexpr unsigned long TDMA_FRAME_MIN = 2000;
+constexpr unsigned long TDMA_RX_OFFSET = 50;                   // De la baliza al primer slot
+constexpr unsigned long TDMA_SLOT_LENGTH = 120;
+constexpr unsigned long TDMA_SLOT_GUARD = 10;                  // Margen al final de cada slot
+constexpr unsigned long TDMA_FRAME_SPACING = 6;                // Entre tramas dentro de un slot
+constexpr unsigned long TDMA_FRAME_SPACING_MIN = 2;            // Con la cola cargada
+constexpr unsigned long TDMA_SCAN_GUARD = 150;                 // Del fin del escaneo a la baliza
+constexpr unsigned long TDMA_SCAN_MIN = 1000;                  // Escaneo recortado más corto útil
+constexpr unsigned long TDMA_BEACON_GUARD = 40;                // El esclavo escucha desde antes
+constexpr unsigned long TDMA_SLOT_EXPIRY = 120000;             // Sin oír al esclavo = slot libre
+constexpr unsigned long TDMA_ACQUIRE_WINDOW = 15000;           // Escucha para sincronizar
+constexpr unsigned long TDMA_REACQUIRE_INTERVAL = 300000;      // Bajo consumo sin maestro TDMA
+constexpr uint8_t TDMA_SYNC_LOSS = 3;                          // Balizas perdidas seguidas
+constexpr size_t TDMA_QUEUE_LIMIT = 64;
+
+// Reparto del aire en el maestro entre BLE, subida y ESP-NOW (ver airtime_manager.h)
+constexpr uint16_t AIRTIME_SCAN_WINDOW_MIN = 40;          // ms de cada BLE_SCAN_INTERVAL
+constexpr uint16_t AIRTIME_SCAN_STEP = 10;
+constexpr size_t AIRTIME_HEAVY_BACKLOG = 3;               // Envíos pendientes = subida cargada
+constexpr unsigned long AIRTIME_UPLINK_PER_DELIVERY = 250; // ms de ventana por envío pendiente
+constexpr unsigned long AIRTIME_UPLINK_MIN = 300;
+constexpr unsigned long AIRTIME_UPLINK_MAX = 2000;
+constexpr unsigned long AIRTIME_RX_TAIL_STEP = 25;        // Cola de la ventana de recepción
+constexpr unsigned long AIRTIME_RX_TAIL_MAX = 200;
+constexpr float AIRTIME_ESPNOW_LATE_LIMIT = 0.1f;         // Tramas fuera de ventana toleradas
+constexpr float AIRTIME_BLE_LOSS_LIMIT = 0.3f;            // Pérdida BLE que frena el recorte
+constexpr float AIRTIME_EWMA_ALPHA = 0.2f;
+constexpr unsigned long AIRTIME_REPORT_INTERVAL = 60000;
@@ -14,3 +14,21 @@ constexpr int LCD_SDA = 21;
 constexpr int LCD_SCL = 22;
 constexpr int LCD_COLS = 16;
 constexpr int LCD_ROWS = 2;
+
+// LED RGB por LEDC (PWM por hardware) y cola del motor de patrones de AlertManager
+constexpr uint8_t ALERT_LEDC_CHANNEL_RED = 0;
+constexpr uint8_t ALERT_LEDC_CHANNEL_GREEN = 1;
+constexpr uint8_t ALERT_LEDC_CHANNEL_BLUE = 2;
+constexpr uint32_t ALERT_LEDC_FREQUENCY = 5000;
+constexpr uint8_t ALERT_LEDC_RESOLUTION = 8;
+constexpr int ALERT_QUEUE_SIZE = 4;
+
+// LCD: framebuffer en RAM volcado por su propia tarea, solo lo que cambió
+constexpr unsigned long LCD_REFRESH_INTERVAL = 200;  // Máximo 5 refrescos por segundo
+constexpr uint32_t LCD_TASK_STACK = 2048;
+constexpr uint8_t LCD_TASK_PRIORITY = 1;
+
+// Batería por divisor resistivo a un pin ADC1 (ADC2 no se puede usar con WiFi)
+constexpr int BATTERY_ADC_PIN = 35;
+constexpr float BATTERY_DIVIDER_RATIO = 2.0f;
+constexpr int BATTERY_ADC_SAMPLES = 8;
@@ -1,27 +1,96 @@
 #pragma once
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
 
 extern const char* WIFI_SSID;
 extern const char* WIFI_PASSWORD;
 extern const char* CONFIG_PORTAL_PASSWORD;
 extern const char* AP_SSID_PREFIX;
+extern const char* WIFI_STATIC_IP;
+extern const char* WIFI_STATIC_GATEWAY;
+extern const char* WIFI_STATIC_SUBNET;
+extern const char* WIFI_STATIC_DNS;
 extern const char* API_URL;
 extern const char* API_KEY;
 extern const char* MQTT_BROKER;
 extern const char* MQTT_USER;
 extern const char* MQTT_PASSWORD;
 extern const char* MQTT_TOPIC;
+extern const char* MQTT_BATCH_TOPIC;
+extern const char* MQTT_DEVICE_TOPIC_PREFIX;
+extern const char* MQTT_REGISTER_TOPIC;
 extern const char* NTP_SERVER1;
 extern const char* NTP_SERVER2;
+extern const char* MQTT_ROOT_CA;
+extern const char* BACKEND_ROOT_CA;
 
 constexpr unsigned long WIFI_TIMEOUT = 20000;
 constexpr unsigned long WIFI_RETRY_INTERVAL = 300000;
+constexpr unsigned long WIFI_FAST_CONNECT_TIMEOUT = 3000;
+constexpr bool WIFI_REUSE_DHCP_LEASE = true;
+constexpr uint32_t WIFI_LEASE_MAX_AGE = 3600;
 constexpr bool ENABLE_WIFI_SYNC = true;
 constexpr bool ENABLE_WIFI_PORTAL = true;
+constexpr size_t PORTAL_JOB_SLOTS = 4;
+constexpr unsigned long PORTAL_JOB_RESULT_TTL = 120000;
 constexpr int HTTP_TIMEOUT = 15000;
+constexpr size_t DNS_CACHE_SIZE = 8;
+constexpr size_t DNS_MAX_HOST_LEN = 64;
+constexpr uint32_t DNS_MIN_TTL = 30;
+constexpr uint32_t DNS_MAX_TTL = 3600;
+constexpr unsigned long DNS_PREFETCH_BEFORE = 15000;
+constexpr unsigned long DNS_QUERY_TIMEOUT = 2000;
+constexpr unsigned long DNS_RETRY_INTERVAL = 5000;
+constexpr unsigned long DNS_RESOLVE_TIMEOUT = 3000;
+constexpr unsigned long DNS_SAVE_INTERVAL = 60000;
+constexpr unsigned long HTTP_KEEPALIVE_IDLE_TIMEOUT = 45000;
 constexpr int MAX_RETRY_ATTEMPTS = 3;
+constexpr size_t API_MAX_PENDING_JOBS = 8;
+constexpr unsigned long API_RETRY_MAX_DELAY = 60000;
+constexpr int API_CIRCUIT_FAILURE_THRESHOLD = 5;
+constexpr unsigned long API_CIRCUIT_OPEN_TIME = 30000;
+constexpr unsigned long API_CIRCUIT_MAX_OPEN_TIME = 300000;
+constexpr uint32_t API_TASK_STACK = 8192;  // TLS + HTTPClient
+constexpr uint8_t API_TASK_PRIORITY = 1;
+constexpr int BEACON_STATUS_CACHE_SIZE = 128;
+constexpr unsigned long BEACON_STATUS_TTL = 600000;
+constexpr unsigned long BEACON_STATUS_NEGATIVE_TTL = 120000;
+constexpr bool BEACON_STATUS_PERSIST = false;
+constexpr unsigned long BEACON_STATUS_SAVE_INTERVAL = 300000;
+constexpr bool ENABLE_HTTPS_UPLINK = true;
+constexpr unsigned long REGISTRATION_REFRESH_INTERVAL = 60000;
+constexpr size_t REGISTRATION_MAX_TRACKED = 300;
+constexpr size_t REGISTRATION_MACS_PER_MESSAGE = 40;
+constexpr size_t UPLINK_MAX_PENDING = 8;
+constexpr unsigned long UPLINK_DELIVERY_TIMEOUT = 30000;
+constexpr float UPLINK_EWMA_ALPHA = 0.2f;
+constexpr float UPLINK_LATENCY_SCALE = 10000.0f;
+constexpr float UPLINK_MQTT_BIAS = 0.1f;
+constexpr unsigned long UPLINK_HEALTH_DECAY_INTERVAL = 60000;  // Sin tráfico: la salud vuelve a neutra
 constexpr int MQTT_PORT = 8883;
 constexpr bool ENABLE_MQTT = true;
 constexpr unsigned long MQTT_RECONNECT_INTERVAL = 5000;
+constexpr uint16_t MQTT_KEEPALIVE_SECONDS = 15;
+constexpr uint8_t MQTT_DETECTIONS_QOS = 1;
+constexpr int MQTT_INFLIGHT_WINDOW = 8;
+constexpr size_t MQTT_MAX_QUEUED_MESSAGES = 24;
+constexpr size_t MQTT_MAX_PACKET_SIZE = 4096;
+constexpr size_t MQTT_TX_BUFFER_LIMIT = 4096;
+constexpr size_t MQTT_WRITE_CHUNK = 512;
+constexpr unsigned long MQTT_CONNACK_TIMEOUT = 10000;
+constexpr unsigned long MQTT_ACK_TIMEOUT = 20000;
+constexpr unsigned long MQTT_PINGRESP_TIMEOUT = 10000;
+constexpr bool ENABLE_DETECTION_BATCHING = false;
+constexpr int BATCH_CYCLES = 10;
+constexpr int MAX_BATCH_CYCLES = 50;
+constexpr size_t MAX_BATCH_RECORDS = 600;
 constexpr long GMT_OFFSET_SEC = -21600;
 constexpr int DAYLIGHT_OFFSET_SEC = 0;
-constexpr int NTP_TIMEOUT_SECONDS = 30;
+constexpr time_t TIME_MIN_VALID_EPOCH = 1700000000;
+constexpr unsigned long TIME_PERSIST_INTERVAL = 3600000;
+constexpr unsigned long TIME_DRIFT_MIN_INTERVAL = 600000;
+constexpr float TIME_MAX_DRIFT_PPM = 200.0f;
+constexpr int TLS_SESSION_CACHE_SIZE = 4;
+constexpr bool TLS_SESSION_PERSIST = false;
+constexpr size_t TLS_SESSION_MAX_BLOB = 2048;
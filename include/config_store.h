@@ -0,0 +1,69 @@
+#ifndef CONFIG_STORE_H
+#define CONFIG_STORE_H
+
+#include <Arduino.h>
+#include <functional>
+#include <vector>
+#include "config.h"
+
+typedef std::function<void(uint32_t changes)> ConfigListener;
+
+// Configuración del dispositivo (modo, MAC del maestro, WiFi, ubicación,
+// bajo consumo y flag de primera ejecución) en un único registro versionado de NVS. Se lee
+// una vez al arrancar; las lecturas posteriores son de RAM. Los cambios se
+// acumulan en memoria y commit() los escribe en una sola operación; los
+// suscriptores reciben los bits ConfigChange desde loop(), en la tarea principal.
+class ConfigStore {
+public:
+    ConfigStore();
+    void load();
+    bool hasMode() const;
+    bool isConfigured() const;
+    const char* getSSID() const { return config.ssid; }
+    const char* getPassword() const { return config.password; }
+    bool isFirstRunPending() const { return config.firstRunPending != 0; }
+    bool isLowPower() const { return config.lowPower != 0; }
+    void setCredentials(const String& ssid, const String& password);
+    bool setDevice(DeviceMode mode, const String& masterMac);
+    void setLocation(const String& zoneName, const String& subLocation, int zoneId);
+    void setFirstRunPending(bool pending);
+    void setLowPower(bool enabled);
+    bool commit();
+    void clear();
+    void subscribe(ConfigListener listener);
+    void loop();
+    void discardChanges();
+    static bool parseMac(const String& text, uint8_t* mac);
+
+private:
+    struct StoredConfig {
+        uint8_t version;
+        uint8_t mode;             // 0 = ESCLAVO, 1 = MAESTRO, 0xFF = sin configurar
+        uint8_t masterMac[6];
+        uint8_t hasMasterMac;
+        uint8_t firstRunPending;
+        int32_t zoneId;
+        char ssid[33];
+        char password[65];
+        char zoneName[64];
+        char subLocation[64];
+        uint8_t lowPower;         // Versión 2: esclavo a batería (ver power_manager.h)
+    };
+
+    StoredConfig config;
+    bool dirty;
+    uint32_t changes;        // Sin guardar todavía
+    uint32_t pendingNotify;  // Guardados, falta avisar a los suscriptores
+    SemaphoreHandle_t lock;
+    std::vector<ConfigListener> listeners;
+
+    void setDefaults();
+    bool validate();
+    bool importLegacy();
+    static void clearLegacy();
+    void applyDerived();
+};
+
+extern ConfigStore configStore;
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef DETECTION_BATCHER_H
+#define DETECTION_BATCHER_H
+
+#include <Arduino.h>
+#include <map>
+#include <vector>
+#include "config.h"
+
+// Acumula varios ciclos de detección y los codifica en un único lote columnar.
+//
+// Formato binario (versión 1, enteros como varint LEB128):
+//   u8      versión
+//   u8[6]   MAC del maestro
+//   varint  timestamp base (epoch del primer ciclo)
+//   varint  ciclos acumulados
+//   varint  entradas del diccionario de ubicaciones, cada una: varint longitud + bytes
+//   varint  número de registros N
+//   N x varint  animal_id, ordenados ascendente y con delta sobre el anterior
+//   N x varint  timestamp, zig-zag delta sobre el registro anterior (el primero sobre la base)
+//   N x varint  rssi, zig-zag delta sobre el registro anterior
+//   N x varint  índice de ubicación en el diccionario
+// La distancia no se transmite: el backend la recalcula desde el RSSI.
+// Los ciclos se guardan con su tiempo de actividad y se convierten a epoch al
+// codificar, así los capturados antes de la sincronización SNTP salen bien.
+class DetectionBatcher {
+public:
+    DetectionBatcher();
+    bool addCycle(const std::map<String, BeaconData>& beacons, uint32_t uptime);
+    bool isReady() const;
+    bool isEmpty() const { return cycleCount == 0; }
+    size_t getCycleCount() const { return cycleCount; }
+    size_t getRecordCount() const { return records.size(); }
+    std::vector<uint8_t> encode() const;
+    void clear();
+
+private:
+    struct BatchRecord {
+        uint32_t animalId;
+        uint32_t uptime;
+        int8_t rssi;
+        uint8_t locationIndex;
+    };
+
+    std::vector<BatchRecord> records;
+    std::vector<String> locationDictionary;
+    size_t cycleCount;
+    uint32_t baseUptime;
+    bool dictionaryFull;
+
+    bool lookupLocation(const String& location, uint8_t& index);
+    static void writeVarint(std::vector<uint8_t>& out, uint32_t value);
+    static uint32_t zigZag(int32_t value);
+};
+
+extern DetectionBatcher detectionBatcher;
+
+#endif
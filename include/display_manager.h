@@ -3,8 +3,14 @@
 
 #include <Arduino.h>
 #include <LiquidCrystal_I2C.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
 #include "config.h"
 
+// Los show*() solo escriben en un framebuffer de 16x2 en RAM. Una tarea
+// propia lo vuelca al LCD como mucho cada LCD_REFRESH_INTERVAL y envía por
+// I2C solo los caracteres que cambiaron (sin lcd->clear(), sin parpadeo).
 class DisplayManager {
 public:
     DisplayManager();
@@ -26,6 +32,15 @@ public:
 
 private:
     LiquidCrystal_I2C* lcd;
+    char frame[LCD_ROWS][LCD_COLS];  // Lo que se quiere mostrar
+    char shown[LCD_ROWS][LCD_COLS];  // Lo que tiene el LCD (solo lo toca la tarea)
+    SemaphoreHandle_t lock;
+    TaskHandle_t flushTask;
+
+    void setLines(const String& line1, const String& line2);
+    void writeRow(int row, const String& text);
+    void flush();
+    static void flushTaskMain(void* arg);
     String truncate(const String& text, int maxLength = 16);
 };
 
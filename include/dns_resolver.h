@@ -0,0 +1,58 @@
+#ifndef DNS_RESOLVER_H
+#define DNS_RESOLVER_H
+
+#include <Arduino.h>
+#include <AsyncUDP.h>
+#include <freertos/FreeRTOS.h>
+#include "config.h"
+
+// Resolver DNS compartido para los hosts a los que conecta el firmware
+// (backend y broker MQTT). Consulta al DNS de la red por UDP sin bloquear, respeta el TTL
+// de cada respuesta, renueva las entradas antes de que venzan y guarda en NVS
+// la última IP buena para poder arrancar sin DNS.
+class DnsResolver {
+public:
+    DnsResolver();
+    void begin();
+    void loop();
+    void track(const char* host);
+    bool lookup(const char* host, IPAddress& ip);
+    bool resolve(const char* host, IPAddress& ip, unsigned long timeoutMs = DNS_RESOLVE_TIMEOUT);
+    void invalidate(const char* host);
+
+private:
+    struct Entry {
+        char host[DNS_MAX_HOST_LEN];
+        uint32_t ip;
+        unsigned long expiresAt;
+        unsigned long lastQuery;
+        uint16_t queryId;
+        bool used;
+        bool pending;
+    };
+
+    struct StoredEntry {
+        char host[DNS_MAX_HOST_LEN];
+        uint32_t ip;
+    };
+
+    Entry entries[DNS_CACHE_SIZE];
+    AsyncUDP udp;
+    IPAddress udpServer;
+    portMUX_TYPE lock;
+    uint16_t nextQueryId;
+    bool dirty;
+    unsigned long lastSave;
+
+    Entry* find(const char* host);
+    Entry* allocate(const char* host);
+    bool isFresh(const Entry& entry) const;
+    bool sendQuery(Entry& entry);
+    bool ensureSocket();
+    void handleResponse(AsyncUDPPacket& packet);
+    void persist();
+};
+
+extern DnsResolver dnsResolver;
+
+#endif
@@ -6,4 +6,20 @@ enum DeviceMode {
     DEVICE_SLAVE
 };
 
+// Qué cambió en un ConfigStore::commit(); se combinan como bits
+enum ConfigChange {
+    CONFIG_CHANGE_MODE = 1 << 0,
+    CONFIG_CHANGE_MASTER_MAC = 1 << 1,
+    CONFIG_CHANGE_WIFI = 1 << 2,
+    CONFIG_CHANGE_LOCATION = 1 << 3,
+    CONFIG_CHANGE_POWER = 1 << 4
+};
+
+// Un patrón de AlertManager interrumpe al actual solo si es de mayor prioridad
+enum AlertPriority {
+    ALERT_PRIORITY_LOW,     // Info / éxito
+    ALERT_PRIORITY_NORMAL,  // Advertencias
+    ALERT_PRIORITY_HIGH     // Errores
+};
+
 #endif
\ No newline at end of file
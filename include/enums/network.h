@@ -0,0 +1,28 @@
+#ifndef NETWORK_ENUMS_H
+#define NETWORK_ENUMS_H
+
+enum PayloadEncoding {
+    ENCODING_JSON,
+    ENCODING_BATCH
+};
+
+enum UplinkTransport {
+    UPLINK_MQTT,
+    UPLINK_HTTPS,
+    UPLINK_COUNT
+};
+
+enum CircuitState {
+    CIRCUIT_CLOSED,
+    CIRCUIT_OPEN,
+    CIRCUIT_HALF_OPEN
+};
+
+enum PortalJobState {
+    PORTAL_JOB_UNKNOWN,
+    PORTAL_JOB_PENDING,
+    PORTAL_JOB_RUNNING,
+    PORTAL_JOB_DONE
+};
+
+#endif
@@ -4,22 +4,40 @@
 #include <Arduino.h>
 #include <esp_now.h>
 #include <WiFi.h>
+#include <functional>
 #include <vector>
 #include "config.h"
 
+typedef std::function<void()> SyncBeaconCallback;
+
 class ESPNowManager {
 public:
     ESPNowManager();
     bool initializeMaster();
     bool initializeSlave();
+    void end();
+    void onConfigChanged(uint32_t changes);
+    bool radioOn();
+    void radioOff();
     bool sendToMaster(const String& jsonMessage);
+    bool sendMessage(const ESPNowMessage& msg);
+    bool broadcastSync(const ESPNowSyncBeacon& beacon);
+    bool takeSyncBeacon(ESPNowSyncBeacon& beacon, unsigned long& receivedAt);
+    int takeHeardSlaves(uint8_t macs[][6], int maxCount);
+    void setReceiveWindow(unsigned long start, unsigned long end);
+    void takeReceiveStats(uint32_t& inWindow, uint32_t& outOfWindow);
+    void onSyncBeacon(SyncBeaconCallback callback) { syncCallback = callback; }
     std::vector<ESPNowMessage> getReceivedMessages();
     void clearReceivedMessages();
 
 private:
     bool isMaster;
+    bool initialized;
+    bool radioActive;
+    uint8_t channel;
     std::vector<ESPNowMessage> receivedMessages;
     esp_now_peer_info_t masterPeerInfo;
+    static SyncBeaconCallback syncCallback;
     
     static void onDataReceive(const uint8_t* mac, const uint8_t* data, int len);
     bool addPeer(const uint8_t* macAddress);
@@ -0,0 +1,35 @@
+#ifndef HTTP_BODY_STREAM_H
+#define HTTP_BODY_STREAM_H
+
+#include <Arduino.h>
+
+// Vista de solo lectura sobre el cuerpo de una respuesta HTTP. Decodifica
+// Transfer-Encoding: chunked y se detiene en Content-Length, de modo que un
+// parser nunca lee más allá del cuerpo en un socket keep-alive.
+class HttpBodyStream : public Stream {
+public:
+    // contentLength < 0: desconocido (hasta que el servidor cierre)
+    HttpBodyStream(Stream& source, int contentLength, bool chunked, unsigned long timeout);
+
+    int available() override;
+    int read() override;
+    int peek() override;
+    size_t write(uint8_t) override { return 0; }
+    void flush() override {}
+    bool finished() const { return done && lookahead < 0; }
+
+private:
+    Stream& source;
+    bool chunked;
+    bool done;
+    bool chunkNeedsCRLF;
+    long remaining;
+    int lookahead;
+    unsigned long byteTimeout;
+
+    int readRaw();
+    bool readChunkHeader();
+    int waitByte();
+};
+
+#endif
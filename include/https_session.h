@@ -0,0 +1,45 @@
+#ifndef HTTPS_SESSION_H
+#define HTTPS_SESSION_H
+
+#include <Arduino.h>
+#include <HTTPClient.h>
+#include <functional>
+#include "secure_client.h"
+#include "config.h"
+
+// Recibe el código HTTP y el cuerpo como stream (ya sin chunked ni bytes extra)
+typedef std::function<void(int httpCode, Stream& body)> ResponseReader;
+
+// Conexión HTTPS/1.1 keep-alive de larga duración contra un host. Las
+// peticiones secuenciales reutilizan el mismo socket TLS; si el servidor lo
+// cerró por inactividad se reconecta de forma transparente.
+class HttpsSession {
+public:
+    HttpsSession();
+    int request(const char* method, const String& url, const String& body, String& response, bool authorize = false);
+    int streamRequest(const char* method, const String& url, const String& body, ResponseReader reader, bool authorize = false);
+    void close();
+    bool isConnected();
+    uint32_t getRequestCount() const { return requestCount; }
+    uint32_t getReusedCount() const { return reusedCount; }
+    unsigned long getRetryAfter() const { return retryAfter; }
+
+private:
+    SecureClient client;
+    HTTPClient http;
+    String currentHost;
+    unsigned long lastActivity;
+    uint32_t requestCount;
+    uint32_t reusedCount;
+    unsigned long retryAfter;
+
+    int dispatch(const char* method, const String& url, const String& body, String* response, ResponseReader* reader, bool authorize);
+    int send(const char* method, const String& url, const String& body, String* response, ResponseReader* reader, bool authorize);
+    static String hostOf(const String& url);
+    static bool isStaleConnectionError(int httpCode);
+};
+
+// Sesión compartida con el backend (REST e ingest)
+extern HttpsSession backendSession;
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef JSON_STREAM_H
+#define JSON_STREAM_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <functional>
+
+typedef std::function<void(JsonObjectConst item)> JsonItemHandler;
+
+// Recorre el array asociado a `key` directamente desde el stream, elemento a
+// elemento y aplicando `filter` a cada uno. La memoria usada es la de un solo
+// elemento (itemCapacity) sin importar cuántos traiga la respuesta.
+// Devuelve la cantidad de elementos o -1 si el array no aparece o es inválido.
+int streamJsonArray(Stream& input, const char* key, const JsonDocument& filter,
+                    size_t itemCapacity, JsonItemHandler handler);
+
+#endif
@@ -1,9 +1,19 @@
 #pragma once
+#include <functional>
+
+// Botones por interrupción: cada flanco rearma un esp_timer de antirrebote y
+// la pulsación larga de reset la mide otro timer. Los eventos quedan
+// pendientes hasta que checkResetButton()/checkModeButtonPress() los consumen.
+typedef std::function<void()> ButtonEventCallback;
 
 void initResetButton();
 bool checkResetButton();
+bool waitForResetButtonOnStartup();
 void initModeButton();
 void enterRegistrationMode();
 void exitRegistrationMode();
 void checkModeButtonPress();
 bool isRegistrationModeActive();
+void onButtonEvent(ButtonEventCallback callback);
+void enableButtonWakeup();
+void restoreButtonInterrupts();
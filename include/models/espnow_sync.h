@@ -0,0 +1,20 @@
+#ifndef ESPNOW_SYNC_MODEL_H
+#define ESPNOW_SYNC_MODEL_H
+#include <Arduino.h>
+#include "config/device_config.h"
+
+// Baliza de sincronía que difunde el maestro al empezar cada trama TDMA.
+// Los esclavos de la tabla transmiten en su slot; el slot siguiente al
+// último asignado queda libre para los que aún no tienen uno.
+struct ESPNowSyncBeacon
+{
+    uint32_t magic;
+    uint32_t frameLength;   // ms hasta la próxima baliza
+    uint16_t sequence;
+    uint16_t rxOffset;      // ms de la baliza al primer slot
+    uint16_t slotLength;    // ms por slot
+    uint8_t slotCount;
+    uint8_t slots[MAX_SLAVES][6];
+};
+
+#endif
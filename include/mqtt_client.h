@@ -2,28 +2,91 @@
 #define MQTT_CLIENT_H
 
 #include <Arduino.h>
-#include <PubSubClient.h>
-#include <WiFiClientSecure.h>
+#include "secure_client.h"
+#include <deque>
 #include <map>
+#include <vector>
 #include "config.h"
+#include "uplink.h"
 
+// Cliente MQTT 3.1.1 no bloqueante: los mensajes se encolan y loop() los
+// escribe cuando el socket acepta datos. QoS 1 con ventana de mensajes en
+// vuelo; los no confirmados se retransmiten (DUP) al reconectar.
 class MQTTClient {
 public:
     MQTTClient();
     bool initialize();
+    void stop();
+    void onConfigChanged(uint32_t changes);
     bool isConnected();
     bool reconnect();
     void loop();
-    bool sendDetections(const std::map<String, BeaconData>& beacons);
-    bool publish(const char* topic, const char* payload);
+    // Publica un payload de detecciones; devuelve id de entrega (0 si no se encoló)
+    uint32_t sendDetections(const String& payload);
+    bool cancel(uint32_t deliveryId);
+    void onDelivery(DeliveryCallback callback) { deliveryCallback = callback; }
+    bool publish(const char* topic, const char* payload, uint8_t qos = 0);
+    bool publishBinary(const char* topic, const uint8_t* payload, size_t length, uint8_t qos = 0);
+    size_t getInFlightCount() const;
+    size_t getQueuedCount() const { return outbound.size(); }
 
 private:
-    WiFiClientSecure wifiClient;
-    PubSubClient mqttClient;
+    enum ConnectionState {
+        MQTT_STATE_DISCONNECTED,
+        MQTT_STATE_CONNECTING,
+        MQTT_STATE_CONNECTED
+    };
+
+    struct OutboundMessage {
+        uint16_t packetId;
+        uint32_t deliveryId;
+        uint8_t qos;
+        bool sent;
+        bool dup;
+        unsigned long sentAt;
+        String topic;
+        std::vector<uint8_t> payload;
+    };
+
+    SecureClient wifiClient;
+    ConnectionState state;
     unsigned long lastReconnectAttempt;
-    
-    String createDetectionsPayload(const std::map<String, BeaconData>& beacons);
-    static void messageCallback(char* topic, byte* payload, unsigned int length);
+    unsigned long connectStartedAt;
+    unsigned long lastOutboundActivity;
+    unsigned long lastInboundActivity;
+    bool pingOutstanding;
+    unsigned long pingSentAt;
+    uint16_t nextPacketId;
+    uint32_t nextDeliveryId;
+    DeliveryCallback deliveryCallback;
+
+    std::deque<OutboundMessage> outbound;
+    std::vector<uint8_t> txBuffer;
+    size_t txOffset;
+    std::vector<uint8_t> rxBuffer;
+    size_t rxDiscard;
+    String commandTopic;
+    String statusTopic;
+    String registerAckTopic;
+
+    bool enqueue(const char* topic, const uint8_t* payload, size_t length, uint8_t qos, uint32_t deliveryId = 0);
+    void reportDeliveries(const std::vector<uint32_t>& deliveryIds, bool success);
+    void startSession();
+    void dropConnection(const char* reason);
+    void onConnected(bool sessionPresent);
+    void readIncoming();
+    bool parsePacket();
+    void handlePacket(uint8_t header, const uint8_t* body, size_t length);
+    void flushOutbound();
+    void writePending();
+    void checkTimeouts();
+    void sendSubscribe(const char* topic, uint8_t qos);
+    void appendPacket(uint8_t header, const std::vector<uint8_t>& body);
+    uint16_t allocatePacketId();
+    static void appendString(std::vector<uint8_t>& out, const char* value);
+    static void appendUint16(std::vector<uint8_t>& out, uint16_t value);
+
+    void messageCallback(char* topic, byte* payload, unsigned int length);
 };
 
 extern MQTTClient mqttClient;
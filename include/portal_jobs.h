@@ -0,0 +1,43 @@
+#ifndef PORTAL_JOBS_H
+#define PORTAL_JOBS_H
+
+#include <Arduino.h>
+#include <functional>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "config.h"
+
+typedef std::function<String()> PortalJobWork;
+
+// Trabajos largos del portal (login, zonas, conexión WiFi...). Los handlers
+// HTTP solo los encolan y devuelven un id; runPending() los ejecuta desde el
+// loop principal y el navegador consulta el resultado con /job?id=N.
+class PortalJobs {
+public:
+    PortalJobs();
+    uint32_t submit(const char* name, PortalJobWork work);
+    PortalJobState poll(uint32_t id, String& result);
+    void runPending();
+    void clear();
+
+private:
+    struct Slot {
+        uint32_t id;
+        PortalJobState state;
+        const char* name;
+        PortalJobWork work;
+        String result;
+        unsigned long finishedAt;
+    };
+
+    Slot slots[PORTAL_JOB_SLOTS];
+    uint32_t nextId;
+    SemaphoreHandle_t lock;
+
+    Slot* findSlot(uint32_t id);
+    Slot* allocate();
+};
+
+extern PortalJobs portalJobs;
+
+#endif
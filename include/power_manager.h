@@ -0,0 +1,48 @@
+#ifndef POWER_MANAGER_H
+#define POWER_MANAGER_H
+
+#include <Arduino.h>
+#include "config.h"
+
+#ifdef CONFIG_PM_ENABLE
+#include <esp_pm.h>
+#endif
+
+// Bajo consumo de los esclavos a batería: light sleep entre ventanas de
+// escaneo, CPU a frecuencia reducida salvo con la radio WiFi en uso y una
+// estimación de la energía gastada en cada ciclo. Con CONFIG_PM_ENABLE el
+// escalado y el light sleep los hace el gestor de energía del IDF y aquí
+// solo se toman los locks; sin él se duerme explícitamente.
+class PowerManager {
+public:
+    PowerManager();
+    void begin();
+    void end();
+    bool isEnabled() const { return enabled; }
+    void acquireRadio();
+    void releaseRadio();
+    void idle(unsigned long ms, bool scanning);
+    void endCycle();
+    float readBatteryVoltage();
+
+private:
+    bool enabled;
+    bool sleepFailed;
+    int radioHolds;
+    unsigned long radioSince;
+    unsigned long cycleStart;
+    unsigned long sleepMs;
+    unsigned long scanMs;
+    unsigned long radioMs;
+#ifdef CONFIG_PM_ENABLE
+    esp_pm_lock_handle_t apbLock;
+    esp_pm_lock_handle_t noSleepLock;
+#endif
+
+    bool sleep(unsigned long ms);
+    void resetCycle(unsigned long now);
+};
+
+extern PowerManager powerManager;
+
+#endif
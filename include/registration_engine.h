@@ -0,0 +1,43 @@
+#ifndef REGISTRATION_ENGINE_H
+#define REGISTRATION_ENGINE_H
+
+#include <Arduino.h>
+#include <map>
+#include <vector>
+#include "config.h"
+
+// Sesión de registro de beacons: anuncia cada MAC una sola vez (con refresco
+// periódico mientras siga visible) y la retira al confirmarla el backend.
+class RegistrationEngine {
+public:
+    RegistrationEngine();
+    void begin();
+    void end();
+    void observe(const std::vector<String>& macAddresses);
+    void flush();
+    void handleAck(const char* payload, size_t length);
+    bool isActive() const { return active; }
+    size_t getPendingCount() const;
+    size_t getConfirmedCount() const { return confirmedCount; }
+
+private:
+    // La clave de records es la MAC en mayúsculas (comparación sin importar
+    // mayúsculas); al backend se publica tal como llegó del escaneo
+    struct Record {
+        String mac;
+        unsigned long lastSeen;
+        unsigned long lastAnnounced;
+        bool confirmed;
+    };
+
+    std::map<String, Record> records;
+    size_t confirmedCount;
+    bool active;
+
+    bool publish(const std::vector<String>& macAddresses);
+    static String keyOf(const String& mac);
+};
+
+extern RegistrationEngine registrationEngine;
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef RUNTIME_CONFIG_H
+#define RUNTIME_CONFIG_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Parámetros ajustables en caliente (comando MQTT) y persistidos en NVS.
+// Los valores de compilación de ble_config.h / network_config.h son los defaults.
+struct RuntimeSettings {
+    uint8_t version;
+    uint8_t scanDuration;
+    int8_t minRssi;
+    uint8_t encoding;
+    uint32_t cycleInterval;
+    uint8_t uuidCount;
+    uint8_t uuids[MAX_BEACON_UUIDS][16];
+};
+
+class RuntimeConfig {
+public:
+    RuntimeConfig();
+    void load();
+    const RuntimeSettings& get() const { return settings; }
+    int getScanDuration() const { return settings.scanDuration; }
+    unsigned long getCycleInterval() const { return settings.cycleInterval; }
+    int getMinRssi() const { return settings.minRssi; }
+    PayloadEncoding getEncoding() const { return (PayloadEncoding)settings.encoding; }
+    bool matchesUUID(const uint8_t* uuid) const;
+    bool handleCommand(const char* payload, size_t length, String& reply);
+    String describe() const;
+
+private:
+    RuntimeSettings settings;
+
+    void setDefaults(RuntimeSettings& target) const;
+    bool save();
+    bool applySetting(const String& key, const String& value, RuntimeSettings& target, String& error) const;
+    static bool parseUUID(const String& text, uint8_t* out);
+};
+
+extern RuntimeConfig runtimeConfig;
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <Arduino.h>
+#include <functional>
+#include "config.h"
+
+typedef std::function<void()> SchedulerJob;
+typedef std::function<void(unsigned long idleMs)> SchedulerIdleHandler;
+
+// Planificador cooperativo del loop principal. Cada trabajo tiene período
+// (0 = solo por evento con trigger() o runAt()) y un presupuesto de tiempo; los que se
+// pasan del presupuesto se informan. Entre vueltas se duerme hasta el próximo
+// vencimiento en lugar de un delay fijo; un manejador de reposo puede
+// sustituir ese delay (p. ej. light sleep).
+class Scheduler {
+public:
+    Scheduler();
+    int add(const char* name, unsigned long period, unsigned long budget, SchedulerJob job);
+    void setPeriod(int id, unsigned long period);
+    void trigger(int id);
+    void runAt(int id, unsigned long when);
+    void setIdleSlice(unsigned long slice) { idleSlice = slice; }
+    void setIdleHandler(SchedulerIdleHandler handler) { idleHandler = handler; }
+    void run();
+
+private:
+    struct Job {
+        const char* name;
+        SchedulerJob work;
+        unsigned long period;
+        unsigned long budget;
+        unsigned long nextRun;
+        volatile bool pending;  // trigger() puede llegar desde otra tarea
+        bool armed;             // runAt(): una ejecución a una hora concreta
+        unsigned long runAtTime;
+        uint32_t runs;
+        uint32_t overruns;
+        unsigned long maxDuration;
+        unsigned long maxLateness;
+    };
+
+    Job jobs[SCHEDULER_MAX_JOBS];
+    int count;
+    unsigned long lastReport;
+    unsigned long idleSlice;
+    SchedulerIdleHandler idleHandler;
+
+    void runJob(Job& job, unsigned long now);
+    static bool isArmedDue(const Job& job, unsigned long now);
+    unsigned long idleTime(unsigned long now) const;
+    void report(unsigned long now);
+};
+
+extern Scheduler scheduler;
+
+#endif
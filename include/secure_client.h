@@ -0,0 +1,58 @@
+#ifndef SECURE_CLIENT_H
+#define SECURE_CLIENT_H
+
+#include <Arduino.h>
+#include <WiFiClientSecure.h>
+#include <mbedtls/ssl.h>
+#include "config.h"
+
+// Cache de sesiones TLS por host (RAM + NVS opcional) para reanudar
+// handshakes con session ID / session ticket en lugar de hacerlos completos.
+class TLSSessionCache {
+public:
+    TLSSessionCache();
+    mbedtls_ssl_session* find(const String& key);
+    void store(const String& key, const mbedtls_ssl_context* ssl);
+    void invalidate(const String& key);
+
+private:
+    struct Entry {
+        String key;
+        mbedtls_ssl_session session;
+        bool valid;
+        uint32_t persistedHash;
+        unsigned long lastUsed;
+    };
+
+    Entry entries[TLS_SESSION_CACHE_SIZE];
+    bool persistedLoaded;
+
+    Entry* findEntry(const String& key);
+    Entry* allocateEntry(const String& key);
+    void loadPersisted(Entry& entry);
+    void persist(Entry& entry);
+    static String nvsKey(const String& key);
+    static uint32_t hashBytes(const uint8_t* data, size_t length);
+};
+
+extern TLSSessionCache tlsSessionCache;
+
+// WiFiClientSecure que ofrece la sesión guardada al servidor antes del
+// handshake y guarda la sesión negociada al conectar.
+class SecureClient : public WiFiClientSecure {
+public:
+    SecureClient();
+    void setTrustAnchor(const char* rootCA);
+    using WiFiClientSecure::connect;
+    int connect(IPAddress ip, uint16_t port) override;
+    int connect(const char* host, uint16_t port) override;
+    bool isWritable();
+    unsigned long getLastHandshakeTime() const { return lastHandshakeTime; }
+
+private:
+    unsigned long lastHandshakeTime;
+
+    int connectWithSession(const String& sessionKey, std::function<int()> doConnect);
+};
+
+#endif
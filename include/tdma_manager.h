@@ -0,0 +1,72 @@
+#ifndef TDMA_MANAGER_H
+#define TDMA_MANAGER_H
+
+#include <Arduino.h>
+#include <deque>
+#include "config.h"
+
+// Reparto del aire de ESP-NOW en tramas TDMA. El maestro difunde al inicio
+// de cada trama una baliza con la tabla de slots (aprendida de los
+// remitentes que oye) y solo escanea BLE después de la ventana de
+// recepción y de la de subida (AirtimeManager), terminando antes de la
+// siguiente baliza. Los esclavos encolan
+// sus tramas y las envían en su slot; sin sincronía envían al momento.
+class TDMAManager {
+public:
+    TDMAManager();
+    void begin(DeviceMode mode);
+    void end();
+    bool isSynced() const { return synced; }
+    void enqueue(const ESPNowMessage& msg);
+    void loop();
+    int scanSeconds() const;
+    bool nextEvent(unsigned long& when) const;
+
+private:
+    struct Slot {
+        uint8_t mac[6];
+        unsigned long lastHeard;
+    };
+
+    bool active;
+    DeviceMode role;
+
+    // Maestro
+    Slot slots[MAX_SLAVES];
+    int slotCount;
+    uint16_t sequence;
+    unsigned long rxEnd;
+    unsigned long scanStart;     // Tras la ventana de subida
+    unsigned long nextFrame;
+
+    // Esclavo
+    std::deque<ESPNowMessage> queue;
+    uint32_t dropped;            // Descartadas por cola llena desde el último informe
+    ESPNowSyncBeacon sync;
+    bool synced;
+    uint8_t missed;
+    unsigned long beaconAt;      // Inicio de la trama actual (recibida o prevista)
+    unsigned long lastHeardAt;   // Última baliza recibida de verdad
+    int mySlot;
+    uint8_t ownMac[6];
+    bool radioHeld;
+    bool beaconListened;         // Radio encendida en la ventana de la baliza prevista
+    unsigned long listenUntil;
+    unsigned long nextAcquire;
+
+    void loopMaster(unsigned long now);
+    void updateSlots(unsigned long now);
+    void sendBeacon(unsigned long now);
+    void loopSlave(unsigned long now);
+    void applyBeacon(const ESPNowSyncBeacon& beacon, unsigned long receivedAt);
+    bool wantsBeacon() const;
+    bool inBeaconWindow(unsigned long now) const;
+    unsigned long slotStart() const;
+    unsigned long slotEnd() const;
+    void transmit(unsigned long until);
+    void setRadio(bool on);
+};
+
+extern TDMAManager tdmaManager;
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef TIME_SERVICE_H
+#define TIME_SERVICE_H
+
+#include <Arduino.h>
+#include <sys/time.h>
+#include "config.h"
+
+// Hora del sistema sin bloquear el arranque: se siembra desde el reloj RTC
+// (sobrevive a reinicios por software) o desde la última hora guardada en
+// NVS, SNTP corre en segundo plano y entre sincronizaciones se compensa la
+// deriva medida del cristal.
+class TimeService {
+public:
+    TimeService();
+    void begin();
+    void loop();
+    bool isSynced() const { return synced; }
+    bool isValid() const { return anchorEpochMs > 0; }
+    time_t now() const;
+    time_t epochAt(uint32_t uptimeSeconds) const;
+    uint32_t uptimeSeconds() const;
+    String formatLocal(time_t epoch) const;
+    float getDriftPpm() const { return driftPpm; }
+
+private:
+    int64_t anchorEpochMs;
+    int64_t anchorUptimeMs;
+    float driftPpm;
+    bool synced;
+    bool sntpStarted;
+    unsigned long lastPersist;
+
+    void startSntp();
+    void applySync(int64_t epochMs, int64_t uptimeMs);
+    void setAnchor(int64_t epochMs, int64_t uptimeMs);
+    int64_t estimateEpochMs(int64_t uptimeMs) const;
+    void persist();
+    static int64_t uptimeMs();
+    static void onSntpSync(struct timeval* tv);
+};
+
+extern TimeService timeService;
+
+#endif
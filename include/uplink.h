@@ -0,0 +1,66 @@
+#ifndef UPLINK_H
+#define UPLINK_H
+
+#include <Arduino.h>
+#include <functional>
+#include <map>
+#include <vector>
+#include "config.h"
+
+// Resultado final de un envío: éxito, o fallo definitivo tras agotar reintentos
+typedef std::function<void(uint32_t deliveryId, bool success, int code)> DeliveryCallback;
+
+// Serializador único de detecciones, común a MQTT y HTTPS
+String buildDetectionsPayload(const std::map<String, BeaconData>& beacons);
+
+// Elige el transporte de subida según su salud reciente (tasa de éxito y
+// latencia, ambas EWMA) y reenvía por el otro si la entrega falla. La salud
+// de un transporte sin tráfico vuelve poco a poco a neutra, para que el que
+// perdió una comparación pueda recuperar las entregas. Los lotes binarios
+// van solo por MQTT (el backend no tiene endpoint HTTPS para ellos).
+class UplinkRouter {
+public:
+    UplinkRouter();
+    void initialize();
+    void loop();
+    bool sendDetections(const std::map<String, BeaconData>& beacons);
+    size_t getPendingCount() const { return pending.size(); }
+    uint32_t getFailedCount() const;
+
+private:
+    struct TransportHealth {
+        float successRate;
+        float latencyMs;
+        uint32_t delivered;
+        uint32_t failed;
+        unsigned long updatedAt;
+    };
+
+    struct PendingDelivery {
+        UplinkTransport transport;
+        uint32_t deliveryId;
+        unsigned long sentAt;
+        bool timedOut;
+        bool failedOver;
+        String payload;
+    };
+
+    TransportHealth health[UPLINK_COUNT];
+    std::vector<PendingDelivery> pending;
+
+    bool selectTransport(UplinkTransport& transport);
+    bool isAvailable(UplinkTransport transport);
+    float score(UplinkTransport transport) const;
+    bool dispatch(UplinkTransport transport, const String& payload, bool failedOver);
+    uint32_t submit(UplinkTransport transport, const String& payload);
+    bool cancel(UplinkTransport transport, uint32_t deliveryId);
+    void onResult(UplinkTransport transport, uint32_t deliveryId, bool success);
+    void recordHealth(UplinkTransport transport, bool success, unsigned long latency);
+    void decayHealth(unsigned long now);
+    void failOver(PendingDelivery delivery);
+    static const char* transportName(UplinkTransport transport);
+};
+
+extern UplinkRouter uplinkRouter;
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef WIFI_CONNECT_CACHE_H
+#define WIFI_CONNECT_CACHE_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include "config.h"
+
+// Último punto de acceso y lease DHCP con los que se conectó el maestro.
+// Permite un join dirigido (BSSID + canal, sin escaneo) y, si el lease es
+// reciente, saltar también DHCP; tras ese join el cliente DHCP se reanuda en
+// segundo plano y solo un lease nuevo renueva la fecha guardada. Se guarda
+// en NVS solo cuando cambia.
+class WiFiConnectCache {
+public:
+    WiFiConnectCache();
+    void load();
+    bool matches(const String& ssid) const;
+    const uint8_t* getBSSID() const { return record.bssid; }
+    int32_t getChannel() const { return record.channel; }
+    bool applyIPConfig();
+    void update(const String& ssid);
+    void loop();
+    void invalidate();
+
+private:
+    struct Record {
+        uint8_t version;
+        uint8_t bssid[6];
+        uint8_t channel;
+        uint32_t ssidHash;
+        uint32_t ip;
+        uint32_t gateway;
+        uint32_t subnet;
+        uint32_t dns;
+        uint32_t savedAt;  // epoch; 0 = hora desconocida al guardar
+    };
+
+    Record record;
+    bool valid;
+    bool leaseReused;     // La conexión actual usa el lease en cache, sin DHCP
+    bool dhcpPending;     // DHCP reanudado tras el join; falta el lease nuevo
+    String pendingSSID;
+
+    bool leaseUsable() const;
+    static bool staticIPConfigured();
+    static uint32_t hashSSID(const String& ssid);
+    void persist();
+};
+
+extern WiFiConnectCache wifiConnectCache;
+
+#endif
@@ -4,16 +4,19 @@
 #include <Arduino.h>
 #include <WiFi.h>
 #include <WiFiClientSecure.h>
-#include <WebServer.h>
-#include <DNSServer.h>
+#include <ESPAsyncWebServer.h>
 #include <HTTPClient.h>
 #include <ArduinoJson.h>
 #include "config.h"
+#include "captive_dns.h"
+#include "portal_jobs.h"
 
 class WiFiManager {
 public:
     WiFiManager();
     void begin();
+    void end();
+    void onConfigChanged(uint32_t changes);
     bool connect();
     bool isConnected();
     bool reconnect();
@@ -36,8 +39,9 @@ public:
 private:
     unsigned long lastConnectionAttempt;
     bool wasConnected;
-    WebServer configServer;
-    DNSServer dnsServer;
+    bool connectedOnce;
+    AsyncWebServer configServer;
+    CaptiveDNS dnsServer;
     bool portalActive;
     bool pendingReconnect;
     unsigned long lastPortalAnnounce;
@@ -47,23 +51,28 @@ private:
     int connectionAttempts;
     int loggedUserId;
     String detectedMasterMac;
-    bool dnsServerActive;
-    IPAddress cachedBackendIP;
-    bool backendIPCached;
+    bool pendingActivation;
+    unsigned long activationRequestTime;
+    int pendingActivationId;
     
     void loadStoredCredentials();
     bool resolveBackendDNS(IPAddress& ip);
     String loginUser(const String& email, const String& password);
     void saveCredentials(const String& ssid, const String& password);
-    void loadDeviceConfig();
-    void loadDeviceLocation();
-    void saveDeviceConfig(DeviceMode mode, const String& masterMac);
+    bool saveDeviceConfig(DeviceMode mode, const String& masterMac);
     void setupPortalRoutes();
-    void sendCORSHeaders();
-    String renderPortalPage(const String& statusMessage);
+    String connectPortalWifi(const String& ssid, const String& password);
+    String savePortalConfig(DeviceMode mode, const String& ssid, const String& password,
+                            const String& zoneName, const String& subLocation,
+                            int zoneId, int dispositivoId, bool lowPower);
+    void sendPortalPage(AsyncWebServerRequest* request, bool captiveProbe);
+    void sendCaptiveText(AsyncWebServerRequest* request, const char* text);
+    void sendJson(AsyncWebServerRequest* request, int code, const String& json);
+    String saveErrorJson(const String& message);
+    void sendSaveError(AsyncWebServerRequest* request, const String& message);
+    void submitJob(AsyncWebServerRequest* request, const char* name, PortalJobWork work);
     bool attemptConnection(unsigned long timeout);
     String macToString(const uint8_t* mac);
-    void stringToMac(const String& macStr, uint8_t* mac);
 };
 
 extern WiFiManager wifiManager;
@@ -0,0 +1,64 @@
+# Comprime los archivos de web/ con gzip y los embebe en PROGMEM.
+# Se ejecuta antes de compilar (extra_scripts = pre:...) y genera
+# include/generated/web_assets.h; solo reescribe el header si cambia.
+import gzip
+import hashlib
+import os
+import re
+
+try:
+    Import("env")  # noqa: F821 (inyectado por PlatformIO)
+    PROJECT_DIR = env["PROJECT_DIR"]  # noqa: F821
+except NameError:
+    PROJECT_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+WEB_DIR = os.path.join(PROJECT_DIR, "web")
+OUTPUT = os.path.join(PROJECT_DIR, "include", "generated", "web_assets.h")
+
+
+def symbol_for(filename):
+    return re.sub(r"[^A-Za-z0-9]", "_", filename).upper()
+
+
+def render_asset(filename):
+    with open(os.path.join(WEB_DIR, filename), "rb") as source:
+        raw = source.read()
+    # mtime=0 para que el resultado sea reproducible entre compilaciones
+    compressed = gzip.compress(raw, compresslevel=9, mtime=0)
+    etag = hashlib.sha1(compressed).hexdigest()[:16]
+    symbol = symbol_for(filename)
+
+    lines = ["// %s: %d -> %d bytes" % (filename, len(raw), len(compressed))]
+    lines.append("const uint8_t %s_GZ[] PROGMEM = {" % symbol)
+    for i in range(0, len(compressed), 16):
+        chunk = compressed[i:i + 16]
+        lines.append("    " + ", ".join("0x%02x" % b for b in chunk) + ",")
+    lines.append("};")
+    lines.append("constexpr size_t %s_GZ_LEN = %d;" % (symbol, len(compressed)))
+    lines.append('constexpr const char* %s_ETAG = "\\"%s\\"";' % (symbol, etag))
+    return "\n".join(lines)
+
+
+def main():
+    assets = sorted(f for f in os.listdir(WEB_DIR) if not f.startswith("."))
+    header = [
+        "// Generado por scripts/embed_web_assets.py a partir de web/. No editar.",
+        "#pragma once",
+        "#include <Arduino.h>",
+        "",
+    ]
+    header.extend(render_asset(f) + "\n" for f in assets)
+    content = "\n".join(header)
+
+    if os.path.exists(OUTPUT):
+        with open(OUTPUT, "r") as current:
+            if current.read() == content:
+                return
+
+    os.makedirs(os.path.dirname(OUTPUT), exist_ok=True)
+    with open(OUTPUT, "w") as output:
+        output.write(content)
+    print("[web] %s actualizado (%d archivos)" % (OUTPUT, len(assets)))
+
+
+main()
@@ -2,16 +2,60 @@
 #include "config.h"
 #include "ble_scanner.h"
 #include "wifi_manager.h"
+#include "wifi_connect_cache.h"
 #include "mqtt_client.h"
 #include "display_manager.h"
 #include "alerts.h"
 #include "espnow_manager.h"
-#include <Preferences.h>
+#include "detection_batcher.h"
+#include "api_client.h"
+#include "uplink.h"
+#include "registration_engine.h"
+#include "time_service.h"
+#include "dns_resolver.h"
+#include "config_store.h"
+#include "runtime_config.h"
+#include "beacon_status_cache.h"
+#include "scheduler.h"
+#include "power_manager.h"
+#include "tdma_manager.h"
+#include "airtime_manager.h"
 #include <esp_system.h>
+#include <deque>
 #include <ArduinoJson.h>
 
-unsigned long lastCycleTime = 0;
 bool systemReady = false;
+DeviceMode activeMode = DEVICE_SLAVE;  // Modo con el que están inicializados los módulos
+
+// Mensajes ESP-NOW drenados entre ciclos y texto pendiente para el LCD
+std::vector<ESPNowMessage> remoteMessages;
+String statusLine1, statusLine2;
+bool statusDirty = false;
+
+// Pipeline de dos etapas: la captura entrega cada ventana terminada a la
+// cola y vuelve a escanear; la etapa de proceso/envío la consume aparte
+struct CycleSnapshot {
+    std::map<String, BeaconData> beacons;
+    unsigned long capturedAt;
+};
+std::deque<CycleSnapshot> cycleQueue;
+bool pipelineStalled = false;
+
+int scanJobId = -1;
+int buttonsJobId = -1;
+int tdmaJobId = -1;
+int captureJobId = -1;
+int processJobId = -1;
+int espNowJobId = -1;
+int uplinkJobId = -1;
+int servicesJobId = -1;
+int uiJobId = -1;
+
+// Períodos normales (ms); en bajo consumo se alargan o se anulan
+constexpr unsigned long ESPNOW_JOB_PERIOD = 250;
+constexpr unsigned long UPLINK_JOB_PERIOD = 10;
+constexpr unsigned long SERVICES_JOB_PERIOD = 50;
+constexpr unsigned long UI_JOB_PERIOD = 250;
 
 void printWelcomeMessage();
 void checkResetButtonOnStartup();
@@ -24,10 +68,26 @@ void initializeMasterMode();
 void initializeSlaveMode();
 void initializeBLE();
 void finishSetup();
-void processSlaveCycle();
-void processMasterCycle();
-void processRegistrationCycle();
+void processSlaveCycle(const std::map<String, BeaconData>& beacons);
+void processMasterCycle(const std::map<String, BeaconData>& localBeacons);
+void processRegistrationCycle(const std::map<String, BeaconData>& beacons);
 void handleResetButtonInLoop();
+void teardownDeviceMode();
+void onConfigChanged(uint32_t changes);
+void registerJobs();
+void applyPowerPolicy();
+unsigned long scanInterval();
+void buttonsJob();
+void tdmaJob();
+void startScanIfAllowed();
+void scanJob();
+void captureJob();
+void processJob();
+void espNowDrainJob();
+void uplinkJob();
+void servicesJob();
+void uiJob();
+void postStatus(const String& line1, const String& line2);
 
 void setup() {
     Serial.begin(115200);
@@ -35,6 +95,11 @@ void setup() {
     printWelcomeMessage();
     checkResetButtonOnStartup();
     bool configurationExists = loadDeviceConfiguration();
+    configStore.subscribe(onConfigChanged);
+    runtimeConfig.load();
+    beaconStatusCache.load();
+    timeService.begin();
+    dnsResolver.begin();
     initializeDisplay();
     if (!configurationExists) {
         handleConfigurationPortal();
@@ -42,39 +107,235 @@ void setup() {
     initializeAlerts();
     initializeDeviceMode();
     initializeBLE();
+    registerJobs();
     finishSetup();
 }
 
 void loop() {
-    unsigned long now = millis();
+    scheduler.run();
+}
+
+// ==================== Trabajos del planificador ====================
+// Orden = prioridad dentro de cada vuelta: el escaneo y los botones van
+// primero para que un envío lento no retrase la siguiente ventana de escaneo
+void registerJobs() {
+    scanJobId = scheduler.add("scan", scanInterval(), 20, scanJob);
+    buttonsJobId = scheduler.add("buttons", 0, 5, buttonsJob);
+    tdmaJobId = scheduler.add("tdma", 0, TDMA_SLOT_LENGTH + 20, tdmaJob);
+    captureJobId = scheduler.add("capture", 0, 5, captureJob);
+    processJobId = scheduler.add("process", 0, 500, processJob);
+    espNowJobId = scheduler.add("espnow", ESPNOW_JOB_PERIOD, 10, espNowDrainJob);
+    uplinkJobId = scheduler.add("uplink", UPLINK_JOB_PERIOD, 100, uplinkJob);
+    servicesJobId = scheduler.add("services", SERVICES_JOB_PERIOD, 100, servicesJob);
+    uiJobId = scheduler.add("ui", UI_JOB_PERIOD, 50, uiJob);
+    
+    // El reposo entre vueltas lo decide el gestor de energía
+    scheduler.setIdleHandler([](unsigned long ms) { powerManager.idle(ms, bleScanner.isScanning()); });
+    
+    // Fin de la ventana de escaneo (tarea BLE) -> entregar resultados
+    bleScanner.onScanComplete([]() { scheduler.trigger(captureJobId); });
+    
+    // Los botones ya no se sondean: el antirrebote (esp_timer) avisa del evento
+    onButtonEvent([]() { scheduler.trigger(buttonsJobId); });
+    scheduler.trigger(buttonsJobId);  // Eventos llegados durante el arranque
+    
+    // Baliza TDMA recibida (tarea WiFi) -> recalcular el slot propio
+    espNowManager.onSyncBeacon([]() { scheduler.trigger(tdmaJobId); });
+    scheduler.trigger(tdmaJobId);
+}
+
+// Esclavo a batería (ajuste del portal): una ventana BLE cada
+// POWER_SCAN_INTERVAL con light sleep entre medias, radio WiFi apagada salvo
+// para enviar y sin los trabajos que solo usa el maestro. Se aplica al
+// arrancar, en cada cambio de modo y al cambiar el ajuste.
+void applyPowerPolicy() {
+    bool lowPower = configStore.isLowPower() && activeMode == DEVICE_SLAVE;
+    
+    if (lowPower) {
+        powerManager.begin();
+        espNowManager.radioOff();
+    } else {
+        powerManager.end();
+    }
     
-    // ==================== DETECCIÓN DE BOTONES (SIEMPRE ACTIVO) ====================
+    scheduler.setIdleSlice(lowPower ? POWER_SCAN_INTERVAL : SCHEDULER_IDLE_SLICE);
+    scheduler.setPeriod(scanJobId, scanInterval());
+    scheduler.setPeriod(espNowJobId, lowPower ? 0 : ESPNOW_JOB_PERIOD);
+    scheduler.setPeriod(uplinkJobId, lowPower ? 0 : UPLINK_JOB_PERIOD);
+    scheduler.setPeriod(servicesJobId, lowPower ? POWER_SERVICES_INTERVAL : SERVICES_JOB_PERIOD);
+    scheduler.setPeriod(uiJobId, lowPower ? POWER_SERVICES_INTERVAL : UI_JOB_PERIOD);
+}
+
+unsigned long scanInterval() {
+    unsigned long interval = runtimeConfig.getCycleInterval();
+    if (powerManager.isEnabled() && interval < POWER_SCAN_INTERVAL) {
+        interval = POWER_SCAN_INTERVAL;
+    }
+    return interval;
+}
+
+void buttonsJob() {
     if (CURRENT_DEVICE_MODE == DEVICE_MASTER) {
         checkModeButtonPress();  // Detecta cambios de modo
     }
     handleResetButtonInLoop();  // Detecta botón de reset
+}
+
+// Baliza (maestro) o envío en el slot propio (esclavo); el trabajo se
+// reprograma solo para el siguiente evento del plan TDMA
+void tdmaJob() {
+    tdmaManager.loop();
+    if (activeMode == DEVICE_MASTER) {
+        startScanIfAllowed();  // La ventana de recepción pudo acabar de cerrarse
+    }
     
-    // ==================== CICLO CADA 2 SEGUNDOS ====================
-    if (now - lastCycleTime >= SCAN_CYCLE_INTERVAL) {
-        lastCycleTime = now;
-        
-        if (CURRENT_DEVICE_MODE == DEVICE_SLAVE) {
-            processSlaveCycle();
+    unsigned long when;
+    if (tdmaManager.nextEvent(when)) {
+        scheduler.runAt(tdmaJobId, when);
+    }
+}
+
+// El maestro no escanea durante los slots de recepción ESP-NOW ni en la
+// ventana de subida; la ventana BLE dentro de cada intervalo la fija el reparto del aire
+void startScanIfAllowed() {
+    if (bleScanner.isScanning() || bleScanner.hasResults()) {
+        return;
+    }
+    int seconds = tdmaManager.scanSeconds();
+    if (seconds == 0) {
+        return;
+    }
+    bleScanner.setDuty(airtimeManager.getScanWindow(), BLE_SCAN_INTERVAL);
+    bleScanner.startScan(seconds);
+}
+
+// Respaldo periódico: abre una ventana si no hay ninguna en curso (arranque,
+// fallo al iniciar o fin de la espera por cola llena). El ritmo normal lo
+// marca captureJob, que encadena las ventanas sin hueco entre ellas.
+void scanJob() {
+    scheduler.setPeriod(scanJobId, scanInterval());
+    
+    if (bleScanner.isScanning()) {
+        return;
+    }
+    if (bleScanner.hasResults()) {
+        captureJob();
+        return;
+    }
+    startScanIfAllowed();
+}
+
+// Etapa 1: la ventana terminada pasa a la cola y la radio vuelve a escanear
+// de inmediato. Con la cola llena (envío atrasado) los resultados esperan en
+// el scanner y no se abre otra ventana: la memoria queda acotada. En bajo
+// consumo la siguiente ventana la abre scanJob, tras dormir.
+void captureJob() {
+    if (!bleScanner.hasResults()) {
+        return;
+    }
+    
+    if (cycleQueue.size() >= CYCLE_PIPELINE_DEPTH) {
+        if (!pipelineStalled) {
+            pipelineStalled = true;
+            Serial.printf("[PIPE] Cola llena (%d ciclos): escaneo en pausa hasta procesar el anterior\n", cycleQueue.size());
+        }
+        return;
+    }
+    pipelineStalled = false;
+    
+    CycleSnapshot snapshot;
+    snapshot.beacons = bleScanner.takeBeacons();
+    airtimeManager.recordScan(snapshot.beacons.size(), bleScanner.getScanWindow(), bleScanner.getScanSeconds());
+    snapshot.capturedAt = millis();
+    cycleQueue.push_back(std::move(snapshot));
+    
+    if (!powerManager.isEnabled()) {
+        startScanIfAllowed();
+    }
+    scheduler.trigger(processJobId);
+}
+
+// Etapa 2: procesa y envía un ciclo mientras la radio ya escanea el siguiente
+void processJob() {
+    if (cycleQueue.empty()) {
+        return;
+    }
+    
+    CycleSnapshot snapshot = std::move(cycleQueue.front());
+    cycleQueue.pop_front();
+    
+    if (CURRENT_DEVICE_MODE == DEVICE_SLAVE) {
+        processSlaveCycle(snapshot.beacons);
+    } else {
+        // En modo MAESTRO: verificar si estamos en modo REGISTRO o NORMAL
+        if (isRegistrationModeActive()) {
+            processRegistrationCycle(snapshot.beacons);
         } else {
-            // En modo MAESTRO: verificar si estamos en modo REGISTRO o NORMAL
-            if (isRegistrationModeActive()) {
-                processRegistrationCycle();
-            } else {
-                processMasterCycle();
+            if (registrationEngine.isActive()) {
+                Serial.println("\n[REGISTRO] ==========================================");
+                Serial.println("[REGISTRO] VOLVIENDO A MODO NORMAL");
+                Serial.println("[REGISTRO] ==========================================\n");
+                registrationEngine.end();
             }
+            processMasterCycle(snapshot.beacons);
         }
     }
     
-    if (CURRENT_DEVICE_MODE == DEVICE_MASTER && ENABLE_MQTT) {
+    // Hay hueco en la cola: si la captura estaba en pausa, se reanuda ya
+    if (pipelineStalled) {
+        scheduler.trigger(captureJobId);
+    }
+    if (!cycleQueue.empty()) {
+        scheduler.trigger(processJobId);
+    }
+}
+
+// Vacía el buffer de recepción ESP-NOW a menudo para que no crezca entre ciclos
+void espNowDrainJob() {
+    if (CURRENT_DEVICE_MODE != DEVICE_MASTER) {
+        return;
+    }
+    std::vector<ESPNowMessage> received = espNowManager.getReceivedMessages();
+    if (!received.empty()) {
+        espNowManager.clearReceivedMessages();
+        remoteMessages.insert(remoteMessages.end(), received.begin(), received.end());
+    }
+}
+
+void uplinkJob() {
+    if (CURRENT_DEVICE_MODE != DEVICE_MASTER) {
+        return;
+    }
+    if (ENABLE_MQTT) {
         mqttClient.loop();
     }
-    
-    delay(10);  // Small delay para evitar watchdog
+    apiClient.loop();  // Envíos HTTPS pendientes y sus reintentos
+    uplinkRouter.loop();  // Timeouts de entrega y failover
+}
+
+void servicesJob() {
+    timeService.loop();  // SNTP en segundo plano y persistencia de la hora
+    dnsResolver.loop();  // Renovación de IPs antes de que venza su TTL
+    wifiConnectCache.loop();  // Lease DHCP tras un join con el lease en cache
+    configStore.loop();  // Cambios de configuración aplicados en caliente
+}
+
+// El LCD (I2C) se actualiza solo aquí y solo si el texto cambió
+void uiJob() {
+    if (!statusDirty) {
+        return;
+    }
+    statusDirty = false;
+    displayManager.showMessage(statusLine1, statusLine2);
+}
+
+void postStatus(const String& line1, const String& line2) {
+    if (line1 == statusLine1 && line2 == statusLine2) {
+        return;
+    }
+    statusLine1 = line1;
+    statusLine2 = line2;
+    statusDirty = true;
 }
 
 void printWelcomeMessage() {
@@ -86,111 +347,23 @@ void printWelcomeMessage() {
     Serial.println();
 }
 
+// Solo se espera si el botón ya está pulsado al arrancar; en marcha, la
+// pulsación larga la atiende el trabajo "buttons"
 void checkResetButtonOnStartup() {
     initResetButton();
-    Serial.println("[MAIN] Verificando botón de reset (3 segundos)...");
-    unsigned long resetCheckStart = millis();
-    while (millis() - resetCheckStart < 3000) {
-        if (checkResetButton()) {
-            Serial.println("[MAIN] Reiniciando configuración...");     
-            Preferences prefsDevice, prefsLocation, prefsWifi;
-            prefsDevice.begin("device_cfg", false);
-            prefsDevice.clear();
-            prefsDevice.end();
-            delay(100);
-            prefsLocation.begin("location_cfg", false);
-            prefsLocation.clear();
-            prefsLocation.end();
-            delay(100);
-            prefsWifi.begin("wifi_cfg", false);
-            prefsWifi.clear();
-            prefsWifi.end();
-            delay(100);
-            Serial.println("[MAIN] Configuración borrada. Reiniciando...");
-            delay(1000);
-            ESP.restart();
-        }
-        delay(10);
+    if (waitForResetButtonOnStartup()) {
+        Serial.println("[MAIN] Reiniciando configuración...");     
+        configStore.clear();
+        Serial.println("[MAIN] Configuración borrada. Se abrirá el portal de configuración");
     }
 }
 
 bool loadDeviceConfiguration() {
     Serial.println("[MAIN] Cargando configuración guardada...");
     
-    Preferences prefsDevice;
-    bool configurationExists = false;
-    
-    if (prefsDevice.begin("device_cfg", true)) {  
-        uint8_t savedMode = prefsDevice.getUChar("mode", 255);
-        
-        if (savedMode == 1) {
-            CURRENT_DEVICE_MODE = DEVICE_MASTER;
-            configurationExists = true;
-            Serial.println("[MAIN] Modo cargado: MAESTRO");
-        } else if (savedMode == 0) {
-            CURRENT_DEVICE_MODE = DEVICE_SLAVE;
-            configurationExists = true;
-            Serial.println("[MAIN] Modo cargado: ESCLAVO");
-            
-            String masterMac = prefsDevice.getString("master_mac", "");
-            if (masterMac.length() > 0) {
-                Serial.printf("[MAIN] MAC Maestro: %s\n", masterMac.c_str());
-                
-                // Convertir string de MAC a array de bytes
-                int values[6];
-                if (sscanf(masterMac.c_str(), "%x:%x:%x:%x:%x:%x",
-                           &values[0], &values[1], &values[2],
-                           &values[3], &values[4], &values[5]) == 6) {
-                    for (int i = 0; i < 6; i++) {
-                        MASTER_MAC_ADDRESS[i] = (uint8_t)values[i];
-                    }
-                    Serial.println("[MAIN] ✓ MAC del maestro cargada correctamente");
-                } else {
-                    Serial.println("[MAIN] ⚠️ Error al parsear MAC del maestro");
-                }
-            }
-        } else {
-            Serial.println("[MAIN]   Sin configuración guardada");
-        }
-        prefsDevice.end();
-    } else {
-        Serial.println("[MAIN]   Sin configuración guardada");
-    }
-    
-    Preferences prefsLocation;
-    if (prefsLocation.begin("location_cfg", true)) {
-        LOADED_ZONE_NAME = prefsLocation.getString("zone_name", "");
-        LOADED_SUB_LOCATION = prefsLocation.getString("sub_location", "");
-        LOADED_ZONE_ID = prefsLocation.getInt("zone_id", 0);
-        
-        if (LOADED_ZONE_NAME.length() > 0) {
-            Serial.printf("[MAIN] Zona cargada: %s (ID: %d)\n", LOADED_ZONE_NAME.c_str(), LOADED_ZONE_ID);
-        }
-        if (LOADED_SUB_LOCATION.length() > 0) {
-            Serial.printf("[MAIN] Sub-ubicación: %s\n", LOADED_SUB_LOCATION.c_str());
-            
-            String deviceType, locationName;
-            int slashPos = LOADED_SUB_LOCATION.indexOf('/');
-            
-            if (slashPos > 0) {
-                deviceType = LOADED_SUB_LOCATION.substring(0, slashPos);
-                locationName = LOADED_SUB_LOCATION.substring(slashPos + 1);
-            } else {
-                locationName = LOADED_SUB_LOCATION;
-            }
-            
-            deviceType.toUpperCase();
-            locationName.toUpperCase();
-            locationName.replace(" ", "_");
-            locationName.replace("-", "_");
-            
-            LOADED_DEVICE_ID = "IOT_" + deviceType + "_" + locationName;
-            Serial.printf("[MAIN] ID Dispositivo: %s\n", LOADED_DEVICE_ID.c_str());
-        }
-        prefsLocation.end();
-    }
-    
-    return configurationExists;
+    // Única lectura de NVS; a partir de aquí todo se consulta en RAM
+    configStore.load();
+    return configStore.hasMode();
 }
 
 void handleConfigurationPortal() {
@@ -217,9 +390,7 @@ void handleConfigurationPortal() {
         delay(10);
     }
     
-    Serial.println("[MAIN] Configuración completada. Reiniciando...");
-    delay(1000);
-    ESP.restart();
+    Serial.println("[MAIN] Configuración completada. Continuando sin reiniciar...");
 }
 
 void initializeDisplay() {
@@ -244,17 +415,13 @@ void initializeMasterMode() {
     Serial.println("\n[MAIN] =======================================");
     Serial.println("[MAIN]   DISPOSITIVO MAESTRO");
     Serial.println("[MAIN] =======================================");
+    activeMode = DEVICE_MASTER;
     
     wifiManager.begin();
     displayManager.showMessage("WiFi...", "Conectando");
     
     // Verificar si es primera ejecución después de configurar
-    Preferences prefsFirstRun;
-    bool firstRunAfterConfig = false;
-    if (prefsFirstRun.begin("first_run", true)) {
-        firstRunAfterConfig = prefsFirstRun.getBool("pending", false);
-        prefsFirstRun.end();
-    }
+    bool firstRunAfterConfig = configStore.isFirstRunPending();
     
     if (!wifiManager.connect()) {
         Serial.println("[MAIN]     WiFi no disponible. Esperando configuración...");
@@ -269,12 +436,17 @@ void initializeMasterMode() {
         Serial.println("[MAIN] Configuración WiFi completada");
         Serial.println("[MAIN] ========================================");
         
-        // Marcar que hay modo registro pendiente
-        if (prefsFirstRun.begin("first_run", false)) {
-            prefsFirstRun.putBool("pending", true);
-            prefsFirstRun.end();
+        // El portal pudo dejar el equipo configurado como ESCLAVO
+        if (CURRENT_DEVICE_MODE != DEVICE_MASTER) {
+            wifiManager.end();
+            initializeSlaveMode();
+            return;
         }
         
+        // El modo registro se activa ahora mismo; el flag del portal ya no hace falta
+        configStore.setFirstRunPending(false);
+        configStore.commit();
+        
         // Inicializar botón de modo ANTES de entrar al modo registro
         initModeButton();
         
@@ -298,10 +470,8 @@ void initializeMasterMode() {
         Serial.println("[MAIN] ========================================");
         
         // Limpiar el flag
-        if (prefsFirstRun.begin("first_run", false)) {
-            prefsFirstRun.putBool("pending", false);
-            prefsFirstRun.end();
-        }
+        configStore.setFirstRunPending(false);
+        configStore.commit();
         
         // Inicializar botón de modo
         initModeButton();
@@ -315,8 +485,12 @@ void initializeMasterMode() {
         displayManager.showMessage("MQTT...", "Conectando");
     }
     
+    uplinkRouter.initialize();
+    
     if (!espNowManager.initializeMaster()) {
         Serial.println("[MAIN]   Error al inicializar ESP-NOW");
+    } else {
+        tdmaManager.begin(DEVICE_MASTER);
     }
 }
 
@@ -324,6 +498,7 @@ void initializeSlaveMode() {
     Serial.println("\n[MAIN] =======================================");
     Serial.println("[MAIN]   DISPOSITIVO ESCLAVO");
     Serial.println("[MAIN] =======================================");
+    activeMode = DEVICE_SLAVE;
     
     if (!espNowManager.initializeSlave()) {
         Serial.println("[MAIN]   Error al inicializar ESP-NOW");
@@ -331,6 +506,7 @@ void initializeSlaveMode() {
         alertManager.showError();
         while (1) delay(1000);
     }
+    tdmaManager.begin(DEVICE_SLAVE);
 }
 
 void initializeBLE() {
@@ -343,7 +519,11 @@ void initializeBLE() {
 }
 
 void finishSetup() {
+    // Los módulos acaban de arrancar con la configuración vigente; los
+    // avisos acumulados durante el portal ya están aplicados
+    configStore.discardChanges();
     systemReady = true;
+    applyPowerPolicy();
     displayManager.showMessage("Sistema", "Listo");
     alertManager.showSuccess();
     delay(2000);
@@ -352,61 +532,39 @@ void finishSetup() {
     Serial.println("[MAIN] Iniciando ciclo de escaneo...\n");
 }
 
-void processSlaveCycle() {
+void processSlaveCycle(const std::map<String, BeaconData>& beacons) {
     static unsigned long cycleNumber = 0;
     cycleNumber++;
     
     Serial.printf("\n[ESCLAVO] ━━━━━ Ciclo Esclavo #%lu ━━━━━\n", cycleNumber);
     Serial.printf("[ESCLAVO] Canal WiFi actual: %d\n", WiFi.channel());
     
-    bleScanner.performScan();
-    std::map<String, BeaconData> beacons = bleScanner.getBeaconData();
-    
     if (beacons.size() > 0) {
         Serial.printf("[ESCLAVO] Beacons detectados: %d\n", beacons.size());
-        int sentCount = 0;
-        int failCount = 0;
         
+        // Se encolan; TDMAManager los envía en el slot de este esclavo
         for (const auto& pair : beacons) {
             const BeaconData& beacon = pair.second;
             
-            StaticJsonDocument<256> doc;
-            String currentDeviceId = LOADED_DEVICE_ID.length() > 0 ? LOADED_DEVICE_ID : LOADED_DEVICE_ID;
-            String currentLocation = beacon.detectedLocation;
-            
-            doc["device_id"] = currentDeviceId;
-            doc["device_location"] = currentLocation;
-            doc["animal_id"] = beacon.animalId;
-            doc["rssi"] = beacon.rssi;
-            doc["distance"] = beacon.distance;
-            
-            String jsonMessage;
-            serializeJson(doc, jsonMessage);
-            
-            bool sent = espNowManager.sendToMaster(jsonMessage);
-            if (sent) {
-                sentCount++;
-                Serial.printf("[ESCLAVO] ✓ Enviado: ID=%u, RSSI=%d, Dist=%.2fm\n",
-                             beacon.animalId, beacon.rssi, beacon.distance);
-            } else {
-                failCount++;
-                Serial.printf("[ESCLAVO] ✗ FALLÓ envío: ID=%u\n", beacon.animalId);
-            }
-            
-            // Pequeño delay para garantizar que el mensaje se transmita antes del siguiente
-            delay(15);
+            ESPNowMessage msg;
+            memset(&msg, 0, sizeof(msg));
+            strncpy(msg.deviceId, LOADED_DEVICE_ID.c_str(), sizeof(msg.deviceId) - 1);
+            strncpy(msg.location, beacon.detectedLocation.c_str(), sizeof(msg.location) - 1);
+            msg.animalId = beacon.animalId;
+            msg.rssi = beacon.rssi;
+            msg.distance = beacon.distance;
+            tdmaManager.enqueue(msg);
         }
-        
-        Serial.printf("[ESCLAVO] Resumen envíos: %d exitosos, %d fallidos\n", sentCount, failCount);
+        scheduler.trigger(tdmaJobId);
     } else {
         Serial.println("[ESCLAVO] Sin beacons detectados");
     }
     
-    bleScanner.clearBeacons();
-    displayManager.showMessage("Esclavo", String(beacons.size()) + " vacas");
+    postStatus("Esclavo", String(beacons.size()) + " vacas");
+    powerManager.endCycle();
 }
 
-void processMasterCycle() {
+void processMasterCycle(const std::map<String, BeaconData>& localBeacons) {
     // Log de modo actual (cada 10 ciclos para no saturar)
     static int cycleCount = 0;
     if (cycleCount % 10 == 0) {
@@ -425,10 +583,11 @@ void processMasterCycle() {
     
     Serial.println("\n[MAESTRO] ━━━━━ Ciclo Maestro ━━━━━");
     
-    // Leer y limpiar mensajes ESP-NOW INMEDIATAMENTE para no perder paquetes
-    std::vector<ESPNowMessage> receivedMsgs = espNowManager.getReceivedMessages();
+    // Mensajes ESP-NOW acumulados por el trabajo de drenado desde el ciclo anterior
+    espNowDrainJob();
+    std::vector<ESPNowMessage> receivedMsgs;
+    receivedMsgs.swap(remoteMessages);
     int msgCount = receivedMsgs.size();
-    espNowManager.clearReceivedMessages();  // Limpiar AHORA para capturar nuevos mensajes
     Serial.printf("[MAESTRO] Mensajes de esclavos: %d\n", msgCount);
     
     // DEBUG: Mostrar detalles de cada mensaje recibido
@@ -441,8 +600,6 @@ void processMasterCycle() {
         }
     }
     
-    bleScanner.performScan();
-    std::map<String, BeaconData> localBeacons = bleScanner.getBeaconData();
     Serial.printf("[MAESTRO] Beacons locales: %d\n", localBeacons.size());
     
     std::map<String, BeaconData> allBeacons = localBeacons;
@@ -464,38 +621,52 @@ void processMasterCycle() {
     
     Serial.printf("[MAESTRO] Total beacons: %d\n", allBeacons.size());
     
-    if (ENABLE_MQTT && mqttClient.isConnected()) {
+    bool batching = runtimeConfig.getEncoding() == ENCODING_BATCH;
+    if (batching) {
+        detectionBatcher.addCycle(allBeacons, timeService.uptimeSeconds());
+    }
+    
+    // Al cambiar a JSON por comando remoto se vacía el lote pendiente. El lote
+    // binario solo tiene destino MQTT: no pasa por el router ni hace failover
+    // a HTTPS; si MQTT no está, se queda acumulado hasta que vuelva
+    bool flushBatch = !detectionBatcher.isEmpty() && (detectionBatcher.isReady() || !batching);
+    if (flushBatch && ENABLE_MQTT && mqttClient.isConnected()) {
+        std::vector<uint8_t> batch = detectionBatcher.encode();
+        Serial.printf("[MAESTRO] Lote: %d ciclos, %d registros, %d bytes\n",
+                     detectionBatcher.getCycleCount(), detectionBatcher.getRecordCount(), batch.size());
+        
+        if (mqttClient.publishBinary(MQTT_BATCH_TOPIC, batch.data(), batch.size(), MQTT_DETECTIONS_QOS)) {
+            detectionBatcher.clear();
+        } else {
+            Serial.println("[MAESTRO] Error al enviar lote, se reintenta el próximo ciclo");
+        }
+    }
+    
+    if (!batching) {
         if (allBeacons.size() > 0) {
-            bool mqttSuccess = mqttClient.sendDetections(allBeacons);
-            if (mqttSuccess) {
-                Serial.println("[MAESTRO] Datos enviados a MQTT");
+            // El router elige MQTT o HTTPS según su salud reciente
+            if (uplinkRouter.sendDetections(allBeacons)) {
+                Serial.println("[MAESTRO] Datos encolados para envío");
             } else {
-                Serial.println("[MAESTRO] Error al enviar MQTT");
+                Serial.println("[MAESTRO] Error al enviar detecciones");
             }
         } else {
-            Serial.println("[MAESTRO] Sin datos para enviar a MQTT");
+            Serial.println("[MAESTRO] Sin datos para enviar");
         }
     }
     
-    bleScanner.clearBeacons();
-    displayManager.showMessage("Maestro", String(allBeacons.size()) + " vacas");
+    postStatus("Maestro", String(allBeacons.size()) + " vacas");
 }
 
-void processRegistrationCycle() {
-    static bool firstTime = true;
-    
-    if (firstTime) {
+void processRegistrationCycle(const std::map<String, BeaconData>& beacons) {
+    if (!registrationEngine.isActive()) {
         Serial.println("\n[REGISTRO] ==========================================");
         Serial.println("[REGISTRO] MODO: REGISTRO DE BEACONS ACTIVO");
         Serial.println("[REGISTRO] Presiona botón para volver a NORMAL");
         Serial.println("[REGISTRO] ==========================================\n");
-        firstTime = false;
+        registrationEngine.begin();
     }
     
-    // Escanear beacons
-    bleScanner.performScan();
-    std::map<String, BeaconData> beacons = bleScanner.getBeaconData();
-    
     if (!beacons.empty()) {
         std::vector<String> macAddresses;
         Serial.printf("[REGISTRO] Beacons detectados: %d\n", beacons.size());
@@ -503,69 +674,81 @@ void processRegistrationCycle() {
         for (const auto& pair : beacons) {
             macAddresses.push_back(pair.second.macAddress);
         }
-        
-        // Publicar a MQTT
-        extern MQTTClient mqttClient;
-        if (mqttClient.isConnected()) {
-            DynamicJsonDocument doc(1024);
-            doc["zone_id"] = LOADED_ZONE_ID;
-            
-            JsonArray macsArray = doc.createNestedArray("macs");
-            for (const String& mac : macAddresses) {
-                macsArray.add(mac);
-            }
-            
-            String payload;
-            serializeJson(doc, payload);
-            
-            Serial.printf("[REGISTRO] Enviando %d MACs al MQTT...\n", macAddresses.size());
-            Serial.printf("[REGISTRO] Payload: %s\n", payload.c_str());
-            
-            mqttClient.publish("bovino_io/register_beacon", payload.c_str());
-        }
+        registrationEngine.observe(macAddresses);
     } else {
         Serial.println("[REGISTRO] No se detectaron beacons en este ciclo");
     }
     
-    bleScanner.clearBeacons();
-    displayManager.showMessage("REGISTRO", String(beacons.size()) + " beacons");
+    // Solo se publican MACs nuevas o con refresco vencido
+    registrationEngine.flush();
     
-    // Si salimos del modo registro, resetear flag
-    static bool wasInRegistrationMode = true;
-    if (!isRegistrationModeActive() && wasInRegistrationMode) {
-        Serial.println("\n[REGISTRO] ==========================================");
-        Serial.println("[REGISTRO] VOLVIENDO A MODO NORMAL");
-        Serial.println("[REGISTRO] ==========================================\n");
-        firstTime = true;  // Reset para próxima entrada
-    }
-    wasInRegistrationMode = isRegistrationModeActive();
+    postStatus("REGISTRO", String(registrationEngine.getConfirmedCount()) + "/" +
+                               String(registrationEngine.getConfirmedCount() + registrationEngine.getPendingCount()) + " ok");
 }
 
 void handleResetButtonInLoop() {
     if (checkResetButton()) {
         Serial.println("[MAIN] Reset solicitado. Borrando configuración...");
         
-        Preferences prefsDevice, prefsLocation, prefsWifi;
-        
-        prefsDevice.begin("device_cfg", false);
-        prefsDevice.clear();
-        prefsDevice.end();
-        delay(100);
+        configStore.clear();
         
-        prefsLocation.begin("location_cfg", false);
-        prefsLocation.clear();
-        prefsLocation.end();
-        delay(100);
-        
-        prefsWifi.begin("wifi_cfg", false);
-        prefsWifi.clear();
-        prefsWifi.end();
-        delay(100);
-        
-        Serial.println("[MAIN] Configuración borrada. Reiniciando en 2 segundos...");
-        displayManager.showMessage("RESET", "Reiniciando");
+        displayManager.showMessage("RESET", "Config borrada");
         alertManager.showWarning();
-        delay(2000);
-        ESP.restart();
+        
+        // Sin reiniciar: se baja el modo actual y se repite el arranque desde el portal
+        systemReady = false;
+        teardownDeviceMode();
+        bleScanner.end();
+        handleConfigurationPortal();
+        initializeDeviceMode();
+        initializeBLE();
+        finishSetup();
+    }
+}
+
+// ==================== Configuración en caliente ====================
+void teardownDeviceMode() {
+    if (activeMode == DEVICE_MASTER) {
+        exitRegistrationMode();
+        if (registrationEngine.isActive()) {
+            registrationEngine.end();
+        }
+        detectionBatcher.clear();
+        remoteMessages.clear();
+        mqttClient.stop();
+        wifiManager.end();
     }
+    tdmaManager.end();
+    espNowManager.end();
+    powerManager.end();
+    cycleQueue.clear();  // Ciclos capturados con el modo anterior
+}
+
+void onConfigChanged(uint32_t changes) {
+    if (!systemReady) {
+        return;
+    }
+    
+    // Cambio MAESTRO <-> ESCLAVO: bajar el modo actual y levantar el nuevo;
+    // BLE es común a los dos y sigue activo
+    if ((changes & CONFIG_CHANGE_MODE) && CURRENT_DEVICE_MODE != activeMode) {
+        Serial.printf("[MAIN] Cambio de modo a %s sin reiniciar\n",
+                     CURRENT_DEVICE_MODE == DEVICE_MASTER ? "MAESTRO" : "ESCLAVO");
+        displayManager.showMessage("Config", "Cambiando modo");
+        teardownDeviceMode();
+        initializeDeviceMode();
+        applyPowerPolicy();
+        displayManager.showMessage("Sistema", "Listo");
+        return;
+    }
+    
+    if (changes & CONFIG_CHANGE_POWER) {
+        applyPowerPolicy();
+    }
+    
+    // Mismo modo: cada módulo reinicializa solo lo que le afecta
+    wifiManager.onConfigChanged(changes);
+    espNowManager.onConfigChanged(changes);
+    mqttClient.onConfigChanged(changes);
+    bleScanner.onConfigChanged(changes);
 }
@@ -0,0 +1,155 @@
+#include "airtime_manager.h"
+#include "espnow_manager.h"
+#include "mqtt_client.h"
+#include "runtime_config.h"
+#include "uplink.h"
+
+AirtimeManager airtimeManager;
+
+AirtimeManager::AirtimeManager()
+    : active(false),
+      rxTail(0),
+      uplinkWindow(0),
+      scanWindow(BLE_SCAN_WINDOW),
+      backlog(0),
+      lastFailed(0),
+      espNowLate(0.0f),
+      bleBaseline(0.0f),
+      bleLoss(0.0f),
+      uplinkFailures(0),
+      reportStart(0),
+      rxTime(0),
+      uplinkTime(0),
+      frameTime(0),
+      scanAirTime(0) {
+}
+
+void AirtimeManager::begin() {
+    active = true;
+    rxTail = 0;
+    uplinkWindow = 0;
+    scanWindow = BLE_SCAN_WINDOW;
+    lastFailed = uplinkRouter.getFailedCount();
+    espNowLate = 0.0f;
+    bleLoss = 0.0f;
+    uplinkFailures = 0;
+    reportStart = millis();
+    rxTime = 0;
+    uplinkTime = 0;
+    frameTime = 0;
+    scanAirTime = 0;
+}
+
+// Fuera del maestro BLE vuelve a tener todo el aire
+void AirtimeManager::end() {
+    active = false;
+    rxTail = 0;
+    uplinkWindow = 0;
+    scanWindow = BLE_SCAN_WINDOW;
+}
+
+// ==================== Plan de la trama ====================
+// Se llama al emitir cada baliza, con lo medido durante la trama anterior
+void AirtimeManager::planFrame() {
+    if (!active) {
+        return;
+    }
+
+    // ESP-NOW: tramas fuera de ventana = esclavos desfasados o sin sincronía;
+    // se alarga la cola de la ventana para que caigan sin BLE encima
+    uint32_t inWindow = 0;
+    uint32_t outOfWindow = 0;
+    espNowManager.takeReceiveStats(inWindow, outOfWindow);
+    if (inWindow + outOfWindow > 0) {
+        float late = (float)outOfWindow / (inWindow + outOfWindow);
+        espNowLate = AIRTIME_EWMA_ALPHA * late + (1.0f - AIRTIME_EWMA_ALPHA) * espNowLate;
+    }
+    if (espNowLate > AIRTIME_ESPNOW_LATE_LIMIT) {
+        rxTail = min(rxTail + AIRTIME_RX_TAIL_STEP, AIRTIME_RX_TAIL_MAX);
+    } else if (rxTail >= AIRTIME_RX_TAIL_STEP) {
+        rxTail -= AIRTIME_RX_TAIL_STEP;
+    }
+
+    // Subida: ventana sin BLE proporcional a lo pendiente; con fallos, la máxima
+    backlog = uplinkRouter.getPendingCount() + mqttClient.getQueuedCount();
+    uint32_t failed = uplinkRouter.getFailedCount();
+    uint32_t newFailures = failed - lastFailed;
+    lastFailed = failed;
+    uplinkFailures += newFailures;
+
+    if (backlog == 0) {
+        uplinkWindow = 0;
+    } else if (newFailures > 0) {
+        uplinkWindow = AIRTIME_UPLINK_MAX;
+    } else {
+        uplinkWindow = constrain(backlog * AIRTIME_UPLINK_PER_DELIVERY, AIRTIME_UPLINK_MIN, AIRTIME_UPLINK_MAX);
+    }
+
+    // BLE: con la subida cargada la ventana de escaneo cede huecos a WiFi,
+    // salvo que el escaneo ya esté perdiendo demasiados beacons
+    bool uplinkBusy = backlog >= AIRTIME_HEAVY_BACKLOG || newFailures > 0;
+    if (uplinkBusy && bleLoss < AIRTIME_BLE_LOSS_LIMIT) {
+        if (scanWindow >= AIRTIME_SCAN_WINDOW_MIN + AIRTIME_SCAN_STEP) {
+            scanWindow -= AIRTIME_SCAN_STEP;
+        }
+    } else if (scanWindow < BLE_SCAN_WINDOW) {
+        scanWindow = min((uint16_t)(scanWindow + AIRTIME_SCAN_STEP), BLE_SCAN_WINDOW);
+    }
+}
+
+void AirtimeManager::recordFrame(unsigned long rxWindow, unsigned long frameLength) {
+    if (!active) {
+        return;
+    }
+
+    unsigned long scanTime = runtimeConfig.getScanDuration() * 1000UL;
+    rxTime += rxWindow;
+    uplinkTime += uplinkWindow;
+    frameTime += frameLength;
+    scanAirTime += scanTime * scanWindow / BLE_SCAN_INTERVAL;
+
+    unsigned long now = millis();
+    if (now - reportStart >= AIRTIME_REPORT_INTERVAL) {
+        report(now);
+    }
+}
+
+// Beacons distintos vistos en una ventana. Los escaneos a pleno y sin
+// subida en curso fijan la referencia; los demás miden cuánto se pierde.
+// Los recortados por llegar tarde a la ventana no cuentan para ninguno
+void AirtimeManager::recordScan(size_t beaconCount, uint16_t window, int seconds) {
+    if (!active || seconds < runtimeConfig.getScanDuration()) {
+        return;
+    }
+
+    if (window >= BLE_SCAN_WINDOW && backlog == 0) {
+        bleBaseline = bleBaseline == 0.0f ? beaconCount
+                                          : AIRTIME_EWMA_ALPHA * beaconCount + (1.0f - AIRTIME_EWMA_ALPHA) * bleBaseline;
+        bleLoss = (1.0f - AIRTIME_EWMA_ALPHA) * bleLoss;
+        return;
+    }
+
+    if (bleBaseline >= 1.0f) {
+        float loss = 1.0f - beaconCount / bleBaseline;
+        loss = constrain(loss, 0.0f, 1.0f);
+        bleLoss = AIRTIME_EWMA_ALPHA * loss + (1.0f - AIRTIME_EWMA_ALPHA) * bleLoss;
+    }
+}
+
+// ==================== Informe ====================
+void AirtimeManager::report(unsigned long now) {
+    if (frameTime > 0) {
+        Serial.printf("[AIR] Reparto: ESP-NOW %lu%%, subida %lu%%, BLE %lu%% del aire (ventana %u/%u ms)\n",
+                      rxTime * 100 / frameTime, uplinkTime * 100 / frameTime,
+                      scanAirTime * 100 / frameTime, scanWindow, BLE_SCAN_INTERVAL);
+        Serial.printf("[AIR] Pérdidas: ESP-NOW fuera de ventana %.0f%%, BLE ~%.0f%%, subida %u fallos (%u pendientes)\n",
+                      espNowLate * 100.0f, bleLoss * 100.0f, uplinkFailures, backlog);
+    }
+
+    reportStart = now;
+    rxTime = 0;
+    uplinkTime = 0;
+    frameTime = 0;
+    scanAirTime = 0;
+    uplinkFailures = 0;
+}
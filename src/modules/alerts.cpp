@@ -4,17 +4,36 @@
 AlertManager alertManager;
 
 // ==================== Constructor ====================
-AlertManager::AlertManager() : loaderState(false) {
+AlertManager::AlertManager()
+    : queueCount(0),
+      playing(false),
+      phaseOn(false),
+      remaining(0),
+      phaseDeadline(0),
+      loaderState(false),
+      timer(nullptr) {
+    lock = xSemaphoreCreateMutex();
 }
 
 // ==================== Inicialización ====================
 void AlertManager::initialize() {
-
-    pinMode(LED_RGB_RED, OUTPUT);
-    pinMode(LED_RGB_GREEN, OUTPUT);
-    pinMode(LED_RGB_BLUE, OUTPUT);
+    ledcSetup(ALERT_LEDC_CHANNEL_RED, ALERT_LEDC_FREQUENCY, ALERT_LEDC_RESOLUTION);
+    ledcSetup(ALERT_LEDC_CHANNEL_GREEN, ALERT_LEDC_FREQUENCY, ALERT_LEDC_RESOLUTION);
+    ledcSetup(ALERT_LEDC_CHANNEL_BLUE, ALERT_LEDC_FREQUENCY, ALERT_LEDC_RESOLUTION);
+    ledcAttachPin(LED_RGB_RED, ALERT_LEDC_CHANNEL_RED);
+    ledcAttachPin(LED_RGB_GREEN, ALERT_LEDC_CHANNEL_GREEN);
+    ledcAttachPin(LED_RGB_BLUE, ALERT_LEDC_CHANNEL_BLUE);
     pinMode(ZUMBADOR, OUTPUT);
 
+    if (timer == nullptr) {
+        esp_timer_create_args_t timerArgs = {};
+        timerArgs.callback = onTimer;
+        timerArgs.arg = this;
+        timerArgs.dispatch_method = ESP_TIMER_TASK;
+        timerArgs.name = "alerts";
+        esp_timer_create(&timerArgs, &timer);
+    }
+
     allOff();
 
     Serial.println("[Alerts] Sistema de alertas inicializado");
@@ -25,79 +44,200 @@ void AlertManager::initialize() {
 }
 
 // ==================== Control del LED de Carga (Loader) ====================
+// El loader es el color de reposo: se ve cuando no hay un patrón sonando
 void AlertManager::loaderOn() {
-    setColor(0, 0, 255);  // Azul para indicar cargando
     loaderState = true;
+    showIdle();
 }
 
 void AlertManager::loaderOff() {
-    allOff();
     loaderState = false;
+    showIdle();
 }
 
 void AlertManager::loaderToggle() {
     loaderState = !loaderState;
-    if (loaderState) {
-        setColor(0, 0, 255);  // Azul
-    } else {
-        allOff();
+    showIdle();
+}
+
+void AlertManager::showIdle() {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (!playing) {
+        if (loaderState) {
+            writeOutputs(0, 0, 255, false);  // Azul para indicar cargando
+        } else {
+            writeOutputs(0, 0, 0, false);
+        }
     }
+    xSemaphoreGive(lock);
 }
 
 // ==================== Control de Color RGB ====================
 void AlertManager::setColor(uint8_t red, uint8_t green, uint8_t blue) {
-    analogWrite(LED_RGB_RED, red);
-    analogWrite(LED_RGB_GREEN, green);
-    analogWrite(LED_RGB_BLUE, blue);
+    if (timer == nullptr) {
+        return;  // LEDC todavía sin configurar (p. ej. botón de reset al arrancar)
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (!playing) {
+        writeOutputs(red, green, blue, false);
+    }
+    xSemaphoreGive(lock);
 }
 
-void AlertManager::flashColor(uint8_t red, uint8_t green, uint8_t blue, int times, int delayMs) {
-    for (int i = 0; i < times; i++) {
-        setColor(red, green, blue);
-        delay(delayMs);
-        allOff();
-        delay(delayMs);
-    }
+void AlertManager::writeOutputs(uint8_t red, uint8_t green, uint8_t blue, bool buzzer) {
+    ledcWrite(ALERT_LEDC_CHANNEL_RED, red);
+    ledcWrite(ALERT_LEDC_CHANNEL_GREEN, green);
+    ledcWrite(ALERT_LEDC_CHANNEL_BLUE, blue);
+    digitalWrite(ZUMBADOR, buzzer ? HIGH : LOW);
 }
 
 // ==================== Alertas Predefinidas ====================
 void AlertManager::showSuccess(int times) {
     // Verde puro
-    flashColor(0, 255, 0, times, 100);
+    post(0, 255, 0, false, 100, 100, times, ALERT_PRIORITY_LOW);
 }
 
 void AlertManager::showError(int times) {
     // Rojo puro con beep
-    for (int i = 0; i < times; i++) {
-        setColor(255, 0, 0);
-        digitalWrite(ZUMBADOR, HIGH);
-        delay(200);
-        allOff();
-        digitalWrite(ZUMBADOR, LOW);
-        delay(200);
-    }
+    post(255, 0, 0, true, 200, 200, times, ALERT_PRIORITY_HIGH);
 }
 
 void AlertManager::showWarning(int times) {
     // Amarillo (rojo + verde)
-    flashColor(255, 255, 0, times, 150);
+    post(255, 255, 0, false, 150, 150, times, ALERT_PRIORITY_NORMAL);
 }
 
 void AlertManager::showInfo(int times) {
     // Azul puro
-    flashColor(0, 0, 255, times, 100);
+    post(0, 0, 255, false, 100, 100, times, ALERT_PRIORITY_LOW);
 }
 
-// ==================== Control General ====================
 void AlertManager::beep(int duration) {
-    digitalWrite(ZUMBADOR, HIGH);
-    delay(duration);
-    digitalWrite(ZUMBADOR, LOW);
+    post(0, 0, 0, true, duration, 0, 1, ALERT_PRIORITY_LOW);
+}
+
+// ==================== Cola de Patrones ====================
+void AlertManager::post(uint8_t red, uint8_t green, uint8_t blue, bool buzzer,
+                        uint16_t onTime, uint16_t offTime, int times, AlertPriority priority) {
+    if (timer == nullptr || times <= 0) {
+        return;
+    }
+
+    Pattern pattern;
+    pattern.red = red;
+    pattern.green = green;
+    pattern.blue = blue;
+    pattern.buzzer = buzzer;
+    pattern.onTime = onTime;
+    pattern.offTime = offTime;
+    pattern.repeat = (uint8_t)min(times, 255);
+    pattern.priority = priority;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (!playing) {
+        startLocked(pattern);
+    } else if (priority > current.priority) {
+        // Preempción: el patrón en curso se descarta
+        esp_timer_stop(timer);
+        startLocked(pattern);
+    } else if (queueCount < ALERT_QUEUE_SIZE) {
+        queue[queueCount++] = pattern;
+    } else {
+        // Cola llena: el nuevo reemplaza al pendiente de menor prioridad si lo supera
+        int lowest = 0;
+        for (int i = 1; i < queueCount; i++) {
+            if (queue[i].priority < queue[lowest].priority) {
+                lowest = i;
+            }
+        }
+        if (priority > queue[lowest].priority) {
+            for (int i = lowest; i < queueCount - 1; i++) {
+                queue[i] = queue[i + 1];
+            }
+            queue[queueCount - 1] = pattern;
+        }
+    }
+    xSemaphoreGive(lock);
+}
+
+void AlertManager::startLocked(const Pattern& pattern) {
+    current = pattern;
+    playing = true;
+    phaseOn = true;
+    remaining = pattern.repeat;
+    writeOutputs(pattern.red, pattern.green, pattern.blue, pattern.buzzer);
+    schedulePhase(pattern.onTime);
 }
 
+void AlertManager::schedulePhase(uint16_t duration) {
+    phaseDeadline = esp_timer_get_time() + (int64_t)duration * 1000;
+    esp_timer_start_once(timer, (uint64_t)duration * 1000);
+}
+
+// Fase terminada: encendido -> apagado -> siguiente repetición o patrón
+void AlertManager::advanceLocked() {
+    if (phaseOn) {
+        phaseOn = false;
+        writeOutputs(0, 0, 0, false);
+        if (current.offTime > 0) {
+            schedulePhase(current.offTime);
+            return;
+        }
+    }
+
+    if (--remaining > 0) {
+        phaseOn = true;
+        writeOutputs(current.red, current.green, current.blue, current.buzzer);
+        schedulePhase(current.onTime);
+        return;
+    }
+
+    finishLocked();
+}
+
+// Siguiente en cola: el de mayor prioridad y, entre iguales, el más antiguo
+void AlertManager::finishLocked() {
+    if (queueCount == 0) {
+        playing = false;
+        if (loaderState) {
+            writeOutputs(0, 0, 255, false);
+        }
+        return;
+    }
+
+    int next = 0;
+    for (int i = 1; i < queueCount; i++) {
+        if (queue[i].priority > queue[next].priority) {
+            next = i;
+        }
+    }
+    Pattern pattern = queue[next];
+    for (int i = next; i < queueCount - 1; i++) {
+        queue[i] = queue[i + 1];
+    }
+    queueCount--;
+    startLocked(pattern);
+}
+
+// Tarea de esp_timer. Si mientras esperaba el lock se arrancó otro patrón
+// (preempción), el aviso es del anterior y se ignora.
+void AlertManager::onTimer(void* arg) {
+    AlertManager* self = static_cast<AlertManager*>(arg);
+    xSemaphoreTake(self->lock, portMAX_DELAY);
+    if (self->playing && esp_timer_get_time() + 1000 >= self->phaseDeadline) {
+        self->advanceLocked();
+    }
+    xSemaphoreGive(self->lock);
+}
+
+// ==================== Control General ====================
 void AlertManager::allOff() {
-    analogWrite(LED_RGB_RED, 0);
-    analogWrite(LED_RGB_GREEN, 0);
-    analogWrite(LED_RGB_BLUE, 0);
-    digitalWrite(ZUMBADOR, LOW);
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (timer != nullptr) {
+        esp_timer_stop(timer);
+    }
+    queueCount = 0;
+    playing = false;
+    writeOutputs(0, 0, 0, false);
+    xSemaphoreGive(lock);
 }
@@ -1,50 +1,32 @@
 #include "api_client.h"
 #include "wifi_manager.h"
-#include "alerts.h"
-#include "display_manager.h"
+#include "https_session.h"
+#include "beacon_status_cache.h"
+#include "time_service.h"
+#include "json_stream.h"
+#include <set>
 
 APIClient apiClient;
 
-APIClient::APIClient() {
-}
-
-bool APIClient::initializeTimeSync() {
-    Serial.println("[NTP] Sincronizando tiempo con servidores NTP...");
-    
-    configTime(0, 0, NTP_SERVER1, NTP_SERVER2);
-    
-    time_t now = time(nullptr);
-    int attempts = 0;
-    
-    while (now < 8 * 3600 * 2 && attempts < NTP_TIMEOUT_SECONDS) {
-        delay(500);
-        Serial.print(".");
-        now = time(nullptr);
-        attempts++;
-    }
-    
-    if (now >= 8 * 3600 * 2) {
-        Serial.println("\n[NTP]     Tiempo sincronizado correctamente");
-        return true;
-    } else {
-        Serial.println("\n[NTP]     Advertencia: Tiempo no sincronizado");
-        return false;
-    }
+APIClient::APIClient()
+    : nextJobId(1),
+      circuitState(CIRCUIT_CLOSED),
+      consecutiveFailures(0),
+      circuitOpenedAt(0),
+      circuitOpenTime(API_CIRCUIT_OPEN_TIME),
+      postTask(nullptr),
+      inFlightId(0),
+      resultReady(false) {
+    resultLock = xSemaphoreCreateMutex();
+    sessionLock = xSemaphoreCreateMutex();
 }
 
 time_t APIClient::getCurrentEpoch() {
-    return time(NULL);
+    return timeService.now();
 }
 
 String APIClient::getCurrentTimestamp() {
-    time_t now = time(NULL);
-    now -= 6 * 3600;  // Ajuste de zona horaria (GMT-6)
-    
-    struct tm* timeinfo = gmtime(&now);
-    char isoTime[25];
-    strftime(isoTime, sizeof(isoTime), "%Y-%m-%dT%H:%M:%SZ", timeinfo);
-    
-    return String(isoTime);
+    return timeService.formatLocal(timeService.now());
 }
 
 // ==================== Manejo de Respuestas ====================
@@ -92,214 +74,261 @@ unsigned long APIClient::getRetryDelay(int httpCode) {
 }
 
 // ==================== Envío de Detecciones (API Real) ====================
-bool APIClient::sendDetections(const std::map<String, BeaconData>& beacons) {
-    if (beacons.empty()) {
-        Serial.println("[API] No hay detecciones para enviar");
-        return false;
+uint32_t APIClient::sendDetections(const String& payload) {
+    if (jobs.size() >= API_MAX_PENDING_JOBS) {
+        // Cola llena: se descarta el envío más antiguo
+        Serial.printf("[API] Cola llena, descartando envío #%u\n", jobs.front().id);
+        uint32_t droppedId = jobs.front().id;
+        jobs.pop_front();
+        if (deliveryCallback) {
+            deliveryCallback(droppedId, false, 0);
+        }
     }
 
-    Serial.println("\n========================================");
-    Serial.printf("  Enviando %d Detecciones a la API\n", beacons.size());
-    Serial.println("========================================");
-
-    // Crear el payload JSON
-    String payload = createDetectionsPayload(beacons);
-    
-    Serial.println("[API] Payload:");
-    Serial.println(payload);
+    PostJob job;
+    job.id = nextJobId++;
+    if (nextJobId == 0) {
+        nextJobId = 1;
+    }
+    job.payload = payload;
+    job.attempts = 0;
+    job.nextAttemptAt = millis();
+    jobs.push_back(job);
 
-    int attempt = 1;
-    bool success = false;
+    Serial.printf("[API] Detecciones encoladas (envío #%u, %d pendientes)\n", job.id, jobs.size());
+    return job.id;
+}
 
-    while (!success && attempt <= MAX_RETRY_ATTEMPTS) {
-        //  CRÍTICO: Liberar memoria antes de cada intento HTTPS
-        Serial.printf("\n[API] Intento #%d/%d\n", attempt, MAX_RETRY_ATTEMPTS);
-        Serial.printf("[API] Memoria libre: %d bytes\n", ESP.getFreeHeap());
-        
-        // Forzar garbage collection
-        if (attempt > 1) {
-            Serial.println("[API] Esperando estabilización de heap...");
-            delay(2000);
+bool APIClient::cancel(uint32_t jobId) {
+    for (auto it = jobs.begin(); it != jobs.end(); ++it) {
+        if (it->id == jobId) {
+            jobs.erase(it);
+            return true;
         }
-        
-        HTTPClient http;
-        http.setTimeout(HTTP_TIMEOUT);
+    }
+    return false;
+}
 
-        Serial.printf("[API] POST a: %s\n", API_URL);
+// Recoge el resultado del intento en curso y lanza como máximo uno nuevo;
+// nunca espera a la red ni entre reintentos
+void APIClient::loop() {
+    collectResult();
 
-        alertManager.loaderOn();
+    if (inFlightId != 0 || jobs.empty() || WiFi.status() != WL_CONNECTED) {
+        return;
+    }
 
-        // Iniciar conexión HTTP
-        if (!http.begin(API_URL)) {
-            Serial.println("[API]  Error: No se pudo iniciar la conexión HTTP");
-            alertManager.loaderOff();
-            alertManager.showError();
-            delay(2000);
-            attempt++;
-            continue;
-        }
+    PostJob& job = jobs.front();
+    if ((long)(millis() - job.nextAttemptAt) < 0) {
+        return;
+    }
+    if (!circuitAllowsRequest()) {
+        return;
+    }
 
-        // ⚡ CRÍTICO: Dar tiempo para estabilización de memoria antes de HTTPS
-        if (attempt > 1) {
-            Serial.println("[API] Esperando estabilización de memoria...");
-            delay(2000);  // Dar tiempo para que el heap se reorganice
-        }
-        
-        Serial.printf("[API] Memoria libre antes de HTTP: %d bytes\n", ESP.getFreeHeap());
-        
-        // Configurar headers
-        http.addHeader("Content-Type", "application/json");
+    startJob(job);
+}
 
-        // Enviar POST
-        int httpCode = http.POST(payload);
-        
-        Serial.printf("[API] Memoria libre después de HTTP: %d bytes\n", ESP.getFreeHeap());
-        
-        alertManager.loaderOff();
-
-        if (httpCode > 0) {
-            String response = http.getString();
-            Serial.printf("[API] Código HTTP: %d\n", httpCode);
-            Serial.println("[API] Respuesta:");
-            Serial.println(response);
-
-            if (handleResponse(httpCode, response)) {
-                // Éxito
-                Serial.println("[API] Detecciones enviadas correctamente");
-                alertManager.showSuccess();
-                delay(1500);
-                success = true;
-            } 
-            else if (shouldRetry(httpCode)) {
-                // Error recuperable, reintentar
-                Serial.printf("[API] Error %d - Reintentando...\n", httpCode);
-                alertManager.showError();
-                unsigned long retryDelay = getRetryDelay(httpCode);
-                delay(retryDelay);
-                attempt++;
-            } 
-            else {
-                // Error no recuperable
-                Serial.printf("[API]  Error no recuperable: %d\n", httpCode);
-                alertManager.showError();
-                delay(3000);
-                break;
-            }
-        } 
-        else {
-            // Error de conexión
-            Serial.printf("[API]  Error de conexión: %d (Memoria: %d bytes)\n", 
-                         httpCode, ESP.getFreeHeap());
-            alertManager.showError();
-
-            if (httpCode == -11) {
-                // Error SSL - Memoria insuficiente o timeout
-                Serial.println("[API]  Error SSL/TLS - Reconectando WiFi y liberando memoria...");
-                wifiManager.reconnect();
-                delay(3000);  // Tiempo extra para estabilización
-            }
+void APIClient::startJob(PostJob& job) {
+    if (postTask == nullptr &&
+        xTaskCreate(postTaskMain, "api", API_TASK_STACK, this, API_TASK_PRIORITY, &postTask) != pdPASS) {
+        postTask = nullptr;
+        Serial.println("[API] Error: no se pudo crear la tarea de envío");
+        return;
+    }
+
+    job.attempts++;
+    Serial.printf("\n[API] Envío #%u, intento %d/%d (memoria libre: %d bytes)\n",
+                 job.id, job.attempts, MAX_RETRY_ATTEMPTS, ESP.getFreeHeap());
+
+    inFlightId = job.id;
+    inFlightPayload = job.payload;
+    xTaskNotifyGive(postTask);
+}
+
+// TLS y HTTP (hasta HTTP_TIMEOUT) quedan fuera del loop principal
+void APIClient::postTaskMain(void* arg) {
+    APIClient* self = static_cast<APIClient*>(arg);
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        self->runPost();
+    }
+}
+
+void APIClient::runPost() {
+    PostResult done;
+    done.id = inFlightId;
+
+    unsigned long startedAt = millis();
+    xSemaphoreTake(sessionLock, portMAX_DELAY);
+    done.httpCode = backendSession.request("POST", API_URL, inFlightPayload, done.response);
+    if (done.httpCode <= 0) {
+        // Error de transporte: descartar el socket TLS para el próximo intento
+        backendSession.close();
+    }
+    done.retryAfter = backendSession.getRetryAfter();
+    xSemaphoreGive(sessionLock);
+    done.elapsed = millis() - startedAt;
+
+    xSemaphoreTake(resultLock, portMAX_DELAY);
+    result = done;
+    resultReady = true;
+    xSemaphoreGive(resultLock);
+}
+
+void APIClient::collectResult() {
+    xSemaphoreTake(resultLock, portMAX_DELAY);
+    if (!resultReady) {
+        xSemaphoreGive(resultLock);
+        return;
+    }
+    PostResult done = result;
+    result.response = String();
+    resultReady = false;
+    xSemaphoreGive(resultLock);
 
-            delay(2000);
-            attempt++;
+    inFlightId = 0;
+    inFlightPayload = String();
+    handleResult(done);
+}
+
+// Si el envío se canceló o descartó mientras estaba en curso, el resultado
+// solo cuenta para el circuito
+void APIClient::handleResult(const PostResult& done) {
+    int httpCode = done.httpCode;
+    Serial.printf("[API] Código HTTP: %d en %lu ms (envío #%u)\n", httpCode, done.elapsed, done.id);
+
+    if (httpCode > 0 && handleResponse(httpCode, done.response)) {
+        Serial.println("[API] Detecciones enviadas correctamente");
+        recordOutcome(true);
+        finishJob(done.id, true, httpCode);
+        return;
+    }
+
+    if (httpCode > 0) {
+        Serial.printf("[API] Respuesta: %s\n", done.response.c_str());
+    }
+
+    // 5xx y errores de conexión cuentan contra el circuito; 4xx son del cliente
+    recordOutcome(httpCode > 0 && httpCode < 500);
+
+    PostJob* job = findJob(done.id);
+    if (job == nullptr) {
+        return;
+    }
+
+    if ((httpCode > 0 && !shouldRetry(httpCode)) || job->attempts >= MAX_RETRY_ATTEMPTS) {
+        Serial.printf("[API] Envío #%u descartado (código %d)\n", job->id, httpCode);
+        finishJob(done.id, false, httpCode);
+        return;
+    }
+
+    unsigned long backoff = computeBackoff(httpCode, job->attempts, done.retryAfter);
+    job->nextAttemptAt = millis() + backoff;
+    Serial.printf("[API] Reintento de envío #%u en %lu ms\n", job->id, backoff);
+}
+
+APIClient::PostJob* APIClient::findJob(uint32_t jobId) {
+    for (PostJob& job : jobs) {
+        if (job.id == jobId) {
+            return &job;
         }
+    }
+    return nullptr;
+}
 
-        http.end();
+void APIClient::finishJob(uint32_t jobId, bool success, int httpCode) {
+    for (auto it = jobs.begin(); it != jobs.end(); ++it) {
+        if (it->id == jobId) {
+            jobs.erase(it);
+            if (deliveryCallback) {
+                deliveryCallback(jobId, success, httpCode);
+            }
+            return;
+        }
     }
+}
 
-    if (!success) {
-        Serial.println("[API]  No se pudieron enviar las detecciones después de todos los intentos");
+// Backoff exponencial con jitter; Retry-After del servidor tiene prioridad si es mayor
+unsigned long APIClient::computeBackoff(int httpCode, int attempts, unsigned long retryAfter) {
+    unsigned long base = getRetryDelay(httpCode);
+    unsigned long delayMs = base << min(attempts - 1, 5);
+    if (delayMs > API_RETRY_MAX_DELAY) {
+        delayMs = API_RETRY_MAX_DELAY;
     }
+    delayMs = delayMs / 2 + random(delayMs / 2 + 1);
 
-    return success;
+    if (retryAfter > delayMs) {
+        delayMs = min(retryAfter, API_CIRCUIT_MAX_OPEN_TIME);
+    }
+    return delayMs;
 }
 
-// ==================== Creación de Payload de Detecciones ====================
-String APIClient::createDetectionsPayload(const std::map<String, BeaconData>& beacons) {
-    // OPTIMIZACIÓN: Reducir tamaño del documento para evitar error -11
-    DynamicJsonDocument doc(1536);  // Reducido de 2048 a 1536 bytes
-    
-    // Datos del dispositivo - usar valores cargados con fallback automático
-    String currentDeviceId = String(getDeviceId());
-    String currentZoneName = String(getDeviceLocation());
-    doc["device_id"] = currentDeviceId;
-    doc["zone_name"] = currentZoneName;
-    
-    // Timestamp actual (epoch Unix)
-    time_t currentTime = getCurrentEpoch();
-    doc["timestamp"] = currentTime;
+// ==================== Circuit Breaker ====================
+bool APIClient::circuitAllowsRequest() {
+    if (circuitState != CIRCUIT_OPEN) {
+        return true;
+    }
+    if (millis() - circuitOpenedAt < circuitOpenTime) {
+        return false;
+    }
+    Serial.println("[API] Circuito semiabierto: probando backend");
+    circuitState = CIRCUIT_HALF_OPEN;
+    return true;
+}
 
-    // Array de detecciones
-    JsonArray detections = doc.createNestedArray("detections");
+void APIClient::recordOutcome(bool backendHealthy) {
+    if (backendHealthy) {
+        if (circuitState != CIRCUIT_CLOSED) {
+            Serial.println("[API] Backend recuperado, circuito cerrado");
+        }
+        circuitState = CIRCUIT_CLOSED;
+        consecutiveFailures = 0;
+        circuitOpenTime = API_CIRCUIT_OPEN_TIME;
+        return;
+    }
 
-    for (const auto& entry : beacons) {
-        const BeaconData& beacon = entry.second;
-        
-        JsonObject detection = detections.createNestedObject();
-        
-        // ID del tag (animal)
-        detection["tag_id"] = beacon.animalId;
-        
-        // Ubicación del dispositivo
-        detection["device_location"] = getDeviceLocation();
-        
-        // Distancia calculada
-        detection["distance"] = round(beacon.distance * 100.0) / 100.0;  // 2 decimales
-        
-        // RSSI
-        detection["rssi"] = beacon.rssi;
-        
-        // Timestamp actual (epoch)
-        detection["detected_at"] = currentTime;
+    consecutiveFailures++;
+    if (circuitState == CIRCUIT_HALF_OPEN) {
+        // La prueba falló: abrir de nuevo duplicando la espera
+        circuitOpenTime = min(circuitOpenTime * 2, API_CIRCUIT_MAX_OPEN_TIME);
+    } else if (consecutiveFailures < API_CIRCUIT_FAILURE_THRESHOLD) {
+        return;
     }
 
-    String payload;
-    serializeJson(doc, payload);
-    return payload;
+    circuitState = CIRCUIT_OPEN;
+    circuitOpenedAt = millis();
+    Serial.printf("[API] Circuito abierto tras %d fallos, pausa de %lu ms\n",
+                 consecutiveFailures, circuitOpenTime);
 }
 
 // ==================== Consulta Status de Beacon ====================
 String APIClient::checkBeaconStatus(const String& macAddress) {
     Serial.printf("[API] Consultando status del beacon: %s\n", macAddress.c_str());
     
-    if (WiFi.status() != WL_CONNECTED) {
-        Serial.println("[API] Error: WiFi no conectado");
-        return "unknown";
+    String cached;
+    if (beaconStatusCache.lookup(macAddress, cached)) {
+        Serial.printf("[API] Status en cache: %s\n", cached.c_str());
+        return cached;
     }
     
-    WiFiClientSecure *client = new WiFiClientSecure();
-    if (!client) {
-        Serial.println("[API] Error: No se pudo crear cliente SSL");
+    if (WiFi.status() != WL_CONNECTED) {
+        Serial.println("[API] Error: WiFi no conectado");
         return "unknown";
     }
     
-    client->setInsecure();
-    client->setTimeout(10);
-    
-    HTTPClient http;
-    http.setTimeout(12000);
-    http.setReuse(false);
-    
     // Construir URL del endpoint
     String url = String(API_URL) + "/api/beacon/status/" + macAddress;
     
     Serial.printf("[API] URL: %s\n", url.c_str());
     
-    if (!http.begin(*client, url)) {
-        Serial.println("[API] Error: No se pudo iniciar conexion HTTPS");
-        delete client;
-        return "unknown";
-    }
-    
-    http.addHeader("Content-Type", "application/json");
-    if (strlen(API_KEY) > 0) {
-        http.addHeader("Authorization", String("Bearer ") + API_KEY);
-    }
-    
-    int httpCode = http.GET();
+    String response;
+    xSemaphoreTake(sessionLock, portMAX_DELAY);
+    int httpCode = backendSession.request("GET", url, "", response, true);
+    xSemaphoreGive(sessionLock);
     String status = "unknown";
     
     if (httpCode > 0) {
-        String response = http.getString();
         Serial.printf("[API] HTTP: %d\n", httpCode);
         Serial.printf("[API] Respuesta: %s\n", response.c_str());
         
@@ -311,6 +340,7 @@ String APIClient::checkBeaconStatus(const String& macAddress) {
                 if (doc.containsKey("status")) {
                     status = doc["status"].as<String>();
                     Serial.printf("[API] Status del beacon: %s\n", status.c_str());
+                    beaconStatusCache.store(macAddress, status);
                 } else {
                     Serial.println("[API] Error: Campo 'status' no encontrado");
                 }
@@ -320,6 +350,7 @@ String APIClient::checkBeaconStatus(const String& macAddress) {
         } else if (httpCode == 404) {
             Serial.println("[API] Beacon no encontrado en el sistema");
             status = "unknown";
+            beaconStatusCache.store(macAddress, status, true);
         } else {
             Serial.printf("[API] Error HTTP: %d\n", httpCode);
         }
@@ -327,9 +358,6 @@ String APIClient::checkBeaconStatus(const String& macAddress) {
         Serial.printf("[API] Error de conexion: %d\n", httpCode);
     }
     
-    http.end();
-    delete client;
-    
     return status;
 }
 
@@ -342,46 +370,38 @@ std::map<String, String> APIClient::checkMultipleBeaconStatus(const std::vector<
         return results;
     }
     
-    Serial.printf("[API] Consultando status de %d beacons...\n", macAddresses.size());
+    // Solo se consultan al backend las MACs que no están en cache
+    std::vector<String> misses;
+    for (const String& mac : macAddresses) {
+        String cached;
+        if (!beaconStatusCache.lookup(mac, cached)) {
+            misses.push_back(mac);
+        } else if (cached == "unregistered") {
+            results[mac] = cached;
+        }
+    }
+    
+    Serial.printf("[API] Consultando status de %d beacons (%d en cache)...\n",
+                 misses.size(), macAddresses.size() - misses.size());
     
-    if (WiFi.status() != WL_CONNECTED) {
-        Serial.println("[API] Error: WiFi no conectado");
+    if (misses.empty()) {
         return results;
     }
     
-    WiFiClientSecure *client = new WiFiClientSecure();
-    if (!client) {
-        Serial.println("[API] Error: No se pudo crear cliente SSL");
+    if (WiFi.status() != WL_CONNECTED) {
+        Serial.println("[API] Error: WiFi no conectado");
         return results;
     }
     
-    client->setInsecure();
-    client->setTimeout(15);
-    
-    HTTPClient http;
-    http.setTimeout(20000);
-    http.setReuse(false);
-    
     // Construir URL del endpoint
     String url = String(API_URL) + "/api/beacons/status/batch";
     
     Serial.printf("[API] URL: %s\n", url.c_str());
     
-    if (!http.begin(*client, url)) {
-        Serial.println("[API] Error: No se pudo iniciar conexion HTTPS");
-        delete client;
-        return results;
-    }
-    
-    http.addHeader("Content-Type", "application/json");
-    if (strlen(API_KEY) > 0) {
-        http.addHeader("Authorization", String("Bearer ") + API_KEY);
-    }
-    
     // Crear payload JSON con array de MACs
     DynamicJsonDocument doc(2048);
     JsonArray macs = doc.createNestedArray("mac_addresses");
-    for (const String& mac : macAddresses) {
+    for (const String& mac : misses) {
         macs.add(mac);
     }
     
@@ -390,40 +410,54 @@ std::map<String, String> APIClient::checkMultipleBeaconStatus(const std::vector<
     
     Serial.printf("[API] Payload: %s\n", payload.c_str());
     
-    int httpCode = http.POST(payload);
+    // Solo mac y status de cada elemento; se procesa directo del socket
+    StaticJsonDocument<64> filter;
+    filter["mac"] = true;
+    filter["status"] = true;
+    
+    int beaconCount = -1;
+    std::set<String> answered;
+    xSemaphoreTake(sessionLock, portMAX_DELAY);
+    int httpCode = backendSession.streamRequest("POST", url, payload, [&](int code, Stream& body) {
+        if (code != 200) {
+            return;
+        }
+        beaconCount = streamJsonArray(body, "beacons", filter, 192, [&](JsonObjectConst beacon) {
+            String mac = beacon["mac"] | "";
+            String status = beacon["status"] | "";
+            if (mac.length() == 0) {
+                return;
+            }
+            beaconStatusCache.store(mac, status);
+            answered.insert(mac);
+            
+            // Backend ya filtró: solo envía "unregistered"
+            // Pero verificamos por seguridad
+            if (status == "unregistered") {
+                results[mac] = status;
+                Serial.printf("[API] %s -> unregistered\n", mac.c_str());
+            }
+        });
+    }, true);
+    xSemaphoreGive(sessionLock);
     
     if (httpCode > 0) {
-        String response = http.getString();
         Serial.printf("[API] HTTP: %d\n", httpCode);
-        Serial.printf("[API] Respuesta: %s\n", response.c_str());
         
-        if (httpCode == 200) {
-            DynamicJsonDocument responseDoc(4096);
-            DeserializationError error = deserializeJson(responseDoc, response);
-            
-            if (!error) {
-                if (responseDoc.containsKey("beacons")) {
-                    JsonArray beacons = responseDoc["beacons"];
-                    
-                    for (JsonObject beacon : beacons) {
-                        String mac = beacon["mac"].as<String>();
-                        String status = beacon["status"].as<String>();
-                        
-                        // Backend ya filtró: solo envía "unregistered"
-                        // Pero verificamos por seguridad
-                        if (status == "unregistered") {
-                            results[mac] = status;
-                            Serial.printf("[API] %s -> unregistered\n", mac.c_str());
-                        }
-                    }
-                    
-                    Serial.printf("[API] Beacons unregistered recibidos: %d\n", results.size());
-                } else {
-                    Serial.println("[API] Error: Campo 'beacons' no encontrado");
+        if (httpCode == 200 && beaconCount >= 0) {
+            // Las MACs omitidas por el backend no están pendientes de
+            // registro: se guardan como respuesta negativa (TTL corto)
+            for (const String& mac : misses) {
+                if (answered.count(mac) == 0) {
+                    beaconStatusCache.store(mac, "registered", true);
                 }
-            } else {
-                Serial.printf("[API] Error JSON: %s\n", error.c_str());
             }
+            
+            beaconStatusCache.saveIfDirty();
+            
+            Serial.printf("[API] Beacons unregistered recibidos: %d (de %d)\n", results.size(), beaconCount);
+        } else if (httpCode == 200) {
+            Serial.println("[API] Error: Campo 'beacons' no encontrado o inválido");
         } else {
             Serial.printf("[API] Error HTTP: %d\n", httpCode);
         }
@@ -431,8 +465,5 @@ std::map<String, String> APIClient::checkMultipleBeaconStatus(const std::vector<
         Serial.printf("[API] Error de conexion: %d\n", httpCode);
     }
     
-    http.end();
-    delete client;
-    
     return results;
 }
@@ -0,0 +1,176 @@
+#include "beacon_status_cache.h"
+#include <Preferences.h>
+#include <vector>
+
+BeaconStatusCache beaconStatusCache;
+
+static constexpr uint8_t BEACON_CACHE_VERSION = 1;
+
+BeaconStatusCache::BeaconStatusCache()
+    : dirty(false),
+      lastSave(0) {
+    clear();
+}
+
+void BeaconStatusCache::clear() {
+    for (int i = 0; i < BEACON_STATUS_CACHE_SIZE; i++) {
+        entries[i].valid = false;
+    }
+}
+
+size_t BeaconStatusCache::size() const {
+    size_t count = 0;
+    for (int i = 0; i < BEACON_STATUS_CACHE_SIZE; i++) {
+        if (entries[i].valid) {
+            count++;
+        }
+    }
+    return count;
+}
+
+// ==================== Consulta ====================
+bool BeaconStatusCache::lookup(const String& macAddress, String& status) {
+    Entry* entry = find(normalize(macAddress));
+    if (entry == nullptr) {
+        return false;
+    }
+    
+    unsigned long now = millis();
+    if ((long)(now - entry->expiresAt) >= 0) {
+        entry->valid = false;
+        return false;
+    }
+    
+    entry->lastUsed = now;
+    status = entry->status;
+    return true;
+}
+
+void BeaconStatusCache::store(const String& macAddress, const String& status, bool negative) {
+    String key = normalize(macAddress);
+    Entry* entry = find(key);
+    if (entry == nullptr) {
+        entry = allocate();
+    }
+    
+    unsigned long now = millis();
+    strlcpy(entry->mac, key.c_str(), sizeof(entry->mac));
+    strlcpy(entry->status, status.c_str(), sizeof(entry->status));
+    entry->valid = true;
+    entry->expiresAt = now + (negative ? BEACON_STATUS_NEGATIVE_TTL : BEACON_STATUS_TTL);
+    entry->lastUsed = now;
+    dirty = true;
+}
+
+BeaconStatusCache::Entry* BeaconStatusCache::find(const String& macAddress) {
+    for (int i = 0; i < BEACON_STATUS_CACHE_SIZE; i++) {
+        if (entries[i].valid && macAddress == entries[i].mac) {
+            return &entries[i];
+        }
+    }
+    return nullptr;
+}
+
+// Hueco libre o, si no hay, la entrada usada hace más tiempo
+BeaconStatusCache::Entry* BeaconStatusCache::allocate() {
+    Entry* oldest = &entries[0];
+    for (int i = 0; i < BEACON_STATUS_CACHE_SIZE; i++) {
+        if (!entries[i].valid) {
+            return &entries[i];
+        }
+        if ((long)(entries[i].lastUsed - oldest->lastUsed) < 0) {
+            oldest = &entries[i];
+        }
+    }
+    return oldest;
+}
+
+String BeaconStatusCache::normalize(const String& macAddress) {
+    String key = macAddress;
+    key.toUpperCase();
+    return key;
+}
+
+// ==================== Persistencia (opcional) ====================
+void BeaconStatusCache::load() {
+    if (!BEACON_STATUS_PERSIST) {
+        return;
+    }
+    
+    Preferences prefs;
+    if (!prefs.begin("beacon_cache", true)) {
+        return;
+    }
+    
+    size_t length = prefs.getBytesLength("entries");
+    if (length < 1 || (length - 1) % sizeof(StoredEntry) != 0) {
+        prefs.end();
+        return;
+    }
+    
+    std::vector<uint8_t> blob(length);
+    prefs.getBytes("entries", blob.data(), length);
+    prefs.end();
+    
+    if (blob[0] != BEACON_CACHE_VERSION) {
+        return;
+    }
+    
+    // El TTL restante se cuenta desde el arranque: el tiempo apagado no se conoce
+    unsigned long now = millis();
+    size_t count = (length - 1) / sizeof(StoredEntry);
+    size_t loaded = 0;
+    for (size_t i = 0; i < count && loaded < BEACON_STATUS_CACHE_SIZE; i++) {
+        StoredEntry stored;
+        memcpy(&stored, blob.data() + 1 + i * sizeof(StoredEntry), sizeof(StoredEntry));
+        stored.mac[sizeof(stored.mac) - 1] = '\0';
+        stored.status[sizeof(stored.status) - 1] = '\0';
+        
+        Entry& entry = entries[loaded++];
+        memcpy(entry.mac, stored.mac, sizeof(entry.mac));
+        memcpy(entry.status, stored.status, sizeof(entry.status));
+        entry.valid = true;
+        entry.expiresAt = now + min((unsigned long)stored.remaining, BEACON_STATUS_TTL);
+        entry.lastUsed = now;
+    }
+    
+    lastSave = now;
+    Serial.printf("[CACHE] %d estados de beacon restaurados de NVS\n", loaded);
+}
+
+// Escritura agrupada: como mucho una cada BEACON_STATUS_SAVE_INTERVAL
+void BeaconStatusCache::saveIfDirty() {
+    if (!BEACON_STATUS_PERSIST || !dirty) {
+        return;
+    }
+    
+    unsigned long now = millis();
+    if (lastSave != 0 && now - lastSave < BEACON_STATUS_SAVE_INTERVAL) {
+        return;
+    }
+    
+    std::vector<uint8_t> blob;
+    blob.push_back(BEACON_CACHE_VERSION);
+    for (int i = 0; i < BEACON_STATUS_CACHE_SIZE; i++) {
+        const Entry& entry = entries[i];
+        if (!entry.valid || (long)(now - entry.expiresAt) >= 0) {
+            continue;
+        }
+        StoredEntry stored;
+        memcpy(stored.mac, entry.mac, sizeof(stored.mac));
+        memcpy(stored.status, entry.status, sizeof(stored.status));
+        stored.remaining = entry.expiresAt - now;
+        const uint8_t* raw = (const uint8_t*)&stored;
+        blob.insert(blob.end(), raw, raw + sizeof(stored));
+    }
+    
+    Preferences prefs;
+    if (!prefs.begin("beacon_cache", false)) {
+        return;
+    }
+    prefs.putBytes("entries", blob.data(), blob.size());
+    prefs.end();
+    
+    dirty = false;
+    lastSave = now;
+}
@@ -1,13 +1,18 @@
 #include "ble_scanner.h"
-#include "mqtt_client.h"
-#include <ArduinoJson.h>
+#include "runtime_config.h"
 #include <cmath>
 #include <vector>
 
 BLEScanner bleScanner;
 
 // ==================== Constructor ====================
-BLEScanner::BLEScanner() {
+BLEScanner::BLEScanner()
+    : scanning(false),
+      resultsReady(false),
+      scanWindow(BLE_SCAN_WINDOW),
+      scanInterval(BLE_SCAN_INTERVAL),
+      scanSeconds(0) {
+    beaconsLock = xSemaphoreCreateMutex();
     Serial.println("[BLE] Scanner inicializado");
 }
 
@@ -16,6 +21,7 @@ bool BLEScanner::initialize() {
     Serial.println("[BLE] Sistema de Monitoreo de Ganado - BovinoIOT");
     Serial.printf("[BLE] Zona: %s\n", getDeviceLocation());
     Serial.printf("[BLE] ID Dispositivo: %s\n", getDeviceId());
+    updateScanLocation();
     
     try {
         Serial.println("[BLE] Limpiando estado anterior de BLE...");
@@ -41,12 +47,12 @@ bool BLEScanner::initialize() {
         
         // Configurar escaneo activo
         pBLEScan->setActiveScan(true);
-        pBLEScan->setInterval(100);
-        pBLEScan->setWindow(99);
+        pBLEScan->setInterval(scanInterval);
+        pBLEScan->setWindow(scanWindow);
         
         Serial.println("[BLE] Sistema BLE listo");
-        Serial.printf("[BLE] Duración de escaneo: %d segundos\n", SCAN_DURATION);
-        Serial.printf("[BLE] RSSI mínimo: %d dBm (aprox. 1 metro)\n", MIN_RSSI_THRESHOLD);
+        Serial.printf("[BLE] Duración de escaneo: %d segundos\n", runtimeConfig.getScanDuration());
+        Serial.printf("[BLE] RSSI mínimo: %d dBm (aprox. 1 metro)\n", runtimeConfig.getMinRssi());
         
         return true;
         
@@ -56,34 +62,111 @@ bool BLEScanner::initialize() {
     }
 }
 
-// ==================== Escaneo Simple ====================
-void BLEScanner::performScan() {
-    Serial.println("\n[BLE] ━━━━━ Iniciando escaneo ━━━━━");
+// Libera el controlador BLE (el portal necesita esa memoria)
+void BLEScanner::end() {
+    if (scanning) {
+        BLEDevice::getScan()->stop();
+        scanning = false;
+    }
+    BLEDevice::deinit(false);
+    clearBeacons();
+    Serial.println("[BLE] Bluetooth detenido");
+}
+
+// La ubicación se copia en cada detección: las acumuladas llevan la anterior
+void BLEScanner::onConfigChanged(uint32_t changes) {
+    if (changes & CONFIG_CHANGE_LOCATION) {
+        updateScanLocation();
+        clearBeacons();
+    }
+}
+
+// Copia propia de la ubicación: applyDerived() reasigna los globales desde
+// el loop mientras la tarea de BLE sigue detectando
+void BLEScanner::updateScanLocation() {
+    String location = LOADED_LOCATION_NAME.length() > 0 ? LOADED_LOCATION_NAME : String(getDeviceLocation());
+    xSemaphoreTake(beaconsLock, portMAX_DELAY);
+    scanLocation = location;
+    xSemaphoreGive(beaconsLock);
+}
+
+// ==================== Escaneo (no bloqueante) ====================
+// La ventana de escaneo corre en la tarea de BLE; el loop sigue atendiendo
+// el resto de trabajos y procesa los resultados cuando llega el aviso.
+// La duración la fija el llamador: el maestro puede recortarla (TDMA)
+bool BLEScanner::startScan(int seconds) {
+    if (scanning) {
+        return false;
+    }
     
     BLEScan* pBLEScan = BLEDevice::getScan();
     if (pBLEScan == nullptr) {
         Serial.println("[BLE]  Error: Scanner no disponible");
-        return;
+        return false;
     }
     
     // Limpiar resultados anteriores
     pBLEScan->clearResults();
-    
-    // Escanear por 2 segundos
-    Serial.printf("[BLE] Escaneando por %d segundos...\n", SCAN_DURATION);
-    pBLEScan->start(SCAN_DURATION, false);
-    // Se realiza una pausa de 2s, en lo que el ecaneo finaliza
-    Serial.printf("[BLE] Escaneo completado: %d beacons detectados\n", beacons.size());
+    pBLEScan->setInterval(scanInterval);
+    pBLEScan->setWindow(scanWindow);
+    
+    Serial.printf("\n[BLE] ━━━━━ Escaneando por %d segundos (ventana %u/%u ms) ━━━━━\n",
+                  seconds, scanWindow, scanInterval);
+    scanning = true;
+    resultsReady = false;
+    scanSeconds = seconds;
+    if (!pBLEScan->start(seconds, handleScanComplete, false)) {
+        scanning = false;
+        Serial.println("[BLE]  Error al iniciar el escaneo");
+        return false;
+    }
+    return true;
+}
+
+// Fracción del aire para BLE durante el escaneo; se aplica en el siguiente startScan()
+void BLEScanner::setDuty(uint16_t window, uint16_t interval) {
+    scanInterval = interval;
+    scanWindow = min(window, interval);
+}
+
+// Llamado desde la tarea de BLE al terminar la ventana
+void BLEScanner::handleScanComplete(BLEScanResults results) {
+    xSemaphoreTake(bleScanner.beaconsLock, portMAX_DELAY);
+    size_t count = bleScanner.beacons.size();
+    xSemaphoreGive(bleScanner.beaconsLock);
+    bleScanner.scanning = false;
+    bleScanner.resultsReady = true;
+    Serial.printf("[BLE] Escaneo completado: %d beacons detectados\n", count);
+    if (bleScanner.scanCompleteCallback) {
+        bleScanner.scanCompleteCallback();
+    }
 }
 
 // ==================== Obtener Beacons Actuales ====================
 std::map<String, BeaconData> BLEScanner::getBeaconData() {
-    return beacons;
+    xSemaphoreTake(beaconsLock, portMAX_DELAY);
+    std::map<String, BeaconData> copy = beacons;
+    xSemaphoreGive(beaconsLock);
+    return copy;
+}
+
+// Entrega los resultados de la ventana terminada sin copiarlos y deja el
+// scanner listo para la siguiente
+std::map<String, BeaconData> BLEScanner::takeBeacons() {
+    std::map<String, BeaconData> snapshot;
+    xSemaphoreTake(beaconsLock, portMAX_DELAY);
+    snapshot.swap(beacons);
+    xSemaphoreGive(beaconsLock);
+    resultsReady = false;
+    return snapshot;
 }
 
 // ==================== Limpiar Beacons ====================
 void BLEScanner::clearBeacons() {
+    xSemaphoreTake(beaconsLock, portMAX_DELAY);
     beacons.clear();
+    xSemaphoreGive(beaconsLock);
+    resultsReady = false;
     Serial.println("[BLE] Beacons limpiados");
 }
 
@@ -110,18 +193,8 @@ bool matchesBeaconUUID(const uint8_t* uuid, size_t length) {
         return false;
     }
     
-    // UUIDs esperados (sin guiones)
-    const uint8_t expectedUuid1[] = {
-        0xFD, 0xA5, 0x06, 0x93, 0xA4, 0xE2, 0x4F, 0xB1,
-        0xAF, 0xCF, 0xC6, 0xEB, 0x07, 0x64, 0x78, 0x25
-    };
-    
-    const uint8_t expectedUuid2[] = {
-        0xD5, 0x46, 0xDF, 0x97, 0x47, 0x57, 0x47, 0xEF,
-        0xBE, 0x09, 0x3E, 0x2D, 0xCB, 0xDD, 0x0C, 0x77
-    };
-    
-    return (memcmp(uuid, expectedUuid1, 16) == 0) || (memcmp(uuid, expectedUuid2, 16) == 0);
+    // Lista de UUIDs ajustable por comando MQTT (ver runtime_config)
+    return runtimeConfig.matchesUUID(uuid);
 }
 
 // ==================== Procesar Dispositivo Detectado ====================
@@ -130,7 +203,7 @@ void BLEScanner::processDevice(BLEAdvertisedDevice advertisedDevice) {
     int8_t rssi = advertisedDevice.getRSSI();
     
     // ==================== FILTRO 1: RSSI MÍNIMO ====================
-    if (rssi < MIN_RSSI_THRESHOLD) {
+    if (rssi < runtimeConfig.getMinRssi()) {
         return;  // Fuera de rango (> 1 metro aproximadamente)
     }
     
@@ -167,26 +240,20 @@ void BLEScanner::processDevice(BLEAdvertisedDevice advertisedDevice) {
     // Calcular distancia
     float distance = calculateDistance(rssi);
     
-    // Obtener ubicación actual
-    String currentLocation = String(getDeviceLocation());
-    if (LOADED_SUB_LOCATION.length() > 0) {
-        int slashPos = LOADED_SUB_LOCATION.indexOf('/');
-        if (slashPos > 0) {
-            currentLocation = LOADED_SUB_LOCATION.substring(slashPos + 1);
-        }
-    }
-    
     // Crear BeaconData simplificado
     BeaconData beacon;
     beacon.animalId = animalId;
     beacon.macAddress = mac;
     beacon.rssi = rssi;
     beacon.distance = distance;
-    beacon.detectedLocation = currentLocation;
     
-    // Guardar con clave única
+    // Guardar con clave única (con la ubicación actual)
     String beaconKey = mac + "_" + String(animalId);
+    xSemaphoreTake(beaconsLock, portMAX_DELAY);
+    beacon.detectedLocation = scanLocation;
+    String currentLocation = scanLocation;
     beacons[beaconKey] = beacon;
+    xSemaphoreGive(beaconsLock);
     
     Serial.printf("[BLE] Beacon: ID=%u, MAC=%s, RSSI=%d dBm, Dist=%.2fm, Ubicacion=%s\n",
                  animalId, mac.c_str(), rssi, distance, currentLocation.c_str());
@@ -217,143 +284,3 @@ AnimalBeaconCallbacks::AnimalBeaconCallbacks(BLEScanner* scanner) : bleScanner(s
 void AnimalBeaconCallbacks::onResult(BLEAdvertisedDevice advertisedDevice) {
     bleScanner->processDevice(advertisedDevice);
 }
-
-// ==================== Modo Registro de Beacons ====================
-void BLEScanner::startBeaconRegistrationMode() {
-    Serial.println("[BLE] ==========================================");
-    Serial.println("[BLE] MODO: REGISTRO DE BEACONS");
-    Serial.println("[BLE] ==========================================");
-    Serial.println("[BLE] Este modo permite enlazar beacons con animales");
-    Serial.println("[BLE] Activo mientras el modo este en REGISTRO");
-    Serial.println("[BLE] Presiona boton de nuevo para salir");
-    Serial.println("[BLE] ==========================================");
-    
-    extern bool beaconRegistrationModeActive;
-    extern bool isRegistrationModeActive();
-    
-    unsigned long lastScan = 0;
-    unsigned long scanInterval = 2000;  // Escanear cada 2 segundos
-    
-    registeredBeaconsCache.clear();  // Limpiar cache
-    
-    while (isRegistrationModeActive() && beaconRegistrationModeActive) {
-        // El loop continúa mientras el switch esté en posición IZQUIERDA
-        
-        if (millis() - lastScan >= scanInterval) {
-            Serial.println("[BLE] Escaneando beacons para registro...");
-            
-            std::vector<String> detectedMacs;  // Acumular MACs detectadas en este escaneo
-            
-            BLEScan* pBLEScan = BLEDevice::getScan();
-            if (pBLEScan) {
-                pBLEScan->clearResults();
-                BLEScanResults foundDevices = pBLEScan->start(SCAN_DURATION, false);
-                
-                int devicesFound = foundDevices.getCount();
-                Serial.printf("[BLE] Dispositivos encontrados: %d\n", devicesFound);
-                
-                // Recolectar todas las MACs detectadas (sin caché, enviar siempre)
-                for (int i = 0; i < devicesFound; i++) {
-                    BLEAdvertisedDevice device = foundDevices.getDevice(i);
-                    String mac = String(device.getAddress().toString().c_str());
-                    mac.toUpperCase();
-                    
-                    // Aplicar filtros locales básicos
-                    if (!shouldProcessBeacon(device)) {
-                        continue;
-                    }
-                    
-                    // Agregar todas las MACs sin verificar caché
-                    detectedMacs.push_back(mac);
-                }
-                
-                pBLEScan->clearResults();
-                
-                // Enviar todas las MACs detectadas al MQTT cada ciclo
-                if (!detectedMacs.empty()) {
-                    Serial.printf("[BLE] Enviando %d MACs al MQTT...\n", detectedMacs.size());
-                    publishBeaconsToMQTT(detectedMacs);
-                } else {
-                    Serial.println("[BLE] No se detectaron beacons en este ciclo");
-                }
-            }
-            
-            lastScan = millis();
-        }
-        
-        delay(100);
-    }
-    
-    Serial.println("[BLE] ==========================================");
-    Serial.println("[BLE] Modo registro finalizado");
-    Serial.printf("[BLE] Beacons procesados: %d\n", registeredBeaconsCache.size());
-    Serial.println("[BLE] Iniciando modo normal de sondeo...");
-    Serial.println("[BLE] ==========================================");
-}
-
-bool BLEScanner::shouldProcessBeacon(BLEAdvertisedDevice& device) {
-    // Verificar RSSI
-    int8_t rssi = device.getRSSI();
-    if (rssi < MIN_RSSI_THRESHOLD) {
-        return false;  // Señal muy débil
-    }
-    
-    // Verificar que tenga manufacturer data (iBeacon format)
-    if (!device.haveManufacturerData()) {
-        return false;
-    }
-    
-    std::string mData = device.getManufacturerData();
-    if (mData.length() < 25) {
-        return false;
-    }
-    
-    uint8_t* data = (uint8_t*)mData.data();
-    uint16_t companyId = data[0] | (data[1] << 8);
-    
-    // Verificar formato iBeacon (0x004C + tipo 0x02)
-    if (companyId != 0x004C || data[2] != 0x02 || data[3] != 0x15) {
-        return false;
-    }
-    
-    // UUID está en bytes 4-19
-    const uint8_t* uuid = &data[4];
-    
-    // Usar la misma función de validación que processDevice
-    return matchesBeaconUUID(uuid, 16);
-}
-
-void BLEScanner::publishBeaconsToMQTT(const std::vector<String>& macAddresses) {
-    // Importar mqttClient desde main o donde esté definido
-    extern MQTTClient mqttClient;
-    
-    if (!mqttClient.isConnected()) {
-        Serial.println("[BLE] MQTT no conectado - no se puede publicar beacons");
-        return;
-    }
-    
-    // Crear payload JSON con zone_id y array de MACs
-    DynamicJsonDocument doc(1024);
-    doc["zone_id"] = LOADED_ZONE_ID;
-    
-    JsonArray macsArray = doc.createNestedArray("macs");
-    for (const String& mac : macAddresses) {
-        macsArray.add(mac);
-    }
-    
-    String payload;
-    serializeJson(doc, payload);
-    
-    const char* topic = "bovino_io/register_beacon";
-    
-    Serial.printf("[BLE] Publicando a MQTT topic: %s\n", topic);
-    Serial.printf("[BLE] Payload: %s\n", payload.c_str());
-    
-    bool published = mqttClient.publish(topic, payload.c_str());
-    
-    if (published) {
-        Serial.printf("[BLE] %d beacons publicados exitosamente a MQTT\n", macAddresses.size());
-    } else {
-        Serial.println("[BLE] Error al publicar beacons a MQTT");
-    }
-}
\ No newline at end of file
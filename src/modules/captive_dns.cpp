@@ -0,0 +1,98 @@
+#include "captive_dns.h"
+
+namespace {
+constexpr size_t DNS_HEADER_SIZE = 12;
+constexpr size_t DNS_MAX_PACKET = 512;
+constexpr uint16_t DNS_TYPE_A = 1;
+constexpr uint16_t DNS_CLASS_IN = 1;
+constexpr uint32_t DNS_ANSWER_TTL = 60;
+
+uint16_t readU16(const uint8_t* data) {
+    return (uint16_t)((data[0] << 8) | data[1]);
+}
+
+void writeU16(uint8_t* data, uint16_t value) {
+    data[0] = value >> 8;
+    data[1] = value & 0xFF;
+}
+}
+
+CaptiveDNS::CaptiveDNS()
+    : active(false) {
+}
+
+bool CaptiveDNS::start(uint16_t port, const IPAddress& ip) {
+    stop();
+    resolvedIP = ip;
+    if (!udp.listen(port)) {
+        return false;
+    }
+    udp.onPacket([this](AsyncUDPPacket& packet) {
+        handlePacket(packet);
+    });
+    active = true;
+    return true;
+}
+
+void CaptiveDNS::stop() {
+    if (active) {
+        udp.close();
+        active = false;
+    }
+}
+
+void CaptiveDNS::handlePacket(AsyncUDPPacket& packet) {
+    const uint8_t* query = packet.data();
+    size_t length = packet.length();
+    if (length <= DNS_HEADER_SIZE || length > DNS_MAX_PACKET) {
+        return;
+    }
+
+    // Solo consultas estándar (QR=0, OPCODE=0) con al menos una pregunta
+    uint16_t flags = readU16(query + 2);
+    if ((flags & 0x8000) != 0 || (flags & 0x7800) != 0 || readU16(query + 4) == 0) {
+        return;
+    }
+
+    // Recorrer el nombre de la primera pregunta hasta la etiqueta vacía
+    size_t offset = DNS_HEADER_SIZE;
+    while (offset < length && query[offset] != 0) {
+        if ((query[offset] & 0xC0) != 0) {
+            return;  // Punteros no válidos en una pregunta
+        }
+        offset += query[offset] + 1;
+    }
+    size_t questionEnd = offset + 1 + 4;
+    if (questionEnd > length) {
+        return;
+    }
+    uint16_t qtype = readU16(query + offset + 1);
+    uint16_t qclass = readU16(query + offset + 3);
+    bool answerA = (qtype == DNS_TYPE_A && qclass == DNS_CLASS_IN);
+
+    uint8_t response[DNS_MAX_PACKET + 16];
+    memcpy(response, query, questionEnd);
+    writeU16(response + 2, 0x8400 | (flags & 0x0100));  // QR, AA y RD copiado
+    writeU16(response + 4, 1);
+    writeU16(response + 6, answerA ? 1 : 0);
+    writeU16(response + 8, 0);
+    writeU16(response + 10, 0);
+
+    size_t responseLength = questionEnd;
+    if (answerA) {
+        uint8_t* answer = response + questionEnd;
+        writeU16(answer, 0xC000 | DNS_HEADER_SIZE);  // Puntero al nombre de la pregunta
+        writeU16(answer + 2, DNS_TYPE_A);
+        writeU16(answer + 4, DNS_CLASS_IN);
+        writeU16(answer + 6, DNS_ANSWER_TTL >> 16);
+        writeU16(answer + 8, DNS_ANSWER_TTL & 0xFFFF);
+        writeU16(answer + 10, 4);
+        for (int i = 0; i < 4; i++) {
+            answer[12 + i] = resolvedIP[i];
+        }
+        responseLength += 16;
+    }
+
+    // Para AAAA y otros tipos: NOERROR sin respuestas, así el cliente cae a IPv4
+    packet.write(response, responseLength);
+}
@@ -4,11 +4,23 @@ const char* WIFI_SSID = "UZIEL 1257";
 const char* WIFI_PASSWORD = "123456789";
 const char* CONFIG_PORTAL_PASSWORD = "bovinoiot";
 const char* AP_SSID_PREFIX = "bovino_io";
+// IP fija opcional para el maestro ("" = DHCP, con reutilización del último lease)
+const char* WIFI_STATIC_IP = "";
+const char* WIFI_STATIC_GATEWAY = "";
+const char* WIFI_STATIC_SUBNET = "255.255.255.0";
+const char* WIFI_STATIC_DNS = "";
 const char* API_URL = "https://bovino-io-backend.onrender.com/detections/ingest";
 const char* API_KEY = "tu-api-key";
 const char* MQTT_BROKER = "621de91008c745099bb8eb28731701af.s1.eu.hivemq.cloud";
 const char* MQTT_USER = "orizoncompany";
 const char* MQTT_PASSWORD = "UzObFn33";
 const char* MQTT_TOPIC = "bovino_io/detections";
+const char* MQTT_BATCH_TOPIC = "bovino_io/detections/batch";
+const char* MQTT_DEVICE_TOPIC_PREFIX = "bovino_io/devices/";
+const char* MQTT_REGISTER_TOPIC = "bovino_io/register_beacon";
 const char* NTP_SERVER1 = "pool.ntp.org";
 const char* NTP_SERVER2 = "time.nist.gov";
+
+// CA raíz (PEM) a fijar por servidor. nullptr = conexión TLS sin verificar certificado.
+const char* MQTT_ROOT_CA = nullptr;
+const char* BACKEND_ROOT_CA = nullptr;
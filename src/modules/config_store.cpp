@@ -0,0 +1,379 @@
+#include "config_store.h"
+#include <Preferences.h>
+
+ConfigStore configStore;
+
+static constexpr uint8_t CONFIG_STORE_VERSION = 2;
+static constexpr uint8_t CONFIG_MODE_SLAVE = 0;
+static constexpr uint8_t CONFIG_MODE_MASTER = 1;
+static constexpr uint8_t CONFIG_MODE_UNSET = 0xFF;
+static const char* CONFIG_NAMESPACE = "device_store";
+
+ConfigStore::ConfigStore()
+    : dirty(false),
+      changes(0),
+      pendingNotify(0) {
+    lock = xSemaphoreCreateMutex();
+    setDefaults();
+}
+
+void ConfigStore::setDefaults() {
+    memset(&config, 0, sizeof(config));
+    config.version = CONFIG_STORE_VERSION;
+    config.mode = CONFIG_MODE_UNSET;
+    memset(config.masterMac, 0xFF, sizeof(config.masterMac));
+    config.lowPower = ENABLE_LOW_POWER_SLAVE ? 1 : 0;
+}
+
+bool ConfigStore::hasMode() const {
+    return config.mode == CONFIG_MODE_SLAVE || config.mode == CONFIG_MODE_MASTER;
+}
+
+// MAESTRO necesita WiFi; ESCLAVO, la MAC de su maestro
+bool ConfigStore::isConfigured() const {
+    if (config.mode == CONFIG_MODE_MASTER) {
+        return config.ssid[0] != '\0';
+    }
+    return config.hasMasterMac != 0;
+}
+
+// ==================== Carga ====================
+void ConfigStore::load() {
+    setDefaults();
+    dirty = false;
+    bool found = false;
+
+    Preferences prefs;
+    if (prefs.begin(CONFIG_NAMESPACE, true)) {
+        size_t length = prefs.getBytesLength("config");
+        if (length > 0) {
+            found = true;
+            StoredConfig stored;
+            if (length == sizeof(stored) &&
+                prefs.getBytes("config", &stored, sizeof(stored)) == sizeof(stored) &&
+                (stored.version == CONFIG_STORE_VERSION || stored.version == 1)) {
+                // La versión 1 ocupa lo mismo: lowPower cae en su relleno final
+                static_assert(sizeof(StoredConfig) == 244, "StoredConfig v2 debe medir lo mismo que v1");
+                if (stored.version == 1) {
+                    stored.version = CONFIG_STORE_VERSION;
+                    stored.lowPower = ENABLE_LOW_POWER_SLAVE ? 1 : 0;
+                    dirty = true;
+                }
+                config = stored;
+                if (!validate()) {
+                    Serial.println("[Config] Configuración guardada inválida, usando valores por defecto");
+                    setDefaults();
+                    dirty = false;
+                }
+            } else {
+                Serial.printf("[Config] Configuración guardada incompatible (%d bytes), usando valores por defecto\n", length);
+            }
+        }
+        prefs.end();
+    }
+    if (dirty && commit()) {
+        Serial.printf("[Config] Configuración actualizada a la versión %d\n", CONFIG_STORE_VERSION);
+    }
+
+    // Primera carga tras actualizar: importar las claves sueltas de versiones
+    // anteriores, guardarlas como un solo registro y borrar las viejas
+    if (!found && importLegacy()) {
+        validate();
+        dirty = true;
+        if (commit()) {
+            clearLegacy();
+            Serial.println("[Config] Configuración migrada al formato unificado");
+        }
+    }
+
+    applyDerived();
+
+    if (hasMode()) {
+        Serial.printf("[Config] Modo: %s\n", CURRENT_DEVICE_MODE == DEVICE_MASTER ? "MAESTRO" : "ESCLAVO");
+    } else {
+        Serial.println("[Config] Sin configuración guardada");
+    }
+    if (config.hasMasterMac) {
+        Serial.printf("[Config] MAC Maestro: %02X:%02X:%02X:%02X:%02X:%02X\n",
+                      config.masterMac[0], config.masterMac[1], config.masterMac[2],
+                      config.masterMac[3], config.masterMac[4], config.masterMac[5]);
+    }
+    if (config.zoneName[0] != '\0') {
+        Serial.printf("[Config] Zona: %s (ID: %d)\n", config.zoneName, config.zoneId);
+    }
+    if (config.subLocation[0] != '\0') {
+        Serial.printf("[Config] Sublocalización: %s\n", config.subLocation);
+        Serial.printf("[Config] Device ID: %s\n", LOADED_DEVICE_ID.c_str());
+    }
+}
+
+// Cierra las cadenas y descarta valores fuera de rango
+bool ConfigStore::validate() {
+    config.ssid[sizeof(config.ssid) - 1] = '\0';
+    config.password[sizeof(config.password) - 1] = '\0';
+    config.zoneName[sizeof(config.zoneName) - 1] = '\0';
+    config.subLocation[sizeof(config.subLocation) - 1] = '\0';
+
+    if (config.mode != CONFIG_MODE_SLAVE && config.mode != CONFIG_MODE_MASTER && config.mode != CONFIG_MODE_UNSET) {
+        return false;
+    }
+
+    config.hasMasterMac = config.hasMasterMac ? 1 : 0;
+    config.firstRunPending = config.firstRunPending ? 1 : 0;
+    config.lowPower = config.lowPower ? 1 : 0;
+    if (config.zoneId < 0) {
+        config.zoneId = 0;
+    }
+    return true;
+}
+
+// Esquema anterior (versión 0): device_cfg, location_cfg, wifi_cfg y first_run
+bool ConfigStore::importLegacy() {
+    Preferences prefs;
+    bool imported = false;
+
+    if (prefs.begin("device_cfg", true)) {
+        config.mode = prefs.getUChar("mode", CONFIG_MODE_UNSET);
+        config.hasMasterMac = parseMac(prefs.getString("master_mac", ""), config.masterMac) ? 1 : 0;
+        prefs.end();
+        imported = true;
+    }
+
+    if (prefs.begin("location_cfg", true)) {
+        strlcpy(config.zoneName, prefs.getString("zone_name", "").c_str(), sizeof(config.zoneName));
+        strlcpy(config.subLocation, prefs.getString("sub_location", "").c_str(), sizeof(config.subLocation));
+        config.zoneId = prefs.getInt("zone_id", 0);
+        prefs.end();
+        imported = true;
+    }
+
+    if (prefs.begin("wifi_cfg", true)) {
+        strlcpy(config.ssid, prefs.getString("ssid", "").c_str(), sizeof(config.ssid));
+        strlcpy(config.password, prefs.getString("pass", "").c_str(), sizeof(config.password));
+        prefs.end();
+        imported = true;
+    }
+
+    if (prefs.begin("first_run", true)) {
+        config.firstRunPending = prefs.getBool("pending", false) ? 1 : 0;
+        prefs.end();
+        imported = true;
+    }
+
+    return imported;
+}
+
+void ConfigStore::clearLegacy() {
+    static const char* legacyNamespaces[] = {"device_cfg", "location_cfg", "wifi_cfg", "first_run"};
+    Preferences prefs;
+    for (const char* name : legacyNamespaces) {
+        if (prefs.begin(name, false)) {
+            prefs.clear();
+            prefs.end();
+        }
+    }
+}
+
+// Valores derivados: se calculan aquí una vez y el resto del código los lee
+// de las variables globales de device_config.h
+void ConfigStore::applyDerived() {
+    CURRENT_DEVICE_MODE = (config.mode == CONFIG_MODE_MASTER) ? DEVICE_MASTER : DEVICE_SLAVE;
+    if (config.hasMasterMac) {
+        memcpy(MASTER_MAC_ADDRESS, config.masterMac, sizeof(config.masterMac));
+    } else {
+        memset(MASTER_MAC_ADDRESS, 0xFF, sizeof(config.masterMac));
+    }
+
+    LOADED_ZONE_NAME = config.zoneName;
+    LOADED_SUB_LOCATION = config.subLocation;
+    LOADED_ZONE_ID = config.zoneId;
+    LOADED_LOCATION_NAME = "";
+    LOADED_DEVICE_ID = "";
+
+    if (config.subLocation[0] == '\0') {
+        return;
+    }
+
+    // Sublocalización "tipo/nombre": "master/Corral Norte" -> "IOT_MASTER_CORRAL_NORTE"
+    String deviceType;
+    String locationName = LOADED_SUB_LOCATION;
+    int slashPos = LOADED_SUB_LOCATION.indexOf('/');
+    if (slashPos > 0) {
+        deviceType = LOADED_SUB_LOCATION.substring(0, slashPos);
+        locationName = LOADED_SUB_LOCATION.substring(slashPos + 1);
+        LOADED_LOCATION_NAME = locationName;
+    }
+
+    deviceType.toUpperCase();
+    locationName.toUpperCase();
+    locationName.replace(" ", "_");
+    locationName.replace("-", "_");
+
+    LOADED_DEVICE_ID = "IOT_" + deviceType + "_" + locationName;
+}
+
+// ==================== Cambios (en RAM hasta commit) ====================
+void ConfigStore::setCredentials(const String& ssid, const String& password) {
+    if (ssid == config.ssid && password == config.password) {
+        return;
+    }
+    strlcpy(config.ssid, ssid.c_str(), sizeof(config.ssid));
+    strlcpy(config.password, password.c_str(), sizeof(config.password));
+    changes |= CONFIG_CHANGE_WIFI;
+    dirty = true;
+}
+
+bool ConfigStore::setDevice(DeviceMode mode, const String& masterMac) {
+    // El MAESTRO no necesita MAC; se conserva la que hubiera
+    if (mode == DEVICE_SLAVE && masterMac.length() > 0) {
+        uint8_t mac[6];
+        if (!parseMac(masterMac, mac)) {
+            Serial.printf("[Config] MAC del maestro inválida: %s\n", masterMac.c_str());
+            return false;
+        }
+        if (!config.hasMasterMac || memcmp(config.masterMac, mac, sizeof(mac)) != 0) {
+            memcpy(config.masterMac, mac, sizeof(mac));
+            config.hasMasterMac = 1;
+            changes |= CONFIG_CHANGE_MASTER_MAC;
+            dirty = true;
+        }
+    }
+
+    uint8_t storedMode = (mode == DEVICE_MASTER) ? CONFIG_MODE_MASTER : CONFIG_MODE_SLAVE;
+    if (config.mode != storedMode) {
+        config.mode = storedMode;
+        changes |= CONFIG_CHANGE_MODE;
+        dirty = true;
+    }
+    applyDerived();
+    return true;
+}
+
+void ConfigStore::setLocation(const String& zoneName, const String& subLocation, int zoneId) {
+    int storedZoneId = zoneId > 0 ? zoneId : 0;
+    if (zoneName == config.zoneName && subLocation == config.subLocation && storedZoneId == config.zoneId) {
+        return;
+    }
+    strlcpy(config.zoneName, zoneName.c_str(), sizeof(config.zoneName));
+    strlcpy(config.subLocation, subLocation.c_str(), sizeof(config.subLocation));
+    config.zoneId = storedZoneId;
+    changes |= CONFIG_CHANGE_LOCATION;
+    dirty = true;
+    applyDerived();
+}
+
+void ConfigStore::setFirstRunPending(bool pending) {
+    if (isFirstRunPending() == pending) {
+        return;
+    }
+    config.firstRunPending = pending ? 1 : 0;
+    dirty = true;
+}
+
+void ConfigStore::setLowPower(bool enabled) {
+    if (isLowPower() == enabled) {
+        return;
+    }
+    config.lowPower = enabled ? 1 : 0;
+    changes |= CONFIG_CHANGE_POWER;
+    dirty = true;
+}
+
+// Un solo putBytes: NVS escribe el registro nuevo antes de invalidar el
+// anterior, así que un corte deja la configuración vieja o la nueva completa
+bool ConfigStore::commit() {
+    if (!dirty) {
+        return true;
+    }
+
+    Preferences prefs;
+    if (!prefs.begin(CONFIG_NAMESPACE, false)) {
+        Serial.println("[Config] No se pudo abrir NVS para guardar");
+        return false;
+    }
+    bool ok = prefs.putBytes("config", &config, sizeof(config)) == sizeof(config);
+    prefs.end();
+
+    if (ok) {
+        dirty = false;
+        xSemaphoreTake(lock, portMAX_DELAY);
+        pendingNotify |= changes;
+        xSemaphoreGive(lock);
+        changes = 0;
+    } else {
+        Serial.println("[Config] Error al guardar la configuración");
+    }
+    return ok;
+}
+
+void ConfigStore::clear() {
+    Preferences prefs;
+    if (prefs.begin(CONFIG_NAMESPACE, false)) {
+        prefs.clear();
+        prefs.end();
+    }
+    clearLegacy();
+
+    setDefaults();
+    dirty = false;
+    changes = 0;
+    discardChanges();
+    applyDerived();
+}
+
+// ==================== Suscriptores ====================
+void ConfigStore::subscribe(ConfigListener listener) {
+    listeners.push_back(listener);
+}
+
+// Los suscriptores reinicializan módulos, así que se les avisa solo desde
+// el loop principal y no dentro de commit()
+void ConfigStore::loop() {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    uint32_t notify = pendingNotify;
+    pendingNotify = 0;
+    xSemaphoreGive(lock);
+
+    if (notify == 0) {
+        return;
+    }
+
+    Serial.printf("[Config] Aplicando cambios sin reiniciar (0x%02X)\n", notify);
+    for (const ConfigListener& listener : listeners) {
+        listener(notify);
+    }
+}
+
+// Para cuando el llamador ya reinicializó todo con la configuración nueva
+void ConfigStore::discardChanges() {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    pendingNotify = 0;
+    xSemaphoreGive(lock);
+}
+
+// "AA:BB:CC:DD:EE:FF" (también con '-') -> 6 bytes
+bool ConfigStore::parseMac(const String& text, uint8_t* mac) {
+    if (text.length() != 17) {
+        return false;
+    }
+
+    for (int i = 0; i < 6; i++) {
+        uint8_t value = 0;
+        for (int j = 0; j < 2; j++) {
+            char c = text.charAt(i * 3 + j);
+            value <<= 4;
+            if (c >= '0' && c <= '9') value |= c - '0';
+            else if (c >= 'a' && c <= 'f') value |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') value |= c - 'A' + 10;
+            else return false;
+        }
+        if (i < 5) {
+            char separator = text.charAt(i * 3 + 2);
+            if (separator != ':' && separator != '-') {
+                return false;
+            }
+        }
+        mac[i] = value;
+    }
+    return true;
+}
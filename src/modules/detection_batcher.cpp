@@ -0,0 +1,154 @@
+#include "detection_batcher.h"
+#include <WiFi.h>
+#include "time_service.h"
+#include <algorithm>
+
+DetectionBatcher detectionBatcher;
+
+static constexpr uint8_t BATCH_FORMAT_VERSION = 1;
+static constexpr size_t MAX_LOCATION_ENTRIES = 255;
+
+static_assert(BATCH_CYCLES > 0 && BATCH_CYCLES <= MAX_BATCH_CYCLES,
+              "BATCH_CYCLES fuera de rango (1..MAX_BATCH_CYCLES)");
+
+DetectionBatcher::DetectionBatcher() : cycleCount(0), baseUptime(0), dictionaryFull(false) {
+}
+
+// ==================== Acumulación de Ciclos ====================
+bool DetectionBatcher::addCycle(const std::map<String, BeaconData>& beacons, uint32_t uptime) {
+    if (cycleCount == 0) {
+        baseUptime = uptime;
+    }
+    cycleCount++;
+
+    size_t dropped = 0;
+    size_t unplaced = 0;
+    for (const auto& pair : beacons) {
+        if (records.size() >= MAX_BATCH_RECORDS) {
+            dropped++;
+            continue;
+        }
+
+        const BeaconData& beacon = pair.second;
+        BatchRecord record;
+        if (!lookupLocation(beacon.detectedLocation, record.locationIndex)) {
+            unplaced++;
+            continue;
+        }
+        record.animalId = beacon.animalId;
+        record.uptime = uptime;
+        record.rssi = beacon.rssi;
+        records.push_back(record);
+    }
+
+    if (dropped > 0) {
+        Serial.printf("[Batch] Lote lleno: %d detecciones descartadas\n", dropped);
+    }
+    if (unplaced > 0) {
+        Serial.printf("[Batch] Diccionario de ubicaciones lleno: %d detecciones descartadas, se cierra el lote\n", unplaced);
+    }
+
+    Serial.printf("[Batch] Ciclo %d/%d acumulado (%d registros)\n",
+                  cycleCount, BATCH_CYCLES, records.size());
+    return dropped == 0 && unplaced == 0;
+}
+
+bool DetectionBatcher::isReady() const {
+    return cycleCount >= (size_t)BATCH_CYCLES || records.size() >= MAX_BATCH_RECORDS || dictionaryFull;
+}
+
+void DetectionBatcher::clear() {
+    records.clear();
+    locationDictionary.clear();
+    cycleCount = 0;
+    baseUptime = 0;
+    dictionaryFull = false;
+}
+
+// false con el diccionario lleno: la detección se descarta en vez de llevar
+// un índice ajeno y el lote queda listo para enviarse; el siguiente empieza
+// con el diccionario vacío
+bool DetectionBatcher::lookupLocation(const String& location, uint8_t& index) {
+    for (size_t i = 0; i < locationDictionary.size(); i++) {
+        if (locationDictionary[i] == location) {
+            index = (uint8_t)i;
+            return true;
+        }
+    }
+
+    if (locationDictionary.size() >= MAX_LOCATION_ENTRIES) {
+        dictionaryFull = true;
+        return false;
+    }
+
+    locationDictionary.push_back(location);
+    index = (uint8_t)(locationDictionary.size() - 1);
+    return true;
+}
+
+// ==================== Codificación Columnar ====================
+void DetectionBatcher::writeVarint(std::vector<uint8_t>& out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((uint8_t)value);
+}
+
+uint32_t DetectionBatcher::zigZag(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+std::vector<uint8_t> DetectionBatcher::encode() const {
+    std::vector<BatchRecord> sorted = records;
+    std::sort(sorted.begin(), sorted.end(), [](const BatchRecord& a, const BatchRecord& b) {
+        if (a.animalId != b.animalId) {
+            return a.animalId < b.animalId;
+        }
+        return a.uptime < b.uptime;
+    });
+
+    std::vector<uint8_t> out;
+    out.reserve(32 + sorted.size() * 5);
+
+    out.push_back(BATCH_FORMAT_VERSION);
+    uint8_t mac[6];
+    WiFi.macAddress(mac);
+    out.insert(out.end(), mac, mac + 6);
+    uint32_t baseTimestamp = timeService.epochAt(baseUptime);
+    writeVarint(out, baseTimestamp);
+    writeVarint(out, cycleCount);
+
+    writeVarint(out, locationDictionary.size());
+    for (const String& location : locationDictionary) {
+        writeVarint(out, location.length());
+        out.insert(out.end(), location.c_str(), location.c_str() + location.length());
+    }
+
+    writeVarint(out, sorted.size());
+
+    uint32_t previousId = 0;
+    for (const BatchRecord& record : sorted) {
+        writeVarint(out, record.animalId - previousId);
+        previousId = record.animalId;
+    }
+
+    uint32_t previousTimestamp = baseTimestamp;
+    for (const BatchRecord& record : sorted) {
+        uint32_t timestamp = timeService.epochAt(record.uptime);
+        writeVarint(out, zigZag((int32_t)(timestamp - previousTimestamp)));
+        previousTimestamp = timestamp;
+    }
+
+    int32_t previousRssi = 0;
+    for (const BatchRecord& record : sorted) {
+        writeVarint(out, zigZag(record.rssi - previousRssi));
+        previousRssi = record.rssi;
+    }
+
+    for (const BatchRecord& record : sorted) {
+        writeVarint(out, record.locationIndex);
+    }
+
+    return out;
+}
@@ -3,174 +3,164 @@
 // Definición de la instancia global
 DisplayManager displayManager;
 
-DisplayManager::DisplayManager() {
+DisplayManager::DisplayManager()
+    : flushTask(nullptr) {
     lcd = new LiquidCrystal_I2C(LCD_I2C_ADDR, LCD_COLS, LCD_ROWS);
+    lock = xSemaphoreCreateMutex();
+    memset(frame, ' ', sizeof(frame));
+    memset(shown, ' ', sizeof(shown));
 }
 // ==================== Inicialización ====================
 void DisplayManager::initialize() {
     lcd->init();           // Inicializar LCD I2C
     lcd->backlight();      // Encender la retroiluminación
+    lcd->clear();          // Único clear: a partir de aquí se reescriben solo diferencias
+    memset(shown, ' ', sizeof(shown));
+    
+    if (flushTask == nullptr) {
+        xTaskCreate(flushTaskMain, "lcd", LCD_TASK_STACK, this, LCD_TASK_PRIORITY, &flushTask);
+    }
+    
     Serial.println("[LCD] Pantalla LCD I2C inicializada");
     Serial.printf("[LCD] Dirección I2C: 0x%02X, Tamaño: %dx%d\n", 
                   LCD_I2C_ADDR, LCD_COLS, LCD_ROWS);
 }
 
+// ==================== Framebuffer ====================
+void DisplayManager::writeRow(int row, const String& text) {
+    int length = min((int)text.length(), LCD_COLS);
+    memcpy(frame[row], text.c_str(), length);
+    memset(frame[row] + length, ' ', LCD_COLS - length);
+}
+
+void DisplayManager::setLines(const String& line1, const String& line2) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    writeRow(0, line1);
+    writeRow(1, line2);
+    xSemaphoreGive(lock);
+}
+
+// Envía solo los tramos de cada fila que difieren de lo que ya muestra el LCD
+void DisplayManager::flush() {
+    char pending[LCD_ROWS][LCD_COLS];
+    xSemaphoreTake(lock, portMAX_DELAY);
+    memcpy(pending, frame, sizeof(frame));
+    xSemaphoreGive(lock);
+    
+    for (int row = 0; row < LCD_ROWS; row++) {
+        int col = 0;
+        while (col < LCD_COLS) {
+            if (pending[row][col] == shown[row][col]) {
+                col++;
+                continue;
+            }
+            int start = col;
+            while (col < LCD_COLS && pending[row][col] != shown[row][col]) {
+                col++;
+            }
+            lcd->setCursor(start, row);
+            for (int i = start; i < col; i++) {
+                lcd->write((uint8_t)pending[row][i]);
+                shown[row][i] = pending[row][i];
+            }
+        }
+    }
+}
+
+// El tráfico I2C queda fuera del loop principal
+void DisplayManager::flushTaskMain(void* arg) {
+    DisplayManager* self = static_cast<DisplayManager*>(arg);
+    for (;;) {
+        self->flush();
+        vTaskDelay(pdMS_TO_TICKS(LCD_REFRESH_INTERVAL));
+    }
+}
+
 // ==================== Mensajes Generales ====================
 void DisplayManager::showWelcome() {
-    clear();
-    lcd->print("Waiting for");
-    lcd->setCursor(0, 1);
-    lcd->print("Connect");
+    setLines("Waiting for", "Connect");
 }
 
 void DisplayManager::clear() {
-    lcd->clear();
+    setLines("", "");
 }
 
 void DisplayManager::showMessage(const String& line1, const String& line2) {
-    clear();
-    lcd->print(truncate(line1));
-    if (line2.length() > 0) {
-        lcd->setCursor(0, 1);
-        lcd->print(truncate(line2));
-    }
+    setLines(line1, line2);
 }
 
 // ==================== Mensajes de WiFi ====================
 void DisplayManager::showWiFiStatus(bool connecting, const String& ssid) {
-    clear();
     if (connecting) {
-        lcd->print("Conectando WiFi");
-        if (ssid.length() > 0) {
-            lcd->setCursor(0, 1);
-            lcd->print(truncate(ssid));
-        }
+        setLines("Conectando WiFi", ssid);
     } else {
-        lcd->print("WiFi Conectado");
+        setLines("WiFi Conectado", "");
     }
 }
 
 void DisplayManager::showIP(const String& ip) {
-    clear();
-    lcd->print("WiFi Conectado");
-    lcd->setCursor(0, 1);
-    lcd->print("IP: ");
-    lcd->print(truncate(ip, 11));
+    setLines("WiFi Conectado", "IP: " + truncate(ip, 11));
 }
 
 void DisplayManager::showWiFiError() {
-    clear();
-    lcd->print("WiFi ERROR");
-    lcd->setCursor(0, 1);
-    lcd->print("Sin conexion");
+    setLines("WiFi ERROR", "Sin conexion");
 }
 
 // ==================== Mensajes de Escaneo BLE ====================
 void DisplayManager::showScanning(int stage) {
-    clear();
-    lcd->print("Sondeo ");
-    lcd->print(stage);
-    lcd->setCursor(0, 1);
-    lcd->print("Escaneando BLE...");
+    setLines("Sondeo " + String(stage), "Escaneando BLE...");
 }
 
 void DisplayManager::showDevicesDetected(int stage, int count) {
-    clear();
-    lcd->print("Sondeo ");
-    lcd->print(stage);
-    lcd->print(": ");
-    lcd->print(count);
-    lcd->setCursor(0, 1);
-    lcd->print("Enviando POST...");
+    setLines("Sondeo " + String(stage) + ": " + String(count), "Enviando POST...");
 }
 
 void DisplayManager::showNoDevices(int stage) {
-    clear();
-    lcd->print("Sondeo ");
-    lcd->print(stage);
-    lcd->setCursor(0, 1);
-    lcd->print("Sin dispositivos");
+    setLines("Sondeo " + String(stage), "Sin dispositivos");
 }
 
 // ==================== Mensajes de HTTP ====================
 void DisplayManager::showPostStatus(int stage, int attempt) {
-    clear();
-    lcd->print("POST Intento #");
-    lcd->print(attempt);
-    lcd->setCursor(0, 1);
-    lcd->print("Etapa ");
-    lcd->print(stage);
-    lcd->print(" - Ping API");
+    setLines("POST Intento #" + String(attempt), "Etapa " + String(stage) + " - Ping API");
 }
 
 void DisplayManager::showPostSuccess(int stage, int httpCode) {
-    clear();
-    lcd->print("POST Exitoso!");
-    lcd->setCursor(0, 1);
-    lcd->print("Etapa ");
-    lcd->print(stage);
-    lcd->print(" - ");
-    lcd->print(httpCode);
+    setLines("POST Exitoso!", "Etapa " + String(stage) + " - " + String(httpCode));
 }
 
 void DisplayManager::showHTTPError(int stage, int errorCode) {
-    clear();
-    lcd->print("HTTP ERROR");
-    lcd->setCursor(0, 1);
-    lcd->print("Etapa ");
-    lcd->print(stage);
-    lcd->print(" - ");
-    lcd->print(errorCode);
+    setLines("HTTP ERROR", "Etapa " + String(stage) + " - " + String(errorCode));
 }
 
 void DisplayManager::showServerError(int httpCode) {
-    clear();
-    
     switch (httpCode) {
         case 404:
-            lcd->print("HTTP 404 Error");
-            lcd->setCursor(0, 1);
-            lcd->print("Reintentando...");
+            setLines("HTTP 404 Error", "Reintentando...");
             break;
         
         case 500:
-            lcd->print("Error Servidor");
-            lcd->setCursor(0, 1);
-            lcd->print("Reintentando...");
+            setLines("Error Servidor", "Reintentando...");
             break;
         
         case 502:
-            lcd->print("Servidor Caido");
-            lcd->setCursor(0, 1);
-            lcd->print("Reintentando...");
+            setLines("Servidor Caido", "Reintentando...");
             break;
         
         case 503:
-            lcd->print("Servicio");
-            lcd->setCursor(0, 1);
-            lcd->print("No disponible");
+            setLines("Servicio", "No disponible");
             break;
         
         case 504:
-            lcd->print("Timeout Gateway");
-            lcd->setCursor(0, 1);
-            lcd->print("Reintentando...");
+            setLines("Timeout Gateway", "Reintentando...");
             break;
         
         default:
             if (httpCode >= 400 && httpCode < 500) {
-                lcd->print("Error Cliente");
-                lcd->setCursor(0, 1);
-                lcd->print("Cod: ");
-                lcd->print(httpCode);
+                setLines("Error Cliente", "Cod: " + String(httpCode));
             } else if (httpCode >= 500) {
-                lcd->print("Error Servidor");
-                lcd->setCursor(0, 1);
-                lcd->print("Cod: ");
-                lcd->print(httpCode);
+                setLines("Error Servidor", "Cod: " + String(httpCode));
             } else {
-                lcd->print("Error ");
-                lcd->print(httpCode);
+                setLines("Error " + String(httpCode), "");
             }
             break;
     }
@@ -178,10 +168,7 @@ void DisplayManager::showServerError(int httpCode) {
 
 // ==================== Mensaje de Finalización ====================
 void DisplayManager::showComplete() {
-    clear();
-    lcd->print("SONDEO DE CLASE");
-    lcd->setCursor(0, 1);
-    lcd->print("FINALIZADO!");
+    setLines("SONDEO DE CLASE", "FINALIZADO!");
 }
 
 // ==================== Utilidades ====================
@@ -0,0 +1,429 @@
+#include "dns_resolver.h"
+#include <WiFi.h>
+#include <Preferences.h>
+#include <vector>
+
+DnsResolver dnsResolver;
+
+static constexpr uint8_t DNS_CACHE_VERSION = 1;
+
+namespace {
+constexpr size_t DNS_HEADER_SIZE = 12;
+constexpr uint16_t DNS_TYPE_A = 1;
+constexpr uint16_t DNS_CLASS_IN = 1;
+
+uint16_t readU16(const uint8_t* data) {
+    return (uint16_t)((data[0] << 8) | data[1]);
+}
+
+uint32_t readU32(const uint8_t* data) {
+    return ((uint32_t)readU16(data) << 16) | readU16(data + 2);
+}
+
+void writeU16(uint8_t* data, uint16_t value) {
+    data[0] = value >> 8;
+    data[1] = value & 0xFF;
+}
+
+// Salta un nombre (etiquetas o puntero de compresión); 0 si es inválido
+size_t skipName(const uint8_t* data, size_t length, size_t offset) {
+    while (offset < length) {
+        uint8_t label = data[offset];
+        if ((label & 0xC0) == 0xC0) {
+            return offset + 2;
+        }
+        if (label == 0) {
+            return offset + 1;
+        }
+        offset += label + 1;
+    }
+    return 0;
+}
+
+// Host de una URL ("https://host/ruta" -> "host")
+String hostOfUrl(const char* url) {
+    String value(url);
+    int start = value.indexOf("://");
+    start = start < 0 ? 0 : start + 3;
+    int end = value.indexOf('/', start);
+    String host = end < 0 ? value.substring(start) : value.substring(start, end);
+    int port = host.indexOf(':');
+    return port < 0 ? host : host.substring(0, port);
+}
+}
+
+DnsResolver::DnsResolver()
+    : lock(portMUX_INITIALIZER_UNLOCKED),
+      nextQueryId(1),
+      dirty(false),
+      lastSave(0) {
+    for (Entry& entry : entries) {
+        entry.used = false;
+        entry.pending = false;
+        entry.ip = 0;
+    }
+}
+
+// ==================== Inicialización ====================
+void DnsResolver::begin() {
+    // Últimas IPs buenas: sirven solo de respaldo hasta la primera respuesta
+    Preferences prefs;
+    if (prefs.begin("dns_cache", true)) {
+        size_t length = prefs.getBytesLength("entries");
+        if (length > 1 && (length - 1) % sizeof(StoredEntry) == 0) {
+            std::vector<uint8_t> blob(length);
+            prefs.getBytes("entries", blob.data(), length);
+            if (blob[0] == DNS_CACHE_VERSION) {
+                size_t count = (length - 1) / sizeof(StoredEntry);
+                for (size_t i = 0; i < count; i++) {
+                    StoredEntry stored;
+                    memcpy(&stored, blob.data() + 1 + i * sizeof(StoredEntry), sizeof(StoredEntry));
+                    stored.host[sizeof(stored.host) - 1] = '\0';
+                    Entry* entry = allocate(stored.host);
+                    if (entry != nullptr) {
+                        entry->ip = stored.ip;
+                        entry->expiresAt = millis();  // Vencida: se renueva al tener red
+                    }
+                }
+                Serial.printf("[DNS] %d hosts restaurados de NVS\n", count);
+            }
+        }
+        prefs.end();
+    }
+
+    track(hostOfUrl(API_URL).c_str());
+    track("bovino-io-backend.onrender.com");
+    track(MQTT_BROKER);
+    lastSave = millis();
+}
+
+void DnsResolver::track(const char* host) {
+    if (host == nullptr || strlen(host) == 0 || strlen(host) >= DNS_MAX_HOST_LEN) {
+        return;
+    }
+    IPAddress literal;
+    if (literal.fromString(host)) {
+        return;  // Ya es una IP
+    }
+    portENTER_CRITICAL(&lock);
+    if (find(host) == nullptr) {
+        allocate(host);
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+// ==================== Consulta ====================
+// No bloquea nunca: devuelve la IP en cache (aunque esté vencida) y, si hace
+// falta, dispara la consulta para la próxima vez
+bool DnsResolver::lookup(const char* host, IPAddress& ip) {
+    if (ip.fromString(host)) {
+        return true;
+    }
+    track(host);
+
+    portENTER_CRITICAL(&lock);
+    Entry* entry = find(host);
+    uint32_t cached = entry != nullptr ? entry->ip : 0;
+    bool needsQuery = entry != nullptr && !entry->pending && !isFresh(*entry) &&
+                      millis() - entry->lastQuery >= DNS_RETRY_INTERVAL;
+    portEXIT_CRITICAL(&lock);
+
+    if (needsQuery && WiFi.status() == WL_CONNECTED) {
+        sendQuery(*entry);
+    }
+    if (cached == 0) {
+        return false;
+    }
+    ip = IPAddress(cached);
+    return true;
+}
+
+// Espera como máximo timeoutMs y solo si no hay una respuesta vigente. Si la
+// red no responde se usa la última IP conocida.
+bool DnsResolver::resolve(const char* host, IPAddress& ip, unsigned long timeoutMs) {
+    if (ip.fromString(host)) {
+        return true;
+    }
+    track(host);
+
+    portENTER_CRITICAL(&lock);
+    Entry* entry = find(host);
+    bool fresh = entry != nullptr && isFresh(*entry);
+    uint32_t cached = entry != nullptr ? entry->ip : 0;
+    bool pending = entry != nullptr && entry->pending;
+    portEXIT_CRITICAL(&lock);
+
+    if (fresh) {
+        ip = IPAddress(cached);
+        return true;
+    }
+    if (entry == nullptr || WiFi.status() != WL_CONNECTED) {
+        if (cached != 0) {
+            ip = IPAddress(cached);
+            return true;
+        }
+        return false;
+    }
+
+    if (pending || sendQuery(*entry)) {
+        unsigned long start = millis();
+        while (millis() - start < timeoutMs) {
+            portENTER_CRITICAL(&lock);
+            fresh = isFresh(*entry);
+            cached = entry->ip;
+            pending = entry->pending;
+            portEXIT_CRITICAL(&lock);
+            if (fresh || !pending) {
+                break;
+            }
+            delay(10);
+        }
+        if (fresh) {
+            ip = IPAddress(cached);
+            return true;
+        }
+    }
+
+    // Sin respuesta propia: último recurso el resolver del sistema
+    IPAddress systemIP;
+    if (WiFi.hostByName(host, systemIP) && (uint32_t)systemIP != 0) {
+        portENTER_CRITICAL(&lock);
+        if (entry->ip != (uint32_t)systemIP) {
+            dirty = true;
+        }
+        entry->ip = (uint32_t)systemIP;
+        entry->expiresAt = millis() + DNS_MIN_TTL * 1000UL;
+        portEXIT_CRITICAL(&lock);
+        ip = systemIP;
+        return true;
+    }
+
+    if (cached != 0) {
+        Serial.printf("[DNS] %s sin respuesta, usando ultima IP conocida\n", host);
+        ip = IPAddress(cached);
+        return true;
+    }
+    Serial.printf("[DNS] ERROR: No se pudo resolver %s\n", host);
+    return false;
+}
+
+// La conexión con la IP en cache falló: vencerla para que la próxima
+// resolución consulte de nuevo en lugar de insistir con un servidor caído
+void DnsResolver::invalidate(const char* host) {
+    portENTER_CRITICAL(&lock);
+    Entry* entry = find(host);
+    if (entry != nullptr) {
+        entry->expiresAt = millis();
+        entry->lastQuery = millis() - DNS_RETRY_INTERVAL;
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+// ==================== Loop ====================
+void DnsResolver::loop() {
+    if (WiFi.status() != WL_CONNECTED) {
+        return;
+    }
+
+    unsigned long now = millis();
+    for (Entry& entry : entries) {
+        portENTER_CRITICAL(&lock);
+        bool used = entry.used;
+        if (used && entry.pending && now - entry.lastQuery >= DNS_QUERY_TIMEOUT) {
+            entry.pending = false;
+        }
+        // Renovar antes de que venza para que nadie espere una consulta
+        bool due = used && !entry.pending &&
+                   (entry.ip == 0 || (long)(entry.expiresAt - now) < (long)DNS_PREFETCH_BEFORE) &&
+                   now - entry.lastQuery >= DNS_RETRY_INTERVAL;
+        portEXIT_CRITICAL(&lock);
+
+        if (due) {
+            sendQuery(entry);
+            break;  // Una consulta por vuelta
+        }
+    }
+
+    if (dirty && now - lastSave >= DNS_SAVE_INTERVAL) {
+        persist();
+    }
+}
+
+// ==================== UDP ====================
+bool DnsResolver::ensureSocket() {
+    IPAddress server = WiFi.dnsIP(0);
+    if ((uint32_t)server == 0) {
+        return false;
+    }
+    if (server == udpServer && udp.connected()) {
+        return true;
+    }
+    udp.close();
+    if (!udp.connect(server, 53)) {
+        return false;
+    }
+    udp.onPacket([this](AsyncUDPPacket& packet) {
+        handleResponse(packet);
+    });
+    udpServer = server;
+    return true;
+}
+
+bool DnsResolver::sendQuery(Entry& entry) {
+    if (!ensureSocket()) {
+        return false;
+    }
+
+    uint8_t query[DNS_HEADER_SIZE + DNS_MAX_HOST_LEN + 6];
+    memset(query, 0, DNS_HEADER_SIZE);
+
+    portENTER_CRITICAL(&lock);
+    uint16_t id = nextQueryId++;
+    entry.queryId = id;
+    entry.pending = true;
+    entry.lastQuery = millis();
+    portEXIT_CRITICAL(&lock);
+
+    writeU16(query, id);
+    writeU16(query + 2, 0x0100);  // Consulta estándar, recursión deseada
+    writeU16(query + 4, 1);
+
+    // "api.ejemplo.com" -> 3api7ejemplo3com0
+    size_t offset = DNS_HEADER_SIZE;
+    const char* label = entry.host;
+    while (*label != '\0') {
+        const char* dot = strchr(label, '.');
+        size_t labelLength = dot != nullptr ? (size_t)(dot - label) : strlen(label);
+        if (labelLength == 0 || labelLength > 63) {
+            break;
+        }
+        query[offset++] = (uint8_t)labelLength;
+        memcpy(query + offset, label, labelLength);
+        offset += labelLength;
+        label += labelLength + (dot != nullptr ? 1 : 0);
+    }
+    query[offset++] = 0;
+    writeU16(query + offset, DNS_TYPE_A);
+    writeU16(query + offset + 2, DNS_CLASS_IN);
+    offset += 4;
+
+    return udp.write(query, offset) == offset;
+}
+
+// Corre en la tarea de lwIP: solo actualiza la tabla bajo el lock
+void DnsResolver::handleResponse(AsyncUDPPacket& packet) {
+    const uint8_t* data = packet.data();
+    size_t length = packet.length();
+    if (length < DNS_HEADER_SIZE) {
+        return;
+    }
+
+    uint16_t id = readU16(data);
+    uint16_t flags = readU16(data + 2);
+    uint16_t questions = readU16(data + 4);
+    uint16_t answers = readU16(data + 6);
+    bool ok = (flags & 0x8000) != 0 && (flags & 0x000F) == 0;
+
+    size_t offset = DNS_HEADER_SIZE;
+    for (uint16_t i = 0; i < questions && offset != 0; i++) {
+        offset = skipName(data, length, offset);
+        offset = offset != 0 ? offset + 4 : 0;
+    }
+
+    // Primer registro A; el TTL efectivo es el menor de la cadena (CNAMEs)
+    uint32_t address = 0;
+    uint32_t ttl = DNS_MAX_TTL;
+    for (uint16_t i = 0; ok && i < answers && offset != 0 && address == 0; i++) {
+        offset = skipName(data, length, offset);
+        if (offset == 0 || offset + 10 > length) {
+            break;
+        }
+        uint16_t type = readU16(data + offset);
+        uint32_t recordTtl = readU32(data + offset + 4);
+        uint16_t dataLength = readU16(data + offset + 8);
+        offset += 10;
+        if (offset + dataLength > length) {
+            break;
+        }
+        ttl = min(ttl, recordTtl);
+        if (type == DNS_TYPE_A && dataLength == 4) {
+            memcpy(&address, data + offset, 4);
+        }
+        offset += dataLength;
+    }
+    ttl = max(ttl, (uint32_t)DNS_MIN_TTL);
+
+    portENTER_CRITICAL(&lock);
+    for (Entry& entry : entries) {
+        if (entry.used && entry.pending && entry.queryId == id) {
+            entry.pending = false;
+            if (address != 0) {
+                if (entry.ip != address) {
+                    dirty = true;
+                }
+                entry.ip = address;
+                entry.expiresAt = millis() + ttl * 1000UL;
+            }
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+// ==================== Tabla ====================
+bool DnsResolver::isFresh(const Entry& entry) const {
+    return entry.ip != 0 && (long)(entry.expiresAt - millis()) > 0;
+}
+
+DnsResolver::Entry* DnsResolver::find(const char* host) {
+    for (Entry& entry : entries) {
+        if (entry.used && strcasecmp(entry.host, host) == 0) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+// Sin desalojo: los hosts del firmware son pocos y fijos
+DnsResolver::Entry* DnsResolver::allocate(const char* host) {
+    for (Entry& entry : entries) {
+        if (!entry.used) {
+            strlcpy(entry.host, host, sizeof(entry.host));
+            entry.used = true;
+            entry.pending = false;
+            entry.ip = 0;
+            entry.expiresAt = millis();
+            entry.lastQuery = millis() - DNS_RETRY_INTERVAL;
+            entry.queryId = 0;
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+void DnsResolver::persist() {
+    std::vector<uint8_t> blob(1);
+    blob[0] = DNS_CACHE_VERSION;
+
+    for (const Entry& entry : entries) {
+        StoredEntry stored;
+        portENTER_CRITICAL(&lock);
+        bool keep = entry.used && entry.ip != 0;
+        memcpy(stored.host, entry.host, sizeof(stored.host));
+        stored.ip = entry.ip;
+        portEXIT_CRITICAL(&lock);
+        if (keep) {
+            const uint8_t* raw = reinterpret_cast<const uint8_t*>(&stored);
+            blob.insert(blob.end(), raw, raw + sizeof(stored));
+        }
+    }
+
+    Preferences prefs;
+    if (prefs.begin("dns_cache", false)) {
+        prefs.putBytes("entries", blob.data(), blob.size());
+        prefs.end();
+    }
+    dirty = false;
+    lastSave = millis();
+    Serial.printf("[DNS] %d IPs guardadas en NVS\n", (blob.size() - 1) / sizeof(StoredEntry));
+}
@@ -8,12 +8,43 @@ ESPNowManager espNowManager;
 // Variable estática para almacenar mensajes recibidos
 static std::vector<ESPNowMessage> staticReceivedMessages;
 
+// TDMA: última baliza recibida (esclavo) y MACs de esclavos oídos (maestro).
+// Los escribe el callback de recepción (tarea WiFi)
+static portMUX_TYPE tdmaMux = portMUX_INITIALIZER_UNLOCKED;
+static ESPNowSyncBeacon staticSyncBeacon;
+static unsigned long staticSyncReceivedAt = 0;
+static bool staticSyncPending = false;
+static uint8_t staticHeardMacs[MAX_SLAVES][6];
+static int staticHeardCount = 0;
+static unsigned long staticWindowStart = 0;
+static unsigned long staticWindowEnd = 0;
+static uint32_t staticInWindow = 0;
+static uint32_t staticOutOfWindow = 0;
+SyncBeaconCallback ESPNowManager::syncCallback = nullptr;
+
 // Constructor
-ESPNowManager::ESPNowManager() : isMaster(false) {
+ESPNowManager::ESPNowManager() : isMaster(false), initialized(false), radioActive(false), channel(1) {
 }
 
 // Callback para recibir datos
 void ESPNowManager::onDataReceive(const uint8_t* mac, const uint8_t* data, int len) {
+    if (len == sizeof(ESPNowSyncBeacon)) {
+        ESPNowSyncBeacon beacon;
+        memcpy(&beacon, data, sizeof(beacon));
+        if (beacon.magic != TDMA_SYNC_MAGIC) {
+            return;
+        }
+        portENTER_CRITICAL(&tdmaMux);
+        staticSyncBeacon = beacon;
+        staticSyncReceivedAt = millis();
+        staticSyncPending = true;
+        portEXIT_CRITICAL(&tdmaMux);
+        if (syncCallback) {
+            syncCallback();
+        }
+        return;
+    }
+    
     if (len != sizeof(ESPNowMessage)) {
         Serial.printf("[ESP-NOW] ⚠️ Tamaño incorrecto: %d bytes (esperado: %d)\n", 
                      len, sizeof(ESPNowMessage));
@@ -23,6 +54,23 @@ void ESPNowManager::onDataReceive(const uint8_t* mac, const uint8_t* data, int l
     ESPNowMessage msg;
     memcpy(&msg, data, sizeof(ESPNowMessage));
     staticReceivedMessages.push_back(msg);
+    
+    // Remitente para la tabla de slots TDMA y si llegó dentro de la ventana
+    unsigned long now = millis();
+    portENTER_CRITICAL(&tdmaMux);
+    if ((long)(now - staticWindowStart) >= 0 && (long)(now - staticWindowEnd) < 0) {
+        staticInWindow++;
+    } else {
+        staticOutOfWindow++;
+    }
+    bool known = false;
+    for (int i = 0; i < staticHeardCount && !known; i++) {
+        known = memcmp(staticHeardMacs[i], mac, 6) == 0;
+    }
+    if (!known && staticHeardCount < MAX_SLAVES) {
+        memcpy(staticHeardMacs[staticHeardCount++], mac, 6);
+    }
+    portEXIT_CRITICAL(&tdmaMux);
 
     Serial.printf("[ESP-NOW] ✓ Recibido de %02X:%02X:%02X:%02X:%02X:%02X - ID=%u, Buffer: %d msgs\n",
                   mac[0], mac[1], mac[2], mac[3], mac[4], mac[5],
@@ -68,6 +116,8 @@ bool ESPNowManager::initializeMaster() {
     }
     
     isMaster = true;
+    initialized = true;
+    radioActive = true;
     
     // Obtener canal actual del WiFi
     uint8_t currentChannel;
@@ -131,7 +181,13 @@ bool ESPNowManager::initializeSlave() {
         return false;
     }
     
+    // Recepción de las balizas de sincronía TDMA del maestro
+    esp_now_register_recv_cb(onDataReceive);
+    
     isMaster = false;
+    initialized = true;
+    radioActive = true;
+    channel = detectedChannel;
     Serial.println("[ESP-NOW] Esclavo inicializado correctamente");
     Serial.printf("[ESP-NOW] MAC Address: %s\n", WiFi.macAddress().c_str());
     Serial.printf("[ESP-NOW] Maestro configurado: %02X:%02X:%02X:%02X:%02X:%02X\n",
@@ -141,6 +197,67 @@ bool ESPNowManager::initializeSlave() {
     return true;
 }
 
+// Apagar ESP-NOW para cambiar de modo sin reiniciar
+void ESPNowManager::end() {
+    if (!initialized) {
+        return;
+    }
+    
+    esp_now_unregister_recv_cb();
+    // El siguiente modo espera la radio WiFi encendida
+    radioOn();
+    esp_now_deinit();
+    staticReceivedMessages.clear();
+    portENTER_CRITICAL(&tdmaMux);
+    staticSyncPending = false;
+    staticHeardCount = 0;
+    portEXIT_CRITICAL(&tdmaMux);
+    initialized = false;
+    Serial.println("[ESP-NOW] Detenido");
+}
+
+// Esclavo con otro maestro: basta con cambiar el peer
+void ESPNowManager::onConfigChanged(uint32_t changes) {
+    if (!initialized || isMaster || !(changes & CONFIG_CHANGE_MASTER_MAC)) {
+        return;
+    }
+    
+    esp_now_del_peer(masterPeerInfo.peer_addr);
+    if (addPeer(MASTER_MAC_ADDRESS)) {
+        Serial.printf("[ESP-NOW] Nuevo maestro: %02X:%02X:%02X:%02X:%02X:%02X\n",
+                      MASTER_MAC_ADDRESS[0], MASTER_MAC_ADDRESS[1], MASTER_MAC_ADDRESS[2],
+                      MASTER_MAC_ADDRESS[3], MASTER_MAC_ADDRESS[4], MASTER_MAC_ADDRESS[5]);
+    } else {
+        Serial.println("[ESP-NOW] Error al agregar el nuevo maestro como peer");
+    }
+}
+
+// Bajo consumo (esclavo): la radio WiFi solo se enciende para enviar. Los
+// peers de ESP-NOW se conservan; al volver a arrancar se fija otra vez el canal
+bool ESPNowManager::radioOn() {
+    if (!initialized || radioActive) {
+        return initialized;
+    }
+    
+    if (esp_wifi_start() != ESP_OK) {
+        Serial.println("[ESP-NOW] Error al encender la radio");
+        return false;
+    }
+    esp_wifi_set_promiscuous(true);
+    esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE);
+    esp_wifi_set_promiscuous(false);
+    radioActive = true;
+    return true;
+}
+
+void ESPNowManager::radioOff() {
+    if (!initialized || isMaster || !radioActive) {
+        return;
+    }
+    esp_wifi_stop();
+    radioActive = false;
+}
+
 // Agregar peer
 bool ESPNowManager::addPeer(const uint8_t* macAddress) {
     memcpy(masterPeerInfo.peer_addr, macAddress, 6);
@@ -178,21 +295,84 @@ bool ESPNowManager::sendToMaster(const String& jsonMessage) {
     }
 
     ESPNowMessage msg;
+    memset(&msg, 0, sizeof(msg));
     strncpy(msg.deviceId, doc["device_id"] | "", sizeof(msg.deviceId) - 1);
     strncpy(msg.location, doc["device_location"] | "", sizeof(msg.location) - 1);
     msg.animalId = doc["animal_id"] | 0;
     msg.rssi = doc["rssi"] | 0;
     msg.distance = doc["distance"] | 0.0f;
 
-    esp_err_t result = esp_now_send(MASTER_MAC_ADDRESS, (uint8_t*)&msg, sizeof(msg));
-    
-    if (result == ESP_OK) {
+    if (sendMessage(msg)) {
         Serial.println("[ESP-NOW] Mensaje enviado al maestro");
         return true;
-    } else {
+    }
+    return false;
+}
+
+bool ESPNowManager::sendMessage(const ESPNowMessage& msg) {
+    if (!initialized || isMaster) {
+        return false;
+    }
+    
+    esp_err_t result = esp_now_send(MASTER_MAC_ADDRESS, (const uint8_t*)&msg, sizeof(msg));
+    if (result != ESP_OK) {
         Serial.printf("[ESP-NOW] Error al enviar: %d\n", result);
         return false;
     }
+    return true;
+}
+
+// ==================== Sincronía TDMA ====================
+bool ESPNowManager::broadcastSync(const ESPNowSyncBeacon& beacon) {
+    if (!initialized || !isMaster) {
+        return false;
+    }
+    
+    static const uint8_t broadcastAddress[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    esp_err_t result = esp_now_send(broadcastAddress, (const uint8_t*)&beacon, sizeof(beacon));
+    if (result != ESP_OK) {
+        Serial.printf("[ESP-NOW] Error al difundir la baliza TDMA: %d\n", result);
+        return false;
+    }
+    return true;
+}
+
+bool ESPNowManager::takeSyncBeacon(ESPNowSyncBeacon& beacon, unsigned long& receivedAt) {
+    portENTER_CRITICAL(&tdmaMux);
+    bool pending = staticSyncPending;
+    if (pending) {
+        beacon = staticSyncBeacon;
+        receivedAt = staticSyncReceivedAt;
+        staticSyncPending = false;
+    }
+    portEXIT_CRITICAL(&tdmaMux);
+    return pending;
+}
+
+// Ventana de recepción TDMA vigente, para medir las tramas que llegan fuera
+void ESPNowManager::setReceiveWindow(unsigned long start, unsigned long end) {
+    portENTER_CRITICAL(&tdmaMux);
+    staticWindowStart = start;
+    staticWindowEnd = end;
+    portEXIT_CRITICAL(&tdmaMux);
+}
+
+void ESPNowManager::takeReceiveStats(uint32_t& inWindow, uint32_t& outOfWindow) {
+    portENTER_CRITICAL(&tdmaMux);
+    inWindow = staticInWindow;
+    outOfWindow = staticOutOfWindow;
+    staticInWindow = 0;
+    staticOutOfWindow = 0;
+    portEXIT_CRITICAL(&tdmaMux);
+}
+
+int ESPNowManager::takeHeardSlaves(uint8_t macs[][6], int maxCount) {
+    portENTER_CRITICAL(&tdmaMux);
+    int count = min(staticHeardCount, maxCount);
+    memcpy(macs, staticHeardMacs, count * 6);
+    staticHeardCount = 0;
+    portEXIT_CRITICAL(&tdmaMux);
+    return count;
 }
 
 // Obtener mensajes recibidos
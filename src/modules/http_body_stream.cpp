@@ -0,0 +1,147 @@
+#include "http_body_stream.h"
+
+HttpBodyStream::HttpBodyStream(Stream& source, int contentLength, bool chunked, unsigned long timeout)
+    : source(source),
+      chunked(chunked),
+      done(false),
+      chunkNeedsCRLF(false),
+      remaining(chunked ? 0 : contentLength),
+      lookahead(-1),
+      byteTimeout(timeout) {
+    setTimeout(timeout);
+    if (!chunked && contentLength == 0) {
+        done = true;
+    }
+}
+
+int HttpBodyStream::available() {
+    if (lookahead >= 0) {
+        return 1;
+    }
+    if (done) {
+        return 0;
+    }
+    int pending = source.available();
+    if (remaining > 0 && pending > remaining) {
+        return (int)remaining;
+    }
+    // Con chunked y remaining == 0 lo disponible es una cabecera de chunk
+    return (chunked && remaining == 0) ? (pending > 0 ? 1 : 0) : pending;
+}
+
+int HttpBodyStream::read() {
+    if (lookahead >= 0) {
+        int c = lookahead;
+        lookahead = -1;
+        return c;
+    }
+    return readRaw();
+}
+
+int HttpBodyStream::peek() {
+    if (lookahead < 0) {
+        lookahead = readRaw();
+    }
+    return lookahead;
+}
+
+// Siguiente byte del cuerpo, o -1 si todavía no llegó o se terminó
+int HttpBodyStream::readRaw() {
+    if (done) {
+        return -1;
+    }
+    if (chunked && remaining == 0 && !readChunkHeader()) {
+        done = true;
+        return -1;
+    }
+    if (!chunked && remaining == 0) {
+        done = true;
+        return -1;
+    }
+
+    int c = source.read();
+    if (c < 0) {
+        return -1;
+    }
+    if (remaining > 0) {
+        remaining--;
+        if (chunked && remaining == 0) {
+            chunkNeedsCRLF = true;
+        } else if (!chunked && remaining == 0) {
+            done = true;
+        }
+    }
+    return c;
+}
+
+// "<hex>[;ext]\r\n"; un chunk de tamaño 0 cierra el cuerpo (con trailers)
+bool HttpBodyStream::readChunkHeader() {
+    if (chunkNeedsCRLF) {
+        waitByte();
+        waitByte();
+        chunkNeedsCRLF = false;
+    }
+
+    long size = 0;
+    bool inExtension = false;
+    bool sawDigit = false;
+    while (true) {
+        int c = waitByte();
+        if (c < 0) {
+            return false;
+        }
+        if (c == '\n') {
+            break;
+        }
+        if (c == ';') {
+            inExtension = true;
+        }
+        if (inExtension || c == '\r' || c == ' ') {
+            continue;
+        }
+        int digit = isdigit(c) ? c - '0' : (isxdigit(c) ? (tolower(c) - 'a' + 10) : -1);
+        if (digit < 0) {
+            return false;
+        }
+        size = size * 16 + digit;
+        sawDigit = true;
+    }
+
+    if (!sawDigit) {
+        return false;
+    }
+    if (size == 0) {
+        // Descartar trailers hasta la línea vacía
+        int lineLength = 0;
+        while (true) {
+            int c = waitByte();
+            if (c < 0) {
+                break;
+            }
+            if (c == '\n') {
+                if (lineLength == 0) {
+                    break;
+                }
+                lineLength = 0;
+            } else if (c != '\r') {
+                lineLength++;
+            }
+        }
+        return false;
+    }
+
+    remaining = size;
+    return true;
+}
+
+int HttpBodyStream::waitByte() {
+    unsigned long start = millis();
+    while (millis() - start < byteTimeout) {
+        int c = source.read();
+        if (c >= 0) {
+            return c;
+        }
+        delay(1);
+    }
+    return -1;
+}
@@ -0,0 +1,149 @@
+#include "https_session.h"
+#include "http_body_stream.h"
+
+HttpsSession backendSession;
+
+HttpsSession::HttpsSession()
+    : lastActivity(0),
+      requestCount(0),
+      reusedCount(0),
+      retryAfter(0) {
+}
+
+bool HttpsSession::isConnected() {
+    return client.connected();
+}
+
+void HttpsSession::close() {
+    if (client.connected()) {
+        Serial.printf("[HTTPS] Cerrando conexión con %s\n", currentHost.c_str());
+    }
+    http.end();
+    client.stop();
+    currentHost = "";
+}
+
+// ==================== Petición ====================
+int HttpsSession::request(const char* method, const String& url, const String& body, String& response, bool authorize) {
+    return dispatch(method, url, body, &response, nullptr, authorize);
+}
+
+// Igual que request() pero el cuerpo se entrega como stream al lector, sin
+// copiarlo a un String; pensado para respuestas JSON de tamaño arbitrario
+int HttpsSession::streamRequest(const char* method, const String& url, const String& body, ResponseReader reader, bool authorize) {
+    return dispatch(method, url, body, nullptr, &reader, authorize);
+}
+
+int HttpsSession::dispatch(const char* method, const String& url, const String& body, String* response, ResponseReader* reader, bool authorize) {
+    String host = hostOf(url);
+    
+    // El balanceador del backend cierra sockets inactivos; cerrar antes de
+    // escribir en uno medio cerrado evita perder la petición.
+    if (client.connected()) {
+        if (host != currentHost) {
+            close();
+        } else if (millis() - lastActivity > HTTP_KEEPALIVE_IDLE_TIMEOUT) {
+            Serial.println("[HTTPS] Conexión inactiva demasiado tiempo, reconectando");
+            close();
+        }
+    }
+    
+    bool reused = client.connected();
+    int httpCode = send(method, url, body, response, reader, authorize);
+    
+    if (reused && isStaleConnectionError(httpCode)) {
+        // El servidor cerró el socket sin avisar: un único reintento en frío
+        Serial.printf("[HTTPS] Conexión reutilizada caída (%d), reintentando\n", httpCode);
+        close();
+        reused = false;
+        httpCode = send(method, url, body, response, reader, authorize);
+    }
+    
+    requestCount++;
+    if (reused) {
+        reusedCount++;
+    }
+    Serial.printf("[HTTPS] %s %s -> %d (%s, %lu/%lu reutilizadas)\n",
+                 method, host.c_str(), httpCode, reused ? "keep-alive" : "nueva conexión",
+                 (unsigned long)reusedCount, (unsigned long)requestCount);
+    
+    return httpCode;
+}
+
+int HttpsSession::send(const char* method, const String& url, const String& body, String* response, ResponseReader* reader, bool authorize) {
+    if (response != nullptr) {
+        *response = "";
+    }
+    retryAfter = 0;
+    
+    if (!client.connected()) {
+        client.setTrustAnchor(BACKEND_ROOT_CA);
+        client.setTimeout(HTTP_TIMEOUT / 1000);
+    }
+    
+    if (!http.begin(client, url)) {
+        return HTTPC_ERROR_CONNECTION_REFUSED;
+    }
+    http.setReuse(true);
+    http.setTimeout(HTTP_TIMEOUT);
+    http.addHeader("Content-Type", "application/json");
+    if (authorize && strlen(API_KEY) > 0) {
+        http.addHeader("Authorization", String("Bearer ") + API_KEY);
+    }
+    
+    const char* headerKeys[] = {"Retry-After", "Transfer-Encoding"};
+    http.collectHeaders(headerKeys, 2);
+    
+    bool reusable = true;
+    int httpCode = http.sendRequest(method, body);
+    if (httpCode > 0) {
+        // Solo la forma en segundos; la forma fecha HTTP se ignora
+        if (http.hasHeader("Retry-After")) {
+            retryAfter = http.header("Retry-After").toInt() * 1000UL;
+        }
+        if (reader != nullptr) {
+            bool chunked = http.header("Transfer-Encoding").equalsIgnoreCase("chunked");
+            int contentLength = http.getSize();
+            HttpBodyStream bodyStream(http.getStream(), contentLength, chunked, HTTP_TIMEOUT);
+            (*reader)(httpCode, bodyStream);
+            
+            // Consumir lo que el lector no usó para dejar el socket alineado
+            // con la próxima respuesta; sin longitud conocida no es reutilizable
+            if (chunked || contentLength >= 0) {
+                char scratch[64];
+                while (!bodyStream.finished() && bodyStream.readBytes(scratch, sizeof(scratch)) > 0) {
+                }
+                reusable = bodyStream.finished();
+            } else {
+                reusable = false;
+            }
+        } else if (response != nullptr) {
+            *response = http.getString();
+        }
+    }
+    
+    // Con keep-alive end() deja el socket abierto si el servidor lo permite
+    http.end();
+    if (!reusable) {
+        client.stop();
+    }
+    currentHost = hostOf(url);
+    lastActivity = millis();
+    
+    return httpCode;
+}
+
+// ==================== Utilidades ====================
+String HttpsSession::hostOf(const String& url) {
+    int start = url.indexOf("://");
+    start = start < 0 ? 0 : start + 3;
+    int end = url.indexOf('/', start);
+    return end < 0 ? url.substring(start) : url.substring(start, end);
+}
+
+bool HttpsSession::isStaleConnectionError(int httpCode) {
+    return httpCode == HTTPC_ERROR_SEND_HEADER_FAILED ||
+           httpCode == HTTPC_ERROR_SEND_PAYLOAD_FAILED ||
+           httpCode == HTTPC_ERROR_NOT_CONNECTED ||
+           httpCode == HTTPC_ERROR_CONNECTION_LOST;
+}
@@ -0,0 +1,71 @@
+#include "json_stream.h"
+
+namespace {
+// Siguiente carácter no blanco, esperando hasta el timeout del stream
+int nextNonSpace(Stream& input, bool consume) {
+    unsigned long start = millis();
+    while (millis() - start < input.getTimeout()) {
+        int c = input.peek();
+        if (c < 0) {
+            delay(1);
+            continue;
+        }
+        if (isspace(c)) {
+            input.read();
+            continue;
+        }
+        if (consume) {
+            input.read();
+        }
+        return c;
+    }
+    return -1;
+}
+
+// Deja el stream justo después del '[' de "key": [ ... El nombre puede
+// aparecer antes como valor (p. ej. en el "path" de un error GraphQL).
+bool seekArray(Stream& input, const char* key) {
+    String pattern = String("\"") + key + "\"";
+    while (input.find(pattern.c_str())) {
+        if (nextNonSpace(input, true) != ':') {
+            continue;
+        }
+        return nextNonSpace(input, true) == '[';
+    }
+    return false;
+}
+}
+
+int streamJsonArray(Stream& input, const char* key, const JsonDocument& filter,
+                    size_t itemCapacity, JsonItemHandler handler) {
+    if (!seekArray(input, key)) {
+        Serial.printf("[JSON] Array '%s' no encontrado\n", key);
+        return -1;
+    }
+
+    if (nextNonSpace(input, false) == ']') {
+        input.read();
+        return 0;
+    }
+
+    DynamicJsonDocument item(itemCapacity);
+    int count = 0;
+    while (true) {
+        DeserializationError error = deserializeJson(item, input, DeserializationOption::Filter(filter));
+        if (error) {
+            Serial.printf("[JSON] Error en elemento %d de '%s': %s\n", count, key, error.c_str());
+            return -1;
+        }
+        handler(item.as<JsonObjectConst>());
+        count++;
+
+        int separator = nextNonSpace(input, true);
+        if (separator == ']') {
+            return count;
+        }
+        if (separator != ',') {
+            Serial.printf("[JSON] Separador inesperado en '%s'\n", key);
+            return -1;
+        }
+    }
+}
@@ -1,23 +1,143 @@
 #include "managers/button_manager.h"
 #include "config/hardware_config.h"
+#include "alerts.h"
 #include <Arduino.h>
+#include <esp_timer.h>
+#include <driver/gpio.h>
+#include <esp_sleep.h>
 
-static unsigned long buttonPressStart = 0;
-static unsigned long lastDebounceTime = 0;
-static bool buttonWasPressed = false;
-static int lastButtonState = HIGH;
-static int buttonState = HIGH;
+struct ButtonInput {
+    int pin;
+    const char* name;
+    esp_timer_handle_t debounceTimer;
+    esp_timer_handle_t holdTimer;  // Solo reset: pulsación larga
+    volatile bool pressed;
+    volatile bool event;           // Modo: pulsación; reset: pulsación larga cumplida
+    volatile unsigned long pressStart;
+    bool attached;
+};
+
+static ButtonInput resetButton = { RESET_BUTTON, "reset", nullptr, nullptr, false, false, 0, false };
+static ButtonInput modeButton = { MODE_BUTTON, "mode", nullptr, nullptr, false, false, 0, false };
+static ButtonEventCallback eventCallback = nullptr;
 static bool registrationModeState = false;
 
+// ==================== Interrupción y temporizadores ====================
+// Cada rebote reinicia la espera; el nivel se lee cuando el pin se calma
+static void IRAM_ATTR onButtonEdge(void* arg) {
+    ButtonInput* button = static_cast<ButtonInput*>(arg);
+    esp_timer_stop(button->debounceTimer);
+    esp_timer_start_once(button->debounceTimer, DEBOUNCE_DELAY * 1000);
+}
+
+static void notifyButtonEvent() {
+    if (eventCallback) {
+        eventCallback();
+    }
+}
+
+static void onButtonHold(void* arg) {
+    ButtonInput* button = static_cast<ButtonInput*>(arg);
+    if (button->pressed) {
+        button->event = true;
+        notifyButtonEvent();
+    }
+}
+
+static void startPress(ButtonInput& button) {
+    button.pressed = true;
+    button.pressStart = millis();
+
+    if (button.holdTimer != nullptr) {
+        esp_timer_start_once(button.holdTimer, RESET_BUTTON_HOLD_TIME * 1000);
+        alertManager.setColor(255, 0, 0);
+        Serial.printf("[Reset]   Botón presionado - mantén %lu seg...\n", RESET_BUTTON_HOLD_TIME / 1000);
+    } else {
+        button.event = true;
+        notifyButtonEvent();
+    }
+}
+
+static void onButtonSettled(void* arg) {
+    ButtonInput* button = static_cast<ButtonInput*>(arg);
+    bool down = digitalRead(button->pin) == LOW;
+    if (down == button->pressed) {
+        return;
+    }
+
+    if (down) {
+        startPress(*button);
+        return;
+    }
+
+    button->pressed = false;
+    if (button->holdTimer != nullptr) {
+        esp_timer_stop(button->holdTimer);
+        alertManager.setColor(0, 0, 0);
+        Serial.printf("[Reset]   Botón liberado después de %lu ms\n", millis() - button->pressStart);
+    }
+}
+
+static void attachButton(ButtonInput& button, bool withHold) {
+    if (button.attached) {
+        return;
+    }
+
+    pinMode(button.pin, INPUT_PULLUP);
+
+    esp_timer_create_args_t timerArgs = {};
+    timerArgs.callback = onButtonSettled;
+    timerArgs.arg = &button;
+    timerArgs.dispatch_method = ESP_TIMER_TASK;
+    timerArgs.name = button.name;
+    esp_timer_create(&timerArgs, &button.debounceTimer);
+
+    if (withHold) {
+        timerArgs.callback = onButtonHold;
+        esp_timer_create(&timerArgs, &button.holdTimer);
+    }
+
+    attachInterruptArg(button.pin, onButtonEdge, &button, CHANGE);
+    button.attached = true;
+
+    // Sin flanco no hay interrupción: si ya está pulsado (p. ej. desde el
+    // encendido) la pulsación empieza ahora
+    if (digitalRead(button.pin) == LOW) {
+        startPress(button);
+    }
+}
+
+void onButtonEvent(ButtonEventCallback callback) {
+    eventCallback = callback;
+}
+
+// ==================== Botón de reset ====================
 void initResetButton() {
-    pinMode(RESET_BUTTON, INPUT_PULLUP);
-    pinMode(LED_RGB_RED, OUTPUT);
-    pinMode(LED_RGB_BLUE, OUTPUT);
-    digitalWrite(LED_RGB_RED, LOW);
+    attachButton(resetButton, true);
 }
 
+bool checkResetButton() {
+    if (!resetButton.event) {
+        return false;
+    }
+    resetButton.event = false;
+    alertManager.setColor(0, 0, 0);
+    Serial.println("\n[Reset]   RESET CONFIRMADO - Borrando configuración...");
+    return true;
+}
+
+// Solo espera si el botón está pulsado al arrancar; si no, vuelve enseguida
+bool waitForResetButtonOnStartup() {
+    while (resetButton.pressed && !resetButton.event) {
+        delay(10);
+    }
+    return checkResetButton();
+}
+
+// ==================== Botón de modo ====================
 void initModeButton() {
-    pinMode(MODE_BUTTON, INPUT_PULLUP);
+    attachButton(modeButton, false);
+    modeButton.event = false;  // Una pulsación previa a activar el botón no cuenta
 }
 
 void enterRegistrationMode() {
@@ -37,82 +157,48 @@ void exitRegistrationMode() {
 }
 
 void checkModeButtonPress() {
-    static unsigned long localDebounceTime = 0;
-    static int localLastState = HIGH;
-    static int localState = HIGH;
-    
-    int reading = digitalRead(MODE_BUTTON);
-    
-    if (reading != localLastState) {
-        localDebounceTime = millis();
-    }
-    
-    if ((millis() - localDebounceTime) > DEBOUNCE_DELAY) {
-        if (reading != localState) {
-            localState = reading;
-            
-            if (localState == LOW && registrationModeState) {
-                digitalWrite(LED_RGB_BLUE, LOW);
-                exitRegistrationMode();
-            }
-            else if (localState == LOW && !registrationModeState) {
-                digitalWrite(LED_RGB_BLUE, HIGH);
-                enterRegistrationMode();
-            }
-        }
+    if (!modeButton.event) {
+        return;
     }
+    modeButton.event = false;
 
-    localLastState = reading;
+    if (registrationModeState) {
+        alertManager.setColor(0, 0, 0);
+        exitRegistrationMode();
+    } else {
+        alertManager.setColor(0, 0, 255);
+        enterRegistrationMode();
+    }
 }
 
 bool isRegistrationModeActive() {
     return registrationModeState;
 }
 
-bool checkResetButton() {
-    int reading = digitalRead(RESET_BUTTON);
-    
-    if (reading != lastButtonState) {
-        lastDebounceTime = millis();
-    }
-    
-    if ((millis() - lastDebounceTime) > DEBOUNCE_DELAY) {
-        if (reading != buttonState) {
-            buttonState = reading;
-            
-            if (buttonState == LOW && !buttonWasPressed) {
-                buttonWasPressed = true;
-                buttonPressStart = millis();
-                digitalWrite(LED_RGB_RED, HIGH);
-                Serial.println("[Reset]   Botón presionado - mantén 3 seg...");
-            }
-            
-            if (buttonState == HIGH && buttonWasPressed) {
-                unsigned long pressDuration = millis() - buttonPressStart;
-                buttonWasPressed = false;
-                digitalWrite(LED_RGB_RED, LOW);
-                
-                Serial.printf("[Reset]   Botón liberado después de %lu ms\n", pressDuration);
-            }
+// ==================== Despertar desde light sleep ====================
+// El despertar por GPIO solo admite nivel: mientras se duerme la
+// interrupción por flanco queda desactivada y el pin despierta en LOW
+void enableButtonWakeup() {
+    ButtonInput* buttons[] = { &resetButton, &modeButton };
+    for (ButtonInput* button : buttons) {
+        if (button->attached) {
+            gpio_intr_disable((gpio_num_t)button->pin);
+            gpio_wakeup_enable((gpio_num_t)button->pin, GPIO_INTR_LOW_LEVEL);
         }
     }
-    
-    if (buttonWasPressed && buttonState == LOW) {
-        unsigned long pressDuration = millis() - buttonPressStart;
-        
-        static unsigned long lastFeedback = 0;
-        if (pressDuration >= 1000 && pressDuration - lastFeedback >= 1000) {
-            lastFeedback = pressDuration;
-            Serial.printf("[Reset]   Presionado: %lu ms / %lu ms\n", pressDuration, RESET_BUTTON_HOLD_TIME);
-        }
-        
-        if (pressDuration >= RESET_BUTTON_HOLD_TIME) {
-            Serial.println("\n[Reset]   RESET CONFIRMADO - Borrando configuración...");
-            buttonWasPressed = false;
-            return true;
+    esp_sleep_enable_gpio_wakeup();
+}
+
+void restoreButtonInterrupts() {
+    ButtonInput* buttons[] = { &resetButton, &modeButton };
+    for (ButtonInput* button : buttons) {
+        if (button->attached) {
+            gpio_wakeup_disable((gpio_num_t)button->pin);
+            gpio_set_intr_type((gpio_num_t)button->pin, GPIO_INTR_ANYEDGE);
+            gpio_intr_enable((gpio_num_t)button->pin);
+            // Si la pulsación fue la que despertó, el flanco ya pasó: se lee el nivel
+            esp_timer_stop(button->debounceTimer);
+            esp_timer_start_once(button->debounceTimer, DEBOUNCE_DELAY * 1000);
         }
     }
-    
-    lastButtonState = reading;
-    return false;
 }
@@ -1,10 +1,33 @@
 #include "mqtt_client.h"
-#include <ArduinoJson.h>
 #include "api_client.h"
+#include "runtime_config.h"
+#include "registration_engine.h"
 
 MQTTClient mqttClient;
 
-MQTTClient::MQTTClient() : mqttClient(wifiClient), lastReconnectAttempt(0) {
+// Tipos de paquete MQTT 3.1.1 (nibble alto del header fijo)
+static constexpr uint8_t MQTT_CONNECT = 0x10;
+static constexpr uint8_t MQTT_CONNACK = 0x20;
+static constexpr uint8_t MQTT_PUBLISH = 0x30;
+static constexpr uint8_t MQTT_PUBACK = 0x40;
+static constexpr uint8_t MQTT_SUBSCRIBE = 0x82;
+static constexpr uint8_t MQTT_SUBACK = 0x90;
+static constexpr uint8_t MQTT_PINGREQ = 0xC0;
+static constexpr uint8_t MQTT_PINGRESP = 0xD0;
+static constexpr uint8_t MQTT_DISCONNECT = 0xE0;
+
+MQTTClient::MQTTClient()
+    : state(MQTT_STATE_DISCONNECTED),
+      lastReconnectAttempt(0),
+      connectStartedAt(0),
+      lastOutboundActivity(0),
+      lastInboundActivity(0),
+      pingOutstanding(false),
+      pingSentAt(0),
+      nextPacketId(1),
+      nextDeliveryId(1),
+      txOffset(0),
+      rxDiscard(0) {
 }
 
 bool MQTTClient::initialize() {
@@ -16,27 +39,53 @@ bool MQTTClient::initialize() {
     Serial.println("[MQTT] Inicializando cliente MQTT...");
     Serial.printf("[MQTT] Broker: %s:%d\n", MQTT_BROKER, MQTT_PORT);
     Serial.printf("[MQTT] Topic: %s\n", MQTT_TOPIC);
+    Serial.printf("[MQTT] Ventana QoS 1: %d mensajes en vuelo\n", MQTT_INFLIGHT_WINDOW);
     
-    wifiClient.setInsecure();
-    
-    mqttClient.setServer(MQTT_BROKER, MQTT_PORT);
-    mqttClient.setCallback(MQTTClient::messageCallback);
-    mqttClient.setBufferSize(2048);
+    wifiClient.setTrustAnchor(MQTT_ROOT_CA);
     
     return reconnect();
 }
 
+// Cambio de modo a ESCLAVO: cierra la sesión y descarta lo pendiente
+void MQTTClient::stop() {
+    dropConnection("cliente detenido");
+    
+    std::vector<uint32_t> dropped;
+    for (const OutboundMessage& message : outbound) {
+        if (message.deliveryId != 0) {
+            dropped.push_back(message.deliveryId);
+        }
+    }
+    outbound.clear();
+    reportDeliveries(dropped, false);
+    lastReconnectAttempt = 0;
+}
+
+// El client ID y los topics salen del device ID: con otra ubicación hay que
+// abrir una sesión nueva. Los QoS 1 pendientes se retransmiten en ella.
+void MQTTClient::onConfigChanged(uint32_t changes) {
+    if (!(changes & CONFIG_CHANGE_LOCATION) || state == MQTT_STATE_DISCONNECTED) {
+        return;
+    }
+    dropConnection("ubicación actualizada");
+    lastReconnectAttempt = 0;
+}
+
 bool MQTTClient::isConnected() {
-    return mqttClient.connected();
+    return state == MQTT_STATE_CONNECTED && wifiClient.connected();
 }
 
+// Abre TCP/TLS y envía CONNECT. La sesión queda activa al recibir CONNACK en loop().
 bool MQTTClient::reconnect() {
-    if (mqttClient.connected()) {
+    if (state == MQTT_STATE_CONNECTED) {
         return true;
     }
+    if (state == MQTT_STATE_CONNECTING) {
+        return false;
+    }
     
     unsigned long now = millis();
-    if (now - lastReconnectAttempt < MQTT_RECONNECT_INTERVAL) {
+    if (lastReconnectAttempt != 0 && now - lastReconnectAttempt < MQTT_RECONNECT_INTERVAL) {
         return false;
     }
     
@@ -44,117 +93,540 @@ bool MQTTClient::reconnect() {
     
     Serial.println("[MQTT] Intentando conectar al broker...");
     
+    if (!wifiClient.connect(MQTT_BROKER, MQTT_PORT)) {
+        Serial.println("[MQTT] Error al conectar: sin conexión TLS con el broker");
+        return false;
+    }
+    
+    startSession();
+    return false;
+}
+
+void MQTTClient::startSession() {
     String clientId = "ESP32-" + String(LOADED_DEVICE_ID);
-    bool connected = false;
+    bool withCredentials = strlen(MQTT_USER) > 0 && strlen(MQTT_PASSWORD) > 0;
+    
+    std::vector<uint8_t> body;
+    appendString(body, "MQTT");
+    body.push_back(4);  // Nivel de protocolo 3.1.1
     
-    if (strlen(MQTT_USER) > 0 && strlen(MQTT_PASSWORD) > 0) {
-        connected = mqttClient.connect(clientId.c_str(), MQTT_USER, MQTT_PASSWORD);
-    } else {
-        connected = mqttClient.connect(clientId.c_str());
+    // Sesión persistente (clean session = 0) para conservar los packet IDs en vuelo
+    uint8_t flags = 0;
+    if (withCredentials) {
+        flags |= 0x80 | 0x40;
     }
+    body.push_back(flags);
+    appendUint16(body, MQTT_KEEPALIVE_SECONDS);
     
-    if (connected) {
-        Serial.println("[MQTT] Conectado al broker MQTT");
-        mqttClient.subscribe(MQTT_TOPIC);
-        return true;
-    } else {
-        Serial.printf("[MQTT] Error al conectar. Código: %d\n", mqttClient.state());
-        return false;
+    appendString(body, clientId.c_str());
+    if (withCredentials) {
+        appendString(body, MQTT_USER);
+        appendString(body, MQTT_PASSWORD);
     }
+    
+    txBuffer.clear();
+    txOffset = 0;
+    rxBuffer.clear();
+    rxDiscard = 0;
+    pingOutstanding = false;
+    
+    appendPacket(MQTT_CONNECT, body);
+    
+    state = MQTT_STATE_CONNECTING;
+    connectStartedAt = millis();
+    lastInboundActivity = connectStartedAt;
+    
+    writePending();
 }
 
+void MQTTClient::onConnected(bool sessionPresent) {
+    state = MQTT_STATE_CONNECTED;
+    Serial.printf("[MQTT] Conectado al broker MQTT (sesión previa: %s)\n", sessionPresent ? "sí" : "no");
+    
+    // Solo el topic de comandos propio: suscribirse a MQTT_TOPIC hacía que el
+    // dispositivo recibiera de vuelta cada publicación de detecciones. Mismo
+    // id que anuncian los payloads (ESP32_xxxxxx si no hay subLocation).
+    String deviceTopic = String(MQTT_DEVICE_TOPIC_PREFIX) + getDeviceId();
+    commandTopic = deviceTopic + "/cmd";
+    statusTopic = deviceTopic + "/status";
+    registerAckTopic = deviceTopic + "/register_ack";
+    sendSubscribe(commandTopic.c_str(), 1);
+    sendSubscribe(registerAckTopic.c_str(), 1);
+    
+    size_t pending = 0;
+    for (const OutboundMessage& message : outbound) {
+        if (message.dup) {
+            pending++;
+        }
+    }
+    if (pending > 0) {
+        Serial.printf("[MQTT] Retransmitiendo %d mensajes QoS 1 sin confirmar\n", pending);
+    }
+}
+
+void MQTTClient::dropConnection(const char* reason) {
+    if (state == MQTT_STATE_DISCONNECTED) {
+        return;
+    }
+    
+    Serial.printf("[MQTT] Conexión cerrada: %s\n", reason);
+    wifiClient.stop();
+    state = MQTT_STATE_DISCONNECTED;
+    txBuffer.clear();
+    txOffset = 0;
+    rxBuffer.clear();
+    rxDiscard = 0;
+    pingOutstanding = false;
+    
+    // QoS 1 enviados sin PUBACK se retransmiten con DUP; QoS 0 sin enviar se descartan
+    std::vector<uint32_t> dropped;
+    for (auto it = outbound.begin(); it != outbound.end();) {
+        if (it->qos == 0) {
+            if (it->deliveryId != 0) {
+                dropped.push_back(it->deliveryId);
+            }
+            it = outbound.erase(it);
+            continue;
+        }
+        if (it->sent) {
+            it->sent = false;
+            it->dup = true;
+        }
+        ++it;
+    }
+    reportDeliveries(dropped, false);
+}
+
+// ==================== Loop (dirigido por disponibilidad del socket) ====================
 void MQTTClient::loop() {
     if (!ENABLE_MQTT) {
         return;
     }
     
-    if (!mqttClient.connected()) {
+    if (state == MQTT_STATE_DISCONNECTED) {
         reconnect();
-    } else {
-        mqttClient.loop();
+        return;
+    }
+    
+    if (!wifiClient.connected()) {
+        dropConnection("socket desconectado");
+        return;
+    }
+    
+    readIncoming();
+    if (state == MQTT_STATE_DISCONNECTED) {
+        return;
     }
+    
+    if (state == MQTT_STATE_CONNECTED) {
+        flushOutbound();
+    }
+    writePending();
+    checkTimeouts();
 }
 
-bool MQTTClient::publish(const char* topic, const char* payload) {
-    if (!mqttClient.connected()) {
-        Serial.println("[MQTT] No conectado, no se puede publicar");
-        return false;
+void MQTTClient::checkTimeouts() {
+    if (state == MQTT_STATE_DISCONNECTED) {
+        return;
+    }
+    
+    unsigned long now = millis();
+    
+    if (state == MQTT_STATE_CONNECTING) {
+        if (now - connectStartedAt > MQTT_CONNACK_TIMEOUT) {
+            dropConnection("sin CONNACK");
+        }
+        return;
+    }
+    
+    for (const OutboundMessage& message : outbound) {
+        if (message.qos > 0 && message.sent && now - message.sentAt > MQTT_ACK_TIMEOUT) {
+            dropConnection("PUBACK no recibido");
+            return;
+        }
+    }
+    
+    // El plazo del PINGRESP corre desde el PINGREQ, no desde lo último recibido
+    if (pingOutstanding && now - pingSentAt > MQTT_PINGRESP_TIMEOUT) {
+        dropConnection("sin PINGRESP");
+        return;
+    }
+    
+    unsigned long keepAliveMs = (unsigned long)MQTT_KEEPALIVE_SECONDS * 1000UL;
+    
+    if (!pingOutstanding && txBuffer.empty() &&
+        (now - lastOutboundActivity >= keepAliveMs || now - lastInboundActivity >= keepAliveMs)) {
+        appendPacket(MQTT_PINGREQ, std::vector<uint8_t>());
+        pingOutstanding = true;
+        pingSentAt = now;
+        writePending();
     }
-    return mqttClient.publish(topic, payload);
 }
 
-String MQTTClient::createDetectionsPayload(const std::map<String, BeaconData>& beacons) {
-    StaticJsonDocument<2048> doc;
+// ==================== Lectura y Parseo ====================
+void MQTTClient::readIncoming() {
+    uint8_t chunk[256];
     
-    String currentLocation = LOADED_ZONE_NAME.length() > 0 ? LOADED_ZONE_NAME : LOADED_SUB_LOCATION;
-    
-    // Obtener la dirección MAC del ESP32
-    String macAddress = WiFi.macAddress();
+    while (wifiClient.available() > 0) {
+        int n = wifiClient.read(chunk, sizeof(chunk));
+        if (n <= 0) {
+            break;
+        }
+        lastInboundActivity = millis();
+        
+        size_t offset = 0;
+        if (rxDiscard > 0) {
+            size_t skip = min((size_t)n, rxDiscard);
+            rxDiscard -= skip;
+            offset = skip;
+        }
+        rxBuffer.insert(rxBuffer.end(), chunk + offset, chunk + n);
+        
+        while (parsePacket()) {
+            if (state == MQTT_STATE_DISCONNECTED) {
+                return;
+            }
+        }
+    }
+}
+
+// Extrae un paquete completo de rxBuffer. Devuelve false si faltan bytes.
+bool MQTTClient::parsePacket() {
+    if (rxBuffer.size() < 2) {
+        return false;
+    }
     
-    // Extraer location del sondeador desde LOADED_SUB_LOCATION (formato: "tipo/location")
-    String deviceLocation = currentLocation; // Fallback a zona si no hay sublocation
-    if (LOADED_SUB_LOCATION.length() > 0) {
-        int slashPos = LOADED_SUB_LOCATION.indexOf('/');
-        if (slashPos > 0) {
-            deviceLocation = LOADED_SUB_LOCATION.substring(slashPos + 1); // Extraer "Comedero A" de "master/Comedero A"
+    size_t remaining = 0;
+    size_t multiplier = 1;
+    size_t pos = 1;
+    uint8_t encoded;
+    do {
+        if (pos >= rxBuffer.size()) {
+            return false;
+        }
+        if (pos > 4) {
+            dropConnection("longitud de paquete inválida");
+            return false;
         }
+        encoded = rxBuffer[pos++];
+        remaining += (encoded & 0x7F) * multiplier;
+        multiplier *= 128;
+    } while (encoded & 0x80);
+    
+    if (remaining > MQTT_MAX_PACKET_SIZE) {
+        // Paquete demasiado grande: descartar su contenido a medida que llegue
+        size_t available = rxBuffer.size() - pos;
+        size_t skip = min(available, remaining);
+        rxDiscard = remaining - skip;
+        rxBuffer.erase(rxBuffer.begin(), rxBuffer.begin() + pos + skip);
+        Serial.printf("[MQTT] Paquete de %d bytes descartado (máx %d)\n", remaining, MQTT_MAX_PACKET_SIZE);
+        return !rxBuffer.empty();
     }
     
-    doc["mac_address"] = macAddress;
-    doc["zone_name"] = currentLocation;
-    doc["timestamp"] = apiClient.getCurrentEpoch();
+    if (rxBuffer.size() - pos < remaining) {
+        return false;
+    }
     
-    JsonArray detectionsArray = doc.createNestedArray("detections");
+    handlePacket(rxBuffer[0], rxBuffer.data() + pos, remaining);
+    if (state != MQTT_STATE_DISCONNECTED) {
+        rxBuffer.erase(rxBuffer.begin(), rxBuffer.begin() + pos + remaining);
+    }
+    return true;
+}
+
+void MQTTClient::handlePacket(uint8_t header, const uint8_t* body, size_t length) {
+    switch (header & 0xF0) {
+        case MQTT_CONNACK: {
+            if (length < 2) {
+                dropConnection("CONNACK inválido");
+                return;
+            }
+            if (body[1] != 0) {
+                Serial.printf("[MQTT] Error al conectar. Código: %d\n", body[1]);
+                dropConnection("conexión rechazada");
+                return;
+            }
+            onConnected(body[0] & 0x01);
+            break;
+        }
+        
+        case MQTT_PUBACK: {
+            if (length < 2) {
+                return;
+            }
+            uint16_t packetId = (body[0] << 8) | body[1];
+            for (auto it = outbound.begin(); it != outbound.end(); ++it) {
+                if (it->qos > 0 && it->sent && it->packetId == packetId) {
+                    Serial.printf("[MQTT] PUBACK #%u (%lu ms)\n", packetId, millis() - it->sentAt);
+                    std::vector<uint32_t> acked;
+                    if (it->deliveryId != 0) {
+                        acked.push_back(it->deliveryId);
+                    }
+                    outbound.erase(it);
+                    reportDeliveries(acked, true);
+                    break;
+                }
+            }
+            break;
+        }
+        
+        case MQTT_PUBLISH: {
+            uint8_t qos = (header >> 1) & 0x03;
+            if (length < 2) {
+                return;
+            }
+            size_t topicLength = (body[0] << 8) | body[1];
+            size_t pos = 2 + topicLength;
+            if (pos > length) {
+                return;
+            }
+            uint16_t packetId = 0;
+            if (qos > 0) {
+                if (pos + 2 > length) {
+                    return;
+                }
+                packetId = (body[pos] << 8) | body[pos + 1];
+                pos += 2;
+            }
+            
+            String topic;
+            topic.concat((const char*)body + 2, topicLength);
+            std::vector<uint8_t> payload(body + pos, body + length);
+            payload.push_back(0);  // Terminador para consumidores de texto
+            messageCallback((char*)topic.c_str(), payload.data(), length - pos);
+            
+            if (qos == 1) {
+                std::vector<uint8_t> ack;
+                appendUint16(ack, packetId);
+                appendPacket(MQTT_PUBACK, ack);
+            }
+            break;
+        }
+        
+        case MQTT_SUBACK:
+            Serial.println("[MQTT] Suscripción confirmada");
+            break;
+        
+        case MQTT_PINGRESP:
+            pingOutstanding = false;
+            break;
+        
+        default:
+            break;
+    }
+}
+
+// ==================== Escritura ====================
+void MQTTClient::flushOutbound() {
+    size_t inFlight = getInFlightCount();
+    std::vector<uint32_t> written;  // QoS 0: entregados al escribirse
     
-    for (const auto& pair : beacons) {
-        const BeaconData& beacon = pair.second;
+    for (auto it = outbound.begin(); it != outbound.end();) {
+        if (txBuffer.size() - txOffset >= MQTT_TX_BUFFER_LIMIT) {
+            break;
+        }
+        if (it->sent) {
+            ++it;
+            continue;
+        }
+        if (it->qos > 0 && inFlight >= (size_t)MQTT_INFLIGHT_WINDOW) {
+            break;  // Ventana llena: esperar PUBACKs
+        }
         
-        JsonObject detection = detectionsArray.createNestedObject();
-        detection["tag_id"] = beacon.animalId;
+        std::vector<uint8_t> body;
+        appendString(body, it->topic.c_str());
+        if (it->qos > 0) {
+            appendUint16(body, it->packetId);
+        }
+        body.insert(body.end(), it->payload.begin(), it->payload.end());
         
-        // Usar la ubicación específica del beacon (puede ser del maestro o esclavo)
-        String beaconLocation = (beacon.detectedLocation.length() > 0) 
-                                ? beacon.detectedLocation 
-                                : deviceLocation; // Fallback a ubicación del maestro
-        detection["device_location"] = beaconLocation;
+        uint8_t header = MQTT_PUBLISH | (it->qos << 1) | (it->dup ? 0x08 : 0x00);
+        appendPacket(header, body);
         
-        detection["distance"] = round(beacon.distance * 100) / 100.0;
-        detection["rssi"] = beacon.rssi;
+        if (it->qos == 0) {
+            if (it->deliveryId != 0) {
+                written.push_back(it->deliveryId);
+            }
+            it = outbound.erase(it);
+            continue;
+        }
+        
+        it->sent = true;
+        it->sentAt = millis();
+        inFlight++;
+        ++it;
     }
     
-    String payload;
-    serializeJson(doc, payload);
-    return payload;
+    reportDeliveries(written, true);
 }
 
-bool MQTTClient::sendDetections(const std::map<String, BeaconData>& beacons) {
-    if (!ENABLE_MQTT) {
+// Se llama después de modificar la cola para que el callback pueda volver a publicar
+void MQTTClient::reportDeliveries(const std::vector<uint32_t>& deliveryIds, bool success) {
+    if (!deliveryCallback) {
+        return;
+    }
+    for (uint32_t deliveryId : deliveryIds) {
+        deliveryCallback(deliveryId, success, 0);
+    }
+}
+
+void MQTTClient::writePending() {
+    while (txOffset < txBuffer.size()) {
+        if (!wifiClient.isWritable()) {
+            return;  // Buffer de envío lleno: continuar en el próximo loop()
+        }
+        
+        size_t chunk = min(txBuffer.size() - txOffset, MQTT_WRITE_CHUNK);
+        size_t written = wifiClient.write(txBuffer.data() + txOffset, chunk);
+        if (written == 0) {
+            dropConnection("error de escritura");
+            return;
+        }
+        txOffset += written;
+        lastOutboundActivity = millis();
+    }
+    
+    txBuffer.clear();
+    txOffset = 0;
+}
+
+void MQTTClient::sendSubscribe(const char* topic, uint8_t qos) {
+    std::vector<uint8_t> body;
+    appendUint16(body, allocatePacketId());
+    appendString(body, topic);
+    body.push_back(qos);
+    appendPacket(MQTT_SUBSCRIBE, body);
+}
+
+void MQTTClient::appendPacket(uint8_t header, const std::vector<uint8_t>& body) {
+    txBuffer.push_back(header);
+    
+    size_t remaining = body.size();
+    do {
+        uint8_t encoded = remaining % 128;
+        remaining /= 128;
+        if (remaining > 0) {
+            encoded |= 0x80;
+        }
+        txBuffer.push_back(encoded);
+    } while (remaining > 0);
+    
+    txBuffer.insert(txBuffer.end(), body.begin(), body.end());
+}
+
+void MQTTClient::appendString(std::vector<uint8_t>& out, const char* value) {
+    size_t length = strlen(value);
+    appendUint16(out, length);
+    out.insert(out.end(), value, value + length);
+}
+
+void MQTTClient::appendUint16(std::vector<uint8_t>& out, uint16_t value) {
+    out.push_back(value >> 8);
+    out.push_back(value & 0xFF);
+}
+
+uint16_t MQTTClient::allocatePacketId() {
+    uint16_t id = nextPacketId++;
+    if (nextPacketId == 0) {
+        nextPacketId = 1;
+    }
+    return id;
+}
+
+size_t MQTTClient::getInFlightCount() const {
+    size_t count = 0;
+    for (const OutboundMessage& message : outbound) {
+        if (message.qos > 0 && message.sent) {
+            count++;
+        }
+    }
+    return count;
+}
+
+// ==================== Publicación ====================
+bool MQTTClient::enqueue(const char* topic, const uint8_t* payload, size_t length, uint8_t qos, uint32_t deliveryId) {
+    // QoS 0 solo tiene sentido con sesión activa; QoS 1 se encola y se entrega al reconectar
+    if (qos == 0 && !isConnected()) {
+        Serial.println("[MQTT] No conectado, no se puede publicar");
+        return false;
+    }
+    
+    if (outbound.size() >= MQTT_MAX_QUEUED_MESSAGES) {
+        Serial.printf("[MQTT] Cola llena (%d mensajes), publicación rechazada\n", outbound.size());
         return false;
     }
     
+    OutboundMessage message;
+    message.qos = qos > 0 ? 1 : 0;
+    message.packetId = message.qos > 0 ? allocatePacketId() : 0;
+    message.deliveryId = deliveryId;
+    message.sent = false;
+    message.dup = false;
+    message.sentAt = 0;
+    message.topic = topic;
+    message.payload.assign(payload, payload + length);
+    outbound.push_back(message);
+    
+    if (isConnected()) {
+        flushOutbound();
+        writePending();
+    }
+    return true;
+}
+
+bool MQTTClient::publish(const char* topic, const char* payload, uint8_t qos) {
+    return enqueue(topic, (const uint8_t*)payload, strlen(payload), qos);
+}
+
+bool MQTTClient::publishBinary(const char* topic, const uint8_t* payload, size_t length, uint8_t qos) {
+    bool queued = enqueue(topic, payload, length, qos);
+    if (queued) {
+        Serial.printf("[MQTT] Lote encolado en %s (%d bytes)\n", topic, length);
+    }
+    return queued;
+}
+
+uint32_t MQTTClient::sendDetections(const String& payload) {
+    if (!ENABLE_MQTT) {
+        return 0;
+    }
+    
     if (!isConnected()) {
         Serial.println("[MQTT] No conectado al broker");
-        if (!reconnect()) {
-            return false;
-        }
+        reconnect();
     }
     
-    String payload = createDetectionsPayload(beacons);
-    
     Serial.println("\n========================================");
-    Serial.printf("  Publicando en MQTT: %s\n", MQTT_TOPIC);
+    Serial.printf("  Publicando en MQTT: %s (QoS %d)\n", MQTT_TOPIC, MQTT_DETECTIONS_QOS);
     Serial.println("========================================");
     Serial.printf("[MQTT] Payload:\n%s\n\n", payload.c_str());
     
-    bool success = mqttClient.publish(MQTT_TOPIC, payload.c_str());
+    uint32_t deliveryId = nextDeliveryId++;
+    if (nextDeliveryId == 0) {
+        nextDeliveryId = 1;
+    }
     
-    if (success) {
-        Serial.println("[MQTT] Datos publicados correctamente");
-        return true;
-    } else {
+    if (!enqueue(MQTT_TOPIC, (const uint8_t*)payload.c_str(), payload.length(), MQTT_DETECTIONS_QOS, deliveryId)) {
         Serial.println("[MQTT] Error al publicar datos");
-        return false;
+        return 0;
     }
+    
+    Serial.printf("[MQTT] Datos encolados (%d en vuelo, %d en cola)\n", getInFlightCount(), getQueuedCount());
+    return deliveryId;
+}
+
+// Retira un mensaje aún no transmitido; los que ya están en vuelo no se tocan
+bool MQTTClient::cancel(uint32_t deliveryId) {
+    for (auto it = outbound.begin(); it != outbound.end(); ++it) {
+        if (it->deliveryId == deliveryId) {
+            if (it->sent || it->dup) {
+                return false;  // El broker pudo haberlo recibido ya
+            }
+            outbound.erase(it);
+            return true;
+        }
+    }
+    return false;
 }
 
 void MQTTClient::messageCallback(char* topic, byte* payload, unsigned int length) {
@@ -163,4 +635,18 @@ void MQTTClient::messageCallback(char* topic, byte* payload, unsigned int length
         Serial.print((char)payload[i]);
     }
     Serial.println();
+    
+    if (registerAckTopic == topic) {
+        registrationEngine.handleAck((const char*)payload, length);
+        return;
+    }
+    
+    if (commandTopic != topic) {
+        return;
+    }
+    
+    String reply;
+    runtimeConfig.handleCommand((const char*)payload, length, reply);
+    Serial.printf("[MQTT] Respuesta de comando: %s\n", reply.c_str());
+    publish(statusTopic.c_str(), reply.c_str(), 1);
 }
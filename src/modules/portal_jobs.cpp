@@ -0,0 +1,138 @@
+#include "portal_jobs.h"
+
+PortalJobs portalJobs;
+
+PortalJobs::PortalJobs()
+    : nextId(1) {
+    lock = xSemaphoreCreateMutex();
+    for (Slot& slot : slots) {
+        slot.id = 0;
+        slot.state = PORTAL_JOB_UNKNOWN;
+        slot.name = "";
+        slot.finishedAt = 0;
+    }
+}
+
+// Llamado desde la tarea del servidor HTTP
+uint32_t PortalJobs::submit(const char* name, PortalJobWork work) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    Slot* slot = allocate();
+    uint32_t id = 0;
+    if (slot != nullptr) {
+        id = nextId++;
+        if (nextId == 0) {
+            nextId = 1;
+        }
+        slot->id = id;
+        slot->state = PORTAL_JOB_PENDING;
+        slot->name = name;
+        slot->work = work;
+        slot->result = "";
+        slot->finishedAt = 0;
+    }
+    xSemaphoreGive(lock);
+
+    if (id == 0) {
+        Serial.printf("[Portal] Cola de trabajos llena, rechazando '%s'\n", name);
+    } else {
+        Serial.printf("[Portal] Trabajo #%lu '%s' encolado\n", (unsigned long)id, name);
+    }
+    return id;
+}
+
+PortalJobState PortalJobs::poll(uint32_t id, String& result) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    Slot* slot = findSlot(id);
+    PortalJobState state = PORTAL_JOB_UNKNOWN;
+    if (slot != nullptr) {
+        state = slot->state;
+        if (state == PORTAL_JOB_DONE) {
+            result = slot->result;
+        }
+    }
+    xSemaphoreGive(lock);
+    return state;
+}
+
+// Ejecuta el trabajo pendiente más antiguo. Bloquea lo que dure el trabajo,
+// pero el servidor HTTP y el DNS siguen atendiendo desde sus propias tareas.
+void PortalJobs::runPending() {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    Slot* next = nullptr;
+    for (Slot& slot : slots) {
+        if (slot.state == PORTAL_JOB_PENDING && (next == nullptr || slot.id < next->id)) {
+            next = &slot;
+        }
+    }
+    PortalJobWork work;
+    uint32_t id = 0;
+    const char* name = "";
+    if (next != nullptr) {
+        next->state = PORTAL_JOB_RUNNING;
+        work = next->work;
+        next->work = nullptr;
+        id = next->id;
+        name = next->name;
+    }
+    xSemaphoreGive(lock);
+
+    if (!work) {
+        return;
+    }
+
+    unsigned long start = millis();
+    String result = work();
+    Serial.printf("[Portal] Trabajo #%lu '%s' terminado en %lu ms\n", (unsigned long)id, name, millis() - start);
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    Slot* slot = findSlot(id);
+    if (slot != nullptr) {
+        slot->result = result;
+        slot->state = PORTAL_JOB_DONE;
+        slot->finishedAt = millis();
+    }
+    xSemaphoreGive(lock);
+}
+
+void PortalJobs::clear() {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (Slot& slot : slots) {
+        slot.id = 0;
+        slot.state = PORTAL_JOB_UNKNOWN;
+        slot.work = nullptr;
+        slot.result = "";
+    }
+    xSemaphoreGive(lock);
+}
+
+PortalJobs::Slot* PortalJobs::findSlot(uint32_t id) {
+    if (id == 0) {
+        return nullptr;
+    }
+    for (Slot& slot : slots) {
+        if (slot.id == id && slot.state != PORTAL_JOB_UNKNOWN) {
+            return &slot;
+        }
+    }
+    return nullptr;
+}
+
+// Slot libre; si no hay, reutiliza el resultado terminado más viejo.
+// Nunca pisa trabajos pendientes o en curso.
+PortalJobs::Slot* PortalJobs::allocate() {
+    Slot* oldestDone = nullptr;
+    for (Slot& slot : slots) {
+        if (slot.state == PORTAL_JOB_UNKNOWN) {
+            return &slot;
+        }
+        if (slot.state == PORTAL_JOB_DONE) {
+            if (millis() - slot.finishedAt > PORTAL_JOB_RESULT_TTL) {
+                return &slot;
+            }
+            if (oldestDone == nullptr || slot.finishedAt < oldestDone->finishedAt) {
+                oldestDone = &slot;
+            }
+        }
+    }
+    return oldestDone;
+}
@@ -0,0 +1,186 @@
+#include "power_manager.h"
+#include <esp_sleep.h>
+
+PowerManager powerManager;
+
+PowerManager::PowerManager()
+    : enabled(false),
+      sleepFailed(false),
+      radioHolds(0),
+      radioSince(0),
+      cycleStart(0),
+      sleepMs(0),
+      scanMs(0),
+      radioMs(0) {
+#ifdef CONFIG_PM_ENABLE
+    apbLock = nullptr;
+    noSleepLock = nullptr;
+#endif
+}
+
+// ==================== Activación ====================
+void PowerManager::begin() {
+    if (enabled) {
+        return;
+    }
+
+#ifdef CONFIG_PM_ENABLE
+    if (apbLock == nullptr) {
+        esp_pm_lock_create(ESP_PM_APB_FREQ_MAX, 0, "radio", &apbLock);
+        esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "radio_ls", &noSleepLock);
+    }
+    esp_pm_config_esp32_t pmConfig = {};
+    pmConfig.max_freq_mhz = getCpuFrequencyMhz();
+    pmConfig.min_freq_mhz = 40;
+    pmConfig.light_sleep_enable = true;
+    if (esp_pm_configure(&pmConfig) != ESP_OK) {
+        Serial.println("[POWER] No se pudo configurar el gestor de energía");
+    }
+#else
+    setCpuFrequencyMhz(POWER_CPU_MHZ_IDLE);
+#endif
+
+    enabled = true;
+    sleepFailed = false;
+    radioHolds = 0;
+    resetCycle(millis());
+    Serial.printf("[POWER] Bajo consumo activado (CPU %u MHz, batería %.2f V)\n",
+                  getCpuFrequencyMhz(), readBatteryVoltage());
+}
+
+void PowerManager::end() {
+    if (!enabled) {
+        return;
+    }
+
+#ifdef CONFIG_PM_ENABLE
+    while (radioHolds > 0) {
+        releaseRadio();
+    }
+    esp_pm_config_esp32_t pmConfig = {};
+    pmConfig.max_freq_mhz = 240;
+    pmConfig.min_freq_mhz = 240;
+    pmConfig.light_sleep_enable = false;
+    esp_pm_configure(&pmConfig);
+#else
+    setCpuFrequencyMhz(240);
+#endif
+
+    enabled = false;
+    radioHolds = 0;
+    Serial.println("[POWER] Bajo consumo desactivado");
+}
+
+// ==================== Locks de radio ====================
+// Mientras la radio WiFi transmite no se duerme ni se baja el APB
+void PowerManager::acquireRadio() {
+    if (!enabled) {
+        return;
+    }
+    if (radioHolds++ == 0) {
+        radioSince = millis();
+#ifdef CONFIG_PM_ENABLE
+        esp_pm_lock_acquire(apbLock);
+        esp_pm_lock_acquire(noSleepLock);
+#endif
+    }
+}
+
+void PowerManager::releaseRadio() {
+    if (!enabled || radioHolds == 0) {
+        return;
+    }
+    if (--radioHolds == 0) {
+        radioMs += millis() - radioSince;
+#ifdef CONFIG_PM_ENABLE
+        esp_pm_lock_release(noSleepLock);
+        esp_pm_lock_release(apbLock);
+#endif
+    }
+}
+
+// ==================== Reposo del planificador ====================
+// Con un escaneo BLE o la radio en curso no se duerme: se cede un tramo
+// corto para que el fin de la ventana se atienda enseguida
+void PowerManager::idle(unsigned long ms, bool scanning) {
+    if (!enabled || scanning || radioHolds > 0 || sleepFailed || ms < POWER_MIN_SLEEP) {
+        unsigned long slice = max(min(ms, SCHEDULER_IDLE_SLICE), 1UL);
+        delay(slice);
+        if (enabled && scanning) {
+            scanMs += slice;
+        }
+        return;
+    }
+
+    unsigned long start = millis();
+    if (sleep(ms)) {
+        sleepMs += millis() - start;
+    }
+}
+
+bool PowerManager::sleep(unsigned long ms) {
+    // Los botones despiertan por nivel; al volver recuperan el flanco
+    enableButtonWakeup();
+#ifdef CONFIG_PM_ENABLE
+    // Tickless idle: el IDF entra solo en light sleep durante la espera
+    delay(ms);
+    bool slept = true;
+#else
+    Serial.flush();
+    esp_sleep_enable_timer_wakeup((uint64_t)ms * 1000);
+    bool slept = esp_light_sleep_start() == ESP_OK;
+    if (!slept) {
+        // Rechazado (p. ej. por el controlador BT): se sigue sin dormir
+        sleepFailed = true;
+        Serial.println("[POWER] Light sleep rechazado; se continúa sin dormir");
+        delay(ms);
+    }
+#endif
+    restoreButtonInterrupts();
+    return slept;
+}
+
+// ==================== Energía por ciclo ====================
+void PowerManager::endCycle() {
+    if (!enabled) {
+        return;
+    }
+
+    unsigned long now = millis();
+    unsigned long total = now - cycleStart;
+    unsigned long accounted = sleepMs + scanMs + radioMs;
+    unsigned long awake = total > accounted ? total - accounted : 0;
+
+    float voltage = readBatteryVoltage();
+    float supply = voltage > 1.0f ? voltage : POWER_NOMINAL_VOLTAGE;
+    float charge = (sleepMs * POWER_CURRENT_SLEEP_MA +
+                    scanMs * POWER_CURRENT_SCAN_MA +
+                    radioMs * POWER_CURRENT_RADIO_MA +
+                    awake * POWER_CURRENT_ACTIVE_MA) / 1000.0f;  // mA·s
+    float energy = charge * supply;                              // mJ
+
+    Serial.printf("[POWER] Ciclo de %lu ms: ~%.1f mJ (%.2f mA medios) | dormido %lu, BLE %lu, radio %lu, CPU %lu ms | batería %.2f V\n",
+                  total, energy, total > 0 ? charge * 1000.0f / total : 0.0f,
+                  sleepMs, scanMs, radioMs, awake, voltage);
+
+    resetCycle(now);
+}
+
+void PowerManager::resetCycle(unsigned long now) {
+    cycleStart = now;
+    sleepMs = 0;
+    scanMs = 0;
+    radioMs = 0;
+    if (radioHolds > 0) {
+        radioSince = now;
+    }
+}
+
+// Promedio de varias lecturas calibradas; 0 si no hay divisor conectado
+float PowerManager::readBatteryVoltage() {
+    uint32_t total = 0;
+    for (int i = 0; i < BATTERY_ADC_SAMPLES; i++) {
+        total += analogReadMilliVolts(BATTERY_ADC_PIN);
+    }
+    return (total / (float)BATTERY_ADC_SAMPLES) * BATTERY_DIVIDER_RATIO / 1000.0f;
+}
@@ -0,0 +1,150 @@
+#include "registration_engine.h"
+#include <ArduinoJson.h>
+#include "mqtt_client.h"
+
+RegistrationEngine registrationEngine;
+
+RegistrationEngine::RegistrationEngine()
+    : confirmedCount(0),
+      active(false) {
+}
+
+void RegistrationEngine::begin() {
+    records.clear();
+    confirmedCount = 0;
+    active = true;
+    Serial.println("[REGISTRO] Sesión de registro iniciada");
+}
+
+void RegistrationEngine::end() {
+    if (!active) {
+        return;
+    }
+    Serial.printf("[REGISTRO] Sesión finalizada: %d confirmados, %d sin confirmar\n",
+                 confirmedCount, getPendingCount());
+    records.clear();
+    active = false;
+}
+
+size_t RegistrationEngine::getPendingCount() const {
+    return records.size() - confirmedCount;
+}
+
+// ==================== Observación ====================
+void RegistrationEngine::observe(const std::vector<String>& macAddresses) {
+    unsigned long now = millis();
+    
+    for (const String& address : macAddresses) {
+        String key = keyOf(address);
+        
+        auto it = records.find(key);
+        if (it != records.end()) {
+            it->second.lastSeen = now;
+            continue;
+        }
+        
+        if (records.size() >= REGISTRATION_MAX_TRACKED) {
+            Serial.println("[REGISTRO] Límite de beacons en seguimiento alcanzado");
+            continue;
+        }
+        
+        Record record;
+        record.mac = address;
+        record.lastSeen = now;
+        record.lastAnnounced = 0;
+        record.confirmed = false;
+        records[key] = record;
+    }
+}
+
+String RegistrationEngine::keyOf(const String& mac) {
+    String key = mac;
+    key.toUpperCase();
+    return key;
+}
+
+// Publica las MACs nuevas y las pendientes cuyo anuncio ya caducó
+void RegistrationEngine::flush() {
+    unsigned long now = millis();
+    std::vector<String> due;
+    
+    for (auto& entry : records) {
+        Record& record = entry.second;
+        if (record.confirmed) {
+            continue;
+        }
+        
+        bool isNew = record.lastAnnounced == 0;
+        bool needsRefresh = now - record.lastAnnounced >= REGISTRATION_REFRESH_INTERVAL &&
+                            now - record.lastSeen < REGISTRATION_REFRESH_INTERVAL;
+        if (isNew || needsRefresh) {
+            due.push_back(entry.first);
+        }
+    }
+    
+    if (due.empty()) {
+        return;
+    }
+    
+    for (size_t start = 0; start < due.size(); start += REGISTRATION_MACS_PER_MESSAGE) {
+        size_t end = min(start + REGISTRATION_MACS_PER_MESSAGE, due.size());
+        std::vector<String> chunk;
+        for (size_t i = start; i < end; i++) {
+            chunk.push_back(records[due[i]].mac);
+        }
+        
+        if (!publish(chunk)) {
+            return;  // Se reintenta en el próximo ciclo
+        }
+        
+        for (size_t i = start; i < end; i++) {
+            // millis() == 0 marcaría la MAC como nueva otra vez
+            records[due[i]].lastAnnounced = now == 0 ? 1 : now;
+        }
+    }
+}
+
+bool RegistrationEngine::publish(const std::vector<String>& macAddresses) {
+    DynamicJsonDocument doc(256 + macAddresses.size() * 32);
+    doc["zone_id"] = LOADED_ZONE_ID;
+    doc["device_id"] = getDeviceId();
+    
+    JsonArray macsArray = doc.createNestedArray("macs");
+    for (const String& mac : macAddresses) {
+        macsArray.add(mac);
+    }
+    
+    String payload;
+    serializeJson(doc, payload);
+    
+    Serial.printf("[REGISTRO] Anunciando %d MACs: %s\n", macAddresses.size(), payload.c_str());
+    
+    if (!mqttClient.publish(MQTT_REGISTER_TOPIC, payload.c_str(), 1)) {
+        Serial.println("[REGISTRO] Error al publicar MACs");
+        return false;
+    }
+    return true;
+}
+
+// ==================== Confirmación del Backend ====================
+// Payload esperado en <prefijo>/<device_id>/register_ack: {"macs": ["AA:BB:..", ...]}
+void RegistrationEngine::handleAck(const char* payload, size_t length) {
+    DynamicJsonDocument doc(256 + length * 2);
+    DeserializationError error = deserializeJson(doc, payload, length);
+    if (error) {
+        Serial.printf("[REGISTRO] Confirmación inválida: %s\n", error.c_str());
+        return;
+    }
+    
+    size_t acknowledged = 0;
+    for (JsonVariant value : doc["macs"].as<JsonArray>()) {
+        auto it = records.find(keyOf(value.as<String>()));
+        if (it != records.end() && !it->second.confirmed) {
+            it->second.confirmed = true;
+            confirmedCount++;
+            acknowledged++;
+        }
+    }
+    
+    Serial.printf("[REGISTRO] %d MACs confirmadas (%d pendientes)\n", acknowledged, getPendingCount());
+}
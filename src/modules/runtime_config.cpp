@@ -0,0 +1,241 @@
+#include "runtime_config.h"
+#include <Preferences.h>
+
+RuntimeConfig runtimeConfig;
+
+static constexpr uint8_t RUNTIME_SETTINGS_VERSION = 1;
+
+RuntimeConfig::RuntimeConfig() {
+    setDefaults(settings);
+}
+
+void RuntimeConfig::setDefaults(RuntimeSettings& target) const {
+    memset(&target, 0, sizeof(target));
+    target.version = RUNTIME_SETTINGS_VERSION;
+    target.scanDuration = SCAN_DURATION;
+    target.cycleInterval = SCAN_CYCLE_INTERVAL;
+    target.minRssi = MIN_RSSI_THRESHOLD;
+    target.encoding = ENABLE_DETECTION_BATCHING ? ENCODING_BATCH : ENCODING_JSON;
+    
+    if (parseUUID(BEACON_UUID_1, target.uuids[target.uuidCount])) {
+        target.uuidCount++;
+    }
+    if (parseUUID(BEACON_UUID_2, target.uuids[target.uuidCount])) {
+        target.uuidCount++;
+    }
+}
+
+// ==================== Persistencia ====================
+void RuntimeConfig::load() {
+    Preferences prefs;
+    if (!prefs.begin("runtime_cfg", true)) {
+        Serial.println("[Runtime] Sin ajustes guardados, usando valores de compilación");
+        return;
+    }
+    
+    RuntimeSettings stored;
+    size_t length = prefs.getBytes("settings", &stored, sizeof(stored));
+    prefs.end();
+    
+    if (length == sizeof(stored) && stored.version == RUNTIME_SETTINGS_VERSION) {
+        settings = stored;
+        Serial.printf("[Runtime] Ajustes cargados: %s\n", describe().c_str());
+    } else if (length > 0) {
+        Serial.println("[Runtime] Ajustes guardados incompatibles, usando valores de compilación");
+    }
+}
+
+bool RuntimeConfig::save() {
+    Preferences prefs;
+    if (!prefs.begin("runtime_cfg", false)) {
+        return false;
+    }
+    bool ok = prefs.putBytes("settings", &settings, sizeof(settings)) == sizeof(settings);
+    prefs.end();
+    return ok;
+}
+
+// ==================== Filtro de UUID ====================
+bool RuntimeConfig::matchesUUID(const uint8_t* uuid) const {
+    for (uint8_t i = 0; i < settings.uuidCount; i++) {
+        if (memcmp(uuid, settings.uuids[i], 16) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool RuntimeConfig::parseUUID(const String& text, uint8_t* out) {
+    int nibbles = 0;
+    for (unsigned int i = 0; i < text.length(); i++) {
+        char c = text.charAt(i);
+        if (c == '-') {
+            continue;
+        }
+        
+        int value;
+        if (c >= '0' && c <= '9') value = c - '0';
+        else if (c >= 'a' && c <= 'f') value = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') value = c - 'A' + 10;
+        else return false;
+        
+        if (nibbles >= 32) {
+            return false;
+        }
+        if (nibbles % 2 == 0) {
+            out[nibbles / 2] = value << 4;
+        } else {
+            out[nibbles / 2] |= value;
+        }
+        nibbles++;
+    }
+    return nibbles == 32;
+}
+
+// ==================== Comandos Remotos ====================
+// Formato: pares clave=valor separados por ';', espacio o salto de línea.
+//   scan=<s>  interval=<ms>  rssi=<dBm>  uuid=<uuid>[,<uuid>...]  enc=json|batch
+// Verbos: "get" (devuelve ajustes) y "reset" (valores de compilación).
+// Se valida todo el comando antes de aplicar; si algo falla no cambia nada.
+bool RuntimeConfig::handleCommand(const char* payload, size_t length, String& reply) {
+    RuntimeSettings candidate = settings;
+    bool changed = false;
+    
+    size_t pos = 0;
+    while (pos < length) {
+        while (pos < length && (payload[pos] == ';' || payload[pos] == ' ' ||
+                                payload[pos] == '\n' || payload[pos] == '\r')) {
+            pos++;
+        }
+        size_t start = pos;
+        while (pos < length && payload[pos] != ';' && payload[pos] != ' ' &&
+               payload[pos] != '\n' && payload[pos] != '\r') {
+            pos++;
+        }
+        if (pos == start) {
+            break;
+        }
+        
+        String token;
+        token.concat(payload + start, pos - start);
+        
+        if (token == "get") {
+            continue;
+        }
+        if (token == "reset") {
+            setDefaults(candidate);
+            changed = true;
+            continue;
+        }
+        
+        int eq = token.indexOf('=');
+        if (eq <= 0) {
+            reply = "ERR token invalido: " + token;
+            return false;
+        }
+        
+        String key = token.substring(0, eq);
+        String value = token.substring(eq + 1);
+        String error;
+        if (!applySetting(key, value, candidate, error)) {
+            reply = "ERR " + key + ": " + error;
+            return false;
+        }
+        changed = true;
+    }
+    
+    if (candidate.cycleInterval < (uint32_t)candidate.scanDuration * 1000UL + 500UL) {
+        reply = "ERR interval debe superar scan + 500 ms";
+        return false;
+    }
+    
+    if (changed) {
+        settings = candidate;
+        if (!save()) {
+            Serial.println("[Runtime] Advertencia: no se pudieron guardar los ajustes en NVS");
+        }
+        Serial.printf("[Runtime] Ajustes aplicados: %s\n", describe().c_str());
+    }
+    
+    reply = "OK " + describe();
+    return true;
+}
+
+bool RuntimeConfig::applySetting(const String& key, const String& value, RuntimeSettings& target, String& error) const {
+    if (key == "scan") {
+        long seconds = value.toInt();
+        if (seconds < 1 || seconds > 30) {
+            error = "rango 1..30 s";
+            return false;
+        }
+        target.scanDuration = seconds;
+    } else if (key == "interval") {
+        long interval = value.toInt();
+        if (interval < 1000 || interval > 600000) {
+            error = "rango 1000..600000 ms";
+            return false;
+        }
+        target.cycleInterval = interval;
+    } else if (key == "rssi") {
+        long rssi = value.toInt();
+        if (rssi < -110 || rssi > -30) {
+            error = "rango -110..-30 dBm";
+            return false;
+        }
+        target.minRssi = rssi;
+    } else if (key == "enc") {
+        if (value == "json") {
+            target.encoding = ENCODING_JSON;
+        } else if (value == "batch") {
+            target.encoding = ENCODING_BATCH;
+        } else {
+            error = "valores: json|batch";
+            return false;
+        }
+    } else if (key == "uuid") {
+        uint8_t count = 0;
+        int start = 0;
+        while (start <= (int)value.length()) {
+            int comma = value.indexOf(',', start);
+            int end = comma < 0 ? value.length() : comma;
+            if (count >= MAX_BEACON_UUIDS) {
+                error = "maximo " + String(MAX_BEACON_UUIDS) + " UUIDs";
+                return false;
+            }
+            if (!parseUUID(value.substring(start, end), target.uuids[count])) {
+                error = "UUID invalido";
+                return false;
+            }
+            count++;
+            if (comma < 0) {
+                break;
+            }
+            start = comma + 1;
+        }
+        target.uuidCount = count;
+    } else {
+        error = "clave desconocida";
+        return false;
+    }
+    return true;
+}
+
+String RuntimeConfig::describe() const {
+    String text = "scan=" + String(settings.scanDuration) +
+                  ";interval=" + String(settings.cycleInterval) +
+                  ";rssi=" + String(settings.minRssi) +
+                  ";enc=" + String(settings.encoding == ENCODING_BATCH ? "batch" : "json") +
+                  ";uuid=";
+    
+    for (uint8_t i = 0; i < settings.uuidCount; i++) {
+        char hex[33];
+        for (int b = 0; b < 16; b++) {
+            snprintf(hex + b * 2, 3, "%02X", settings.uuids[i][b]);
+        }
+        if (i > 0) {
+            text += ",";
+        }
+        text += hex;
+    }
+    return text;
+}
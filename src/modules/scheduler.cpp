@@ -0,0 +1,176 @@
+#include "scheduler.h"
+
+Scheduler scheduler;
+
+Scheduler::Scheduler()
+    : count(0),
+      lastReport(0),
+      idleSlice(SCHEDULER_IDLE_SLICE),
+      idleHandler(nullptr) {
+}
+
+int Scheduler::add(const char* name, unsigned long period, unsigned long budget, SchedulerJob job) {
+    if (count >= SCHEDULER_MAX_JOBS) {
+        Serial.printf("[SCHED] Sin espacio para el trabajo '%s'\n", name);
+        return -1;
+    }
+
+    Job& slot = jobs[count];
+    slot.name = name;
+    slot.work = job;
+    slot.period = period;
+    slot.budget = budget;
+    slot.nextRun = millis();
+    slot.pending = false;
+    slot.armed = false;
+    slot.runAtTime = 0;
+    slot.runs = 0;
+    slot.overruns = 0;
+    slot.maxDuration = 0;
+    slot.maxLateness = 0;
+    return count++;
+}
+
+void Scheduler::setPeriod(int id, unsigned long period) {
+    if (id < 0 || id >= count || jobs[id].period == period) {
+        return;
+    }
+    // Si el período se alarga, el próximo vencimiento se corre con él
+    jobs[id].nextRun += period - jobs[id].period;
+    jobs[id].period = period;
+}
+
+// Escribir un bool es atómico: se puede llamar desde callbacks de otras tareas
+void Scheduler::trigger(int id) {
+    if (id >= 0 && id < count) {
+        jobs[id].pending = true;
+    }
+}
+
+// Una sola ejecución a la hora indicada (millis); reemplaza la anterior
+void Scheduler::runAt(int id, unsigned long when) {
+    if (id >= 0 && id < count) {
+        jobs[id].runAtTime = when;
+        jobs[id].armed = true;
+    }
+}
+
+bool Scheduler::isArmedDue(const Job& job, unsigned long now) {
+    return job.armed && (long)(now - job.runAtTime) >= 0;
+}
+
+// ==================== Vuelta del loop ====================
+// Los trabajos se revisan en orden de registro, así que los primeros (escaneo,
+// botones) no esperan detrás de uno lento que ya haya corrido en esta vuelta
+void Scheduler::run() {
+    for (int i = 0; i < count; i++) {
+        Job& job = jobs[i];
+        unsigned long now = millis();
+        bool due = job.period > 0 && (long)(now - job.nextRun) >= 0;
+        if (job.pending || due || isArmedDue(job, now)) {
+            runJob(job, now);
+        }
+    }
+
+    unsigned long now = millis();
+    if (now - lastReport >= SCHEDULER_REPORT_INTERVAL) {
+        report(now);
+    }
+
+    unsigned long idle = idleTime(millis());
+    if (idleHandler) {
+        idleHandler(idle);
+        return;
+    }
+    // Siempre se cede al menos 1 ms para que corra la tarea idle (watchdog)
+    delay(max(idle, 1UL));
+}
+
+void Scheduler::runJob(Job& job, unsigned long now) {
+    bool triggered = job.pending;
+    job.pending = false;
+    if (isArmedDue(job, now)) {
+        // Se desarma antes de ejecutar para que el trabajo pueda volver a programarse
+        job.armed = false;
+        triggered = true;
+    }
+
+    if (!triggered) {
+        unsigned long lateness = now - job.nextRun;
+        if (lateness > job.maxLateness) {
+            job.maxLateness = lateness;
+        }
+    }
+
+    unsigned long start = micros();
+    job.work();
+    unsigned long duration = (micros() - start) / 1000;
+
+    job.runs++;
+    if (duration > job.maxDuration) {
+        job.maxDuration = duration;
+    }
+    if (duration > job.budget) {
+        job.overruns++;
+        // Un aviso por ventana de informe; el resto queda en el contador
+        if (job.overruns == 1) {
+            Serial.printf("[SCHED] '%s' tardó %lu ms (presupuesto %lu ms)\n", job.name, duration, job.budget);
+        }
+    }
+
+    if (job.period > 0 && !triggered) {
+        // Ritmo fijo; si quedó más de un período atrás, se resincroniza sin ráfagas
+        job.nextRun += job.period;
+        unsigned long after = millis();
+        if ((long)(after - job.nextRun) >= 0) {
+            job.nextRun = after + job.period;
+        }
+    }
+}
+
+unsigned long Scheduler::idleTime(unsigned long now) const {
+    unsigned long idle = idleSlice;
+    for (int i = 0; i < count; i++) {
+        const Job& job = jobs[i];
+        if (job.pending) {
+            return 0;
+        }
+        if (job.armed) {
+            long remaining = (long)(job.runAtTime - now);
+            if (remaining <= 0) {
+                return 0;
+            }
+            if ((unsigned long)remaining < idle) {
+                idle = remaining;
+            }
+        }
+        if (job.period == 0) {
+            continue;
+        }
+        long remaining = (long)(job.nextRun - now);
+        if (remaining <= 0) {
+            return 0;
+        }
+        if ((unsigned long)remaining < idle) {
+            idle = remaining;
+        }
+    }
+    return idle;
+}
+
+// ==================== Informe de tiempos ====================
+void Scheduler::report(unsigned long now) {
+    lastReport = now;
+
+    for (int i = 0; i < count; i++) {
+        Job& job = jobs[i];
+        if (job.overruns > 0) {
+            Serial.printf("[SCHED] '%s': %u ejecuciones, %u sobre presupuesto (%lu ms), máx %lu ms, retraso máx %lu ms\n",
+                          job.name, job.runs, job.overruns, job.budget, job.maxDuration, job.maxLateness);
+        }
+        job.runs = 0;
+        job.overruns = 0;
+        job.maxDuration = 0;
+        job.maxLateness = 0;
+    }
+}
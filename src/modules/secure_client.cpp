@@ -0,0 +1,269 @@
+#include "secure_client.h"
+#include "dns_resolver.h"
+#include <Preferences.h>
+#include <freertos/semphr.h>
+#include <lwip/sockets.h>
+#include <vector>
+
+TLSSessionCache tlsSessionCache;
+
+// Sesión a ofrecer en el próximo mbedtls_ssl_setup(). Protegida por
+// handshakeMutex: solo un handshake a la vez la puede armar.
+static mbedtls_ssl_session* pendingSession = nullptr;
+static SemaphoreHandle_t handshakeMutex = nullptr;
+
+// ssl_client.cpp (WiFiClientSecure) no expone un punto para inyectar la sesión
+// antes del handshake. Con -Wl,--wrap=mbedtls_ssl_setup (platformio.ini) se
+// intercepta la llamada y se aplica la sesión justo después del setup.
+extern "C" int __real_mbedtls_ssl_setup(mbedtls_ssl_context* ssl, const mbedtls_ssl_config* conf);
+
+extern "C" int __wrap_mbedtls_ssl_setup(mbedtls_ssl_context* ssl, const mbedtls_ssl_config* conf) {
+    int ret = __real_mbedtls_ssl_setup(ssl, conf);
+    if (ret == 0 && pendingSession != nullptr) {
+        if (mbedtls_ssl_set_session(ssl, pendingSession) != 0) {
+            Serial.println("[TLS] No se pudo aplicar la sesión guardada");
+        }
+    }
+    return ret;
+}
+
+// ==================== Cache de Sesiones ====================
+TLSSessionCache::TLSSessionCache() : persistedLoaded(false) {
+    for (Entry& entry : entries) {
+        mbedtls_ssl_session_init(&entry.session);
+        entry.valid = false;
+        entry.persistedHash = 0;
+        entry.lastUsed = 0;
+    }
+}
+
+TLSSessionCache::Entry* TLSSessionCache::findEntry(const String& key) {
+    for (Entry& entry : entries) {
+        if (entry.key == key) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+TLSSessionCache::Entry* TLSSessionCache::allocateEntry(const String& key) {
+    Entry* target = findEntry(key);
+    if (target != nullptr) {
+        return target;
+    }
+
+    // Reutilizar una entrada libre o la usada hace más tiempo
+    target = &entries[0];
+    for (Entry& entry : entries) {
+        if (entry.key.length() == 0) {
+            target = &entry;
+            break;
+        }
+        if (entry.lastUsed < target->lastUsed) {
+            target = &entry;
+        }
+    }
+
+    mbedtls_ssl_session_free(&target->session);
+    mbedtls_ssl_session_init(&target->session);
+    target->key = key;
+    target->valid = false;
+    target->persistedHash = 0;
+    target->lastUsed = millis();
+    return target;
+}
+
+mbedtls_ssl_session* TLSSessionCache::find(const String& key) {
+    Entry* entry = findEntry(key);
+    if (entry == nullptr && TLS_SESSION_PERSIST) {
+        entry = allocateEntry(key);
+        loadPersisted(*entry);
+    }
+    if (entry == nullptr || !entry->valid) {
+        return nullptr;
+    }
+    entry->lastUsed = millis();
+    return &entry->session;
+}
+
+void TLSSessionCache::store(const String& key, const mbedtls_ssl_context* ssl) {
+    Entry* entry = allocateEntry(key);
+
+    mbedtls_ssl_session_free(&entry->session);
+    mbedtls_ssl_session_init(&entry->session);
+
+    if (mbedtls_ssl_get_session(ssl, &entry->session) != 0) {
+        entry->valid = false;
+        return;
+    }
+
+    entry->valid = true;
+    entry->lastUsed = millis();
+
+    if (TLS_SESSION_PERSIST) {
+        persist(*entry);
+    }
+}
+
+void TLSSessionCache::invalidate(const String& key) {
+    Entry* entry = findEntry(key);
+    if (entry == nullptr) {
+        return;
+    }
+
+    mbedtls_ssl_session_free(&entry->session);
+    mbedtls_ssl_session_init(&entry->session);
+    entry->valid = false;
+
+    if (TLS_SESSION_PERSIST && entry->persistedHash != 0) {
+        Preferences prefs;
+        if (prefs.begin("tls_cache", false)) {
+            prefs.remove(nvsKey(key).c_str());
+            prefs.end();
+        }
+        entry->persistedHash = 0;
+    }
+}
+
+// ==================== Persistencia en NVS ====================
+String TLSSessionCache::nvsKey(const String& key) {
+    char buf[12];
+    snprintf(buf, sizeof(buf), "s%08x", hashBytes((const uint8_t*)key.c_str(), key.length()));
+    return String(buf);
+}
+
+uint32_t TLSSessionCache::hashBytes(const uint8_t* data, size_t length) {
+    uint32_t hash = 2166136261u;  // FNV-1a
+    for (size_t i = 0; i < length; i++) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+void TLSSessionCache::loadPersisted(Entry& entry) {
+    Preferences prefs;
+    if (!prefs.begin("tls_cache", true)) {
+        return;
+    }
+
+    String key = nvsKey(entry.key);
+    size_t length = prefs.getBytesLength(key.c_str());
+    if (length > 0 && length <= TLS_SESSION_MAX_BLOB) {
+        std::vector<uint8_t> blob(length);
+        prefs.getBytes(key.c_str(), blob.data(), length);
+        if (mbedtls_ssl_session_load(&entry.session, blob.data(), length) == 0) {
+            entry.valid = true;
+            entry.persistedHash = hashBytes(blob.data(), length);
+            Serial.printf("[TLS] Sesión restaurada desde NVS para %s\n", entry.key.c_str());
+        } else {
+            mbedtls_ssl_session_free(&entry.session);
+            mbedtls_ssl_session_init(&entry.session);
+        }
+    }
+    prefs.end();
+}
+
+void TLSSessionCache::persist(Entry& entry) {
+    size_t length = 0;
+    mbedtls_ssl_session_save(&entry.session, nullptr, 0, &length);
+    if (length == 0 || length > TLS_SESSION_MAX_BLOB) {
+        return;
+    }
+
+    std::vector<uint8_t> blob(length);
+    if (mbedtls_ssl_session_save(&entry.session, blob.data(), length, &length) != 0) {
+        return;
+    }
+
+    // Solo escribir en flash si la sesión cambió (evita desgaste en cada reanudación)
+    uint32_t hash = hashBytes(blob.data(), length);
+    if (hash == entry.persistedHash) {
+        return;
+    }
+
+    Preferences prefs;
+    if (prefs.begin("tls_cache", false)) {
+        prefs.putBytes(nvsKey(entry.key).c_str(), blob.data(), length);
+        prefs.end();
+        entry.persistedHash = hash;
+    }
+}
+
+// ==================== Cliente TLS ====================
+SecureClient::SecureClient() : lastHandshakeTime(0) {
+}
+
+void SecureClient::setTrustAnchor(const char* rootCA) {
+    if (rootCA != nullptr && strlen(rootCA) > 0) {
+        setCACert(rootCA);  // Verificar solo contra la CA fijada
+    } else {
+        setInsecure();
+    }
+}
+
+// true si el socket acepta más datos sin bloquear (select con timeout 0)
+bool SecureClient::isWritable() {
+    if (sslclient == nullptr || sslclient->socket < 0) {
+        return false;
+    }
+    
+    fd_set writeSet;
+    FD_ZERO(&writeSet);
+    FD_SET(sslclient->socket, &writeSet);
+    struct timeval timeout = {0, 0};
+    return select(sslclient->socket + 1, nullptr, &writeSet, nullptr, &timeout) > 0;
+}
+
+int SecureClient::connect(IPAddress ip, uint16_t port) {
+    String key = ip.toString() + ":" + String(port);
+    return connectWithSession(key, [this, ip, port]() {
+        return WiFiClientSecure::connect(ip, port);
+    });
+}
+
+// El host se resuelve con el cache compartido y se conecta por IP, pasando
+// el nombre para SNI y validación del certificado
+int SecureClient::connect(const char* host, uint16_t port) {
+    String key = String(host) + ":" + String(port);
+    return connectWithSession(key, [this, host, port]() {
+        IPAddress ip;
+        if (!dnsResolver.resolve(host, ip)) {
+            return WiFiClientSecure::connect(host, port);
+        }
+        int result = WiFiClientSecure::connect(ip, port, host, _CA_cert, _cert, _private_key);
+        if (!result) {
+            dnsResolver.invalidate(host);
+        }
+        return result;
+    });
+}
+
+int SecureClient::connectWithSession(const String& sessionKey, std::function<int()> doConnect) {
+    if (handshakeMutex == nullptr) {
+        handshakeMutex = xSemaphoreCreateMutex();
+    }
+
+    xSemaphoreTake(handshakeMutex, portMAX_DELAY);
+
+    mbedtls_ssl_session* cached = tlsSessionCache.find(sessionKey);
+    pendingSession = cached;
+
+    unsigned long start = millis();
+    int result = doConnect();
+    lastHandshakeTime = millis() - start;
+
+    pendingSession = nullptr;
+
+    if (result) {
+        tlsSessionCache.store(sessionKey, &sslclient->ssl_ctx);
+        Serial.printf("[TLS] %s conectado en %lu ms (%s)\n", sessionKey.c_str(), lastHandshakeTime,
+                      cached != nullptr ? "sesión ofrecida" : "handshake completo");
+    } else if (cached != nullptr) {
+        // El servidor pudo rechazar la sesión: no volver a ofrecerla
+        tlsSessionCache.invalidate(sessionKey);
+    }
+
+    xSemaphoreGive(handshakeMutex);
+    return result;
+}
@@ -0,0 +1,389 @@
+#include "tdma_manager.h"
+#include "espnow_manager.h"
+#include "ble_scanner.h"
+#include "runtime_config.h"
+#include "power_manager.h"
+#include "airtime_manager.h"
+#include <esp_system.h>
+
+TDMAManager tdmaManager;
+
+TDMAManager::TDMAManager()
+    : active(false),
+      role(DEVICE_SLAVE),
+      slotCount(0),
+      sequence(0),
+      rxEnd(0),
+      scanStart(0),
+      nextFrame(0),
+      dropped(0),
+      synced(false),
+      missed(0),
+      beaconAt(0),
+      lastHeardAt(0),
+      mySlot(0),
+      radioHeld(false),
+      beaconListened(false),
+      listenUntil(0),
+      nextAcquire(0) {
+    memset(&sync, 0, sizeof(sync));
+    memset(ownMac, 0, sizeof(ownMac));
+}
+
+void TDMAManager::begin(DeviceMode mode) {
+    unsigned long now = millis();
+    role = mode;
+    active = true;
+
+    // Maestro: primera baliza enseguida y sin escaneo hasta entonces
+    slotCount = 0;
+    rxEnd = now;
+    scanStart = now;
+    nextFrame = now;
+    if (mode == DEVICE_MASTER) {
+        airtimeManager.begin();
+    }
+
+    // Esclavo: sin sincronía hasta oír la primera baliza
+    queue.clear();
+    dropped = 0;
+    synced = false;
+    missed = 0;
+    radioHeld = false;
+    beaconListened = false;
+    listenUntil = now + TDMA_ACQUIRE_WINDOW;
+    nextAcquire = now + TDMA_REACQUIRE_INTERVAL;
+    esp_read_mac(ownMac, ESP_MAC_WIFI_STA);
+
+    Serial.printf("[TDMA] Iniciado como %s\n", mode == DEVICE_MASTER ? "MAESTRO" : "ESCLAVO");
+}
+
+// Se llama antes de detener ESP-NOW: solo se sueltan los locks propios
+void TDMAManager::end() {
+    if (!active) {
+        return;
+    }
+    if (radioHeld) {
+        radioHeld = false;
+        powerManager.releaseRadio();
+    }
+    queue.clear();
+    synced = false;
+    active = false;
+    airtimeManager.end();
+}
+
+void TDMAManager::loop() {
+    if (!active) {
+        return;
+    }
+    if (role == DEVICE_MASTER) {
+        loopMaster(millis());
+    } else {
+        loopSlave(millis());
+    }
+}
+
+// ==================== Maestro ====================
+// Segundos de escaneo que caben ahora; 0 si no toca. La ventana BLE va de
+// la ventana de subida a la siguiente baliza. Si el loop llega tarde (un
+// envío HTTPS que bloqueó segundos) se escanea lo que queda de la ventana
+// en vez de perderla entera
+int TDMAManager::scanSeconds() const {
+    int duration = runtimeConfig.getScanDuration();
+    if (!active || role != DEVICE_MASTER) {
+        return duration;
+    }
+    unsigned long now = millis();
+    if ((long)(now - scanStart) < 0 || (long)(nextFrame - now) <= 0) {
+        return 0;
+    }
+
+    unsigned long left = nextFrame - now;
+    if (left >= duration * 1000UL) {
+        return duration;  // Cabe entera: TDMA_SCAN_GUARD absorbe el retraso
+    }
+    if (left < TDMA_SCAN_MIN + TDMA_SCAN_GUARD) {
+        return 0;         // La trama se da por perdida para BLE
+    }
+    return (left - TDMA_SCAN_GUARD) / 1000;
+}
+
+void TDMAManager::loopMaster(unsigned long now) {
+    if ((long)(now - nextFrame) < 0) {
+        return;
+    }
+    if (bleScanner.isScanning()) {
+        return;  // La ventana está por cerrar; nextEvent() reintenta enseguida
+    }
+    updateSlots(now);
+    sendBeacon(now);
+}
+
+void TDMAManager::updateSlots(unsigned long now) {
+    uint8_t heard[MAX_SLAVES][6];
+    int heardCount = espNowManager.takeHeardSlaves(heard, MAX_SLAVES);
+
+    for (int h = 0; h < heardCount; h++) {
+        int found = -1;
+        for (int i = 0; i < slotCount; i++) {
+            if (memcmp(slots[i].mac, heard[h], 6) == 0) {
+                found = i;
+                break;
+            }
+        }
+        if (found >= 0) {
+            slots[found].lastHeard = now;
+        } else if (slotCount < MAX_SLAVES) {
+            memcpy(slots[slotCount].mac, heard[h], 6);
+            slots[slotCount].lastHeard = now;
+            Serial.printf("[TDMA] Slot %d asignado a %02X:%02X:%02X:%02X:%02X:%02X\n", slotCount,
+                          heard[h][0], heard[h][1], heard[h][2], heard[h][3], heard[h][4], heard[h][5]);
+            slotCount++;
+        }
+    }
+
+    // Esclavos que no se oyen hace tiempo liberan su slot; los demás se corren
+    int kept = 0;
+    for (int i = 0; i < slotCount; i++) {
+        if (now - slots[i].lastHeard <= TDMA_SLOT_EXPIRY) {
+            slots[kept++] = slots[i];
+        } else {
+            Serial.printf("[TDMA] Slot liberado: %02X:%02X:%02X:%02X:%02X:%02X\n",
+                          slots[i].mac[0], slots[i].mac[1], slots[i].mac[2],
+                          slots[i].mac[3], slots[i].mac[4], slots[i].mac[5]);
+        }
+    }
+    slotCount = kept;
+}
+
+void TDMAManager::sendBeacon(unsigned long now) {
+    // Slots asignados + uno libre para altas (+ la cola que pida el reparto
+    // del aire), la ventana de subida y luego la ventana BLE completa
+    airtimeManager.planFrame();
+    unsigned long rxWindow = TDMA_RX_OFFSET + (slotCount + 1) * TDMA_SLOT_LENGTH + airtimeManager.getRxTail();
+    unsigned long uplinkWindow = airtimeManager.getUplinkWindow();
+    unsigned long scanTime = runtimeConfig.getScanDuration() * 1000UL;
+    unsigned long frameLength = max(TDMA_FRAME_MIN, rxWindow + uplinkWindow + scanTime + TDMA_SCAN_GUARD);
+
+    ESPNowSyncBeacon beacon;
+    memset(&beacon, 0, sizeof(beacon));
+    beacon.magic = TDMA_SYNC_MAGIC;
+    beacon.frameLength = frameLength;
+    beacon.sequence = ++sequence;
+    beacon.rxOffset = TDMA_RX_OFFSET;
+    beacon.slotLength = TDMA_SLOT_LENGTH;
+    beacon.slotCount = slotCount;
+    for (int i = 0; i < slotCount; i++) {
+        memcpy(beacon.slots[i], slots[i].mac, 6);
+    }
+
+    espNowManager.broadcastSync(beacon);
+    espNowManager.setReceiveWindow(now, now + rxWindow);
+    rxEnd = now + rxWindow;
+    scanStart = rxEnd + uplinkWindow;
+    nextFrame = now + frameLength;
+    airtimeManager.recordFrame(rxWindow, frameLength);
+}
+
+// ==================== Esclavo ====================
+void TDMAManager::enqueue(const ESPNowMessage& msg) {
+    if (queue.size() >= TDMA_QUEUE_LIMIT) {
+        queue.pop_front();  // Se pierde la detección más antigua
+        if (dropped++ == 0) {
+            Serial.printf("[TDMA] Cola llena (%d): se descartan las detecciones más antiguas\n", (int)TDMA_QUEUE_LIMIT);
+        }
+    }
+    queue.push_back(msg);
+}
+
+void TDMAManager::applyBeacon(const ESPNowSyncBeacon& beacon, unsigned long receivedAt) {
+    if (!synced) {
+        Serial.printf("[TDMA] Sincronizado con el maestro (trama %lu ms, %u slots)\n",
+                      (unsigned long)beacon.frameLength, beacon.slotCount);
+    }
+    sync = beacon;
+    synced = true;
+    missed = 0;
+    beaconListened = false;
+    beaconAt = receivedAt;
+    lastHeardAt = receivedAt;
+
+    // Sin slot propio se usa el libre que sigue a los asignados
+    mySlot = beacon.slotCount;
+    for (int i = 0; i < beacon.slotCount && i < MAX_SLAVES; i++) {
+        if (memcmp(beacon.slots[i], ownMac, 6) == 0) {
+            mySlot = i;
+            break;
+        }
+    }
+}
+
+// En bajo consumo la baliza solo se escucha si hay algo que enviar
+bool TDMAManager::wantsBeacon() const {
+    return !powerManager.isEnabled() || !queue.empty();
+}
+
+bool TDMAManager::inBeaconWindow(unsigned long now) const {
+    unsigned long expected = beaconAt + sync.frameLength;
+    return (long)(now - (expected - TDMA_BEACON_GUARD)) >= 0 &&
+           (long)(now - (expected + TDMA_BEACON_GUARD)) < 0;
+}
+
+unsigned long TDMAManager::slotStart() const {
+    return beaconAt + sync.rxOffset + (unsigned long)mySlot * sync.slotLength;
+}
+
+unsigned long TDMAManager::slotEnd() const {
+    return slotStart() + sync.slotLength - TDMA_SLOT_GUARD;
+}
+
+void TDMAManager::loopSlave(unsigned long now) {
+    ESPNowSyncBeacon beacon;
+    unsigned long receivedAt;
+    if (espNowManager.takeSyncBeacon(beacon, receivedAt)) {
+        applyBeacon(beacon, receivedAt);
+    }
+
+    // Tramas vencidas sin baliza: se sigue el ritmo previsto. Solo cuenta
+    // como perdida la baliza que se escuchó; las tramas dormidas en bajo
+    // consumo (cola vacía) no, y con la cola nueva se escucha la siguiente
+    while (synced && (long)(now - (beaconAt + sync.frameLength + TDMA_BEACON_GUARD)) >= 0) {
+        beaconAt += sync.frameLength;
+        bool listened = beaconListened || !powerManager.isEnabled();
+        beaconListened = false;
+        if (listened && ++missed >= TDMA_SYNC_LOSS) {
+            synced = false;
+            listenUntil = now + TDMA_ACQUIRE_WINDOW;
+            nextAcquire = now + TDMA_REACQUIRE_INTERVAL;
+            Serial.println("[TDMA] Sin balizas del maestro: envío directo hasta recuperar la sincronía");
+        }
+    }
+
+    if (!queue.empty()) {
+        if (!synced) {
+            transmit(0);
+        } else if (lastHeardAt == beaconAt &&
+                   (long)(now - slotStart()) >= 0 && (long)(now - slotEnd()) < 0) {
+            // Solo con la tabla de esta trama: un slot previsto pudo cambiar
+            transmit(slotEnd());
+        }
+    }
+
+    bool listen;
+    if (!powerManager.isEnabled()) {
+        listen = true;
+    } else if (synced) {
+        listen = wantsBeacon() && inBeaconWindow(now);
+    } else {
+        if ((long)(now - nextAcquire) >= 0) {
+            listenUntil = now + TDMA_ACQUIRE_WINDOW;
+            nextAcquire = now + TDMA_REACQUIRE_INTERVAL;
+        }
+        listen = (long)(now - listenUntil) < 0;
+    }
+    setRadio(listen);
+    if (synced && radioHeld && inBeaconWindow(now)) {
+        beaconListened = true;
+    }
+}
+
+// until = 0: sin slot (sin sincronía), se vacía la cola. En el slot la
+// separación entre tramas se acorta con la cola para que quepan más
+void TDMAManager::transmit(unsigned long until) {
+    setRadio(true);
+
+    unsigned long spacing = TDMA_FRAME_SPACING;
+    if (until != 0 && !queue.empty()) {
+        long left = (long)(until - millis());
+        spacing = left > 0 ? constrain((unsigned long)left / queue.size(), TDMA_FRAME_SPACING_MIN, TDMA_FRAME_SPACING)
+                           : TDMA_FRAME_SPACING;
+    }
+
+    int sentCount = 0;
+    int failCount = 0;
+    while (!queue.empty()) {
+        if (until != 0 && (long)(millis() + spacing - until) > 0) {
+            break;
+        }
+        if (espNowManager.sendMessage(queue.front())) {
+            sentCount++;
+        } else {
+            failCount++;
+        }
+        queue.pop_front();
+        delay(spacing);
+    }
+
+    if (until != 0) {
+        Serial.printf("[TDMA] Slot %d: %d enviados cada %lu ms, %d fallidos, %d en cola, %lu descartados\n",
+                      mySlot, sentCount, spacing, failCount, queue.size(), (unsigned long)dropped);
+    } else {
+        Serial.printf("[TDMA] Envío directo: %d enviados, %d fallidos, %lu descartados\n",
+                      sentCount, failCount, (unsigned long)dropped);
+    }
+    dropped = 0;
+}
+
+void TDMAManager::setRadio(bool on) {
+    if (on == radioHeld) {
+        return;
+    }
+    radioHeld = on;
+    if (on) {
+        powerManager.acquireRadio();
+        espNowManager.radioOn();
+    } else {
+        if (powerManager.isEnabled()) {
+            espNowManager.radioOff();
+        }
+        powerManager.releaseRadio();
+    }
+}
+
+// ==================== Próximo evento ====================
+// Hora a la que el trabajo TDMA debe volver a correr; false si solo hace
+// falta al llegar una baliza o un ciclo nuevo (trigger)
+bool TDMAManager::nextEvent(unsigned long& when) const {
+    if (!active) {
+        return false;
+    }
+    unsigned long now = millis();
+
+    if (role == DEVICE_MASTER) {
+        if ((long)(now - nextFrame) >= 0) {
+            when = now + TDMA_SLOT_GUARD;  // Baliza retrasada por un escaneo
+        } else if ((long)(now - scanStart) < 0) {
+            when = scanStart;              // Fin de recepción y subida: hueco para BLE
+        } else {
+            when = nextFrame;
+        }
+        return true;
+    }
+
+    if (!synced) {
+        if (!powerManager.isEnabled()) {
+            return false;
+        }
+        when = (long)(now - listenUntil) < 0 ? listenUntil : nextAcquire;
+        return true;
+    }
+
+    bool found = false;
+    auto consider = [&](unsigned long candidate) {
+        if ((long)(candidate - now) > 0 && (!found || (long)(candidate - when) < 0)) {
+            when = candidate;
+            found = true;
+        }
+    };
+
+    if (wantsBeacon()) {
+        unsigned long expected = beaconAt + sync.frameLength;
+        consider(expected - TDMA_BEACON_GUARD);
+        consider(expected + TDMA_BEACON_GUARD);
+    }
+    if (!queue.empty() && lastHeardAt == beaconAt) {
+        consider(slotStart());
+    }
+    return found;
+}
@@ -0,0 +1,193 @@
+#include "time_service.h"
+#include <WiFi.h>
+#include <Preferences.h>
+#include <esp_sntp.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+
+TimeService timeService;
+
+// Sobrevive a reinicios por software junto con el reloj RTC
+RTC_DATA_ATTR static bool rtcTimeSynced = false;
+
+// Escritos desde la tarea de lwIP al sincronizar, consumidos en loop()
+static portMUX_TYPE sntpMux = portMUX_INITIALIZER_UNLOCKED;
+static bool sntpSyncPending = false;
+static int64_t sntpEpochMs = 0;
+static int64_t sntpUptimeMs = 0;
+
+TimeService::TimeService()
+    : anchorEpochMs(0),
+      anchorUptimeMs(0),
+      driftPpm(0.0f),
+      synced(false),
+      sntpStarted(false),
+      lastPersist(0) {
+}
+
+// ==================== Arranque (sin esperar a NTP) ====================
+void TimeService::begin() {
+    Preferences prefs;
+    int64_t savedEpoch = 0;
+    if (prefs.begin("time_cfg", true)) {
+        savedEpoch = prefs.getLong64("epoch", 0);
+        driftPpm = prefs.getFloat("drift", 0.0f);
+        prefs.end();
+    }
+    
+    time_t rtcNow = time(nullptr);
+    if (rtcNow >= TIME_MIN_VALID_EPOCH) {
+        // Reinicio por software: el RTC conservó la hora del sistema
+        setAnchor((int64_t)rtcNow * 1000, uptimeMs());
+        synced = rtcTimeSynced;
+        Serial.printf("[TIME] Hora conservada en RTC: %s\n", formatLocal(rtcNow).c_str());
+    } else if (savedEpoch >= TIME_MIN_VALID_EPOCH) {
+        // Arranque en frío: última hora conocida, atrasada lo que duró el apagado
+        setAnchor(savedEpoch * 1000, uptimeMs());
+        struct timeval tv = { (time_t)savedEpoch, 0 };
+        settimeofday(&tv, nullptr);
+        Serial.printf("[TIME] Hora aproximada desde NVS: %s (pendiente de SNTP)\n",
+                     formatLocal(savedEpoch).c_str());
+    } else {
+        Serial.println("[TIME] Sin hora conocida hasta la primera sincronización SNTP");
+    }
+    
+    if (driftPpm != 0.0f) {
+        Serial.printf("[TIME] Deriva del reloj: %.1f ppm\n", driftPpm);
+    }
+    
+    sntp_set_time_sync_notification_cb(onSntpSync);
+}
+
+void TimeService::startSntp() {
+    // configTime solo arranca el cliente SNTP de lwIP; la respuesta llega por callback
+    configTime(0, 0, NTP_SERVER1, NTP_SERVER2);
+    sntpStarted = true;
+    Serial.printf("[TIME] SNTP iniciado en segundo plano (%s, %s)\n", NTP_SERVER1, NTP_SERVER2);
+}
+
+void TimeService::onSntpSync(struct timeval* tv) {
+    portENTER_CRITICAL(&sntpMux);
+    sntpEpochMs = (int64_t)tv->tv_sec * 1000 + tv->tv_usec / 1000;
+    sntpUptimeMs = uptimeMs();
+    sntpSyncPending = true;
+    portEXIT_CRITICAL(&sntpMux);
+}
+
+// ==================== Loop ====================
+void TimeService::loop() {
+    if (!sntpStarted && WiFi.status() == WL_CONNECTED) {
+        startSntp();
+    }
+    
+    bool pending = false;
+    int64_t epochMs = 0;
+    int64_t syncUptimeMs = 0;
+    portENTER_CRITICAL(&sntpMux);
+    if (sntpSyncPending) {
+        pending = true;
+        epochMs = sntpEpochMs;
+        syncUptimeMs = sntpUptimeMs;
+        sntpSyncPending = false;
+    }
+    portEXIT_CRITICAL(&sntpMux);
+    
+    if (pending) {
+        applySync(epochMs, syncUptimeMs);
+    }
+    
+    if (isValid() && millis() - lastPersist >= TIME_PERSIST_INTERVAL) {
+        persist();
+    }
+}
+
+void TimeService::applySync(int64_t epochMs, int64_t syncUptimeMs) {
+    int64_t elapsed = syncUptimeMs - anchorUptimeMs;
+    
+    // La deriva solo se mide entre dos anclas buenas y suficientemente separadas
+    if (synced && elapsed >= (int64_t)TIME_DRIFT_MIN_INTERVAL) {
+        int64_t error = epochMs - estimateEpochMs(syncUptimeMs);
+        float measured = (float)(epochMs - anchorEpochMs - elapsed) * 1e6f / (float)elapsed;
+        
+        if (fabsf(measured) <= TIME_MAX_DRIFT_PPM) {
+            driftPpm = driftPpm == 0.0f ? measured : 0.7f * driftPpm + 0.3f * measured;
+        }
+        Serial.printf("[TIME] Error acumulado: %lld ms en %lld s, deriva %.1f ppm\n",
+                     (long long)error, (long long)(elapsed / 1000), driftPpm);
+    }
+    
+    bool firstSync = !synced;
+    setAnchor(epochMs, syncUptimeMs);
+    synced = true;
+    rtcTimeSynced = true;
+    persist();
+    
+    if (firstSync) {
+        Serial.printf("[TIME] Hora sincronizada: %s\n", formatLocal(now()).c_str());
+    }
+}
+
+void TimeService::setAnchor(int64_t epochMs, int64_t atUptimeMs) {
+    anchorEpochMs = epochMs;
+    anchorUptimeMs = atUptimeMs;
+}
+
+void TimeService::persist() {
+    if (!isValid()) {
+        return;
+    }
+    
+    Preferences prefs;
+    if (prefs.begin("time_cfg", false)) {
+        prefs.putLong64("epoch", now());
+        prefs.putFloat("drift", driftPpm);
+        prefs.end();
+    }
+    lastPersist = millis();
+}
+
+// ==================== Consulta ====================
+int64_t TimeService::estimateEpochMs(int64_t atUptimeMs) const {
+    int64_t elapsed = atUptimeMs - anchorUptimeMs;
+    return anchorEpochMs + elapsed + (int64_t)((double)elapsed * driftPpm / 1e6);
+}
+
+time_t TimeService::now() const {
+    if (!isValid()) {
+        return time(nullptr);
+    }
+    return estimateEpochMs(uptimeMs()) / 1000;
+}
+
+// Epoch de un instante capturado como tiempo de actividad. Permite fechar
+// registros tomados antes de sincronizar usando el ancla actual.
+time_t TimeService::epochAt(uint32_t uptimeSeconds) const {
+    if (!isValid()) {
+        return 0;
+    }
+    return estimateEpochMs((int64_t)uptimeSeconds * 1000) / 1000;
+}
+
+uint32_t TimeService::uptimeSeconds() const {
+    return uptimeMs() / 1000;
+}
+
+int64_t TimeService::uptimeMs() {
+    return esp_timer_get_time() / 1000;
+}
+
+String TimeService::formatLocal(time_t epoch) const {
+    long offset = GMT_OFFSET_SEC + DAYLIGHT_OFFSET_SEC;
+    time_t local = epoch + offset;
+    
+    struct tm timeinfo;
+    gmtime_r(&local, &timeinfo);
+    
+    char isoTime[32];
+    size_t length = strftime(isoTime, sizeof(isoTime), "%Y-%m-%dT%H:%M:%S", &timeinfo);
+    long absOffset = offset < 0 ? -offset : offset;
+    snprintf(isoTime + length, sizeof(isoTime) - length, "%c%02ld:%02ld",
+             offset < 0 ? '-' : '+', absOffset / 3600, (absOffset % 3600) / 60);
+    
+    return String(isoTime);
+}
@@ -0,0 +1,280 @@
+#include "uplink.h"
+#include <ArduinoJson.h>
+#include <WiFi.h>
+#include "mqtt_client.h"
+#include "api_client.h"
+#include "time_service.h"
+
+UplinkRouter uplinkRouter;
+
+// ==================== Serializador de Detecciones ====================
+String buildDetectionsPayload(const std::map<String, BeaconData>& beacons) {
+    DynamicJsonDocument doc(512 + beacons.size() * 192);
+    
+    String currentLocation = LOADED_ZONE_NAME.length() > 0 ? LOADED_ZONE_NAME : LOADED_SUB_LOCATION;
+    
+    // Location del sondeador: parte "location" de "tipo/location", ya separada al cargar
+    const String& deviceLocation = LOADED_LOCATION_NAME.length() > 0 ? LOADED_LOCATION_NAME : currentLocation;
+    
+    time_t currentTime = timeService.now();
+    
+    doc["mac_address"] = WiFi.macAddress();
+    doc["device_id"] = getDeviceId();
+    doc["zone_name"] = currentLocation;
+    doc["timestamp"] = currentTime;
+    
+    // Sin SNTP la hora es aproximada: el backend puede refecharla con el
+    // tiempo de actividad y el de un mensaje posterior ya sincronizado
+    doc["time_synced"] = timeService.isSynced();
+    doc["uptime"] = timeService.uptimeSeconds();
+    
+    JsonArray detectionsArray = doc.createNestedArray("detections");
+    
+    for (const auto& pair : beacons) {
+        const BeaconData& beacon = pair.second;
+        
+        JsonObject detection = detectionsArray.createNestedObject();
+        detection["tag_id"] = beacon.animalId;
+        
+        // Ubicación del beacon (maestro o esclavo), con la del maestro como respaldo
+        detection["device_location"] = beacon.detectedLocation.length() > 0
+                                       ? beacon.detectedLocation
+                                       : deviceLocation;
+        
+        detection["distance"] = round(beacon.distance * 100) / 100.0;
+        detection["rssi"] = beacon.rssi;
+        detection["detected_at"] = currentTime;
+    }
+    
+    String payload;
+    serializeJson(doc, payload);
+    return payload;
+}
+
+// ==================== Router ====================
+UplinkRouter::UplinkRouter() {
+    for (int i = 0; i < UPLINK_COUNT; i++) {
+        health[i].successRate = 1.0f;
+        health[i].latencyMs = 0.0f;
+        health[i].delivered = 0;
+        health[i].failed = 0;
+        health[i].updatedAt = 0;
+    }
+}
+
+void UplinkRouter::initialize() {
+    mqttClient.onDelivery([this](uint32_t deliveryId, bool success, int code) {
+        onResult(UPLINK_MQTT, deliveryId, success);
+    });
+    apiClient.onDelivery([this](uint32_t deliveryId, bool success, int code) {
+        onResult(UPLINK_HTTPS, deliveryId, success);
+    });
+    
+    Serial.printf("[UPLINK] Transportes: MQTT=%s, HTTPS=%s\n",
+                 ENABLE_MQTT ? "sí" : "no", ENABLE_HTTPS_UPLINK ? "sí" : "no");
+}
+
+bool UplinkRouter::sendDetections(const std::map<String, BeaconData>& beacons) {
+    if (pending.size() >= UPLINK_MAX_PENDING) {
+        // Se deja de seguir la entrega más antigua; su transporte sigue intentándolo
+        Serial.println("[UPLINK] Demasiadas entregas pendientes, se pierde el respaldo de la más antigua");
+        pending.erase(pending.begin());
+    }
+    
+    String payload = buildDetectionsPayload(beacons);
+    
+    UplinkTransport transport;
+    if (!selectTransport(transport)) {
+        if (!ENABLE_MQTT) {
+            Serial.println("[UPLINK] Sin transporte disponible, detecciones descartadas");
+            return false;
+        }
+        // MQTT QoS 1 guarda el mensaje hasta reconectar
+        transport = UPLINK_MQTT;
+    }
+    
+    return dispatch(transport, payload, false);
+}
+
+bool UplinkRouter::selectTransport(UplinkTransport& transport) {
+    bool found = false;
+    float bestScore = 0.0f;
+    
+    for (int i = 0; i < UPLINK_COUNT; i++) {
+        UplinkTransport candidate = (UplinkTransport)i;
+        if (!isAvailable(candidate)) {
+            continue;
+        }
+        float candidateScore = score(candidate);
+        if (!found || candidateScore > bestScore) {
+            transport = candidate;
+            bestScore = candidateScore;
+            found = true;
+        }
+    }
+    return found;
+}
+
+bool UplinkRouter::isAvailable(UplinkTransport transport) {
+    switch (transport) {
+        case UPLINK_MQTT:
+            return ENABLE_MQTT && mqttClient.isConnected() &&
+                   mqttClient.getQueuedCount() < MQTT_MAX_QUEUED_MESSAGES;
+        case UPLINK_HTTPS:
+            return ENABLE_HTTPS_UPLINK && WiFi.status() == WL_CONNECTED &&
+                   apiClient.getCircuitState() != CIRCUIT_OPEN &&
+                   apiClient.getPendingCount() < API_MAX_PENDING_JOBS;
+        default:
+            return false;
+    }
+}
+
+// Tasa de éxito penalizada por la latencia; MQTT gana los empates (más barato)
+float UplinkRouter::score(UplinkTransport transport) const {
+    const TransportHealth& h = health[transport];
+    float value = h.successRate - h.latencyMs / UPLINK_LATENCY_SCALE;
+    if (transport == UPLINK_MQTT) {
+        value += UPLINK_MQTT_BIAS;
+    }
+    return value;
+}
+
+bool UplinkRouter::dispatch(UplinkTransport transport, const String& payload, bool failedOver) {
+    uint32_t deliveryId = submit(transport, payload);
+    if (deliveryId == 0) {
+        Serial.printf("[UPLINK] %s rechazó el envío\n", transportName(transport));
+        recordHealth(transport, false, 0);
+        return false;
+    }
+    
+    PendingDelivery delivery;
+    delivery.transport = transport;
+    delivery.deliveryId = deliveryId;
+    delivery.sentAt = millis();
+    delivery.timedOut = false;
+    delivery.failedOver = failedOver;
+    delivery.payload = payload;
+    pending.push_back(delivery);
+    
+    Serial.printf("[UPLINK] Envío por %s (éxito %.0f%%, latencia %.0f ms)\n",
+                 transportName(transport), health[transport].successRate * 100.0f,
+                 health[transport].latencyMs);
+    return true;
+}
+
+uint32_t UplinkRouter::submit(UplinkTransport transport, const String& payload) {
+    return transport == UPLINK_MQTT ? mqttClient.sendDetections(payload)
+                                    : apiClient.sendDetections(payload);
+}
+
+bool UplinkRouter::cancel(UplinkTransport transport, uint32_t deliveryId) {
+    return transport == UPLINK_MQTT ? mqttClient.cancel(deliveryId)
+                                    : apiClient.cancel(deliveryId);
+}
+
+// ==================== Resultados y Failover ====================
+void UplinkRouter::onResult(UplinkTransport transport, uint32_t deliveryId, bool success) {
+    for (auto it = pending.begin(); it != pending.end(); ++it) {
+        if (it->transport != transport || it->deliveryId != deliveryId) {
+            continue;
+        }
+        
+        // Un timeout ya contó como fallo; una confirmación tardía sí cuenta como éxito
+        if (success || !it->timedOut) {
+            recordHealth(transport, success, millis() - it->sentAt);
+        }
+        
+        PendingDelivery delivery = *it;
+        pending.erase(it);
+        if (!success) {
+            failOver(delivery);
+        }
+        return;
+    }
+}
+
+void UplinkRouter::loop() {
+    unsigned long now = millis();
+    decayHealth(now);
+    
+    for (size_t i = 0; i < pending.size();) {
+        PendingDelivery& delivery = pending[i];
+        if (delivery.timedOut || now - delivery.sentAt < UPLINK_DELIVERY_TIMEOUT) {
+            i++;
+            continue;
+        }
+        
+        delivery.timedOut = true;
+        recordHealth(delivery.transport, false, now - delivery.sentAt);
+        Serial.printf("[UPLINK] Entrega por %s sin confirmar tras %lu ms\n",
+                     transportName(delivery.transport), now - delivery.sentAt);
+        
+        // Solo se reenvía si el mensaje no llegó a salir; si está en vuelo se espera
+        if (!delivery.failedOver && cancel(delivery.transport, delivery.deliveryId)) {
+            PendingDelivery cancelled = delivery;
+            pending.erase(pending.begin() + i);
+            failOver(cancelled);
+            continue;
+        }
+        i++;
+    }
+}
+
+void UplinkRouter::failOver(PendingDelivery delivery) {
+    if (delivery.failedOver) {
+        Serial.println("[UPLINK] Entrega fallida en ambos transportes, detecciones perdidas");
+        return;
+    }
+    
+    UplinkTransport alternative = delivery.transport == UPLINK_MQTT ? UPLINK_HTTPS : UPLINK_MQTT;
+    if (!isAvailable(alternative)) {
+        Serial.printf("[UPLINK] %s no disponible para respaldo, detecciones perdidas\n",
+                     transportName(alternative));
+        return;
+    }
+    
+    Serial.printf("[UPLINK] Failover %s -> %s\n",
+                 transportName(delivery.transport), transportName(alternative));
+    dispatch(alternative, delivery.payload, true);
+}
+
+void UplinkRouter::recordHealth(UplinkTransport transport, bool success, unsigned long latency) {
+    TransportHealth& h = health[transport];
+    h.successRate = UPLINK_EWMA_ALPHA * (success ? 1.0f : 0.0f) + (1.0f - UPLINK_EWMA_ALPHA) * h.successRate;
+    if (success) {
+        h.latencyMs = h.delivered == 0 ? latency
+                                       : UPLINK_EWMA_ALPHA * latency + (1.0f - UPLINK_EWMA_ALPHA) * h.latencyMs;
+        h.delivered++;
+    } else {
+        h.failed++;
+    }
+    h.updatedAt = millis();
+}
+
+// Un transporte que no lleva tráfico no tiene cómo mejorar su EWMA: cada
+// intervalo sin resultados se acerca a la salud inicial (éxito total, sin
+// latencia) hasta volver a ganar alguna comparación
+void UplinkRouter::decayHealth(unsigned long now) {
+    for (int i = 0; i < UPLINK_COUNT; i++) {
+        TransportHealth& h = health[i];
+        if (now - h.updatedAt < UPLINK_HEALTH_DECAY_INTERVAL) {
+            continue;
+        }
+        h.successRate += UPLINK_EWMA_ALPHA * (1.0f - h.successRate);
+        h.latencyMs -= UPLINK_EWMA_ALPHA * h.latencyMs;
+        h.updatedAt = now;
+    }
+}
+
+const char* UplinkRouter::transportName(UplinkTransport transport) {
+    return transport == UPLINK_MQTT ? "MQTT" : "HTTPS";
+}
+
+// Fallos y timeouts acumulados de los dos transportes
+uint32_t UplinkRouter::getFailedCount() const {
+    uint32_t failed = 0;
+    for (int i = 0; i < UPLINK_COUNT; i++) {
+        failed += health[i].failed;
+    }
+    return failed;
+}
@@ -0,0 +1,176 @@
+#include "wifi_connect_cache.h"
+#include "time_service.h"
+#include <Preferences.h>
+#include <cstring>
+
+WiFiConnectCache wifiConnectCache;
+
+static constexpr uint8_t WIFI_CACHE_VERSION = 1;
+
+WiFiConnectCache::WiFiConnectCache()
+    : valid(false),
+      leaseReused(false),
+      dhcpPending(false) {
+    memset(&record, 0, sizeof(record));
+}
+
+void WiFiConnectCache::load() {
+    Preferences prefs;
+    if (!prefs.begin("wifi_fast", true)) {
+        return;
+    }
+    Record stored;
+    size_t length = prefs.getBytes("ap", &stored, sizeof(stored));
+    prefs.end();
+
+    if (length != sizeof(stored) || stored.version != WIFI_CACHE_VERSION || stored.channel == 0) {
+        return;
+    }
+    record = stored;
+    valid = true;
+    Serial.printf("[WiFi] AP en cache: %02X:%02X:%02X:%02X:%02X:%02X canal %d\n",
+                 record.bssid[0], record.bssid[1], record.bssid[2],
+                 record.bssid[3], record.bssid[4], record.bssid[5], record.channel);
+}
+
+bool WiFiConnectCache::matches(const String& ssid) const {
+    return valid && record.ssidHash == hashSSID(ssid);
+}
+
+// IP fija de configuración si existe; si no, el último lease mientras sea
+// reciente. Devuelve false cuando corresponde DHCP normal.
+bool WiFiConnectCache::applyIPConfig() {
+    leaseReused = false;
+    dhcpPending = false;
+    if (staticIPConfigured()) {
+        IPAddress ip, gateway, subnet, dns;
+        ip.fromString(WIFI_STATIC_IP);
+        gateway.fromString(WIFI_STATIC_GATEWAY);
+        subnet.fromString(WIFI_STATIC_SUBNET);
+        if (!dns.fromString(WIFI_STATIC_DNS)) {
+            dns = gateway;
+        }
+        WiFi.config(ip, gateway, subnet, dns);
+        Serial.printf("[WiFi] IP fija: %s\n", ip.toString().c_str());
+        return true;
+    }
+
+    if (valid && leaseUsable()) {
+        WiFi.config(IPAddress(record.ip), IPAddress(record.gateway), IPAddress(record.subnet), IPAddress(record.dns));
+        Serial.printf("[WiFi] Reutilizando lease %s (sin DHCP)\n", IPAddress(record.ip).toString().c_str());
+        leaseReused = true;
+        return true;
+    }
+
+    WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE);
+    return false;
+}
+
+// Llamar con el WiFi ya conectado
+void WiFiConnectCache::update(const String& ssid) {
+    if (leaseReused) {
+        // La IP no vino de DHCP: se anota el AP pero el lease conserva su
+        // fecha, y la interfaz vuelve a DHCP sin esperar
+        bool apChanged = memcmp(WiFi.BSSID(), record.bssid, sizeof(record.bssid)) != 0 ||
+                         (uint8_t)WiFi.channel() != record.channel;
+        if (apChanged) {
+            memcpy(record.bssid, WiFi.BSSID(), sizeof(record.bssid));
+            record.channel = (uint8_t)WiFi.channel();
+            persist();
+        }
+        leaseReused = false;
+        dhcpPending = true;
+        pendingSSID = ssid;
+        WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE);
+        Serial.println("[WiFi] Cliente DHCP reanudado en segundo plano");
+        return;
+    }
+
+    Record current;
+    memset(&current, 0, sizeof(current));
+    current.version = WIFI_CACHE_VERSION;
+    memcpy(current.bssid, WiFi.BSSID(), sizeof(current.bssid));
+    current.channel = (uint8_t)WiFi.channel();
+    current.ssidHash = hashSSID(ssid);
+    current.ip = (uint32_t)WiFi.localIP();
+    current.gateway = (uint32_t)WiFi.gatewayIP();
+    current.subnet = (uint32_t)WiFi.subnetMask();
+    current.dns = (uint32_t)WiFi.dnsIP();
+
+    bool sameNetwork = valid &&
+        memcmp(current.bssid, record.bssid, sizeof(current.bssid)) == 0 &&
+        current.channel == record.channel &&
+        current.ssidHash == record.ssidHash &&
+        current.ip == record.ip &&
+        current.gateway == record.gateway;
+
+    // El mismo lease visto de nuevo solo renueva la marca de tiempo en RAM;
+    // se reescribe en flash cuando cambia algo o la marca guardada caducó
+    uint32_t now = timeService.isValid() ? (uint32_t)timeService.now() : 0;
+    if (sameNetwork && (now == 0 || now - record.savedAt < WIFI_LEASE_MAX_AGE / 2)) {
+        return;
+    }
+
+    current.savedAt = now;
+    record = current;
+    valid = current.channel != 0;
+    persist();
+}
+
+// Con el lease nuevo de DHCP se guarda como cualquier otra conexión
+void WiFiConnectCache::loop() {
+    if (!dhcpPending || WiFi.status() != WL_CONNECTED || (uint32_t)WiFi.localIP() == 0) {
+        return;
+    }
+    dhcpPending = false;
+    Serial.printf("[WiFi] Lease DHCP obtenido: %s\n", WiFi.localIP().toString().c_str());
+    update(pendingSSID);
+}
+
+void WiFiConnectCache::invalidate() {
+    if (!valid) {
+        return;
+    }
+    valid = false;
+    Preferences prefs;
+    if (prefs.begin("wifi_fast", false)) {
+        prefs.remove("ap");
+        prefs.end();
+    }
+    Serial.println("[WiFi] Cache de AP descartada");
+}
+
+// El lease solo se reutiliza si se sabe cuándo se obtuvo y es reciente;
+// pasado ese tiempo el router pudo reasignar la IP
+bool WiFiConnectCache::leaseUsable() const {
+    if (!WIFI_REUSE_DHCP_LEASE || record.ip == 0 || record.savedAt == 0 || !timeService.isValid()) {
+        return false;
+    }
+    uint32_t now = (uint32_t)timeService.now();
+    return now >= record.savedAt && now - record.savedAt < WIFI_LEASE_MAX_AGE;
+}
+
+bool WiFiConnectCache::staticIPConfigured() {
+    return WIFI_STATIC_IP != nullptr && strlen(WIFI_STATIC_IP) > 0;
+}
+
+// FNV-1a: evita guardar el SSID en claro una segunda vez
+uint32_t WiFiConnectCache::hashSSID(const String& ssid) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < ssid.length(); i++) {
+        hash ^= (uint8_t)ssid[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+void WiFiConnectCache::persist() {
+    Preferences prefs;
+    if (!prefs.begin("wifi_fast", false)) {
+        return;
+    }
+    prefs.putBytes("ap", &record, sizeof(record));
+    prefs.end();
+    Serial.printf("[WiFi] AP guardado en cache (canal %d, IP %s)\n",
+                 record.channel, IPAddress(record.ip).toString().c_str());
+}
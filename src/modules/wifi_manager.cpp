@@ -1,7 +1,13 @@
 #include "wifi_manager.h"
 #include "alerts.h"
 #include "display_manager.h"
-#include <Preferences.h>
+#include "secure_client.h"
+#include "config_store.h"
+#include "dns_resolver.h"
+#include "wifi_connect_cache.h"
+#include "http_body_stream.h"
+#include "json_stream.h"
+#include "generated/web_assets.h"
 #include <cstring>
 
 WiFiManager wifiManager;
@@ -10,25 +16,48 @@ WiFiManager::WiFiManager()
         : configServer(80),
             lastConnectionAttempt(0),
             wasConnected(false),
+            connectedOnce(false),
             portalActive(false),
             pendingReconnect(false),
             lastPortalAnnounce(0),
             reconnectRequestTime(0),
             connectionAttempts(0),
             loggedUserId(0),
-            dnsServerActive(false),
-            backendIPCached(false) {
+            pendingActivation(false),
+            activationRequestTime(0),
+            pendingActivationId(0) {
 }
 
 // ==================== Inicialización ====================
 void WiFiManager::begin() {
-    loadDeviceConfig();        // ← PRIMERO: Cargar modo del dispositivo (MASTER/SLAVE)
-    loadDeviceLocation();      // ← SEGUNDO: Cargar ubicación (zona, sublocalización, device_id)
-    loadStoredCredentials();   // ← TERCERO: Cargar WiFi (solo si es MASTER)
+    // Modo y ubicación ya vienen de configStore.load() en el arranque
+    loadStoredCredentials();   // Cargar WiFi (solo si es MASTER)
+    wifiConnectCache.load();   // Último AP/lease para reconectar rápido
     
     // NO iniciar portal automáticamente; solo si falla conexión
 }
 
+// Cambio de modo a ESCLAVO: el maestro deja la red; ESP-NOW fija su canal
+void WiFiManager::end() {
+    stopConfigPortal();
+    disconnect();
+    currentSSID = "";
+    currentPassword = "";
+}
+
+// Credenciales nuevas: reconectar en caliente (solo MAESTRO y con el portal cerrado)
+void WiFiManager::onConfigChanged(uint32_t changes) {
+    if (!(changes & CONFIG_CHANGE_WIFI) || CURRENT_DEVICE_MODE != DEVICE_MASTER || portalActive) {
+        return;
+    }
+    
+    loadStoredCredentials();
+    if (isConnected() && WiFi.SSID() == currentSSID) {
+        return;
+    }
+    connect();
+}
+
 bool WiFiManager::connect() {
     if (currentSSID.length() == 0) {
         Serial.println("[WiFi] SSID vacio. Configure credenciales desde el portal web.");
@@ -44,21 +73,45 @@ bool WiFiManager::connect() {
     displayManager.showWiFiStatus(true, currentSSID.c_str());
 
     WiFi.disconnect(false);
-    delay(100);
-
     WiFi.mode(WIFI_STA);
-    WiFi.begin(currentSSID.c_str(), currentPassword.c_str());
 
-    bool connected = attemptConnection(WIFI_TIMEOUT);
+    unsigned long connectStart = millis();
+    bool connected = false;
+
+    // Join dirigido al último AP (sin escaneo de canales) y, si aplica, sin DHCP
+    if (wifiConnectCache.matches(currentSSID)) {
+        wifiConnectCache.applyIPConfig();
+        WiFi.begin(currentSSID.c_str(), currentPassword.c_str(),
+                   wifiConnectCache.getChannel(), wifiConnectCache.getBSSID());
+        connected = attemptConnection(WIFI_FAST_CONNECT_TIMEOUT);
+
+        if (!connected) {
+            Serial.println("\n[WiFi] Join rapido fallo, escaneando todos los canales...");
+            wifiConnectCache.invalidate();
+            WiFi.disconnect(false);
+        }
+    }
+
+    if (!connected) {
+        wifiConnectCache.applyIPConfig();
+        WiFi.begin(currentSSID.c_str(), currentPassword.c_str());
+        connected = attemptConnection(WIFI_TIMEOUT);
+    }
 
     if (connected) {
-        Serial.println("\n[WiFi] [OK] Conexion exitosa");
+        Serial.printf("\n[WiFi] [OK] Conexion exitosa en %lu ms\n", millis() - connectStart);
         Serial.printf("[WiFi] IP Local: %s\n", WiFi.localIP().toString().c_str());
         Serial.printf("[WiFi] RSSI: %d dBm\n", WiFi.RSSI());
 
+        wifiConnectCache.update(currentSSID);
+
         displayManager.showIP(getLocalIP());
         alertManager.showSuccess();
-        delay(2000);
+        // La pausa para ver la IP solo en la primera conexión, no en reconexiones
+        if (!connectedOnce) {
+            delay(2000);
+            connectedOnce = true;
+        }
 
         wasConnected = true;
         
@@ -126,10 +179,10 @@ void WiFiManager::stopConfigPortal() {
     
     // Detener DNS Server
     dnsServer.stop();
-    dnsServerActive = false;
     
-    // Detener Web Server
-    configServer.stop();
+    // Detener Web Server y descartar trabajos pendientes
+    configServer.end();
+    portalJobs.clear();
     
     // Desconectar AP
     WiFi.softAPdisconnect(true);
@@ -144,11 +197,9 @@ void WiFiManager::stopConfigPortal() {
 // ==================== Loop del Portal ====================
 void WiFiManager::loop() {
     if (portalActive) {
-        // Solo procesar DNS si está activo
-        if (dnsServerActive) {
-            dnsServer.processNextRequest();  // Procesar peticiones DNS (Captive Portal)
-        }
-        configServer.handleClient();     // Procesar peticiones HTTP
+        // HTTP y DNS se atienden en sus propias tareas; aquí solo corren
+        // los trabajos largos (login, GraphQL, conexión WiFi)
+        portalJobs.runPending();
 
         // Anunciar el portal periódicamente (cada 30 segundos)
         if (lastPortalAnnounce == 0 || millis() - lastPortalAnnounce > 30000) {
@@ -156,7 +207,7 @@ void WiFiManager::loop() {
             Serial.println("[Portal] ==========================================");
             Serial.printf("[Portal] URL: http://%s\n", WiFi.softAPIP().toString().c_str());
             Serial.printf("[Portal] Clientes conectados: %d\n", WiFi.softAPgetStationNum());
-            if (dnsServerActive) {
+            if (dnsServer.isActive()) {
                 Serial.println("[Portal] DNS activo: Redirigiendo todas las URLs");
             }
             Serial.println("[Portal] Acceso manual: http://192.168.4.1");
@@ -164,6 +215,31 @@ void WiFiManager::loop() {
         }
     }
 
+    // El navegador consulta el resultado de /save cada segundo: margen para
+    // que lo recoja antes de que la activación cierre el portal
+    if (pendingActivation && millis() - activationRequestTime > 1500) {
+        pendingActivation = false;
+
+        // Actualizar estado del dispositivo en la base de datos (DESPUES de enviar respuesta)
+        if (pendingActivationId > 0 && WiFi.status() == WL_CONNECTED) {
+            Serial.printf("[Portal] Actualizando dispositivo %d a estado 'active'\n", pendingActivationId);
+            bool updated = updateDispositivoStatus(pendingActivationId, "active", 100);
+            if (updated) {
+                Serial.println("[Portal] Estado del dispositivo actualizado");
+            } else {
+                Serial.println("[Portal] No se pudo actualizar el estado (se procedera de todos modos)");
+            }
+        } else if (pendingActivationId > 0) {
+            Serial.println("[Portal] WiFi no conectado - saltando actualizacion de estado");
+        }
+
+        // La configuración ya está en RAM: se cierra el portal y el arranque
+        // (o el loop, vía configStore) continúa con ella, sin reiniciar
+        delay(1000);  // Que el navegador reciba la respuesta antes de apagar el AP
+        stopConfigPortal();
+        Serial.println("[Portal] Configuración aplicada");
+    }
+
     if (pendingReconnect && millis() - reconnectRequestTime > 500) {
         pendingReconnect = false;
         
@@ -202,123 +278,31 @@ void WiFiManager::loadStoredCredentials() {
     currentSSID = String(WIFI_SSID);
     currentPassword = String(WIFI_PASSWORD);
 
-    Preferences prefs;
-    if (prefs.begin("wifi_cfg", true)) {
-        String storedSsid = prefs.getString("ssid", "");
-        String storedPass = prefs.getString("pass", "");
-        prefs.end();
-
-        if (storedSsid.length() > 0) {
-            currentSSID = storedSsid;
-            currentPassword = storedPass;
-            Serial.printf("[WiFi] Usando SSID guardado: %s\n", currentSSID.c_str());
-        } else {
-            Serial.println("[WiFi] Sin credenciales guardadas. Se usaran las de compilacion.");
-        }
+    String storedSsid = configStore.getSSID();
+    if (storedSsid.length() > 0) {
+        currentSSID = storedSsid;
+        currentPassword = configStore.getPassword();
+        Serial.printf("[WiFi] Usando SSID guardado: %s\n", currentSSID.c_str());
     } else {
-        Serial.println("[WiFi] No se pudo abrir almacenamiento de preferencias.");
+        Serial.println("[WiFi] Sin credenciales guardadas. Se usaran las de compilacion.");
     }
 }
 
+// Los cambios quedan en RAM; el portal los guarda todos juntos en /save
 void WiFiManager::saveCredentials(const String& ssid, const String& password) {
-    Preferences prefs;
-    if (prefs.begin("wifi_cfg", false)) {
-        prefs.putString("ssid", ssid);
-        prefs.putString("pass", password);
-        prefs.end();
-    }
-
+    configStore.setCredentials(ssid, password);
     currentSSID = ssid;
     currentPassword = password;
 }
 
 // ==================== Configuración del Dispositivo ====================
-void WiFiManager::loadDeviceConfig() {
-    Preferences prefs;
-    if (prefs.begin("device_cfg", true)) {
-        // Cargar modo del dispositivo (0=SLAVE por defecto, 1=MASTER)
-        uint8_t mode = prefs.getUChar("mode", 0);
-        CURRENT_DEVICE_MODE = (mode == 1) ? DEVICE_MASTER : DEVICE_SLAVE;
-        
-        // Cargar MAC del maestro si es esclavo
-        if (CURRENT_DEVICE_MODE == DEVICE_SLAVE) {
-            String macStr = prefs.getString("master_mac", "");
-            if (macStr.length() > 0) {
-                stringToMac(macStr, MASTER_MAC_ADDRESS);
-                Serial.printf("[Config] Modo ESCLAVO - MAC Maestro: %s\n", macStr.c_str());
-            } else {
-                Serial.println("[Config] Modo ESCLAVO - MAC Maestro no configurada");
-            }
-        } else {
-            Serial.println("[Config] Modo MAESTRO");
-        }
-        
-        prefs.end();
-    }
-}
-
-void WiFiManager::loadDeviceLocation() {
-    Preferences prefs;
-    if (prefs.begin("location_cfg", true)) {
-        // Cargar zona, sublocalización y zone_id
-        LOADED_ZONE_NAME = prefs.getString("zone_name", "");
-        LOADED_SUB_LOCATION = prefs.getString("sub_location", "");
-        LOADED_ZONE_ID = prefs.getInt("zone_id", 0);
-        
-        if (LOADED_ZONE_NAME.length() > 0 && LOADED_SUB_LOCATION.length() > 0) {
-            // Generar DEVICE_ID desde sublocalización (formato: tipo/nombre)
-            // Ejemplo: "master/Corral Norte" -> "IOT_MASTER_CORRAL_NORTE"
-            String deviceType = "";
-            String locationName = LOADED_SUB_LOCATION;
-            
-            int slashPos = LOADED_SUB_LOCATION.indexOf('/');
-            if (slashPos > 0) {
-                deviceType = LOADED_SUB_LOCATION.substring(0, slashPos);
-                locationName = LOADED_SUB_LOCATION.substring(slashPos + 1);
-            }
-            
-            // Convertir a ID válido: mayúsculas, espacios -> guiones bajos
-            deviceType.toUpperCase();
-            locationName.toUpperCase();
-            locationName.replace(" ", "_");
-            locationName.replace("-", "_");
-            
-            LOADED_DEVICE_ID = "IOT_" + deviceType + "_" + locationName;
-            
-            Serial.printf("[Config] Ubicación cargada:\n");
-            Serial.printf("  - Zona: %s (ID: %d)\n", LOADED_ZONE_NAME.c_str(), LOADED_ZONE_ID);
-            Serial.printf("  - Sublocalización: %s\n", LOADED_SUB_LOCATION.c_str());
-            Serial.printf("  - Device ID: %s\n", LOADED_DEVICE_ID.c_str());
-        } else {
-            Serial.println("[Config] No hay ubicación guardada, usando valores por defecto");
-            LOADED_ZONE_NAME = LOADED_ZONE_NAME;  // Usar valor hardcoded como fallback
-            LOADED_SUB_LOCATION = LOADED_SUB_LOCATION;
-            LOADED_DEVICE_ID = LOADED_DEVICE_ID;
-            LOADED_ZONE_ID = 0;
-        }
-        
-        prefs.end();
-    }
-}
-
-void WiFiManager::saveDeviceConfig(DeviceMode mode, const String& masterMac) {
-    Preferences prefs;
-    if (prefs.begin("device_cfg", false)) {
-        // Guardar modo (0=SLAVE, 1=MASTER)
-        prefs.putUChar("mode", (mode == DEVICE_MASTER) ? 1 : 0);
-        
-        // Guardar MAC del maestro solo si es esclavo
-        if (mode == DEVICE_SLAVE && masterMac.length() > 0) {
-            prefs.putString("master_mac", masterMac);
-            stringToMac(masterMac, MASTER_MAC_ADDRESS);
-        }
-        
-        prefs.end();
-        Serial.printf("[Config] Configuración guardada - Modo: %s\n", 
-                     (mode == DEVICE_MASTER) ? "MAESTRO" : "ESCLAVO");
+bool WiFiManager::saveDeviceConfig(DeviceMode mode, const String& masterMac) {
+    if (!configStore.setDevice(mode, masterMac)) {
+        return false;
     }
-    
-    CURRENT_DEVICE_MODE = mode;
+    Serial.printf("[Config] Configuración preparada - Modo: %s\n", 
+                 (mode == DEVICE_MASTER) ? "MAESTRO" : "ESCLAVO");
+    return true;
 }
 
 String WiFiManager::macToString(const uint8_t* mac) {
@@ -328,112 +312,34 @@ String WiFiManager::macToString(const uint8_t* mac) {
     return String(macStr);
 }
 
-void WiFiManager::stringToMac(const String& macStr, uint8_t* mac) {
-    int values[6];
-    if (sscanf(macStr.c_str(), "%x:%x:%x:%x:%x:%x",
-               &values[0], &values[1], &values[2],
-               &values[3], &values[4], &values[5]) == 6) {
-        for (int i = 0; i < 6; i++) {
-            mac[i] = (uint8_t)values[i];
-        }
-    }
-}
-
 // ==================== Verificación de Configuración ====================
 bool WiFiManager::isConfigured() {
-    Preferences prefs;
-    bool configured = false;
-    
-    if (prefs.begin("device_cfg", true)) {
-        uint8_t mode = prefs.getUChar("mode", 0);
-        
-        if (mode == 1) {
-            // MAESTRO: verificar que tenga WiFi configurado
-            prefs.end();
-            if (prefs.begin("wifi_cfg", true)) {
-                String ssid = prefs.getString("ssid", "");
-                configured = (ssid.length() > 0);
-                prefs.end();
-            }
-        } else {
-            // ESCLAVO: verificar que tenga MAC del maestro
-            String macStr = prefs.getString("master_mac", "");
-            configured = (macStr.length() >= 17);
-            prefs.end();
-        }
-    }
-    
-    return configured;
+    return configStore.isConfigured();
 }
 
 void WiFiManager::clearAllConfig() {
     Serial.println("[Config] Limpiando TODA la configuración...");
     
-    Preferences prefs;
-    
-    // Limpiar configuración WiFi
-    if (prefs.begin("wifi_cfg", false)) {
-        prefs.clear();
-        prefs.end();
-        Serial.println("[Config] WiFi limpiado");
-    }
-    
-    // Limpiar configuración del dispositivo
-    if (prefs.begin("device_cfg", false)) {
-        prefs.clear();
-        prefs.end();
-        Serial.println("[Config] Dispositivo limpiado");
-    }
-    
-    // Limpiar configuración de ubicación
-    if (prefs.begin("location_cfg", false)) {
-        prefs.clear();
-        prefs.end();
-        Serial.println("[Config] Ubicacion limpiada");
-    }
+    configStore.clear();
     
     // Resetear variables
     currentSSID = "";
     currentPassword = "";
-    CURRENT_DEVICE_MODE = DEVICE_SLAVE;  // Por defecto ESCLAVO
     
     Serial.println("[Config] Configuracion limpiada completamente");
 }
 
-// ==================== Resolver DNS con Retry ====================
+// ==================== Resolver DNS ====================
 bool WiFiManager::resolveBackendDNS(IPAddress& ip) {
     const char* hostname = "bovino-io-backend.onrender.com";
-    const int MAX_DNS_RETRIES = 3;
-    const int DNS_RETRY_DELAY = 2000;
     
-    // Si ya tenemos IP en cache, usar ese
-    if (backendIPCached) {
-        ip = cachedBackendIP;
-        Serial.printf("[DNS] Usando IP en cache: %s\n", ip.toString().c_str());
+    // Cache compartido con TTL; solo espera si no hay una respuesta vigente
+    if (dnsResolver.resolve(hostname, ip)) {
+        Serial.printf("[DNS] %s -> %s\n", hostname, ip.toString().c_str());
         return true;
     }
     
-    // Intentar resolver DNS con retries
-    for (int i = 0; i < MAX_DNS_RETRIES; i++) {
-        Serial.printf("[DNS] Intento %d/%d resolviendo: %s\n", i + 1, MAX_DNS_RETRIES, hostname);
-        
-        if (WiFi.hostByName(hostname, ip)) {
-            Serial.printf("[DNS] Resuelto exitosamente: %s\n", ip.toString().c_str());
-            // Guardar en cache
-            cachedBackendIP = ip;
-            backendIPCached = true;
-            return true;
-        }
-        
-        Serial.printf("[DNS] Fallo intento %d\n", i + 1);
-        
-        if (i < MAX_DNS_RETRIES - 1) {
-            Serial.printf("[DNS] Esperando %dms antes de reintentar...\n", DNS_RETRY_DELAY);
-            delay(DNS_RETRY_DELAY);
-        }
-    }
-    
-    Serial.println("[DNS] ERROR: No se pudo resolver DNS despues de todos los intentos");
+    Serial.println("[DNS] ERROR: No se pudo resolver DNS del backend");
     return false;
 }
 
@@ -455,14 +361,14 @@ String WiFiManager::loginUser(const String& email, const String& password) {
         return "{\"success\":false,\"message\":\"No se pudo resolver DNS del servidor\"}";
     }
     
-    WiFiClientSecure *client = new WiFiClientSecure();
+    SecureClient *client = new SecureClient();
     if (!client) {
         Serial.println("[GraphQL] Error: No se pudo crear cliente SSL");
         return "{\"success\":false,\"message\":\"Error de memoria\"}";
     }
     
     Serial.println("[GraphQL] Configurando cliente SSL...");
-    client->setInsecure();
+    client->setTrustAnchor(BACKEND_ROOT_CA);
     client->setTimeout(90);
     Serial.printf("[GraphQL] Cliente configurado - Timeout: 90s\n");
     
@@ -501,20 +407,25 @@ String WiFiManager::loginUser(const String& email, const String& password) {
     Serial.printf("[GraphQL] Mutation JSON:\n%s\n", mutation.c_str());
     
     http.addHeader("Content-Type", "application/json");
+    http.useHTTP10(true);  // Sin chunked: el cuerpo se parsea directo del socket
     
     int httpCode = http.POST(mutation);
     
     String result = "{\"success\":false,\"message\":\"Error desconocido\"}";
     
     if (httpCode > 0) {
-        String response = http.getString();
         Serial.printf("[GraphQL] Respuesta HTTP: %d\n", httpCode);
-        Serial.printf("[GraphQL] Respuesta: %s\n", response.c_str());
         
         if (httpCode == 200) {
-            const size_t capacity = JSON_OBJECT_SIZE(10) + 200;
-            DynamicJsonDocument doc(capacity);
-            DeserializationError error = deserializeJson(doc, response);
+            // Solo los campos usados; el resto de la respuesta no se guarda
+            StaticJsonDocument<128> filter;
+            filter["data"]["login"]["id_user"] = true;
+            filter["data"]["login"]["name"] = true;
+            filter["errors"][0]["message"] = true;
+            
+            StaticJsonDocument<768> doc;
+            HttpBodyStream body(http.getStream(), http.getSize(), false, 60000);
+            DeserializationError error = deserializeJson(doc, body, DeserializationOption::Filter(filter));
             
             if (!error) {
                 if (doc.containsKey("data")) {
@@ -596,13 +507,13 @@ String WiFiManager::fetchZonesFromGraphQL(int userId) {
     }
     
     // Cliente WiFi seguro
-    WiFiClientSecure *client = new WiFiClientSecure();
+    SecureClient *client = new SecureClient();
     if (!client) {
         Serial.println("[GraphQL] Error: No se pudo crear cliente SSL");
         return "[]";
     }
     
-    client->setInsecure();
+    client->setTrustAnchor(BACKEND_ROOT_CA);
     client->setTimeout(90);  // Aumentado a 90 segundos
     
     HTTPClient http;
@@ -622,59 +533,42 @@ String WiFiManager::fetchZonesFromGraphQL(int userId) {
     String query = "{\"query\":\"query($userId:Int!){ zonesByUser(userId:$userId){ id name } }\",\"variables\":{\"userId\":" + String(userId) + "}}";
     
     http.addHeader("Content-Type", "application/json");
+    http.useHTTP10(true);  // Sin chunked: el cuerpo se parsea directo del socket
     
     int httpCode = http.POST(query);
     
     String result = "[]";
     
     if (httpCode > 0) {
-        String response = http.getString();
         Serial.printf("[GraphQL] Respuesta HTTP: %d\n", httpCode);
-        Serial.printf("[GraphQL] Respuesta completa: %s\n", response.c_str());
         
         if (httpCode == 200) {
-            // Parsear respuesta GraphQL
-            const size_t capacity = JSON_ARRAY_SIZE(10) + JSON_OBJECT_SIZE(50);
-            DynamicJsonDocument doc(capacity);
-            DeserializationError error = deserializeJson(doc, response);
+            // Cada zona se parsea y se agrega al resultado de a una, así el
+            // consumo de memoria no depende de cuántas zonas tenga el usuario
+            StaticJsonDocument<64> filter;
+            filter["id"] = true;
+            filter["name"] = true;
             
-            if (!error) {
-                // Extraer zonas del response
-                if (doc.containsKey("data")) {
-                    JsonObject dataObj = doc["data"];
-                    if (dataObj.containsKey("zonesByUser")) {
-                        JsonArray zones = dataObj["zonesByUser"];
-                        
-                        // Construir resultado como array JSON
-                        DynamicJsonDocument resultDoc(JSON_ARRAY_SIZE(10) + JSON_OBJECT_SIZE(20));
-                        JsonArray resultArray = resultDoc.createNestedArray();
-                        
-                        int zoneCount = 0;
-                        for (JsonVariant item : zones) {
-                            if (item.is<JsonObject>()) {
-                                JsonObject zoneObj = resultArray.createNestedObject();
-                                if (item.containsKey("id")) {
-                                    zoneObj["id"] = item["id"];
-                                }
-                                if (item.containsKey("name")) {
-                                    zoneObj["name"] = item["name"];
-                                }
-                                zoneCount++;
-                            }
-                        }
-                        
-                        result = "";  // Limpiar el string antes de serializar
-                        serializeJson(resultArray, result);
-                        Serial.printf("[GraphQL] Zonas obtenidas: %d\n", zoneCount);
-                        Serial.printf("[GraphQL] JSON resultado: %s\n", result.c_str());
-                    } else {
-                        Serial.println("[GraphQL] Error: Campo 'zonesByUser' no encontrado");
-                    }
-                } else {
-                    Serial.println("[GraphQL] Error: Campo 'data' no encontrado");
+            String zonesArray = "[";
+            HttpBodyStream body(http.getStream(), http.getSize(), false, 60000);
+            int zoneCount = streamJsonArray(body, "zonesByUser", filter, 256, [&](JsonObjectConst item) {
+                StaticJsonDocument<192> zone;
+                zone["id"] = item["id"];
+                zone["name"] = item["name"];
+                String entry;
+                serializeJson(zone, entry);
+                if (zonesArray.length() > 1) {
+                    zonesArray += ",";
                 }
+                zonesArray += entry;
+            });
+            
+            if (zoneCount >= 0) {
+                result = zonesArray + "]";
+                Serial.printf("[GraphQL] Zonas obtenidas: %d\n", zoneCount);
+                Serial.printf("[GraphQL] JSON resultado: %s\n", result.c_str());
             } else {
-                Serial.printf("[GraphQL] Error JSON: %s\n", error.c_str());
+                Serial.println("[GraphQL] Error: Campo 'zonesByUser' no encontrado");
             }
         } else {
             Serial.printf("[GraphQL] Error HTTP: %d\n", httpCode);
@@ -700,26 +594,15 @@ bool WiFiManager::updateDispositivoStatus(int dispositivoId, const String& statu
         return false;
     }
     
-    // Resolver DNS con retry (pero con timeout corto)
+    // Sin IP conocida no se bloquea: la actualización es opcional
     IPAddress serverIP;
-    if (!backendIPCached) {
-        Serial.println("[GraphQL] IP no en cache, intentando resolver DNS rapido...");
-        // Solo 1 intento para no bloquear
-        if (WiFi.hostByName("bovino-io-backend.onrender.com", serverIP)) {
-            Serial.printf("[GraphQL] DNS resuelto: %s\n", serverIP.toString().c_str());
-            cachedBackendIP = serverIP;
-            backendIPCached = true;
-        } else {
-            Serial.println("[GraphQL] DNS no pudo resolverse - saltando actualizacion");
-            return false;
-        }
-    } else {
-        serverIP = cachedBackendIP;
-        Serial.printf("[GraphQL] Usando IP en cache: %s\n", serverIP.toString().c_str());
+    if (!dnsResolver.lookup("bovino-io-backend.onrender.com", serverIP)) {
+        Serial.println("[GraphQL] DNS aun no resuelto - saltando actualizacion");
+        return false;
     }
     
-    WiFiClientSecure client;
-    client.setInsecure();
+    SecureClient client;
+    client.setTrustAnchor(BACKEND_ROOT_CA);
     client.setTimeout(10);  // Timeout corto de 10s
     
     HTTPClient http;
@@ -739,33 +622,32 @@ bool WiFiManager::updateDispositivoStatus(int dispositivoId, const String& statu
     Serial.printf("[GraphQL] Mutation: %s\n", mutation.c_str());
     
     http.addHeader("Content-Type", "application/json");
+    http.useHTTP10(true);  // Sin chunked: el cuerpo se parsea directo del socket
     
     int httpCode = http.POST(mutation);
     bool success = false;
     
     if (httpCode > 0) {
-        String response = http.getString();
         Serial.printf("[GraphQL] Respuesta HTTP: %d\n", httpCode);
-        Serial.printf("[GraphQL] Respuesta: %s\n", response.c_str());
         
         if (httpCode == 200) {
-            const size_t capacity = JSON_OBJECT_SIZE(10) + 200;
-            DynamicJsonDocument doc(capacity);
-            DeserializationError error = deserializeJson(doc, response);
+            StaticJsonDocument<96> filter;
+            filter["data"]["updateDispositivo"]["id"] = true;
+            filter["errors"][0]["message"] = true;
+            
+            StaticJsonDocument<512> doc;
+            HttpBodyStream body(http.getStream(), http.getSize(), false, 12000);
+            DeserializationError error = deserializeJson(doc, body, DeserializationOption::Filter(filter));
             
             if (!error) {
-                if (doc.containsKey("data")) {
-                    JsonObject dataObj = doc["data"];
-                    if (dataObj.containsKey("updateDispositivo")) {
-                        Serial.println("[GraphQL] Dispositivo actualizado correctamente");
-                        success = true;
-                    } else {
-                        Serial.println("[GraphQL] Error: Campo 'updateDispositivo' no encontrado");
-                    }
+                if (!doc["data"]["updateDispositivo"].isNull()) {
+                    Serial.println("[GraphQL] Dispositivo actualizado correctamente");
+                    success = true;
                 } else if (doc.containsKey("errors")) {
-                    Serial.println("[GraphQL] Error en mutation: respuesta con errores");
+                    const char* errorMsg = doc["errors"][0]["message"] | "sin detalle";
+                    Serial.printf("[GraphQL] Error en mutation: %s\n", errorMsg);
                 } else {
-                    Serial.println("[GraphQL] Error: Respuesta inválida");
+                    Serial.println("[GraphQL] Error: Campo 'updateDispositivo' no encontrado");
                 }
             } else {
                 Serial.printf("[GraphQL] Error JSON: %s\n", error.c_str());
@@ -799,8 +681,8 @@ String WiFiManager::fetchSublocationsFromGraphQL(int zoneId) {
     }
     
     // Cliente WiFi seguro para HTTPS
-    WiFiClientSecure client;
-    client.setInsecure();  // Deshabilitar verificación SSL
+    SecureClient client;
+    client.setTrustAnchor(BACKEND_ROOT_CA);
     client.setTimeout(15);  // 15 segundos timeout
     
     HTTPClient http;
@@ -822,88 +704,70 @@ String WiFiManager::fetchSublocationsFromGraphQL(int zoneId) {
     Serial.printf("[GraphQL] Query: %s\n", query.c_str());
     
     http.addHeader("Content-Type", "application/json");
+    http.useHTTP10(true);  // Sin chunked: el cuerpo se parsea directo del socket
     
     int httpCode = http.POST(query);
     
     String result = "[]";
     
     if (httpCode > 0) {
-        String response = http.getString();
         Serial.printf("[GraphQL] Respuesta HTTP: %d\n", httpCode);
-        Serial.printf("[GraphQL] Respuesta completa: %s\n", response.c_str());
         
         if (httpCode == 200) {
-            const size_t capacity = JSON_ARRAY_SIZE(20) + JSON_OBJECT_SIZE(100);
-            DynamicJsonDocument doc(capacity);
-            DeserializationError error = deserializeJson(doc, response);
+            // Un dispositivo a la vez y solo los campos usados: una zona con
+            // muchos dispositivos ya no desborda un documento de tamaño fijo
+            StaticJsonDocument<128> filter;
+            filter["id"] = true;
+            filter["type"] = true;
+            filter["location"] = true;
+            filter["mac_address"] = true;
+            filter["status"] = true;
             
-            if (!error) {
-                if (doc.containsKey("data")) {
-                    JsonObject dataObj = doc["data"];
-                    if (dataObj.containsKey("dispositivosByZone")) {
-                        JsonArray devices = dataObj["dispositivosByZone"];
-                        
-                        DynamicJsonDocument resultDoc(JSON_ARRAY_SIZE(20) + JSON_OBJECT_SIZE(50));
-                        JsonArray resultArray = resultDoc.createNestedArray();
-                        
-                        // Limpiar MAC detectada al inicio
-                        detectedMasterMac = "";
-                        
-                        int deviceCount = 0;
-                        for (JsonVariant item : devices) {
-                            if (item.is<JsonObject>()) {
-                                // FILTRO: Solo incluir dispositivos con status="pending"
-                                String deviceStatus = "";
-                                if (item.containsKey("status")) {
-                                    deviceStatus = item["status"].as<String>();
-                                }
-                                
-                                // Extraer tipo y MAC del dispositivo
-                                String deviceType = "";
-                                if (item.containsKey("type")) {
-                                    deviceType = item["type"].as<String>();
-                                }
-                                
-                                String deviceMac = "";
-                                if (item.containsKey("mac_address")) {
-                                    deviceMac = item["mac_address"].as<String>();
-                                }
-                                
-                                // Guardar MAC del maestro si lo encontramos
-                                if (deviceType == "master" && deviceMac.length() > 0) {
-                                    detectedMasterMac = deviceMac;
-                                    Serial.printf("[GraphQL] MAC del maestro detectado: %s\n", detectedMasterMac.c_str());
-                                }
-                                
-                                // Solo agregar si el estado es "pending" (disponible)
-                                if (deviceStatus == "pending") {
-                                    JsonObject sublocObj = resultArray.createNestedObject();
-                                    if (item.containsKey("id")) {
-                                        sublocObj["id"] = item["id"];
-                                    }
-                                    // Combinar type/location
-                                    String sublocation = "";
-                                    if (item.containsKey("type") && item.containsKey("location")) {
-                                        sublocation = String(item["type"].as<const char*>()) + "/" + String(item["location"].as<const char*>());
-                                        sublocObj["name"] = sublocation;
-                                    }
-                                    deviceCount++;
-                                }
-                            }
-                        }
-                        
-                        result = "";
-                        serializeJson(resultArray, result);
-                        Serial.printf("[GraphQL] Sublocalidades obtenidas: %d\n", deviceCount);
-                        Serial.printf("[GraphQL] JSON resultado: %s\n", result.c_str());
-                    } else {
-                        Serial.println("[GraphQL] Error: Campo 'dispositivosByZone' no encontrado");
-                    }
-                } else {
-                    Serial.println("[GraphQL] Error: Campo 'data' no encontrado");
+            // Limpiar MAC detectada al inicio
+            detectedMasterMac = "";
+            
+            int deviceCount = 0;
+            String sublocationsArray = "[";
+            HttpBodyStream body(http.getStream(), http.getSize(), false, 20000);
+            int totalDevices = streamJsonArray(body, "dispositivosByZone", filter, 384, [&](JsonObjectConst item) {
+                String deviceType = item["type"] | "";
+                String deviceMac = item["mac_address"] | "";
+                String deviceStatus = item["status"] | "";
+                
+                // Guardar MAC del maestro si lo encontramos
+                if (deviceType == "master" && deviceMac.length() > 0) {
+                    detectedMasterMac = deviceMac;
+                    Serial.printf("[GraphQL] MAC del maestro detectado: %s\n", detectedMasterMac.c_str());
                 }
+                
+                // FILTRO: Solo incluir dispositivos con status="pending" (disponible)
+                if (deviceStatus != "pending") {
+                    return;
+                }
+                
+                StaticJsonDocument<192> subloc;
+                if (item.containsKey("id")) {
+                    subloc["id"] = item["id"];
+                }
+                // Combinar type/location
+                if (item.containsKey("type") && item.containsKey("location")) {
+                    subloc["name"] = deviceType + "/" + String(item["location"] | "");
+                }
+                String entry;
+                serializeJson(subloc, entry);
+                if (sublocationsArray.length() > 1) {
+                    sublocationsArray += ",";
+                }
+                sublocationsArray += entry;
+                deviceCount++;
+            });
+            
+            if (totalDevices >= 0) {
+                result = sublocationsArray + "]";
+                Serial.printf("[GraphQL] Sublocalidades obtenidas: %d (de %d dispositivos)\n", deviceCount, totalDevices);
+                Serial.printf("[GraphQL] JSON resultado: %s\n", result.c_str());
             } else {
-                Serial.printf("[GraphQL] Error JSON: %s\n", error.c_str());
+                Serial.println("[GraphQL] Error: Campo 'dispositivosByZone' no encontrado");
             }
         } else {
             Serial.printf("[GraphQL] Error HTTP: %d\n", httpCode);
@@ -917,21 +781,10 @@ String WiFiManager::fetchSublocationsFromGraphQL(int zoneId) {
 }
 
 String WiFiManager::saveDeviceLocation(const String& zoneName, const String& subLocation, int zoneId) {
-    Preferences prefs;
-    if (prefs.begin("location_cfg", false)) {
-        prefs.putString("zone_name", zoneName);
-        prefs.putString("sub_location", subLocation);
-        prefs.putInt("zone_id", zoneId);
-        prefs.end();
-        Serial.printf("[Config] Ubicación guardada - Zona: %s (ID: %d), Sublocalización: %s\n", 
-                     zoneName.c_str(), zoneId, subLocation.c_str());
-        
-        // Actualizar variable global
-        LOADED_ZONE_ID = zoneId;
-        
-        return "OK";
-    }
-    return "ERROR";
+    configStore.setLocation(zoneName, subLocation, zoneId);
+    Serial.printf("[Config] Ubicación preparada - Zona: %s (ID: %d), Sublocalización: %s\n", 
+                 zoneName.c_str(), zoneId, subLocation.c_str());
+    return "OK";
 }
 
 // ==================== Portal de Configuración ====================
@@ -989,13 +842,11 @@ void WiFiManager::startConfigPortal() {
     // Iniciar servidor DNS para Captive Portal
     // Redirige TODAS las peticiones DNS a la IP del ESP32
     const byte DNS_PORT = 53;
-    bool dnsStarted = dnsServer.start(DNS_PORT, "*", local_IP);
+    bool dnsStarted = dnsServer.start(DNS_PORT, local_IP);
     if (dnsStarted) {
-        dnsServerActive = true;  // Marcar DNS como activo
         Serial.printf("[Portal] DNS Server iniciado en puerto %d (Captive Portal activo)\n", DNS_PORT);
         Serial.printf("[Portal] Redirigiendo todas las DNS queries a %s\n", local_IP.toString().c_str());
     } else {
-        dnsServerActive = false;
         Serial.println("[Portal] [ADVERTENCIA] No se pudo iniciar DNS Server");
     }
     
@@ -1022,819 +873,456 @@ void WiFiManager::startConfigPortal() {
     Serial.println("[Portal] =================================");
 }
 
-// Helper para agregar headers CORS a todas las respuestas
-void WiFiManager::sendCORSHeaders() {
-    configServer.sendHeader("Access-Control-Allow-Origin", "*");
-    configServer.sendHeader("Access-Control-Allow-Methods", "GET, POST, OPTIONS");
-    configServer.sendHeader("Access-Control-Allow-Headers", "Content-Type");
-}
-
 void WiFiManager::setupPortalRoutes() {
-    // Handler para peticiones OPTIONS (preflight CORS)
-    configServer.onNotFound([this]() {
-        if (configServer.method() == HTTP_OPTIONS) {
-            sendCORSHeaders();
-            configServer.send(200);
-            return;
-        }
-        IPAddress clientIP = configServer.client().remoteIP();
-        String path = configServer.uri();
-        Serial.printf("[Portal] Ruta no encontrada desde %s: %s - Redirigiendo a /\n", 
-                      clientIP.toString().c_str(), path.c_str());
-        configServer.sendHeader("Location", "/");
-        configServer.send(302);
-    });
-    
+    // Rutas de una ejecución anterior del portal
+    configServer.reset();
+
+    // Headers CORS en todas las respuestas (se registran una sola vez)
+    static bool corsHeadersAdded = false;
+    if (!corsHeadersAdded) {
+        DefaultHeaders::Instance().addHeader("Access-Control-Allow-Origin", "*");
+        DefaultHeaders::Instance().addHeader("Access-Control-Allow-Methods", "GET, POST, OPTIONS");
+        DefaultHeaders::Instance().addHeader("Access-Control-Allow-Headers", "Content-Type");
+        corsHeadersAdded = true;
+    }
+
     // Ruta principal
-    configServer.on("/", HTTP_GET, [this]() {
-        IPAddress clientIP = configServer.client().remoteIP();
-        Serial.printf("[Portal] GET / desde %s\n", clientIP.toString().c_str());
-        sendCORSHeaders();
-        configServer.send(200, "text/html", renderPortalPage(""));
+    configServer.on("/", HTTP_GET, [this](AsyncWebServerRequest* request) {
+        Serial.printf("[Portal] GET / desde %s\n", request->client()->remoteIP().toString().c_str());
+        sendPortalPage(request, false);
+    });
+
+    // Datos dinámicos de la página (la página en sí es estática)
+    configServer.on("/status.json", HTTP_GET, [this](AsyncWebServerRequest* request) {
+        uint8_t localMac[6];
+        WiFi.macAddress(localMac);
+        String macCompact = WiFi.macAddress();
+        macCompact.replace(":", "");
+
+        StaticJsonDocument<256> status;
+        status["mac"] = macToString(localMac);
+        status["mac_compact"] = macCompact;
+        status["ip"] = WiFi.softAPIP().toString();
+        status["message"] = (WiFi.status() == WL_CONNECTED) ? "WiFi conectado: " + WiFi.SSID() : String("");
+        String json;
+        serializeJson(status, json);
+
+        AsyncWebServerResponse* response = request->beginResponse(200, "application/json", json);
+        response->addHeader("Cache-Control", "no-store");
+        request->send(response);
+    });
+
+    // Estado de un trabajo en segundo plano: 202 mientras corre, 200 con el resultado
+    configServer.on("/job", HTTP_GET, [this](AsyncWebServerRequest* request) {
+        uint32_t jobId = (uint32_t)request->arg("id").toInt();
+        String result;
+        PortalJobState state = portalJobs.poll(jobId, result);
+
+        if (state == PORTAL_JOB_DONE) {
+            sendJson(request, 200, result);
+        } else if (state == PORTAL_JOB_UNKNOWN) {
+            sendJson(request, 404, "{\"success\":false,\"message\":\"Trabajo desconocido\"}");
+        } else {
+            String json = "{\"job\":" + String(jobId) + ",\"state\":\"" +
+                          (state == PORTAL_JOB_RUNNING ? "running" : "pending") + "\"}";
+            sendJson(request, 202, json);
+        }
     });
 
     // Ruta para login de usuario
-    configServer.on("/login", HTTP_POST, [this]() {
-        IPAddress clientIP = configServer.client().remoteIP();
-        Serial.printf("[Portal] POST /login desde %s\n", clientIP.toString().c_str());
+    configServer.on("/login", HTTP_POST, [this](AsyncWebServerRequest* request) {
+        Serial.printf("[Portal] POST /login desde %s\n", request->client()->remoteIP().toString().c_str());
         
-        sendCORSHeaders();
-        
-        String email = configServer.arg("email");
-        String password = configServer.arg("password");
+        String email = request->arg("email");
+        String password = request->arg("password");
         
         email.trim();
         password.trim();
         
         if (email.length() == 0 || password.length() == 0) {
-            configServer.send(200, "application/json", "{\"success\":false,\"message\":\"Email y contraseña requeridos\"}");
+            sendJson(request, 200, "{\"success\":false,\"message\":\"Email y contraseña requeridos\"}");
             return;
         }
         
         if (WiFi.status() != WL_CONNECTED) {
-            configServer.send(200, "application/json", "{\"success\":false,\"message\":\"WiFi no conectado\"}");
+            sendJson(request, 200, "{\"success\":false,\"message\":\"WiFi no conectado\"}");
             return;
         }
         
-        Serial.printf("[Portal] Intentando login: %s\n", email.c_str());
-        
-        // Liberar memoria antes de operación HTTPS
-        Serial.printf("[Portal] Memoria libre antes de login: %d bytes\n", ESP.getFreeHeap());
-        delay(500);  // Breve pausa para estabilizar conexión
-        
-        String loginResult = loginUser(email, password);
-        
-        Serial.printf("[Portal] Resultado login: %s\n", loginResult.c_str());
-        
-        configServer.send(200, "application/json", loginResult);
+        submitJob(request, "login", [this, email, password]() {
+            Serial.printf("[Portal] Intentando login: %s\n", email.c_str());
+            Serial.printf("[Portal] Memoria libre antes de login: %d bytes\n", ESP.getFreeHeap());
+            delay(500);  // Breve pausa para estabilizar conexión
+
+            String loginResult = loginUser(email, password);
+            Serial.printf("[Portal] Resultado login: %s\n", loginResult.c_str());
+            return loginResult;
+        });
     });
 
     // Ruta para conectar WiFi y verificar conexión
-    configServer.on("/connectWifi", HTTP_POST, [this]() {
-        IPAddress clientIP = configServer.client().remoteIP();
-        Serial.printf("[Portal] POST /connectWifi desde %s\n", clientIP.toString().c_str());
-        
-        sendCORSHeaders();
+    configServer.on("/connectWifi", HTTP_POST, [this](AsyncWebServerRequest* request) {
+        Serial.printf("[Portal] POST /connectWifi desde %s\n", request->client()->remoteIP().toString().c_str());
         
-        String ssid = configServer.arg("ssid");
-        String password = configServer.arg("password");
+        String ssid = request->arg("ssid");
+        String password = request->arg("password");
         
         ssid.trim();
         password.trim();
         
         if (ssid.length() == 0) {
-            configServer.send(200, "application/json", "{\"success\":false,\"message\":\"SSID vacío\"}");
+            sendJson(request, 200, "{\"success\":false,\"message\":\"SSID vacío\"}");
             return;
         }
         
-        Serial.printf("[Portal] Intentando conectar a WiFi: %s\n", ssid.c_str());
-        
-        // Cambiar a modo DUAL (AP + STA) para conectar a WiFi externo
-        WiFi.mode(WIFI_AP_STA);
-        delay(100);
-        
-        // Conectar al WiFi externo
-        WiFi.begin(ssid.c_str(), password.c_str());
-        
-        // Esperar hasta 15 segundos por conexión
-        int attempts = 0;
-        while (WiFi.status() != WL_CONNECTED && attempts < 30) {
-            delay(500);
-            Serial.print(".");
-            attempts++;
-        }
-        
-        if (WiFi.status() == WL_CONNECTED) {
-            Serial.println("\n[Portal] WiFi conectado exitosamente");
-            Serial.printf("[Portal] IP obtenida: %s\n", WiFi.localIP().toString().c_str());
-            
-            // Detener DNS server para liberar memoria (ya no se necesita)
-            dnsServer.stop();
-            dnsServerActive = false;
-            Serial.println("[Portal] DNS Server detenido (ya no se necesita)");
-            
-            // Mantener portal accesible durante configuración
-            Serial.println("[Portal] IMPORTANTE: Portal sigue activo en ambas redes:");
-            Serial.printf("[Portal]   - Access Point: http://%s\n", WiFi.softAPIP().toString().c_str());
-            Serial.printf("[Portal]   - Red WiFi: http://%s\n", WiFi.localIP().toString().c_str());
-            Serial.println("[Portal] Si pierdes conexión, reconéctate al AP bovino_io_xxx");
-            
-            // Guardar credenciales WiFi
-            saveCredentials(ssid, password);
-            
-            // Liberar memoria manualmente
-            Serial.printf("[Portal] Memoria libre post-WiFi: %d bytes\n", ESP.getFreeHeap());
-            
-            configServer.send(200, "application/json", "{\"success\":true,\"message\":\"WiFi conectado\",\"ip\":\"" + WiFi.localIP().toString() + "\",\"portalIP\":\"" + WiFi.softAPIP().toString() + "\"}");
-        } else {
-            Serial.println("\n[Portal] Error al conectar WiFi");
-            WiFi.disconnect();
-            WiFi.mode(WIFI_AP);  // Volver a modo AP puro
-            configServer.send(200, "application/json", "{\"success\":false,\"message\":\"No se pudo conectar al WiFi\"}");
-        }
+        submitJob(request, "connectWifi", [this, ssid, password]() {
+            return connectPortalWifi(ssid, password);
+        });
     });
 
     // Ruta para obtener zonas desde GraphQL
-    configServer.on("/getZones", HTTP_GET, [this]() {
-        IPAddress clientIP = configServer.client().remoteIP();
-        Serial.printf("[Portal] GET /getZones desde %s\n", clientIP.toString().c_str());
-        
-        sendCORSHeaders();
-        
-        // Verificar si hay usuario logueado
-        if (loggedUserId == 0) {
-            Serial.println("[Portal] No hay usuario logueado");
-            configServer.send(200, "application/json", "{\"zones\":[],\"error\":\"Usuario no autenticado\"}");
-            return;
-        }
+    configServer.on("/getZones", HTTP_GET, [this](AsyncWebServerRequest* request) {
+        Serial.printf("[Portal] GET /getZones desde %s\n", request->client()->remoteIP().toString().c_str());
         
         // Verificar si WiFi está conectado
         if (WiFi.status() != WL_CONNECTED) {
             Serial.println("[Portal] WiFi NO conectado. No se pueden obtener zonas.");
-            configServer.send(200, "application/json", "{\"zones\":[],\"error\":\"WiFi no conectado\"}");
+            sendJson(request, 200, "{\"zones\":[],\"error\":\"WiFi no conectado\"}");
             return;
         }
         
-        Serial.printf("[Portal] WiFi conectado - IP: %s\n", WiFi.localIP().toString().c_str());
-        Serial.printf("[Portal] Usuario logueado - ID: %d\n", loggedUserId);
-        
-        // ⚡ CRÍTICO: Pequeño delay adicional para asegurar estabilidad de memoria
-        // antes de la primera llamada HTTPS que requiere ~8-12KB de heap contiguo
-        delay(500);
-        
-        Serial.println("[Portal] Llamando a fetchZonesFromGraphQL...");
-        
-        String zonesJson = fetchZonesFromGraphQL(loggedUserId);
-        
-        Serial.printf("[Portal] Zonas JSON recibido (longitud: %d): %s\n", zonesJson.length(), zonesJson.c_str());
-        
-        String response = "{\"zones\":" + zonesJson + "}";
-        Serial.printf("[Portal] Enviando respuesta: %s\n", response.c_str());
-        
-        configServer.send(200, "application/json", response);
+        // loggedUserId lo escribe el trabajo de login: se lee también en el loop
+        submitJob(request, "getZones", [this]() -> String {
+            // Verificar si hay usuario logueado
+            if (loggedUserId == 0) {
+                Serial.println("[Portal] No hay usuario logueado");
+                return "{\"zones\":[],\"error\":\"Usuario no autenticado\"}";
+            }
+            int userId = loggedUserId;
+            Serial.printf("[Portal] Usuario logueado - ID: %d\n", userId);
+
+            // ⚡ CRÍTICO: Pequeño delay adicional para asegurar estabilidad de memoria
+            // antes de la primera llamada HTTPS que requiere ~8-12KB de heap contiguo
+            delay(500);
+
+            String zonesJson = fetchZonesFromGraphQL(userId);
+            Serial.printf("[Portal] Zonas JSON recibido (longitud: %d)\n", zonesJson.length());
+            return "{\"zones\":" + zonesJson + "}";
+        });
     });
 
     // Ruta para obtener sublocalidades por zona
-    configServer.on("/getSublocations", HTTP_GET, [this]() {
-        IPAddress clientIP = configServer.client().remoteIP();
-        Serial.printf("[Portal] GET /getSublocations desde %s\n", clientIP.toString().c_str());
-        
-        sendCORSHeaders();
+    configServer.on("/getSublocations", HTTP_GET, [this](AsyncWebServerRequest* request) {
+        Serial.printf("[Portal] GET /getSublocations desde %s\n", request->client()->remoteIP().toString().c_str());
         
-        String zoneIdStr = configServer.arg("zone_id");
-        int zoneId = zoneIdStr.toInt();
+        int zoneId = request->arg("zone_id").toInt();
         
         if (zoneId == 0) {
             Serial.println("[Portal] zone_id invalido o no proporcionado");
-            configServer.send(200, "application/json", "{\"sublocations\":[],\"error\":\"zone_id requerido\"}");
+            sendJson(request, 200, "{\"sublocations\":[],\"error\":\"zone_id requerido\"}");
             return;
         }
         
         if (WiFi.status() != WL_CONNECTED) {
             Serial.println("[Portal] WiFi NO conectado");
-            configServer.send(200, "application/json", "{\"sublocations\":[],\"error\":\"WiFi no conectado\"}");
+            sendJson(request, 200, "{\"sublocations\":[],\"error\":\"WiFi no conectado\"}");
             return;
         }
         
-        Serial.printf("[Portal] Obteniendo sublocalidades para zona ID: %d\n", zoneId);
-        
-        String sublocationsJson = fetchSublocationsFromGraphQL(zoneId);
-        
-        Serial.printf("[Portal] Sublocalidades JSON (longitud: %d): %s\n", sublocationsJson.length(), sublocationsJson.c_str());
-        
-        String response = "{\"sublocations\":" + sublocationsJson + "}";
-        Serial.printf("[Portal] Enviando respuesta: %s\n", response.c_str());
-        
-        configServer.send(200, "application/json", response);
+        submitJob(request, "getSublocations", [this, zoneId]() {
+            Serial.printf("[Portal] Obteniendo sublocalidades para zona ID: %d\n", zoneId);
+            String sublocationsJson = fetchSublocationsFromGraphQL(zoneId);
+            Serial.printf("[Portal] Sublocalidades JSON (longitud: %d)\n", sublocationsJson.length());
+            return "{\"sublocations\":" + sublocationsJson + "}";
+        });
     });
 
     // Manejador OPTIONS para CORS preflight en /save
-    configServer.on("/save", HTTP_OPTIONS, [this]() {
-        sendCORSHeaders();
-        configServer.send(204);  // No Content
+    configServer.on("/save", HTTP_OPTIONS, [](AsyncWebServerRequest* request) {
+        request->send(204);  // No Content
     });
 
-    // Ruta para guardar configuración
-    configServer.on("/save", HTTP_POST, [this]() {
-        sendCORSHeaders();  // Agregar headers CORS
+    configServer.on("/save", HTTP_POST, [this](AsyncWebServerRequest* request) {
+        Serial.printf("[Portal] POST /save desde %s\n", request->client()->remoteIP().toString().c_str());
         
-        IPAddress clientIP = configServer.client().remoteIP();
-        Serial.printf("[Portal] POST /save desde %s\n", clientIP.toString().c_str());
-        
-        String deviceMode = configServer.arg("device_mode");
-        String tempSSID = configServer.arg("temp_ssid");
-        String tempPassword = configServer.arg("temp_password");
-        String masterMac = configServer.arg("master_mac");
-        String zoneName = configServer.arg("zone_name");
-        String subLocation = configServer.arg("sub_location");
-        String dispositivoIdStr = configServer.arg("dispositivo_id");
-        String zoneIdStr = configServer.arg("zone_id");
-        int zoneId = zoneIdStr.toInt();
+        String deviceMode = request->arg("device_mode");
+        String tempSSID = request->arg("temp_ssid");
+        String tempPassword = request->arg("temp_password");
+        String zoneName = request->arg("zone_name");
+        String subLocation = request->arg("sub_location");
+        int dispositivoId = request->arg("dispositivo_id").toInt();
+        int zoneId = request->arg("zone_id").toInt();
+        bool lowPower = request->arg("low_power") == "1";
 
         deviceMode.trim();
         tempSSID.trim();
         tempPassword.trim();
-        masterMac.trim();
         zoneName.trim();
         subLocation.trim();
 
         // Validar zona y sublocalización (requeridas para TODOS)
         if (zoneName.length() == 0) {
             Serial.println("[Portal] Error: Zona requerida");
-            configServer.send(200, "text/html", renderPortalPage("   Debes seleccionar una Zona."));
+            sendSaveError(request, "Debes seleccionar una Zona.");
             return;
         }
         
         if (subLocation.length() == 0) {
             Serial.println("[Portal] Error: Sublocalización requerida");
-            configServer.send(200, "text/html", renderPortalPage("   Debes seleccionar una Sublocalización."));
+            sendSaveError(request, "Debes seleccionar una Sublocalización.");
             return;
         }
 
         // Determinar el modo del dispositivo
         DeviceMode mode = (deviceMode == "master") ? DEVICE_MASTER : DEVICE_SLAVE;
         
-        // Validación según el modo
-        if (mode == DEVICE_MASTER) {
-            // MAESTRO: Guardar WiFi persistentemente
-            if (tempSSID.length() == 0) {
-                Serial.println("[Portal] Error: MAESTRO requiere SSID");
-                configServer.send(200, "text/html", renderPortalPage("   El modo MAESTRO requiere configurar WiFi."));
-                return;
-            }
-            
-            Serial.printf("[Portal] Configurando MAESTRO\n");
-            Serial.printf("[Portal] WiFi SSID: %s (se guardará persistentemente)\n", tempSSID.c_str());
-            Serial.printf("[Portal] Zona: %s (ID: %d), Sublocalización: %s\n", zoneName.c_str(), zoneId, subLocation.c_str());
-            
-            saveCredentials(tempSSID, tempPassword);  // GUARDAR WiFi para MAESTRO
-            saveDeviceConfig(mode, "");  // MAESTRO no necesita MAC
-            saveDeviceLocation(zoneName, subLocation, zoneId);  // Guardar ubicación con zone_id
-            
-            // Marcar que es primera ejecución después de configurar (para activar modo registro)
-            Preferences prefsFirstRun;
-            if (prefsFirstRun.begin("first_run", false)) {
-                prefsFirstRun.putBool("pending", true);
-                prefsFirstRun.end();
-                Serial.println("[Portal] Flag de primera ejecución marcado");
-            }
-            
-            // Respuesta HTML simple y rapida
-            String successHTML = "<!DOCTYPE html><html><head><meta charset='UTF-8'><meta name='viewport' content='width=device-width,initial-scale=1'>";
-            successHTML += "<style>body{font-family:Arial;text-align:center;padding:50px;background:#f0f0f0;}";
-            successHTML += ".success{background:#4CAF50;color:white;padding:20px;border-radius:8px;margin:20px auto;max-width:400px;}";
-            successHTML += ".success p,.success b{color:white;}";
-            successHTML += "h1{color:#333;}</style></head><body>";
-            successHTML += "<h1>BovinoIOT</h1>";
-            successHTML += "<div class='success'>";
-            successHTML += "<h2>Configuracion Exitosa</h2>";
-            successHTML += "<p><b>Modo:</b> MAESTRO</p>";
-            successHTML += "<p><b>WiFi:</b> " + tempSSID + "</p>";
-            successHTML += "<p><b>Zona:</b> " + zoneName + "</p>";
-            successHTML += "<p><b>Sublocalidad:</b> " + subLocation + "</p>";
-            successHTML += "<p style='margin-top:20px;'>El dispositivo se reiniciara en 3 segundos...</p>";
-            successHTML += "</div></body></html>";
-            
-            // Enviar respuesta PRIMERO (HTML simple)
-            sendCORSHeaders();
-            configServer.send(200, "text/html", successHTML);
-            configServer.client().flush();  // Asegurar que se envió
-            delay(200);
-            
-            // Actualizar estado del dispositivo en la base de datos (DESPUES de enviar respuesta)
-            int dispositivoId = dispositivoIdStr.toInt();
-            if (dispositivoId > 0 && WiFi.status() == WL_CONNECTED) {
-                Serial.printf("[Portal] Actualizando dispositivo %d a estado 'active'\n", dispositivoId);
-                bool updated = updateDispositivoStatus(dispositivoId, "active", 100);
-                if (updated) {
-                    Serial.println("[Portal] Estado del dispositivo actualizado");
-                } else {
-                    Serial.println("[Portal] No se pudo actualizar el estado (se procedera de todos modos)");
-                }
-            } else if (dispositivoId > 0) {
-                Serial.println("[Portal] WiFi no conectado - saltando actualizacion de estado");
-            }
-            
-            delay(3000);
-            ESP.restart();  // Reiniciar para aplicar configuración
-            
-        } else {
-            // ESCLAVO: NO guardar WiFi (solo se usó temporalmente)
-            // Usar la MAC del maestro detectada automáticamente
-            if (detectedMasterMac.length() == 0 || detectedMasterMac.length() < 17) {
-                Serial.println("[Portal] Error: No se encontró un maestro en la zona seleccionada");
-                configServer.send(200, "text/html", renderPortalPage("Error: No se puede configurar un ESCLAVO porque no hay un MAESTRO en esta zona.<br><br>Por favor, configura primero un dispositivo como MAESTRO antes de agregar esclavos."));
-                return;
-            }
-            
-            masterMac = detectedMasterMac;
-            Serial.printf("[Portal] Usando MAC del maestro detectada automaticamente: %s\n", masterMac.c_str());
-            
-            Serial.printf("[Portal] Configurando ESCLAVO\n");
-            Serial.printf("[Portal] MAC Maestro (auto-detectada): %s\n", masterMac.c_str());
-            Serial.printf("[Portal] Zona: %s (ID: %d), Sublocalizacion: %s\n", zoneName.c_str(), zoneId, subLocation.c_str());
-            Serial.println("[Portal] WiFi NO se guardara (solo para configuracion inicial)");
-            
-            // NO llamar saveCredentials() - El esclavo NO guarda WiFi
-            saveDeviceConfig(mode, masterMac);  // Guardar modo ESCLAVO + MAC del maestro
-            saveDeviceLocation(zoneName, subLocation, zoneId);  // Guardar ubicación con zone_id
-            
-            // Respuesta HTML simple y rapida
-            String successHTML = "<!DOCTYPE html><html><head><meta charset='UTF-8'><meta name='viewport' content='width=device-width,initial-scale=1'>";
-            successHTML += "<style>body{font-family:Arial;text-align:center;padding:50px;background:#f0f0f0;}";
-            successHTML += ".success{background:#4CAF50;color:white;padding:20px;border-radius:8px;margin:20px auto;max-width:400px;}";
-            successHTML += ".success p,.success b{color:white;}";
-            successHTML += "h1{color:#333;}</style></head><body>";
-            successHTML += "<h1>BovinoIOT</h1>";
-            successHTML += "<div class='success'>";
-            successHTML += "<h2>Configuracion Exitosa</h2>";
-            successHTML += "<p><b>Modo:</b> ESCLAVO</p>";
-            successHTML += "<p><b>MAC Maestro:</b> " + masterMac + "</p>";
-            successHTML += "<p><b>Zona:</b> " + zoneName + "</p>";
-            successHTML += "<p><b>Sublocalidad:</b> " + subLocation + "</p>";
-            successHTML += "<p style='margin-top:20px;'>WiFi NO guardado (solo para configuracion)</p>";
-            successHTML += "<p>El dispositivo se reiniciara en 3 segundos...</p>";
-            successHTML += "</div></body></html>";
-            
-            // Enviar respuesta PRIMERO (HTML simple)
-            sendCORSHeaders();
-            configServer.send(200, "text/html", successHTML);
-            configServer.client().flush();  // Asegurar que se envió
-            delay(200);
-            
-            // Actualizar estado del dispositivo en la base de datos (DESPUES de enviar respuesta)
-            int dispositivoId = dispositivoIdStr.toInt();
-            if (dispositivoId > 0 && WiFi.status() == WL_CONNECTED) {
-                Serial.printf("[Portal] Actualizando dispositivo %d a estado 'active'\n", dispositivoId);
-                bool updated = updateDispositivoStatus(dispositivoId, "active", 100);
-                if (updated) {
-                    Serial.println("[Portal] Estado del dispositivo actualizado");
-                } else {
-                    Serial.println("[Portal] No se pudo actualizar el estado (se procedera de todos modos)");
-                }
-            } else if (dispositivoId > 0) {
-                Serial.println("[Portal] WiFi no conectado - saltando actualizacion de estado");
-            }
-            
-            delay(3000);
-            ESP.restart();  // Reiniciar para aplicar configuración
-        }   
+        if (mode == DEVICE_MASTER && tempSSID.length() == 0) {
+            Serial.println("[Portal] Error: MAESTRO requiere SSID");
+            sendSaveError(request, "El modo MAESTRO requiere configurar WiFi.");
+            return;
+        }
+        
+        // configStore, los globales derivados y la MAC del maestro detectada
+        // se tocan solo desde el loop, igual que en los demás trabajos
+        submitJob(request, "save", [this, mode, tempSSID, tempPassword, zoneName, subLocation, zoneId, dispositivoId, lowPower]() {
+            return savePortalConfig(mode, tempSSID, tempPassword, zoneName, subLocation, zoneId, dispositivoId, lowPower);
+        });
     });
     
     // Captive Portal - Redirigir cualquier petición a la página principal
-    configServer.on("/generate_204", HTTP_GET, [this]() {  // Android
-        IPAddress clientIP = configServer.client().remoteIP();
-        Serial.printf("[Portal] Captive Portal detectado (Android) desde %s\n", clientIP.toString().c_str());
-        configServer.sendHeader("Cache-Control", "no-cache, no-store, must-revalidate");
-        configServer.sendHeader("Pragma", "no-cache");
-        configServer.sendHeader("Expires", "-1");
-        configServer.send(200, "text/html", renderPortalPage(""));
+    configServer.on("/generate_204", HTTP_GET, [this](AsyncWebServerRequest* request) {  // Android
+        Serial.printf("[Portal] Captive Portal detectado (Android) desde %s\n", request->client()->remoteIP().toString().c_str());
+        sendPortalPage(request, true);
     });
     
-    configServer.on("/gen_204", HTTP_GET, [this]() {  // Android alternativo
-        IPAddress clientIP = configServer.client().remoteIP();
-        Serial.printf("[Portal] Captive Portal detectado (Android gen_204) desde %s\n", clientIP.toString().c_str());
-        configServer.sendHeader("Cache-Control", "no-cache, no-store, must-revalidate");
-        configServer.sendHeader("Pragma", "no-cache");
-        configServer.sendHeader("Expires", "-1");
-        configServer.send(200, "text/html", renderPortalPage(""));
+    configServer.on("/gen_204", HTTP_GET, [this](AsyncWebServerRequest* request) {  // Android alternativo
+        Serial.printf("[Portal] Captive Portal detectado (Android gen_204) desde %s\n", request->client()->remoteIP().toString().c_str());
+        sendPortalPage(request, true);
     });
     
-    configServer.on("/hotspot-detect.html", HTTP_GET, [this]() {  // iOS/macOS
-        IPAddress clientIP = configServer.client().remoteIP();
-        Serial.printf("[Portal] Captive Portal detectado (iOS/macOS) desde %s\n", clientIP.toString().c_str());
-        configServer.sendHeader("Cache-Control", "no-cache, no-store, must-revalidate");
-        configServer.sendHeader("Pragma", "no-cache");
-        configServer.sendHeader("Expires", "-1");
-        configServer.send(200, "text/html", renderPortalPage(""));
+    configServer.on("/hotspot-detect.html", HTTP_GET, [this](AsyncWebServerRequest* request) {  // iOS/macOS
+        Serial.printf("[Portal] Captive Portal detectado (iOS/macOS) desde %s\n", request->client()->remoteIP().toString().c_str());
+        sendPortalPage(request, true);
     });
     
-    configServer.on("/library/test/success.html", HTTP_GET, [this]() {  // iOS alternativo
-        IPAddress clientIP = configServer.client().remoteIP();
-        Serial.printf("[Portal] Captive Portal detectado (iOS library) desde %s\n", clientIP.toString().c_str());
-        configServer.send(200, "text/html", renderPortalPage(""));
+    configServer.on("/library/test/success.html", HTTP_GET, [this](AsyncWebServerRequest* request) {  // iOS alternativo
+        Serial.printf("[Portal] Captive Portal detectado (iOS library) desde %s\n", request->client()->remoteIP().toString().c_str());
+        sendPortalPage(request, false);
     });
     
-    configServer.on("/connecttest.txt", HTTP_GET, [this]() {  // Windows
-        IPAddress clientIP = configServer.client().remoteIP();
-        Serial.printf("[Portal] Captive Portal detectado (Windows) desde %s\n", clientIP.toString().c_str());
-        configServer.sendHeader("Cache-Control", "no-cache, no-store, must-revalidate");
-        configServer.sendHeader("Pragma", "no-cache");
-        configServer.sendHeader("Expires", "-1");
+    configServer.on("/connecttest.txt", HTTP_GET, [this](AsyncWebServerRequest* request) {  // Windows
+        Serial.printf("[Portal] Captive Portal detectado (Windows) desde %s\n", request->client()->remoteIP().toString().c_str());
         // Devolver contenido INCORRECTO para forzar detección de captive portal
-        configServer.send(200, "text/plain", "CAPTIVE PORTAL");
+        sendCaptiveText(request, "CAPTIVE PORTAL");
     });
     
-    configServer.on("/ncsi.txt", HTTP_GET, [this]() {  // Windows 10
-        IPAddress clientIP = configServer.client().remoteIP();
-        Serial.printf("[Portal] Captive Portal detectado (Windows 10 ncsi) desde %s\n", clientIP.toString().c_str());
-        configServer.sendHeader("Cache-Control", "no-cache, no-store, must-revalidate");
-        configServer.sendHeader("Pragma", "no-cache");
-        configServer.sendHeader("Expires", "-1");
-        configServer.send(200, "text/plain", "CAPTIVE PORTAL");
+    configServer.on("/ncsi.txt", HTTP_GET, [this](AsyncWebServerRequest* request) {  // Windows 10
+        Serial.printf("[Portal] Captive Portal detectado (Windows 10 ncsi) desde %s\n", request->client()->remoteIP().toString().c_str());
+        sendCaptiveText(request, "CAPTIVE PORTAL");
     });
     
-    configServer.on("/redirect", HTTP_GET, [this]() {  // Windows redirect
-        IPAddress clientIP = configServer.client().remoteIP();
-        Serial.printf("[Portal] Captive Portal detectado (Windows redirect) desde %s\n", clientIP.toString().c_str());
-        configServer.send(200, "text/html", renderPortalPage(""));
+    configServer.on("/redirect", HTTP_GET, [this](AsyncWebServerRequest* request) {  // Windows redirect
+        Serial.printf("[Portal] Captive Portal detectado (Windows redirect) desde %s\n", request->client()->remoteIP().toString().c_str());
+        sendPortalPage(request, false);
     });
     
-    configServer.on("/canonical.html", HTTP_GET, [this]() {  // Ubuntu/Linux
-        IPAddress clientIP = configServer.client().remoteIP();
-        Serial.printf("[Portal] Captive Portal detectado (Ubuntu/Linux) desde %s\n", clientIP.toString().c_str());
-        configServer.send(200, "text/html", renderPortalPage(""));
+    configServer.on("/canonical.html", HTTP_GET, [this](AsyncWebServerRequest* request) {  // Ubuntu/Linux
+        Serial.printf("[Portal] Captive Portal detectado (Ubuntu/Linux) desde %s\n", request->client()->remoteIP().toString().c_str());
+        sendPortalPage(request, false);
     });
     
-    configServer.on("/success.txt", HTTP_GET, [this]() {  // Firefox
-        IPAddress clientIP = configServer.client().remoteIP();
-        Serial.printf("[Portal] Captive Portal detectado (Firefox) desde %s\n", clientIP.toString().c_str());
-        configServer.send(200, "text/plain", "success");
+    configServer.on("/success.txt", HTTP_GET, [](AsyncWebServerRequest* request) {  // Firefox
+        Serial.printf("[Portal] Captive Portal detectado (Firefox) desde %s\n", request->client()->remoteIP().toString().c_str());
+        request->send(200, "text/plain", "success");
     });
 
-    // Manejar cualquier ruta no encontrada
-    configServer.onNotFound([this]() {
-        IPAddress clientIP = configServer.client().remoteIP();
-        Serial.printf("[Portal] Ruta no encontrada desde %s: %s - Redirigiendo a /\n", 
-                     clientIP.toString().c_str(), 
-                     configServer.uri().c_str());
-        configServer.sendHeader("Cache-Control", "no-cache, no-store, must-revalidate");
-        configServer.sendHeader("Pragma", "no-cache");
-        configServer.sendHeader("Expires", "-1");
-        configServer.send(200, "text/html", renderPortalPage(""));
+    // Manejar cualquier ruta no encontrada (y preflight CORS)
+    configServer.onNotFound([this](AsyncWebServerRequest* request) {
+        if (request->method() == HTTP_OPTIONS) {
+            request->send(200);
+            return;
+        }
+        Serial.printf("[Portal] Ruta no encontrada desde %s: %s - Sirviendo portal\n",
+                     request->client()->remoteIP().toString().c_str(),
+                     request->url().c_str());
+        sendPortalPage(request, true);
     });
 }
 
-String WiFiManager::renderPortalPage(const String& statusMessage) {
-    String message = statusMessage;
-    String page;
-    
-    // Obtener la MAC del ESP32
-    uint8_t localMac[6];
-    WiFi.macAddress(localMac);
-    String localMacStr = macToString(localMac);
-
-    page  = "<!DOCTYPE html><html lang='es'><head>";
-    page += "<meta charset='UTF-8'>";
-    page += "<meta name='viewport' content='width=device-width,initial-scale=1'>";
-    page += "<title>BovinoIOT - Configuración</title>";
-    page += "<style>";
-    page += "body{font-family:Arial,sans-serif;background:#f5f5f5;margin:0;padding:20px;}";
-    page += ".container{max-width:450px;margin:0 auto;background:#fff;border-radius:8px;";
-    page += "box-shadow:0 2px 10px rgba(0,0,0,0.1);padding:30px;}";
-    page += "h1{color:#2e7d32;font-size:24px;margin:0 0 10px;text-align:center;}";
-    page += "p{color:#666;font-size:14px;margin:0 0 20px;text-align:center;}";
-    page += "label{display:block;margin:15px 0 5px;font-weight:bold;color:#333;font-size:14px;}";
-    page += "input{width:100%;padding:12px;border:1px solid #ddd;border-radius:4px;";
-    page += "box-sizing:border-box;font-size:16px;}";
-    page += "input:focus{outline:none;border-color:#4CAF50;}";
-    page += "select{width:100%;padding:12px;border:1px solid #ddd;border-radius:4px;";
-    page += "box-sizing:border-box;font-size:16px;background:#fff;cursor:pointer;}";
-    page += "select:focus{outline:none;border-color:#4CAF50;}";
-    page += ".radio-group{display:flex;gap:20px;margin:15px 0;justify-content:center;}";
-    page += ".radio-option{display:flex;align-items:center;padding:10px 20px;";
-    page += "border:2px solid #ddd;border-radius:6px;cursor:pointer;transition:all 0.3s;}";
-    page += ".radio-option:hover{border-color:#4CAF50;background:#e8f5e9;}";
-    page += ".radio-option input{margin-right:8px;cursor:pointer;}";
-    page += ".radio-option label{margin:0;cursor:pointer;font-weight:bold;font-size:15px;}";
-    page += ".radio-option input:checked + label{color:#4CAF50;}";
-    page += "button{width:100%;margin-top:20px;padding:14px;background:#4CAF50;";
-    page += "color:#fff;border:none;border-radius:4px;font-size:16px;cursor:pointer;font-weight:bold;}";
-    page += "button:hover{background:#388E3C;}";
-    page += ".status{margin-top:15px;padding:12px;border-radius:4px;background:#e8f5e9;";
-    page += "color:#2e7d32;font-size:14px;text-align:center;}";
-    page += ".info{background:#f5f5f5;color:#666;margin-top:15px;padding:10px;";
-    page += "border-radius:4px;font-size:12px;text-align:center;}";
-    page += ".mac-display{background:#e8f5e9;color:#2e7d32;padding:15px;border-radius:4px;";
-    page += "text-align:center;font-family:monospace;font-size:16px;margin:10px 0;font-weight:bold;}";
-    page += ".section{margin:20px 0;padding:20px;background:#f9f9f9;border-radius:6px;}";
-    page += ".section-title{font-size:16px;font-weight:bold;color:#2e7d32;margin-bottom:10px;}";
-    page += ".hidden{display:none !important;}";
-    page += ".help-text{font-size:12px;color:#888;margin-top:5px;font-style:italic;}";
-    page += "</style>";
-    page += "<script>";
-    page += "var currentStep=1;";
-    page += "var wifiSSID='';";
-    page += "var wifiPassword='';";
-    page += "var loggedUserId=0;";
-    page += "var loggedUserName='';";
-    page += "var selectedZoneId=null;";
-    page += "function showStep(step){";
-    page += "console.log('showStep llamado con step',step);";
-    page += "var steps=['step1','step2','step3'];";
-    page += "steps.forEach(function(s){";
-    page += "var el=document.getElementById(s);";
-    page += "if(el){el.classList.add('hidden');console.log('Ocultando',s);}";
-    page += "});";
-    page += "var targetStep=document.getElementById('step'+step);";
-    page += "if(targetStep){targetStep.classList.remove('hidden');console.log('Mostrando step',step);}";
-    page += "else{console.error('No se encontro elemento step',step);}";
-    page += "currentStep=step;";
-    page += "}";
-    page += "var portalBase='http://192.168.4.1';";
-    page += "async function connectWifi(){";
-    page += "var ssid=document.getElementById('ssid').value;";
-    page += "var password=document.getElementById('password').value;";
-    page += "if(!ssid){alert('Ingresa el SSID del WiFi');return;}";
-    page += "wifiSSID=ssid;";
-    page += "wifiPassword=password;";
-    page += "document.getElementById('connect_btn').disabled=true;";
-    page += "document.getElementById('connect_btn').innerText='Conectando...';";
-    page += "try{";
-    page += "var response=await fetch('/connectWifi',{method:'POST',headers:{'Content-Type':'application/x-www-form-urlencoded'},body:'ssid='+encodeURIComponent(ssid)+'&password='+encodeURIComponent(password)});";
-    page += "var data=await response.json();";
-    page += "if(data.success){";
-    page += "portalBase='http://'+(data.portalIP||'192.168.4.1');";
-    page += "console.log('Portal base URL:',portalBase);";
-    page += "var statusMsg='<div style=\"color:green;font-weight:bold;margin:10px 0;padding:15px;background:#d4edda;border:1px solid #c3e6cb;border-radius:5px;\">';";
-    page += "statusMsg+='WiFi Conectado<br>';";
-    page += "statusMsg+='<small>Red WiFi IP: '+data.ip+'</small><br>';";
-    page += "statusMsg+='<small>Portal IP: '+(data.portalIP||'192.168.4.1')+'</small><br>';";
-    page += "statusMsg+='<small style=\"color:#856404;background:#fff3cd;padding:5px;display:inline-block;margin-top:5px;border-radius:3px;\">Si pierdes conexion, reconectate al AP bovino_io</small>';";
-    page += "statusMsg+='</div>';";
-    page += "document.getElementById('wifi_status').innerHTML=statusMsg;";
-    page += "setTimeout(function(){showStep(2);},500);";
-    page += "}else{";
-    page += "alert('Error al conectar WiFi: '+data.message);";
-    page += "document.getElementById('connect_btn').disabled=false;";
-    page += "document.getElementById('connect_btn').innerText='Conectar WiFi';";
-    page += "}";
-    page += "}catch(error){";
-    page += "alert('Error de conexión: '+error.message);";
-    page += "document.getElementById('connect_btn').disabled=false;";
-    page += "document.getElementById('connect_btn').innerText='Conectar WiFi';";
-    page += "}";
-    page += "}";
-    page += "async function loginUser(){";
-    page += "var email=document.getElementById('login_email').value;";
-    page += "var password=document.getElementById('login_password').value;";
-    page += "if(!email || !password){alert('Ingresa email y password');return;}";
-    page += "document.getElementById('login_btn').disabled=true;";
-    page += "document.getElementById('login_btn').innerText='Autenticando (puede tardar 90s)...';";
-    page += "document.getElementById('login_status').innerHTML='<div style=\"color:#0056b3;font-size:12px;margin:5px 0;\">Conectando al servidor (puede tardar hasta 90 segundos si esta inactivo)...</div>';";
-    page += "try{";
-    page += "var loginUrl=(typeof portalBase!=='undefined'?portalBase:'http://192.168.4.1')+'/login';";
-    page += "console.log('Login POST URL:',loginUrl);";
-    page += "var response=await fetch(loginUrl,{method:'POST',headers:{'Content-Type':'application/x-www-form-urlencoded'},body:'email='+encodeURIComponent(email)+'&password='+encodeURIComponent(password)});";
-    page += "console.log('Login response status:',response.status);";
-    page += "var data=await response.json();";
-    page += "console.log('Login response data:',data);";
-    page += "if(data.success){";
-    page += "console.log('Login exitoso, user_id:',data.user_id);";
-    page += "loggedUserId=data.user_id;";
-    page += "loggedUserName=data.name;";
-    page += "document.getElementById('login_status').innerHTML='<div style=\"color:green;font-weight:bold;margin:10px 0;\">Bienvenido '+data.name+'</div>';";
-    page += "console.log('Cargando zonas...');";
-    page += "await loadZones();";
-    page += "console.log('Zonas cargadas, mostrando step 3');";
-    page += "showStep(3);";
-    page += "}else{";
-    page += "alert('Error: '+data.message);";
-    page += "document.getElementById('login_btn').disabled=false;";
-    page += "document.getElementById('login_btn').innerText='Iniciar Sesion';";
-    page += "}";
-    page += "}catch(error){";
-    page += "console.error('loginUser error:',error);";
-    page += "var el=document.getElementById('login_status');if(el)el.innerHTML='<div style=\"color:#b94a48;font-weight:bold;margin:10px 0;\">Error de conexion: '+error.message+'<br>Intenta reconectar al AP: http://192.168.4.1</div>';";
-    page += "document.getElementById('login_btn').disabled=false;";
-    page += "document.getElementById('login_btn').innerText='Iniciar Sesion';";
-    page += "}";
-    page += "}";
-    page += "async function loadZones(){";
-    page += "console.log('loadZones iniciado');";
-    page += "var zoneSelect=document.getElementById('zone_name');";
-    page += "if(zoneSelect)zoneSelect.innerHTML='<option value=\"\">Cargando zonas...</option>';";
-    page += "try{";
-    page += "var zonesUrl=(typeof portalBase!=='undefined'?portalBase:'http://192.168.4.1')+'/getZones';";
-    page += "console.log('Fetching zones from:',zonesUrl);";
-    page += "var response=await fetch(zonesUrl);";
-    page += "console.log('getZones response status:',response.status);";
-    page += "if(!response.ok){throw new Error('Error HTTP '+response.status);}";
-    page += "var data=await response.json();";
-    page += "console.log('Respuesta /getZones:',data);";
-    page += "var optionsHTML='<option value=\"\">-- Selecciona una Zona --</option>';";
-    page += "if(data.zones && Array.isArray(data.zones) && data.zones.length>0){";
-    page += "data.zones.forEach(function(zone){";
-    page += "if(zone.name && zone.id){";
-    page += "optionsHTML+='<option value=\"'+zone.name+'\" data-zone-id=\"'+zone.id+'\">'+zone.name+'</option>';";
-    page += "}";
-    page += "});";
-    page += "console.log('Zonas cargadas:',data.zones.length);";
-    page += "}else{";
-    page += "console.warn('No hay zonas');";
-    page += "optionsHTML='<option value=\"\">-- No hay zonas disponibles --</option>';";
-    page += "}";
-    page += "if(zoneSelect){zoneSelect.innerHTML=optionsHTML;}";
-    page += "}catch(error){";
-    page += "console.error('Error loadZones:',error);";
-    page += "var errorHTML='<option value=\"\">-- Error: '+error.message+'</option>';";
-    page += "if(zoneSelect)zoneSelect.innerHTML=errorHTML;";
-    page += "}";
-    page += "}";
-    page += "function onZoneChange(){";
-    page += "var zoneSelect=document.getElementById('zone_name');";
-    page += "var selectedOption=zoneSelect.options[zoneSelect.selectedIndex];";
-    page += "var zoneId=selectedOption.getAttribute('data-zone-id');";
-    page += "if(zoneId){";
-    page += "console.log('Zona seleccionada:',zoneId);";
-    page += "document.getElementById('zone_id').value=zoneId;";
-    page += "loadSublocations(zoneId);";
-    page += "}";
-    page += "}";
-    page += "async function loadSublocations(zoneId){";
-    page += "console.log('loadSublocations iniciado con zoneId:',zoneId);";
-    page += "var subSelect=document.getElementById('sub_location');";
-    page += "if(subSelect)subSelect.innerHTML='<option value=\"\">Cargando sondeadores...</option>';";
-    page += "var deviceInfo=document.getElementById('device_type_info');";
-    page += "if(deviceInfo)deviceInfo.style.display='none';";
-    page += "var slaveMacSection=document.getElementById('slave_mac_section');";
-    page += "if(slaveMacSection)slaveMacSection.style.display='none';";
-    page += "try{";
-    page += "var subUrl=(typeof portalBase!=='undefined'?portalBase:'http://192.168.4.1')+'/getSublocations?zone_id='+zoneId;";
-    page += "console.log('Fetching sublocations from:',subUrl);";
-    page += "var response=await fetch(subUrl);";
-    page += "console.log('getSublocations response status:',response.status);";
-    page += "if(!response.ok){throw new Error('Error HTTP '+response.status);}";
-    page += "var data=await response.json();";
-    page += "console.log('Respuesta /getSublocations:',data);";
-    page += "var optionsHTML='<option value=\"\">-- Selecciona un sondeador --</option>';";
-    page += "if(data.sublocations && Array.isArray(data.sublocations) && data.sublocations.length>0){";
-    page += "data.sublocations.forEach(function(subloc){";
-    page += "if(subloc && subloc.name){";
-    page += "optionsHTML+='<option value=\"'+subloc.name+'\" data-device-id=\"'+(subloc.id||'')+'\">'+subloc.name+'</option>';";
-    page += "}";
-    page += "});";
-    page += "console.log('Sondeadores cargados:',data.sublocations.length);";
-    page += "}else{";
-    page += "console.warn('No hay sondeadores');";
-    page += "optionsHTML='<option value=\"\">-- No hay sondeadores en esta zona --</option>';";
-    page += "}";
-    page += "if(subSelect)subSelect.innerHTML=optionsHTML;";
-    page += "}catch(error){";
-    page += "console.error('Error loadSublocations:',error);";
-    page += "var errorHTML='<option value=\"\">-- Error: '+error.message+'</option>';";
-    page += "if(subSelect)subSelect.innerHTML=errorHTML;";
-    page += "}";
-    page += "}";
-    page += "function onSubLocationChange(){";
-    page += "var subSelect=document.getElementById('sub_location');";
-    page += "var subLocation=subSelect.value;";
-    page += "if(!subLocation){return;}";
-    page += "var selectedOption=subSelect.options[subSelect.selectedIndex];";
-    page += "var deviceId=selectedOption.getAttribute('data-device-id');";
-    page += "if(deviceId){";
-    page += "document.getElementById('dispositivo_id').value=deviceId;";
-    page += "console.log('Device ID guardado:',deviceId);";
-    page += "}";
-    page += "var parts=subLocation.split('/');";
-    page += "if(parts.length<2){return;}";
-    page += "var deviceType=parts[0].toLowerCase();";
-    page += "var deviceName=parts[1];";
-    page += "document.getElementById('device_mode').value=deviceType;";
-    page += "document.getElementById('temp_ssid').value=wifiSSID;";
-    page += "document.getElementById('temp_password').value=wifiPassword;";
-    page += "var infoDiv=document.getElementById('device_type_info');";
-    page += "var infoText=document.getElementById('device_type_text');";
-    page += "if(deviceType==='master'){";
-    page += "infoText.innerText='Tipo: MAESTRO - Usará WiFi y enviará datos al servidor';";
-    page += "infoDiv.style.display='block';";
-    page += "}else if(deviceType==='slave'){";
-    page += "infoText.innerText='Tipo: ESCLAVO - Se comunicará con el maestro vía ESP-NOW';";
-    page += "infoDiv.style.display='block';";
-    page += "}else{";
-    page += "infoDiv.style.display='none';";
-    page += "}";
-    page += "}";
-    page += "function saveConfig(event){";
-    page += "event.preventDefault();";
-    page += "console.log('Guardando configuracion...');";
-    page += "var form=document.getElementById('config_form');";
-    page += "var formData=new FormData(form);";
-    page += "var saveBtn=document.getElementById('save_btn');";
-    page += "saveBtn.disabled=true;";
-    page += "saveBtn.innerText='Guardando...';";
-    page += "var baseUrl=portalBase||'http://192.168.4.1';";
-    page += "console.log('Enviando a:',baseUrl+'/save');";
-    page += "fetch(baseUrl+'/save',{";
-    page += "method:'POST',";
-    page += "headers:{'Content-Type':'application/x-www-form-urlencoded'},";
-    page += "body:new URLSearchParams(formData)";
-    page += "}).then(function(response){";
-    page += "console.log('Respuesta recibida:',response.status);";
-    page += "if(response.ok){";
-    page += "return response.text();";
-    page += "}";
-    page += "throw new Error('Error al guardar (status: '+response.status+')');";
-    page += "}).then(function(html){";
-    page += "console.log('HTML recibido, actualizando pagina');";
-    page += "document.body.innerHTML=html;";
-    page += "}).catch(function(error){";
-    page += "console.error('Error al guardar:',error);";
-    page += "alert('Configuracion guardada en el dispositivo. Se reiniciara en breve.');";
-    page += "});";
-    page += "}";
-    page += "window.addEventListener('DOMContentLoaded',function(){";
-    page += "var form=document.getElementById('config_form');";
-    page += "if(form){";
-    page += "form.addEventListener('submit',saveConfig);";
-    page += "}";
-    page += "});";
-    page += "</script>";
-    page += "</head><body>";
-    page += "<div class='container'>";
-    page += "<h1>BovinoIOT</h1>";
-    page += "<p>Configuración Inicial del Dispositivo</p>";
-    
-    // PASO 1: Conexión WiFi (TODOS)
-    page += "<div id='step1'>";
-    page += "<div class='section'>";
-    page += "<div class='section-title'>Paso 1: Conectar a WiFi</div>";
-    page += "<p class='help-text'>Necesitas WiFi temporalmente para obtener las zonas del servidor</p>";
-    page += "<label for='ssid'>Nombre de Red WiFi (SSID)</label>";
-    page += "<input type='text' id='ssid' maxlength='32' placeholder='Mi_Red_WiFi'>";
-    page += "<label for='password'>Contraseña WiFi</label>";
-    page += "<input type='password' id='password' maxlength='64' placeholder='Dejar vacío si es red abierta'>";
-    page += "<div id='wifi_status'></div>";
-    page += "<button type='button' id='connect_btn' onclick='connectWifi()'>Conectar WiFi</button>";
-    page += "</div>";
-    page += "</div>";
-    
-    // PASO 2: Login de usuario (NUEVO)
-    page += "<div id='step2' class='hidden'>";
-    page += "<div class='section'>";
-    page += "<div class='section-title'>Paso 2: Iniciar Sesión</div>";
-    page += "<p class='help-text'>Ingresa tus credenciales para acceder a tus zonas</p>";
-    page += "<label for='login_email'>Email</label>";
-    page += "<input type='email' id='login_email' placeholder='usuario@ejemplo.com'>";
-    page += "<label for='login_password'>Contraseña</label>";
-    page += "<input type='password' id='login_password' placeholder='Tu contraseña'>";
-    page += "<div id='login_status'></div>";
-    page += "<button type='button' id='login_btn' onclick='loginUser()'>Iniciar Sesión</button>";
-    page += "</div>";
-    page += "</div>";
-    
-    // PASO 3: Configuración del dispositivo (UNIFICADO - determina tipo automáticamente)
-    page += "<div id='step3' class='hidden'>";
-    page += "<form id='config_form' method='POST' action='/save'>";
-    page += "<input type='hidden' id='device_mode' name='device_mode' value=''>";
-    page += "<input type='hidden' id='temp_ssid' name='temp_ssid' value=''>";
-    page += "<input type='hidden' id='temp_password' name='temp_password' value=''>";
-    page += "<input type='hidden' id='dispositivo_id' name='dispositivo_id' value=''>";
-    page += "<input type='hidden' id='zone_id' name='zone_id' value='0'>";  // Nuevo campo
-    page += "<div class='section'>";
-    page += "<div class='section-title'>Paso 3: Configuración del Dispositivo</div>";
-    page += "<div class='mac-display'>" + localMacStr + "</div>";
-    page += "<p class='help-text'>Tu dirección MAC</p>";
-    page += "</div>";
-    page += "<div class='section'>";
-    page += "<div class='section-title'>Ubicación del Dispositivo</div>";
-    page += "<label for='zone_name'>Zona</label>";
-    page += "<select id='zone_name' name='zone_name' required onchange='onZoneChange()'>";
-    page += "<option value=''>-- Selecciona una Zona --</option>";
-    page += "</select>";
-    page += "<label for='sub_location'>Seleccionar sondeador</label>";
-    page += "<select id='sub_location' name='sub_location' required onchange='onSubLocationChange()'>";
-    page += "<option value=''>-- Selecciona un sondeador --</option>";
-    page += "</select>";
-    page += "<div id='device_type_info' style='margin-top:15px;padding:10px;background:#e3f2fd;border-radius:4px;display:none;'>";
-    page += "<p style='margin:0;font-weight:bold;color:#1976d2;' id='device_type_text'></p>";
-    page += "</div>";
-    page += "</div>";
-    page += "<button type='submit' id='save_btn'>Guardar / Activar dispositivo</button>";
-    page += "</form>";
-    page += "</div>";
-
-    if (message.length() > 0) {
-        page += "<div class='status'>" + message + "</div>";
+// Conexión STA desde el portal. Corre como trabajo en segundo plano: puede
+// tardar hasta 15 s sin bloquear el servidor HTTP ni el DNS.
+String WiFiManager::connectPortalWifi(const String& ssid, const String& password) {
+    Serial.printf("[Portal] Intentando conectar a WiFi: %s\n", ssid.c_str());
+    
+    // Cambiar a modo DUAL (AP + STA) para conectar a WiFi externo
+    WiFi.mode(WIFI_AP_STA);
+    delay(100);
+    
+    // Conectar al WiFi externo
+    WiFi.begin(ssid.c_str(), password.c_str());
+    
+    // Esperar hasta 15 segundos por conexión
+    int attempts = 0;
+    while (WiFi.status() != WL_CONNECTED && attempts < 30) {
+        delay(500);
+        Serial.print(".");
+        attempts++;
+    }
+    
+    if (WiFi.status() != WL_CONNECTED) {
+        Serial.println("\n[Portal] Error al conectar WiFi");
+        WiFi.disconnect();
+        WiFi.mode(WIFI_AP);  // Volver a modo AP puro
+        return "{\"success\":false,\"message\":\"No se pudo conectar al WiFi\"}";
     }
 
-    page += "<div class='info'>IP: " + WiFi.softAPIP().toString() + "<br>";
-    String macAddr = WiFi.macAddress();
-    macAddr.replace(":", "");
-    page += "MAC address: " + macAddr + "</div>";
-    page += "</div></body></html>";
+    Serial.println("\n[Portal] WiFi conectado exitosamente");
+    Serial.printf("[Portal] IP obtenida: %s\n", WiFi.localIP().toString().c_str());
+    
+    // Detener DNS server (ya no se necesita)
+    dnsServer.stop();
+    Serial.println("[Portal] DNS Server detenido (ya no se necesita)");
+    
+    // Mantener portal accesible durante configuración
+    Serial.println("[Portal] IMPORTANTE: Portal sigue activo en ambas redes:");
+    Serial.printf("[Portal]   - Access Point: http://%s\n", WiFi.softAPIP().toString().c_str());
+    Serial.printf("[Portal]   - Red WiFi: http://%s\n", WiFi.localIP().toString().c_str());
+    Serial.println("[Portal] Si pierdes conexión, reconéctate al AP bovino_io_xxx");
+    
+    // Las credenciales NO se preparan en configStore: /save las guarda solo
+    // para un MAESTRO (el navegador las reenvía); un ESCLAVO no guarda WiFi
+    
+    Serial.printf("[Portal] Memoria libre post-WiFi: %d bytes\n", ESP.getFreeHeap());
+    
+    return "{\"success\":true,\"message\":\"WiFi conectado\",\"ip\":\"" + WiFi.localIP().toString() + "\",\"portalIP\":\"" + WiFi.softAPIP().toString() + "\"}";
+}
 
-    return page;
+// Guardado final del portal. Corre como trabajo en segundo plano, en el
+// loop, porque modifica configStore y los globales que deriva.
+String WiFiManager::savePortalConfig(DeviceMode mode, const String& ssid, const String& password,
+                                     const String& zoneName, const String& subLocation,
+                                     int zoneId, int dispositivoId, bool lowPower) {
+    StaticJsonDocument<512> result;
+    result["success"] = true;
+    result["zone_name"] = zoneName;
+    result["sub_location"] = subLocation;
+
+    if (mode == DEVICE_MASTER) {
+        // MAESTRO: Guardar WiFi persistentemente
+        Serial.printf("[Portal] Configurando MAESTRO\n");
+        Serial.printf("[Portal] WiFi SSID: %s (se guardará persistentemente)\n", ssid.c_str());
+        Serial.printf("[Portal] Zona: %s (ID: %d), Sublocalización: %s\n", zoneName.c_str(), zoneId, subLocation.c_str());
+        
+        saveCredentials(ssid, password);  // GUARDAR WiFi para MAESTRO
+        saveDeviceConfig(mode, "");  // MAESTRO no necesita MAC
+        saveDeviceLocation(zoneName, subLocation, zoneId);  // Guardar ubicación con zone_id
+        
+        // Marcar que es primera ejecución después de configurar (para activar modo registro)
+        configStore.setFirstRunPending(true);
+        
+        result["mode"] = "master";
+        result["ssid"] = ssid;
+    } else {
+        // ESCLAVO: NO guardar WiFi (solo se usó temporalmente)
+        // Usar la MAC del maestro detectada automáticamente
+        if (detectedMasterMac.length() < 17) {
+            Serial.println("[Portal] Error: No se encontró un maestro en la zona seleccionada");
+            return saveErrorJson("Error: No se puede configurar un ESCLAVO porque no hay un MAESTRO en esta zona.\n\nPor favor, configura primero un dispositivo como MAESTRO antes de agregar esclavos.");
+        }
+        
+        String masterMac = detectedMasterMac;
+        Serial.printf("[Portal] Configurando ESCLAVO\n");
+        Serial.printf("[Portal] MAC Maestro (auto-detectada): %s\n", masterMac.c_str());
+        Serial.printf("[Portal] Zona: %s (ID: %d), Sublocalizacion: %s\n", zoneName.c_str(), zoneId, subLocation.c_str());
+        Serial.println("[Portal] WiFi NO se guardara (solo para configuracion inicial)");
+        
+        // NO llamar saveCredentials() - El esclavo NO guarda WiFi
+        if (!saveDeviceConfig(mode, masterMac)) {  // Guardar modo ESCLAVO + MAC del maestro
+            return saveErrorJson("La MAC del maestro detectada no es valida.");
+        }
+        saveDeviceLocation(zoneName, subLocation, zoneId);  // Guardar ubicación con zone_id
+        configStore.setLowPower(lowPower);  // A batería: ventanas BLE espaciadas y light sleep
+
+        result["mode"] = "slave";
+        result["master_mac"] = masterMac;
+        result["low_power"] = lowPower;
+    }
+
+    // Modo, WiFi, ubicación y flag en una sola escritura a NVS
+    if (!configStore.commit()) {
+        return saveErrorJson("No se pudo guardar la configuracion. Intenta de nuevo.");
+    }
+
+    // Activación en el backend y cierre del portal desde loop(), después de
+    // que el navegador recoja este resultado
+    pendingActivationId = dispositivoId;
+    activationRequestTime = millis();
+    pendingActivation = true;
+
+    // Respuesta JSON corta; la página arma el resumen
+    String successJson;
+    serializeJson(result, successJson);
+    return successJson;
+}
+
+// Página del portal: gzip embebido en flash (ver scripts/embed_web_assets.py).
+// Se envía tal cual; el navegador descomprime y revalida con el ETag. Las
+// sondas de portal cautivo no deben cachearse, así que no usan ETag.
+void WiFiManager::sendPortalPage(AsyncWebServerRequest* request, bool captiveProbe) {
+    if (!captiveProbe && request->hasHeader("If-None-Match") &&
+        request->header("If-None-Match") == PORTAL_HTML_ETAG) {
+        AsyncWebServerResponse* notModified = request->beginResponse(304);
+        notModified->addHeader("ETag", PORTAL_HTML_ETAG);
+        request->send(notModified);
+        return;
+    }
+
+    AsyncWebServerResponse* response = request->beginResponse_P(200, "text/html", PORTAL_HTML_GZ, PORTAL_HTML_GZ_LEN);
+    response->addHeader("Content-Encoding", "gzip");
+    if (captiveProbe) {
+        response->addHeader("Cache-Control", "no-cache, no-store, must-revalidate");
+        response->addHeader("Pragma", "no-cache");
+        response->addHeader("Expires", "-1");
+    } else {
+        response->addHeader("Cache-Control", "no-cache");
+        response->addHeader("ETag", PORTAL_HTML_ETAG);
+    }
+    request->send(response);
+}
+
+void WiFiManager::sendCaptiveText(AsyncWebServerRequest* request, const char* text) {
+    AsyncWebServerResponse* response = request->beginResponse(200, "text/plain", text);
+    response->addHeader("Cache-Control", "no-cache, no-store, must-revalidate");
+    response->addHeader("Pragma", "no-cache");
+    response->addHeader("Expires", "-1");
+    request->send(response);
+}
+
+void WiFiManager::sendJson(AsyncWebServerRequest* request, int code, const String& json) {
+    request->send(code, "application/json", json);
+}
+
+String WiFiManager::saveErrorJson(const String& message) {
+    StaticJsonDocument<384> result;
+    result["success"] = false;
+    result["message"] = message;
+    String json;
+    serializeJson(result, json);
+    return json;
+}
+
+void WiFiManager::sendSaveError(AsyncWebServerRequest* request, const String& message) {
+    sendJson(request, 200, saveErrorJson(message));
+}
+
+// Encola un trabajo y responde 202 con su id; el navegador consulta /job
+void WiFiManager::submitJob(AsyncWebServerRequest* request, const char* name, PortalJobWork work) {
+    uint32_t jobId = portalJobs.submit(name, work);
+    if (jobId == 0) {
+        sendJson(request, 503, "{\"success\":false,\"message\":\"Portal ocupado, intenta de nuevo\"}");
+        return;
+    }
+    sendJson(request, 202, "{\"job\":" + String(jobId) + "}");
 }
 
 bool WiFiManager::attemptConnection(unsigned long timeout) {